@@ -0,0 +1,224 @@
+/*
+ * container_pair_benchmark.c
+ *
+ * Times every binary container operation (and, or, xor, andnot, their
+ * in-place and lazy variants) for every CONTAINER_PAIR of array, run and
+ * bitset containers, while sweeping the cardinality and the run length of
+ * the inputs. Times are the best number of cycles per input element (the
+ * sum of both cardinalities).
+ *
+ * Usage: container_pair_benchmark [operation]
+ * where operation restricts the output to one operation (e.g., lazy_ior).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <roaring/containers/containers.h>
+#include <roaring/misc/configreport.h>
+
+#include "benchmark.h"
+#include "random.h"
+
+enum { REPEAT = 20, NUM_LEVELS = 3 };
+
+/* Cardinality levels for each container type, indexed by typecode, which
+ * keep every container within the bounds of its type. */
+static const int cardinalities[][NUM_LEVELS] = {
+    [ARRAY_CONTAINER_TYPE_CODE] = {128, 1024, 4096},
+    [RUN_CONTAINER_TYPE_CODE] = {256, 8192, 49152},
+    [BITSET_CONTAINER_TYPE_CODE] = {8192, 24576, 57344},
+};
+
+/* Length of the runs the values are drawn in: 1 means scattered values */
+static const int run_lengths[] = {1, 8, 64};
+
+static const uint8_t types[] = {ARRAY_CONTAINER_TYPE_CODE,
+                                RUN_CONTAINER_TYPE_CODE,
+                                BITSET_CONTAINER_TYPE_CODE};
+
+/* Whether an in-place operation frees its first input when it returns a new
+ * container, or leaves that to the caller (see roaring.c). */
+typedef enum { NOT_INPLACE, INPLACE_CALLER_FREES, INPLACE_SELF_FREES } kind_t;
+
+typedef void *(*container_op_t)(void *c1, uint8_t type1, const void *c2,
+                                uint8_t type2, uint8_t *result_type);
+
+typedef struct operation_s {
+    const char *name;
+    container_op_t op;
+    kind_t kind;
+    bool lazy;
+    container_op_t reference; /* non-lazy, non-inplace equivalent */
+} operation_t;
+
+static void *op_and(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                    uint8_t *rt) {
+    return container_and(c1, t1, c2, t2, rt);
+}
+static void *op_iand(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                     uint8_t *rt) {
+    return container_iand(c1, t1, c2, t2, rt);
+}
+static void *op_or(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                   uint8_t *rt) {
+    return container_or(c1, t1, c2, t2, rt);
+}
+static void *op_ior(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                    uint8_t *rt) {
+    return container_ior(c1, t1, c2, t2, rt);
+}
+static void *op_lazy_or(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                        uint8_t *rt) {
+    return container_lazy_or(c1, t1, c2, t2, rt);
+}
+static void *op_lazy_ior(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                         uint8_t *rt) {
+    return container_lazy_ior(c1, t1, c2, t2, rt);
+}
+static void *op_xor(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                    uint8_t *rt) {
+    return container_xor(c1, t1, c2, t2, rt);
+}
+static void *op_ixor(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                     uint8_t *rt) {
+    return container_ixor(c1, t1, c2, t2, rt);
+}
+static void *op_lazy_xor(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                         uint8_t *rt) {
+    return container_lazy_xor(c1, t1, c2, t2, rt);
+}
+static void *op_lazy_ixor(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                          uint8_t *rt) {
+    return container_lazy_ixor(c1, t1, c2, t2, rt);
+}
+static void *op_andnot(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                       uint8_t *rt) {
+    return container_andnot(c1, t1, c2, t2, rt);
+}
+static void *op_iandnot(void *c1, uint8_t t1, const void *c2, uint8_t t2,
+                        uint8_t *rt) {
+    return container_iandnot(c1, t1, c2, t2, rt);
+}
+
+static const operation_t operations[] = {
+    {"and", op_and, NOT_INPLACE, false, op_and},
+    {"iand", op_iand, INPLACE_CALLER_FREES, false, op_and},
+    {"or", op_or, NOT_INPLACE, false, op_or},
+    {"ior", op_ior, INPLACE_CALLER_FREES, false, op_or},
+    {"lazy_or", op_lazy_or, NOT_INPLACE, true, op_or},
+    {"lazy_ior", op_lazy_ior, INPLACE_CALLER_FREES, true, op_or},
+    {"xor", op_xor, NOT_INPLACE, false, op_xor},
+    {"ixor", op_ixor, INPLACE_SELF_FREES, false, op_xor},
+    {"lazy_xor", op_lazy_xor, NOT_INPLACE, true, op_xor},
+    {"lazy_ixor", op_lazy_ixor, INPLACE_SELF_FREES, true, op_xor},
+    {"andnot", op_andnot, NOT_INPLACE, false, op_andnot},
+    {"iandnot", op_iandnot, INPLACE_SELF_FREES, false, op_andnot},
+};
+
+/* A container of the given type with 'card' values, drawn in runs of
+ * 'run_length' consecutive values at random positions. */
+static void *make_container(uint8_t type, int card, int run_length) {
+    bitset_container_t *bitset = bitset_container_create();
+    while (bitset->cardinality < card) {
+        const uint32_t start = ranged_random(1 << 16);
+        for (uint32_t i = start; i < start + run_length && i < (1 << 16) &&
+                                 bitset->cardinality < card;
+             i++)
+            bitset_container_add(bitset, (uint16_t)i);
+    }
+    if (type == BITSET_CONTAINER_TYPE_CODE) return bitset;
+    array_container_t *array = array_container_from_bitset(bitset);
+    bitset_container_free(bitset);
+    if (type == ARRAY_CONTAINER_TYPE_CODE) return array;
+    run_container_t *run = run_container_from_array(array);
+    array_container_free(array);
+    return run;
+}
+
+/* Whether a result holds the same values as expected, after repairing the
+ * result of a lazy operation. Frees the result. */
+static bool consume_result(void *c, uint8_t type, bool lazy,
+                           const void *expected, uint8_t expected_type) {
+    if (lazy) c = container_repair_after_lazy(c, &type);
+    const bool same = container_equals(c, type, expected, expected_type);
+    container_free(c, type);
+    return same;
+}
+
+/* Best number of cycles for one operation over a fresh copy of c1; sets
+ * *wrong if a result does not hold the same values as expected. */
+static uint64_t time_operation(const operation_t *operation, const void *c1,
+                               uint8_t t1, const void *c2, uint8_t t2,
+                               const void *expected, uint8_t expected_type,
+                               bool *wrong) {
+    uint64_t min_diff = UINT64_MAX;
+    for (int r = 0; r < REPEAT; r++) {
+        void *input = (void *)c1;
+        if (operation->kind != NOT_INPLACE) input = container_clone(c1, t1);
+        uint64_t cycles_start, cycles_final;
+        uint8_t result_type;
+        __asm volatile("" ::: /* pretend to clobber */ "memory");
+        RDTSC_START(cycles_start);
+        void *result = operation->op(input, t1, c2, t2, &result_type);
+        RDTSC_FINAL(cycles_final);
+        if (cycles_final - cycles_start < min_diff)
+            min_diff = cycles_final - cycles_start;
+        if (operation->kind == INPLACE_CALLER_FREES && result != input)
+            container_free(input, t1);
+        if (!consume_result(result, result_type, operation->lazy, expected,
+                            expected_type))
+            *wrong = true;
+    }
+    return min_diff;
+}
+
+int main(int argc, char **argv) {
+    const char *only = argc > 1 ? argv[1] : NULL;
+    tellmeall();
+    printf("container pair benchmarks, in cycles per input element\n");
+    printf("%-14s %-10s %7s %7s %4s %8s\n", "pair", "operation", "card1",
+           "card2", "run", "cycles");
+    for (size_t i = 0; i < sizeof(types); i++) {
+        for (size_t j = 0; j < sizeof(types); j++) {
+            const uint8_t t1 = types[i], t2 = types[j];
+            char pair[32];
+            snprintf(pair, sizeof(pair), "%s-%s", get_container_name(t1),
+                     get_container_name(t2));
+            for (int level = 0; level < NUM_LEVELS; level++) {
+                for (size_t l = 0;
+                     l < sizeof(run_lengths) / sizeof(run_lengths[0]); l++) {
+                    void *c1 = make_container(t1, cardinalities[t1][level],
+                                              run_lengths[l]);
+                    void *c2 = make_container(t2, cardinalities[t2][level],
+                                              run_lengths[l]);
+                    const int card1 = container_get_cardinality(c1, t1);
+                    const int card2 = container_get_cardinality(c2, t2);
+                    for (size_t o = 0;
+                         o < sizeof(operations) / sizeof(operations[0]);
+                         o++) {
+                        const operation_t *operation = &operations[o];
+                        if (only != NULL && strcmp(only, operation->name) != 0)
+                            continue;
+                        uint8_t rt;
+                        void *expected =
+                            operation->reference(c1, t1, c2, t2, &rt);
+                        bool wrong = false;
+                        const uint64_t cycles = time_operation(
+                            operation, c1, t1, c2, t2, expected, rt, &wrong);
+                        container_free(expected, rt);
+                        printf("%-14s %-10s %7d %7d %4d %8.2f%s\n", pair,
+                               operation->name, card1, card2, run_lengths[l],
+                               cycles / (double)(card1 + card2),
+                               wrong ? " [ERROR]" : "");
+                    }
+                    container_free(c1, t1);
+                    container_free(c2, t2);
+                }
+            }
+        }
+    }
+    return 0;
+}
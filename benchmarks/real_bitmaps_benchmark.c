@@ -7,17 +7,20 @@
  * Once you have collected all the integers, build the bitmaps.
  */
 static roaring_bitmap_t **create_all_bitmaps(size_t *howmany,
-                                             uint32_t **numbers, size_t count, bool copy_on_write) {
+                                             uint32_t **numbers, size_t count, bool copy_on_write,
+                                             bool verbose) {
     if (numbers == NULL) return NULL;
-    printf("Constructing %d  bitmaps.\n", (int)count);
+    if (verbose) printf("Constructing %d  bitmaps.\n", (int)count);
     roaring_bitmap_t **answer = malloc(sizeof(roaring_bitmap_t *) * count);
     for (size_t i = 0; i < count; i++) {
-        printf(".");
-        fflush(stdout);
+        if (verbose) {
+            printf(".");
+            fflush(stdout);
+        }
         answer[i] = roaring_bitmap_of_ptr(howmany[i], numbers[i]);
         answer[i]->copy_on_write = copy_on_write;
     }
-    printf("\n");
+    if (verbose) printf("\n");
     return answer;
 }
 
@@ -26,7 +29,146 @@ static void printusage(char *command) {
         " Try %s directory \n where directory could be "
         "benchmarks/realdata/census1881\n",
         command);
-    ;
+    printf(" -e extension  extension of the data files (default .txt)\n");
+    printf(" -r            run-optimize the bitmaps before the benchmarks\n");
+    printf(" -o format     output format: text (default), csv or json\n");
+}
+
+enum { MAX_RESULTS = 32, NUM_PROBES = 1 << 16 };
+
+typedef enum { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON } format_t;
+
+/* One timed benchmark: 'cycles' spent over 'units' processed values (or
+ * probes) */
+typedef struct result_s {
+    const char *name;
+    uint64_t cycles;
+    uint64_t units;
+} result_t;
+
+typedef struct report_s {
+    const char *dataset;
+    size_t count;             /* number of bitmaps */
+    uint64_t values;          /* sum of their cardinalities */
+    uint64_t in_memory_bytes; /* allocated by their containers */
+    uint64_t portable_bytes;  /* their portable serialized size */
+    size_t n_results;
+    result_t results[MAX_RESULTS];
+} report_t;
+
+static void add_result(report_t *report, const char *name, uint64_t cycles,
+                       uint64_t units) {
+    if (report->n_results == MAX_RESULTS) return;
+    result_t *r = &report->results[report->n_results++];
+    r->name = name;
+    r->cycles = cycles;
+    r->units = units;
+}
+
+static double per_unit(const result_t *r) {
+    return r->units == 0 ? 0 : r->cycles / (double)r->units;
+}
+
+static void print_report(const report_t *report, format_t format) {
+    switch (format) {
+        case FORMAT_TEXT:
+            printf("\ndataset %s: %zu bitmaps, %" PRIu64 " values\n",
+                   report->dataset, report->count, report->values);
+            printf("memory: %" PRIu64 " bytes in memory, %" PRIu64
+                   " bytes serialized (%.2f and %.2f bits per value)\n",
+                   report->in_memory_bytes, report->portable_bytes,
+                   report->in_memory_bytes * 8.0 / report->values,
+                   report->portable_bytes * 8.0 / report->values);
+            for (size_t i = 0; i < report->n_results; i++) {
+                const result_t *r = &report->results[i];
+                printf("%-24s %14" PRIu64 " cycles %10.2f cycles per unit\n",
+                       r->name, r->cycles, per_unit(r));
+            }
+            break;
+        case FORMAT_CSV:
+            printf(
+                "dataset,bitmaps,values,in_memory_bytes,portable_bytes,"
+                "benchmark,cycles,units,cycles_per_unit\n");
+            for (size_t i = 0; i < report->n_results; i++) {
+                const result_t *r = &report->results[i];
+                printf("%s,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%s,%" PRIu64
+                       ",%" PRIu64 ",%.4f\n",
+                       report->dataset, report->count, report->values,
+                       report->in_memory_bytes, report->portable_bytes,
+                       r->name, r->cycles, r->units, per_unit(r));
+            }
+            break;
+        case FORMAT_JSON:
+            printf("{\"dataset\": \"%s\", \"bitmaps\": %zu, \"values\": %" PRIu64
+                   ",\n",
+                   report->dataset, report->count, report->values);
+            printf(" \"in_memory_bytes\": %" PRIu64
+                   ", \"portable_bytes\": %" PRIu64 ",\n",
+                   report->in_memory_bytes, report->portable_bytes);
+            printf(" \"benchmarks\": [\n");
+            for (size_t i = 0; i < report->n_results; i++) {
+                const result_t *r = &report->results[i];
+                printf("  {\"name\": \"%s\", \"cycles\": %" PRIu64
+                       ", \"units\": %" PRIu64 ", \"cycles_per_unit\": %.4f}%s\n",
+                       r->name, r->cycles, r->units, per_unit(r),
+                       i + 1 < report->n_results ? "," : "");
+            }
+            printf(" ]}\n");
+            break;
+    }
+}
+
+static void count_values(uint32_t value, void *param) {
+    (void)value;
+    (*(uint64_t *)param)++;
+}
+
+typedef roaring_bitmap_t *(*binary_op_t)(const roaring_bitmap_t *,
+                                         const roaring_bitmap_t *);
+typedef void (*inplace_op_t)(roaring_bitmap_t *, const roaring_bitmap_t *);
+
+/* Times op over consecutive pairs; the cardinality of each result is
+ * written to cards. Returns the cycles. */
+static uint64_t successive(roaring_bitmap_t **bitmaps, size_t count,
+                           binary_op_t op, uint64_t *cards) {
+    uint64_t cycles_start = 0, cycles_final = 0, total = 0;
+    for (size_t i = 0; i + 1 < count; ++i) {
+        RDTSC_START(cycles_start);
+        roaring_bitmap_t *r = op(bitmaps[i], bitmaps[i + 1]);
+        RDTSC_FINAL(cycles_final);
+        total += cycles_final - cycles_start;
+        cards[i] = roaring_bitmap_get_cardinality(r);
+        roaring_bitmap_free(r);
+    }
+    return total;
+}
+
+/* Times op in place over copies of consecutive pairs, checking the
+ * cardinalities against those of the out-of-place version. Returns the
+ * cycles, or UINT64_MAX on a mismatch. */
+static uint64_t successive_inplace(roaring_bitmap_t **bitmaps, size_t count,
+                                   inplace_op_t op, const uint64_t *cards,
+                                   bool copy_on_write) {
+    uint64_t cycles_start = 0, cycles_final = 0;
+    roaring_bitmap_t **copies = malloc(sizeof(roaring_bitmap_t *) * count);
+    for (size_t i = 0; i < count; i++) {
+        copies[i] = roaring_bitmap_copy(bitmaps[i]);
+        copies[i]->copy_on_write = copy_on_write;
+    }
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i + 1 < count; i++) {
+        op(copies[i], bitmaps[i + 1]);
+    }
+    RDTSC_FINAL(cycles_final);
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        if (i + 1 < count &&
+            roaring_bitmap_get_cardinality(copies[i]) != cards[i])
+            ok = false;
+        roaring_bitmap_free(copies[i]);
+    }
+    free(copies);
+    return ok ? cycles_final - cycles_start : UINT64_MAX;
 }
 
 #define KNRM "\x1B[0m"
@@ -42,10 +184,27 @@ int main(int argc, char **argv) {
     int c;
     char *extension = ".txt";
     bool copy_on_write = false;
-    while ((c = getopt(argc, argv, "e:h")) != -1) switch (c) {
+    bool run_optimize = false;
+    format_t format = FORMAT_TEXT;
+    while ((c = getopt(argc, argv, "e:ro:h")) != -1) switch (c) {
             case 'e':
                 extension = optarg;
                 break;
+            case 'r':
+                run_optimize = true;
+                break;
+            case 'o':
+                if (strcmp(optarg, "csv") == 0) {
+                    format = FORMAT_CSV;
+                } else if (strcmp(optarg, "json") == 0) {
+                    format = FORMAT_JSON;
+                } else if (strcmp(optarg, "text") == 0) {
+                    format = FORMAT_TEXT;
+                } else {
+                    printusage(argv[0]);
+                    return -1;
+                }
+                break;
             case 'h':
                 printusage(argv[0]);
                 return 0;
@@ -69,88 +228,249 @@ int main(int argc, char **argv) {
             extension, dirname);
         return -1;
     }
+    // progress messages would break machine-readable output
+    const bool verbose = format == FORMAT_TEXT;
+
+    report_t report;
+    memset(&report, 0, sizeof(report));
+    // the name of the directory, without trailing slashes
+    size_t namelen = strlen(dirname);
+    while (namelen > 1 && dirname[namelen - 1] == '/') dirname[--namelen] = 0;
+    const char *slash = strrchr(dirname, '/');
+    report.dataset = slash != NULL ? slash + 1 : dirname;
+    report.count = count;
 
     uint64_t cycles_start = 0, cycles_final = 0;
 
     RDTSC_START(cycles_start);
-    roaring_bitmap_t **bitmaps = create_all_bitmaps(howmany, numbers, count, copy_on_write);
+    roaring_bitmap_t **bitmaps =
+        create_all_bitmaps(howmany, numbers, count, copy_on_write, verbose);
     RDTSC_FINAL(cycles_final);
     if (bitmaps == NULL) return -1;
-    printf("Loaded %d bitmaps from directory %s \n", (int)count, dirname);
+    if (verbose)
+        printf("Loaded %d bitmaps from directory %s \n", (int)count, dirname);
+    uint64_t *cards = malloc(sizeof(uint64_t) * count);
+    for (size_t i = 0; i < count; i++) {
+        cards[i] = roaring_bitmap_get_cardinality(bitmaps[i]);
+        report.values += cards[i];
+    }
+    add_result(&report, "create", cycles_final - cycles_start, report.values);
 
-    printf("Creating %zu bitmaps took %" PRIu64 " cycles\n", count,
-           cycles_final - cycles_start);
+    if (run_optimize) {
+        RDTSC_START(cycles_start);
+        for (size_t i = 0; i < count; i++) {
+            roaring_bitmap_run_optimize(bitmaps[i]);
+        }
+        RDTSC_FINAL(cycles_final);
+        add_result(&report, "run_optimize", cycles_final - cycles_start,
+                   report.values);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        roaring_statistics_t stat;
+        roaring_bitmap_statistics(bitmaps[i], &stat);
+        report.in_memory_bytes += stat.n_bytes_array_containers +
+                                  stat.n_bytes_run_containers +
+                                  stat.n_bytes_bitset_containers;
+        report.portable_bytes +=
+            roaring_bitmap_portable_size_in_bytes(bitmaps[i]);
+    }
 
     RDTSC_START(cycles_start);
-    for (int i = 0; i < (int)count; i += 2) {
-        roaring_bitmap_t *CI = roaring_bitmap_copy(
-            bitmaps[i]);  // to test the inplace version we create a copy
+    for (size_t i = 0; i < count; i++) {
+        roaring_bitmap_t *CI = roaring_bitmap_copy(bitmaps[i]);
         roaring_bitmap_free(CI);
     }
     RDTSC_FINAL(cycles_final);
-    printf("Copying and freeing %zu bitmaps took %" PRIu64 " cycles\n", count,
-           cycles_final - cycles_start);
-
-    uint64_t successive_and = 0;
-    uint64_t successive_or = 0;
-    // try ANDing and ORing together consecutive pairs
-    for (int i = 0; i < (int)count - 1; ++i) {
-        uint32_t c1 = roaring_bitmap_get_cardinality(bitmaps[i]);
-        uint32_t c2 = roaring_bitmap_get_cardinality(bitmaps[i + 1]);
-        RDTSC_START(cycles_start);
-        roaring_bitmap_t *tempand =
-            roaring_bitmap_and(bitmaps[i], bitmaps[i + 1]);
-        RDTSC_FINAL(cycles_final);
-        successive_and += cycles_final - cycles_start;
+    add_result(&report, "copy_and_free", cycles_final - cycles_start,
+               report.values);
 
-        uint32_t ci = roaring_bitmap_get_cardinality(tempand);
-        roaring_bitmap_free(tempand);
-        RDTSC_START(cycles_start);
-        roaring_bitmap_t *tempor =
-            roaring_bitmap_or(bitmaps[i], bitmaps[i + 1]);
-        RDTSC_FINAL(cycles_final);
-        successive_or += cycles_final - cycles_start;
+    // values in consecutive pairs, the inputs of the successive operations
+    uint64_t pair_values = 0;
+    for (size_t i = 0; i + 1 < count; i++)
+        pair_values += cards[i] + cards[i + 1];
 
-        uint32_t co = roaring_bitmap_get_cardinality(tempor);
-        roaring_bitmap_free(tempor);
+    // try ANDing, ORing, XORing and ANDNOTing together consecutive pairs
+    uint64_t *and_cards = malloc(sizeof(uint64_t) * count);
+    uint64_t *or_cards = malloc(sizeof(uint64_t) * count);
+    uint64_t *xor_cards = malloc(sizeof(uint64_t) * count);
+    uint64_t *andnot_cards = malloc(sizeof(uint64_t) * count);
+    add_result(&report, "successive_and",
+               successive(bitmaps, count, roaring_bitmap_and, and_cards),
+               pair_values);
+    add_result(&report, "successive_or",
+               successive(bitmaps, count, roaring_bitmap_or, or_cards),
+               pair_values);
+    add_result(&report, "successive_xor",
+               successive(bitmaps, count, roaring_bitmap_xor, xor_cards),
+               pair_values);
+    add_result(&report, "successive_andnot",
+               successive(bitmaps, count, roaring_bitmap_andnot, andnot_cards),
+               pair_values);
+    for (size_t i = 0; i + 1 < count; ++i) {
+        const uint64_t c1 = cards[i], c2 = cards[i + 1];
+        const uint64_t ci = and_cards[i], co = or_cards[i];
+        if (c1 + c2 != co + ci || xor_cards[i] != co - ci ||
+            andnot_cards[i] != c1 - ci) {
+            fprintf(stderr, KRED "cardinalities are wrong somehow\n" KNRM);
+            fprintf(stderr,
+                    "c1 = %" PRIu64 ", c2 = %" PRIu64 ", co = %" PRIu64
+                    ", ci = %" PRIu64 "\n",
+                    c1, c2, co, ci);
+            return -1;
+        }
+    }
 
-        if (c1 + c2 != co + ci) {
-            printf(KRED "cardinalities are wrong somehow\n");
-            printf("c1 = %d, c2 = %d, co = %d, ci = %d\n", c1, c2, co, ci);
+    const struct {
+        const char *name;
+        inplace_op_t op;
+        const uint64_t *cards;
+    } inplace_ops[] = {
+        {"successive_and_inplace", roaring_bitmap_and_inplace, and_cards},
+        {"successive_or_inplace", roaring_bitmap_or_inplace, or_cards},
+        {"successive_xor_inplace", roaring_bitmap_xor_inplace, xor_cards},
+        {"successive_andnot_inplace", roaring_bitmap_andnot_inplace,
+         andnot_cards},
+    };
+    for (size_t k = 0; k < sizeof(inplace_ops) / sizeof(inplace_ops[0]); k++) {
+        const uint64_t cycles =
+            successive_inplace(bitmaps, count, inplace_ops[k].op,
+                               inplace_ops[k].cards, copy_on_write);
+        if (cycles == UINT64_MAX) {
+            fprintf(stderr, KRED "%s gives wrong cardinalities\n" KNRM,
+                    inplace_ops[k].name);
             return -1;
         }
+        add_result(&report, inplace_ops[k].name, cycles, pair_values);
     }
-    printf(" %zu successive bitmaps intersections took %" PRIu64 " cycles\n",
-           count - 1, successive_and);
-    printf(" %zu successive bitmaps unions took %" PRIu64 " cycles\n",
-           count - 1, successive_or);
+    free(and_cards);
+    free(or_cards);
+    free(xor_cards);
+    free(andnot_cards);
 
-    roaring_bitmap_t **copyofr = malloc(sizeof(roaring_bitmap_t *) * count);
-    for (int i = 0; i < (int)count; i++) {
-        copyofr[i] = roaring_bitmap_copy(bitmaps[i]);
+    // wide unions of all the bitmaps
+    const roaring_bitmap_t **inputs =
+        (const roaring_bitmap_t **)malloc(sizeof(roaring_bitmap_t *) * count);
+    for (size_t i = 0; i < count; i++) inputs[i] = bitmaps[i];
+    RDTSC_START(cycles_start);
+    roaring_bitmap_t *wide = roaring_bitmap_or_many(count, inputs);
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "or_many", cycles_final - cycles_start,
+               report.values);
+    RDTSC_START(cycles_start);
+    roaring_bitmap_t *wide_heap =
+        roaring_bitmap_or_many_heap((uint32_t)count, inputs);
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "or_many_heap", cycles_final - cycles_start,
+               report.values);
+    RDTSC_START(cycles_start);
+    roaring_bitmap_t *wide_horizontal =
+        roaring_bitmap_or_many_horizontal(count, inputs);
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "or_many_horizontal", cycles_final - cycles_start,
+               report.values);
+    if (!roaring_bitmap_equals(wide, wide_heap) ||
+        !roaring_bitmap_equals(wide, wide_horizontal)) {
+        fprintf(stderr, KRED "wide unions disagree\n" KNRM);
+        return -1;
     }
+    free(inputs);
+
+    // probes spread evenly over the range of the values
+    uint32_t max_value = 0;
+    if (!roaring_bitmap_is_empty(wide)) {
+        roaring_statistics_t stat;
+        roaring_bitmap_statistics(wide, &stat);
+        max_value = stat.max_value;
+    }
+    const uint32_t step = max_value / NUM_PROBES + 1;
+    uint64_t hits = 0, probes = 0;
     RDTSC_START(cycles_start);
-    for (int i = 0; i < (int)count - 1; i++) {
-        roaring_bitmap_and_inplace(copyofr[i], bitmaps[i + 1]);
+    for (size_t i = 0; i < count; i++) {
+        for (uint64_t v = i % step; v <= max_value; v += step) {
+            hits += roaring_bitmap_contains(bitmaps[i], (uint32_t)v);
+            probes++;
+        }
     }
     RDTSC_FINAL(cycles_final);
-    printf(" %zu successive in-place bitmaps intersections took %" PRIu64
-           " cycles\n",
-           count - 1, cycles_final - cycles_start);
+    add_result(&report, "contains", cycles_final - cycles_start, probes);
 
-    free(copyofr);
-    copyofr = malloc(sizeof(roaring_bitmap_t *) * count);
-    for (int i = 0; i < (int)count; i++) {
-        copyofr[i] = roaring_bitmap_copy(bitmaps[i]);
+    // iteration, with a callback and with an iterator
+    uint64_t visited = 0;
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i < count; i++) {
+        roaring_iterate(bitmaps[i], count_values, &visited);
     }
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "iterate", cycles_final - cycles_start, visited);
+    uint64_t iterated = 0;
     RDTSC_START(cycles_start);
-    for (int i = 0; i < (int)count - 1; i++) {
-        roaring_bitmap_or_inplace(copyofr[i], bitmaps[i + 1]);
+    for (size_t i = 0; i < count; i++) {
+        roaring_uint32_iterator_t it;
+        roaring_init_iterator(bitmaps[i], &it);
+        while (it.has_value) {
+            iterated++;
+            roaring_advance_uint32_iterator(&it);
+        }
     }
     RDTSC_FINAL(cycles_final);
-    printf(" %zu successive in-place bitmaps unions took %" PRIu64 " cycles\n",
-           count - 1, cycles_final - cycles_start);
+    add_result(&report, "iterator", cycles_final - cycles_start, iterated);
+
+    uint64_t max_card = 0;
+    for (size_t i = 0; i < count; i++)
+        if (cards[i] > max_card) max_card = cards[i];
+    uint32_t *out = malloc(sizeof(uint32_t) * (max_card + 1));
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i < count; i++) {
+        roaring_bitmap_to_uint32_array(bitmaps[i], out);
+    }
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "to_uint32_array", cycles_final - cycles_start,
+               report.values);
+    free(out);
+
+    // portable serialization round trip
+    char **buffers = malloc(sizeof(char *) * count);
+    for (size_t i = 0; i < count; i++) {
+        buffers[i] = malloc(roaring_bitmap_portable_size_in_bytes(bitmaps[i]));
+    }
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i < count; i++) {
+        roaring_bitmap_portable_serialize(bitmaps[i], buffers[i]);
+    }
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "portable_serialize", cycles_final - cycles_start,
+               report.values);
+    roaring_bitmap_t **back = malloc(sizeof(roaring_bitmap_t *) * count);
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i < count; i++) {
+        back[i] = roaring_bitmap_portable_deserialize(buffers[i]);
+    }
+    RDTSC_FINAL(cycles_final);
+    add_result(&report, "portable_deserialize", cycles_final - cycles_start,
+               report.values);
+    for (size_t i = 0; i < count; i++) {
+        if (!roaring_bitmap_equals(back[i], bitmaps[i])) {
+            fprintf(stderr, KRED "serialization round trip failed\n" KNRM);
+            return -1;
+        }
+        roaring_bitmap_free(back[i]);
+        free(buffers[i]);
+    }
+    free(back);
+    free(buffers);
+
+    if (hits > probes || visited != report.values || iterated != visited) {
+        fprintf(stderr, KRED "iteration visited %" PRIu64 " values\n" KNRM,
+                visited);
+        return -1;
+    }
+
+    print_report(&report, format);
 
+    roaring_bitmap_free(wide);
+    roaring_bitmap_free(wide_heap);
+    roaring_bitmap_free(wide_horizontal);
     for (int i = 0; i < (int)count; ++i) {
         free(numbers[i]);
         numbers[i] = NULL;  // paranoid
@@ -158,6 +478,7 @@ int main(int argc, char **argv) {
         bitmaps[i] = NULL;  // paranoid
     }
     free(bitmaps);
+    free(cards);
     free(howmany);
     free(numbers);
 
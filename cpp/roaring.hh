@@ -7,12 +7,139 @@ A C++ header for Roaring Bitmaps.
 #include <stdarg.h>
 
 #include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <new>
 #include <stdexcept>
+#include <utility>
 #include <roaring/roaring.h>
 
+template <class E> class RoaringExpr;
+
+/**
+ * A forward iterator over the values of a bitmap, in increasing order.
+ * The bitmap must not be modified while the iterator is in use.
+ */
+class RoaringSetBitForwardIterator {
+public:
+	typedef std::forward_iterator_tag iterator_category;
+	typedef uint32_t value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const uint32_t * pointer;
+	typedef const uint32_t & reference;
+
+	/**
+	 * Create an exhausted iterator, equal to the end() of any bitmap.
+	 */
+	RoaringSetBitForwardIterator() : it() {
+	}
+
+	/**
+	 * Create an iterator positioned at the smallest value of the bitmap.
+	 */
+	explicit RoaringSetBitForwardIterator(const roaring_bitmap_t * r) {
+		roaring_init_iterator(r, &it);
+	}
+
+	reference operator*() const {
+		return it.current_value;
+	}
+
+	pointer operator->() const {
+		return &it.current_value;
+	}
+
+	/**
+	 * Move to the next value. Steps within an array or run container, or
+	 * within the current word of a bitset container, are inlined, everything
+	 * else goes through roaring_advance_uint32_iterator.
+	 */
+	RoaringSetBitForwardIterator & operator++() {
+		if(!it.has_value) {
+			return *this;
+		}
+		if(it.typecode == BITSET_CONTAINER_TYPE_CODE) {
+			const bitset_container_t * bc =
+				(const bitset_container_t *) it.container;
+			const int32_t next = it.in_container_index + 1;
+			if(next % 64 != 0) {
+				const uint64_t word =
+					bc->array[next / 64] & (UINT64_MAX << (next % 64));
+				if(word != 0) {
+					it.in_container_index =
+						(next & ~63) + __builtin_ctzll(word);
+					it.current_value = it.highbits | it.in_container_index;
+					return *this;
+				}
+			}
+		} else if(it.typecode == ARRAY_CONTAINER_TYPE_CODE) {
+			const array_container_t * ac =
+				(const array_container_t *) it.container;
+			if(it.in_container_index + 1 < ac->cardinality) {
+				it.current_value =
+					it.highbits | ac->array[++it.in_container_index];
+				return *this;
+			}
+		} else if(it.typecode == RUN_CONTAINER_TYPE_CODE) {
+			const run_container_t * rc = (const run_container_t *) it.container;
+			const rle16_t * run = rc->runs + it.run_index;
+			if((it.current_value & 0xFFFF) <
+					(uint32_t)(run->value + run->length)) {
+				it.current_value++;
+				return *this;
+			}
+		}
+		roaring_advance_uint32_iterator(&it);
+		return *this;
+	}
+
+	RoaringSetBitForwardIterator operator++(int) {
+		RoaringSetBitForwardIterator old(*this);
+		++(*this);
+		return old;
+	}
+
+	/**
+	 * Two iterators are equal if both are exhausted, or if both point at
+	 * the same value.
+	 */
+	bool operator==(const RoaringSetBitForwardIterator & o) const {
+		if(!it.has_value || !o.it.has_value) {
+			return it.has_value == o.it.has_value;
+		}
+		return it.current_value == o.it.current_value;
+	}
+
+	bool operator!=(const RoaringSetBitForwardIterator & o) const {
+		return !(*this == o);
+	}
+
+	/**
+	 * Move to the first value >= val, and return whether there is one.
+	 * Values smaller than the current one are never revisited cheaply, so
+	 * this is meant for increasing targets (e.g., merge joins). Must not
+	 * be called on a default-constructed iterator.
+	 */
+	bool equalorlarger(uint32_t val) {
+		return roaring_move_uint32_iterator_equalorlarger(&it, val);
+	}
+
+	/**
+	 * Copy up to count values, starting with the current one, into buf,
+	 * and move past them. Returns the number of values written; fewer
+	 * than count means the iterator is now exhausted.
+	 */
+	uint32_t read(uint32_t * buf, uint32_t count) {
+		return roaring_read_uint32_iterator(&it, buf, count);
+	}
+
+	roaring_uint32_iterator_t it;
+};
+
 class Roaring {
 public:
+	typedef RoaringSetBitForwardIterator const_iterator;
+
 	/**
 	 * Create an empty bitmap
 	 */
@@ -33,7 +160,13 @@ public:
 		}
 	}
 
-
+	/**
+	 * Move constructor. The moved-from bitmap may only be destroyed or
+	 * assigned to.
+	 */
+	Roaring(Roaring && r) noexcept : roaring(r.roaring) {
+		r.roaring = NULL;
+	}
 
 	/**
 	 * Construct a roaring object from the C struct.
@@ -95,22 +228,42 @@ public:
 	 * Destructor
 	 */
 	~Roaring() {
-		roaring_bitmap_free(roaring);
+		if(roaring != NULL) {
+			roaring_bitmap_free(roaring);
+		}
 	}
 
 	/**
 	 * Copies the content of the provided bitmap, and
-	 * discard the current content.
+	 * discard the current content. On failure, the current content is kept.
 	 */
 	Roaring& operator=(const Roaring & r) {
-		roaring_bitmap_free(roaring);
-		roaring = roaring_bitmap_copy(r.roaring);
-		if(roaring == NULL) {
+		roaring_bitmap_t * copy = roaring_bitmap_copy(r.roaring);
+		if(copy == NULL) {
 			throw std::runtime_error("failed memory alloc in assignement");
 		}
+		if(roaring != NULL) {
+			roaring_bitmap_free(roaring);
+		}
+		roaring = copy;
 		return *this;
     }
 
+	/**
+	 * Takes over the content of the provided bitmap, and
+	 * discard the current content.
+	 */
+	Roaring& operator=(Roaring && r) noexcept {
+		if(this != &r) {
+			if(roaring != NULL) {
+				roaring_bitmap_free(roaring);
+			}
+			roaring = r.roaring;
+			r.roaring = NULL;
+		}
+		return *this;
+	}
+
 	/**
 	 * Compute the intersection between the current bitmap and the provided bitmap,
 	 * writing the result in the current bitmap. The provided bitmap is not modified.
@@ -143,6 +296,17 @@ public:
 	}
 
 
+	/**
+	 * Compute the difference between the current bitmap and the provided bitmap,
+	 * writing the result in the current bitmap. The provided bitmap is not modified,
+	 * and must be distinct from the current bitmap.
+	 */
+	Roaring& operator-=(const Roaring & r) {
+		roaring_bitmap_andnot_inplace(roaring,r.roaring);
+		return *this;
+	}
+
+
 	/**
 	 * Exchange the content of this bitmap with another.
 	 */
@@ -220,6 +384,31 @@ public:
 		roaring_iterate(roaring, iterator, ptr);
 	}
 
+	/**
+	 * Iterator positioned at the smallest value. Together with end(), this
+	 * lets the bitmap be used as a sorted range (range-for, STL algorithms).
+	 */
+	const_iterator begin() const {
+		return const_iterator(roaring);
+	}
+
+	/**
+	 * Exhausted iterator marking the end of the values.
+	 */
+	const_iterator end() const {
+		return const_iterator();
+	}
+
+	/**
+	 * Iterator positioned at the first value >= val, or end() if there is
+	 * none.
+	 */
+	const_iterator lower_bound(uint32_t val) const {
+		const_iterator i(roaring);
+		i.equalorlarger(val);
+		return i;
+	}
+
 	/**
 	 * If the size of the roaring bitmap is strictly greater than rank, then this
 	   function returns true and set element to the element of given rank.
@@ -266,7 +455,7 @@ public:
 	 * Computes the intersection between two bitmaps and returns new bitmap.
 	 * The current bitmap and the provided bitmap are unchanged.
 	 */
-	Roaring operator&(const Roaring & o) const {
+	Roaring operator&(const Roaring & o) const & {
 		roaring_bitmap_t * r = roaring_bitmap_and(roaring,
                 o.roaring);
 		if(r == NULL) {
@@ -275,11 +464,21 @@ public:
 		return Roaring(r);
 	}
 
+	/**
+	 * Computes the intersection between a temporary bitmap and the provided
+	 * bitmap, reusing the storage of the temporary (e.g., in a & b & c).
+	 */
+	Roaring operator&(const Roaring & o) && {
+		if(&o == this) return std::move(*this); // e.g., std::move(a) & a
+		roaring_bitmap_and_inplace(roaring, o.roaring);
+		return std::move(*this);
+	}
+
 	/**
 	 * Computes the union between two bitmaps and returns new bitmap.
 	 * The current bitmap and the provided bitmap are unchanged.
 	 */
-	Roaring operator|(const Roaring & o) const {
+	Roaring operator|(const Roaring & o) const & {
 		roaring_bitmap_t * r = roaring_bitmap_or(roaring,
                 o.roaring);
 		if(r == NULL) {
@@ -288,11 +487,21 @@ public:
 		return Roaring(r);
 	}
 
+	/**
+	 * Computes the union between a temporary bitmap and the provided
+	 * bitmap, reusing the storage of the temporary (e.g., in a | b | c).
+	 */
+	Roaring operator|(const Roaring & o) && {
+		if(&o == this) return std::move(*this); // e.g., std::move(a) | a
+		roaring_bitmap_or_inplace(roaring, o.roaring);
+		return std::move(*this);
+	}
+
 	/**
 	 * Computes the symmetric union between two bitmaps and returns new bitmap.
 	 * The current bitmap and the provided bitmap are unchanged.
 	 */
-	Roaring operator^(const Roaring & o) const {
+	Roaring operator^(const Roaring & o) const & {
 		roaring_bitmap_t * r = roaring_bitmap_xor(roaring,
                 o.roaring);
 		if(r == NULL) {
@@ -301,6 +510,58 @@ public:
 		return Roaring(r);
 	}
 
+	/**
+	 * Computes the symmetric union between a temporary bitmap and the provided
+	 * bitmap, reusing the storage of the temporary (e.g., in a ^ b ^ c).
+	 */
+	Roaring operator^(const Roaring & o) && {
+		if(&o == this) return Roaring(); // e.g., std::move(a) ^ a
+		roaring_bitmap_xor_inplace(roaring, o.roaring);
+		return std::move(*this);
+	}
+
+	/**
+	 * Computes the difference between two bitmaps and returns new bitmap.
+	 * The current bitmap and the provided bitmap are unchanged.
+	 */
+	Roaring operator-(const Roaring & o) const & {
+		roaring_bitmap_t * r = roaring_bitmap_andnot(roaring,
+                o.roaring);
+		if(r == NULL) {
+			throw std::runtime_error("failed materalization in andnot");
+		}
+		return Roaring(r);
+	}
+
+	/**
+	 * Computes the difference between a temporary bitmap and the provided
+	 * bitmap, reusing the storage of the temporary (e.g., in a - b - c).
+	 */
+	Roaring operator-(const Roaring & o) && {
+		if(&o == this) return Roaring(); // e.g., std::move(a) - a
+		roaring_bitmap_andnot_inplace(roaring, o.roaring);
+		return std::move(*this);
+	}
+
+	/**
+	 * Evaluates a lazy expression (see lazy()) into a new bitmap.
+	 */
+	template <class E>
+	Roaring(const RoaringExpr<E> & e) : roaring(e.evaluate()) {
+		if(roaring == NULL) {
+			throw std::runtime_error("failed materalization of expression");
+		}
+	}
+
+	/**
+	 * Evaluates a lazy expression (see lazy()) and discard the current
+	 * content. The expression may refer to the current bitmap.
+	 */
+	template <class E>
+	Roaring& operator=(const RoaringExpr<E> & e) {
+		return *this = Roaring(e);
+	}
+
 
 	/**
 	 * Whether or not we apply copy and write.
@@ -330,7 +591,7 @@ public:
 	 * pointer).
 	 */
 	static Roaring fastunion(size_t n, const Roaring **inputs) {
-		const roaring_bitmap_t **x = (const roaring_bitmap_t **) malloc(n
+		const roaring_bitmap_t **x = (const roaring_bitmap_t **) roaring_malloc(n
 				* sizeof(roaring_bitmap_t *));
 		if(x == NULL) {
 			throw std::runtime_error("failed memory alloc in fastunion");
@@ -340,10 +601,10 @@ public:
 
 		Roaring ans(NULL);
 		ans.roaring = roaring_bitmap_or_many(n,x);
+		roaring_free(x);
 		if(ans.roaring == NULL) {
 			throw std::runtime_error("failed memory alloc in fastunion");
 		}
-	    free(x);
 		return ans;
 	}
 
@@ -352,6 +613,626 @@ public:
 };
 
 
+/**
+ * Lazy expressions over bitmaps. lazy(a) starts an expression, and the
+ * operators &, |, ^ and - (andnot) combine expressions and bitmaps, e.g.
+ *
+ *   Roaring r = (lazy(a) & b) | (lazy(c) - d);
+ *
+ * Nothing is computed until the expression is converted to a Roaring or one
+ * of cardinality(), isEmpty() or intersects() is called. Evaluation then
+ * walks the keys of the inputs once, computing each output container in a
+ * single pass over the matching input containers: intermediate results are
+ * single containers, never whole bitmaps, and temporary containers are
+ * reused in place by the next operator. cardinality(), isEmpty() and
+ * intersects() do not build the containers of the outermost operator.
+ *
+ * An expression holds references to its bitmaps, which must outlive it and
+ * must not be modified while it is evaluated.
+ */
+
+/**
+ * Returned by next_key() when an expression has no more keys.
+ */
+const uint32_t ROARING_EXPR_NO_KEY = 0x10000;
+
+/**
+ * The container operations used by expressions. The C functions are large
+ * inline switches over the container types: inlining them all into every
+ * expression would exceed the compiler's inlining limits, so expressions
+ * call them through these small out-of-line wrappers.
+ */
+struct RoaringExprContainers {
+	static void * clone(const void * c, uint8_t t);
+	static void free(void * c, uint8_t t);
+	static int cardinality(const void * c, uint8_t t);
+	static bool nonzero_cardinality(const void * c,
+			uint8_t t);
+	static int and_cardinality(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2);
+	static bool intersect(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2);
+	static void * and_(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * or_(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * xor_(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * andnot(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	// the in-place operations free c1 whenever they return another container
+	static void * iand(void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * ior(void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * ixor(void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+	static void * iandnot(void * c1, uint8_t t1,
+			const void * c2, uint8_t t2, uint8_t * type);
+};
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::clone(const void * c, uint8_t t) {
+	return container_clone(c, t);
+}
+
+inline ROARING_NOINLINE void
+RoaringExprContainers::free(void * c, uint8_t t) {
+	container_free(c, t);
+}
+
+inline ROARING_NOINLINE int
+RoaringExprContainers::cardinality(const void * c, uint8_t t) {
+	return container_get_cardinality(c, t);
+}
+
+inline ROARING_NOINLINE bool
+RoaringExprContainers::nonzero_cardinality(const void * c, uint8_t t) {
+	return container_nonzero_cardinality(c, t);
+}
+
+inline ROARING_NOINLINE int
+RoaringExprContainers::and_cardinality(const void * c1, uint8_t t1,
+		const void * c2, uint8_t t2) {
+	return container_and_cardinality(c1, t1, c2, t2);
+}
+
+inline ROARING_NOINLINE bool
+RoaringExprContainers::intersect(const void * c1, uint8_t t1, const void * c2,
+		uint8_t t2) {
+	return container_intersect(c1, t1, c2, t2);
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::and_(const void * c1, uint8_t t1, const void * c2,
+		uint8_t t2, uint8_t * type) {
+	return container_and(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::or_(const void * c1, uint8_t t1, const void * c2,
+		uint8_t t2, uint8_t * type) {
+	return container_or(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::xor_(const void * c1, uint8_t t1, const void * c2,
+		uint8_t t2, uint8_t * type) {
+	return container_xor(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::andnot(const void * c1, uint8_t t1, const void * c2,
+		uint8_t t2, uint8_t * type) {
+	return container_andnot(c1, t1, c2, t2, type);
+}
+
+/* container_iand and container_ior leave freeing c1 to the caller;
+ * container_ixor and container_iandnot take care of it themselves. */
+inline ROARING_NOINLINE void *
+RoaringExprContainers::iand(void * c1, uint8_t t1, const void * c2, uint8_t t2,
+		uint8_t * type) {
+	void * ans = container_iand(c1, t1, c2, t2, type);
+	if(ans != c1) {
+		container_free(c1, t1);
+	}
+	return ans;
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::ior(void * c1, uint8_t t1, const void * c2, uint8_t t2,
+		uint8_t * type) {
+	void * ans = container_ior(c1, t1, c2, t2, type);
+	if(ans != c1) {
+		container_free(c1, t1);
+	}
+	return ans;
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::ixor(void * c1, uint8_t t1, const void * c2, uint8_t t2,
+		uint8_t * type) {
+	return container_ixor(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringExprContainers::iandnot(void * c1, uint8_t t1, const void * c2,
+		uint8_t t2, uint8_t * type) {
+	return container_iandnot(c1, t1, c2, t2, type);
+}
+
+/**
+ * Base of all expressions, providing the terminal operations. E is the
+ * concrete expression and must provide:
+ *
+ *   void reset() const: rewind before a new evaluation;
+ *   uint32_t next_key(uint32_t key) const: a key >= key such that there are
+ *     no values between key and it, or ROARING_EXPR_NO_KEY. Keys passed to
+ *     next_key() and container() mostly increase during an evaluation, but
+ *     may go back to a key before a previous probe;
+ *   void * container(uint16_t key, uint8_t * type, bool * owned) const: the
+ *     (unwrapped, non-empty) container for key, or NULL if there is none;
+ *     when owned is set, the caller is responsible for freeing it.
+ */
+template <class E>
+class RoaringExpr {
+public:
+	const E & self() const {
+		return static_cast<const E &>(*this);
+	}
+
+	/**
+	 * Materializes the expression. Returns NULL on allocation failure.
+	 */
+	roaring_bitmap_t * evaluate() const {
+		roaring_bitmap_t * ans = roaring_bitmap_create();
+		if(ans == NULL) {
+			return NULL;
+		}
+		self().reset();
+		uint32_t key = self().next_key(0);
+		while(key != ROARING_EXPR_NO_KEY) {
+			uint8_t type;
+			bool owned;
+			void * c = self().container((uint16_t) key, &type, &owned);
+			if(c != NULL) {
+				if(!owned) {
+					c = RoaringExprContainers::clone(c, type);
+				}
+				ra_append(ans->high_low_container, (uint16_t) key, c, type);
+			}
+			key = self().next_key(key + 1);
+		}
+		return ans;
+	}
+
+	/**
+	 * Number of values in the expression.
+	 */
+	uint64_t cardinality() const {
+		uint64_t ans = 0;
+		self().reset();
+		uint32_t key = self().next_key(0);
+		while(key != ROARING_EXPR_NO_KEY) {
+			ans += self().container_cardinality((uint16_t) key);
+			key = self().next_key(key + 1);
+		}
+		return ans;
+	}
+
+	/**
+	 * Whether the expression has no value.
+	 */
+	bool isEmpty() const {
+		self().reset();
+		uint32_t key = self().next_key(0);
+		while(key != ROARING_EXPR_NO_KEY) {
+			if(self().container_cardinality((uint16_t) key) > 0) {
+				return false;
+			}
+			key = self().next_key(key + 1);
+		}
+		return true;
+	}
+
+	/**
+	 * Whether the expression and the other expression have a value in
+	 * common.
+	 */
+	template <class E2>
+	bool intersects(const RoaringExpr<E2> & other) const {
+		const E2 & o = other.self();
+		self().reset();
+		o.reset();
+		uint32_t key = self().next_key(0);
+		while(key != ROARING_EXPR_NO_KEY) {
+			const uint32_t okey = o.next_key(key);
+			if(okey != key) {
+				key = self().next_key(okey);
+				continue;
+			}
+			uint8_t type1 = 0, type2 = 0;
+			bool owned1 = false, owned2 = false;
+			void * c1 = self().container((uint16_t) key, &type1, &owned1);
+			void * c2 = o.container((uint16_t) key, &type2, &owned2);
+			const bool found = c1 != NULL && c2 != NULL &&
+				RoaringExprContainers::intersect(c1, type1, c2, type2);
+			if(c1 != NULL && owned1) {
+				RoaringExprContainers::free(c1, type1);
+			}
+			if(c2 != NULL && owned2) {
+				RoaringExprContainers::free(c2, type2);
+			}
+			if(found) {
+				return true;
+			}
+			key = self().next_key(key + 1);
+		}
+		return false;
+	}
+
+	bool intersects(const Roaring & other) const;
+
+	/**
+	 * Cardinality of the container for key. Expressions may override this
+	 * to avoid building the container.
+	 */
+	int container_cardinality(uint16_t key) const {
+		uint8_t type;
+		bool owned;
+		void * c = self().container(key, &type, &owned);
+		if(c == NULL) {
+			return 0;
+		}
+		const int card = RoaringExprContainers::cardinality(c, type);
+		if(owned) {
+			RoaringExprContainers::free(c, type);
+		}
+		return card;
+	}
+};
+
+/**
+ * A bitmap within an expression.
+ */
+class RoaringLeafExpr : public RoaringExpr<RoaringLeafExpr> {
+public:
+	explicit RoaringLeafExpr(const Roaring & r)
+		: ra(r.roaring->high_low_container), pos(0) {
+	}
+
+	void reset() const {
+		pos = 0;
+	}
+
+	uint32_t next_key(uint32_t key) const {
+		if(key > 0xFFFF) {
+			return ROARING_EXPR_NO_KEY;
+		}
+		seek((uint16_t) key);
+		return pos < ra->size ? ra->keys[pos] : ROARING_EXPR_NO_KEY;
+	}
+
+	void * container(uint16_t key, uint8_t * type, bool * owned) const {
+		seek(key);
+		if(pos >= ra->size || ra->keys[pos] != key) {
+			return NULL;
+		}
+		*type = ra->typecodes[pos];
+		*owned = false;
+		return (void *) container_unwrap_shared(ra->containers[pos], type);
+	}
+
+	int container_cardinality(uint16_t key) const {
+		seek(key);
+		if(pos >= ra->size || ra->keys[pos] != key) {
+			return 0;
+		}
+		return RoaringExprContainers::cardinality(ra->containers[pos],
+			ra->typecodes[pos]);
+	}
+
+private:
+	/* Moves pos to the first key >= key. Keys usually increase, so this
+	 * gallops forward from pos; a parent may ask for a key behind a
+	 * previous probe, in which case it searches from the start. */
+	void seek(uint16_t key) const {
+		if(pos > 0 && ra->keys[pos - 1] >= key) {
+			pos = 0;
+		}
+		if(pos < ra->size && ra->keys[pos] < key) {
+			pos = ra_advance_until(ra, key, pos);
+		}
+	}
+
+	roaring_array_t * ra;
+	mutable int32_t pos;
+};
+
+/**
+ * Operators for RoaringBinaryExpr. Each provides next_key() from the keys
+ * of its operands, and the container and cardinality of the result at a key.
+ * apply() is kept out of line, like the container operations it calls.
+ */
+struct RoaringAndOp {
+	template <class L, class R>
+	static uint32_t next_key(const L & l, const R & r, uint32_t key) {
+		key = l.next_key(key);
+		while(key != ROARING_EXPR_NO_KEY) {
+			const uint32_t rkey = r.next_key(key);
+			if(rkey == key) {
+				return key;
+			}
+			key = l.next_key(rkey);
+		}
+		return key;
+	}
+
+	static void * apply(void * c1, uint8_t t1, bool own1,
+			void * c2, uint8_t t2, bool own2, uint8_t * type, bool * owned);
+
+	static int cardinality(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2) {
+		if(c1 == NULL || c2 == NULL) {
+			return 0;
+		}
+		return RoaringExprContainers::and_cardinality(c1, t1, c2, t2);
+	}
+};
+
+struct RoaringOrOp {
+	template <class L, class R>
+	static uint32_t next_key(const L & l, const R & r, uint32_t key) {
+		return std::min(l.next_key(key), r.next_key(key));
+	}
+
+	static void * apply(void * c1, uint8_t t1, bool own1,
+			void * c2, uint8_t t2, bool own2, uint8_t * type, bool * owned);
+
+	static int cardinality(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2) {
+		if(c1 == NULL) {
+			return c2 == NULL ? 0 : RoaringExprContainers::cardinality(c2, t2);
+		}
+		if(c2 == NULL) {
+			return RoaringExprContainers::cardinality(c1, t1);
+		}
+		return RoaringExprContainers::cardinality(c1, t1) +
+			RoaringExprContainers::cardinality(c2, t2) -
+			RoaringExprContainers::and_cardinality(c1, t1, c2, t2);
+	}
+};
+
+struct RoaringXorOp {
+	template <class L, class R>
+	static uint32_t next_key(const L & l, const R & r, uint32_t key) {
+		return std::min(l.next_key(key), r.next_key(key));
+	}
+
+	static void * apply(void * c1, uint8_t t1, bool own1,
+			void * c2, uint8_t t2, bool own2, uint8_t * type, bool * owned);
+
+	static int cardinality(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2) {
+		if(c1 == NULL || c2 == NULL) {
+			return RoaringOrOp::cardinality(c1, t1, c2, t2);
+		}
+		return RoaringExprContainers::cardinality(c1, t1) +
+			RoaringExprContainers::cardinality(c2, t2) -
+			2 * RoaringExprContainers::and_cardinality(c1, t1, c2, t2);
+	}
+};
+
+struct RoaringAndNotOp {
+	template <class L, class R>
+	static uint32_t next_key(const L & l, const R &, uint32_t key) {
+		return l.next_key(key);
+	}
+
+	static void * apply(void * c1, uint8_t t1, bool own1,
+			void * c2, uint8_t t2, bool own2, uint8_t * type, bool * owned);
+
+	static int cardinality(const void * c1, uint8_t t1,
+			const void * c2, uint8_t t2) {
+		if(c1 == NULL) {
+			return 0;
+		}
+		if(c2 == NULL) {
+			return RoaringExprContainers::cardinality(c1, t1);
+		}
+		return RoaringExprContainers::cardinality(c1, t1) -
+			RoaringExprContainers::and_cardinality(c1, t1, c2, t2);
+	}
+};
+
+inline ROARING_NOINLINE void *
+RoaringAndOp::apply(void * c1, uint8_t t1, bool own1, void * c2, uint8_t t2,
+		bool own2, uint8_t * type, bool * owned) {
+	if(c1 == NULL || c2 == NULL) {
+		if(c1 != NULL && own1) {
+			RoaringExprContainers::free(c1, t1);
+		}
+		if(c2 != NULL && own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		return NULL;
+	}
+	*owned = true;
+	if(own1) {
+		void * ans = RoaringExprContainers::iand(c1, t1, c2, t2, type);
+		if(own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		return ans;
+	}
+	if(own2) {
+		return RoaringExprContainers::iand(c2, t2, c1, t1, type);
+	}
+	return RoaringExprContainers::and_(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringOrOp::apply(void * c1, uint8_t t1, bool own1, void * c2, uint8_t t2,
+		bool own2, uint8_t * type, bool * owned) {
+	if(c1 == NULL || c2 == NULL) {
+		*type = c1 == NULL ? t2 : t1;
+		*owned = c1 == NULL ? own2 : own1;
+		return c1 == NULL ? c2 : c1;
+	}
+	*owned = true;
+	if(own1) {
+		void * ans = RoaringExprContainers::ior(c1, t1, c2, t2, type);
+		if(own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		return ans;
+	}
+	if(own2) {
+		return RoaringExprContainers::ior(c2, t2, c1, t1, type);
+	}
+	return RoaringExprContainers::or_(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringXorOp::apply(void * c1, uint8_t t1, bool own1, void * c2, uint8_t t2,
+		bool own2, uint8_t * type, bool * owned) {
+	if(c1 == NULL || c2 == NULL) {
+		return RoaringOrOp::apply(c1, t1, own1, c2, t2, own2, type, owned);
+	}
+	*owned = true;
+	if(own1) {
+		void * ans = RoaringExprContainers::ixor(c1, t1, c2, t2, type);
+		if(own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		return ans;
+	}
+	if(own2) {
+		return RoaringExprContainers::ixor(c2, t2, c1, t1, type);
+	}
+	return RoaringExprContainers::xor_(c1, t1, c2, t2, type);
+}
+
+inline ROARING_NOINLINE void *
+RoaringAndNotOp::apply(void * c1, uint8_t t1, bool own1, void * c2, uint8_t t2,
+		bool own2, uint8_t * type, bool * owned) {
+	if(c1 == NULL || c2 == NULL) {
+		if(c2 != NULL && own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		*type = t1;
+		*owned = own1;
+		return c1;
+	}
+	*owned = true;
+	void * ans;
+	if(own1) {
+		ans = RoaringExprContainers::iandnot(c1, t1, c2, t2, type);
+	} else {
+		ans = RoaringExprContainers::andnot(c1, t1, c2, t2, type);
+	}
+	if(own2) {
+		RoaringExprContainers::free(c2, t2);
+	}
+	return ans;
+}
+
+/**
+ * Two expressions combined by one of the operators above.
+ */
+template <class Op, class L, class R>
+class RoaringBinaryExpr : public RoaringExpr<RoaringBinaryExpr<Op, L, R> > {
+public:
+	RoaringBinaryExpr(const L & l, const R & r) : left(l), right(r) {
+	}
+
+	void reset() const {
+		left.reset();
+		right.reset();
+	}
+
+	uint32_t next_key(uint32_t key) const {
+		return Op::next_key(left, right, key);
+	}
+
+	void * container(uint16_t key, uint8_t * type, bool * owned) const {
+		uint8_t t1 = 0, t2 = 0;
+		bool own1 = false, own2 = false;
+		void * c1 = left.container(key, &t1, &own1);
+		void * c2 = right.container(key, &t2, &own2);
+		void * ans = Op::apply(c1, t1, own1, c2, t2, own2, type, owned);
+		// container operations expect non-empty inputs
+		if(ans != NULL &&
+				!RoaringExprContainers::nonzero_cardinality(ans, *type)) {
+			if(*owned) {
+				RoaringExprContainers::free(ans, *type);
+			}
+			return NULL;
+		}
+		return ans;
+	}
+
+	/* the operands are built, but not the result */
+	int container_cardinality(uint16_t key) const {
+		uint8_t t1 = 0, t2 = 0;
+		bool own1 = false, own2 = false;
+		void * c1 = left.container(key, &t1, &own1);
+		void * c2 = right.container(key, &t2, &own2);
+		const int card = Op::cardinality(c1, t1, c2, t2);
+		if(c1 != NULL && own1) {
+			RoaringExprContainers::free(c1, t1);
+		}
+		if(c2 != NULL && own2) {
+			RoaringExprContainers::free(c2, t2);
+		}
+		return card;
+	}
+
+private:
+	L left;
+	R right;
+};
+
+template <class E>
+inline bool RoaringExpr<E>::intersects(const Roaring & other) const {
+	return intersects(RoaringLeafExpr(other));
+}
+
+/**
+ * Starts a lazy expression over a bitmap.
+ */
+inline RoaringLeafExpr lazy(const Roaring & r) {
+	return RoaringLeafExpr(r);
+}
+
+#define ROARING_EXPR_OPERATOR(op, Op)                                        \
+	template <class L, class R>                                              \
+	inline RoaringBinaryExpr<Op, L, R> operator op(                          \
+			const RoaringExpr<L> & l, const RoaringExpr<R> & r) {            \
+		return RoaringBinaryExpr<Op, L, R>(l.self(), r.self());              \
+	}                                                                        \
+	template <class L>                                                       \
+	inline RoaringBinaryExpr<Op, L, RoaringLeafExpr> operator op(            \
+			const RoaringExpr<L> & l, const Roaring & r) {                   \
+		return RoaringBinaryExpr<Op, L, RoaringLeafExpr>(l.self(),           \
+			RoaringLeafExpr(r));                                             \
+	}                                                                        \
+	template <class R>                                                       \
+	inline RoaringBinaryExpr<Op, RoaringLeafExpr, R> operator op(            \
+			const Roaring & l, const RoaringExpr<R> & r) {                   \
+		return RoaringBinaryExpr<Op, RoaringLeafExpr, R>(RoaringLeafExpr(l), \
+			r.self());                                                       \
+	}
+
+ROARING_EXPR_OPERATOR(&, RoaringAndOp)
+ROARING_EXPR_OPERATOR(|, RoaringOrOp)
+ROARING_EXPR_OPERATOR(^, RoaringXorOp)
+ROARING_EXPR_OPERATOR(-, RoaringAndNotOp)
+
+#undef ROARING_EXPR_OPERATOR
+
+
+
 
 
 #endif /* INCLUDE_ROARING_HH_ */
@@ -2,8 +2,21 @@
 #define ARRAY_UTIL_H
 
 #include <stddef.h>  // for size_t
+#include <stdbool.h>
 #include <stdint.h>
 
+#include <roaring/portability.h>
+
+/* Which of the vectorized kernels below are available. */
+#if defined(USEAVX) || defined(ROARING_DISPATCH) || defined(USENEON)
+#define ROARING_VECTOR_INTERSECTION_ENABLED
+#define ROARING_VECTOR_DIFFERENCE_ENABLED
+#endif
+#if defined(USE_BMI) || defined(USENEON)
+#define ROARING_VECTOR_UNION_ENABLED
+#define ROARING_VECTOR_XOR_ENABLED
+#endif
+
 int32_t binarySearch(const uint16_t *source, int32_t n, uint16_t target);
 
 int32_t advanceUntil(const uint16_t *array, int32_t pos, int32_t length,
@@ -14,28 +27,82 @@ int32_t advanceUntil(const uint16_t *array, int32_t pos, int32_t length,
  *
  * C should have capacity greater than the minimum of s_1 and s_b + 8
  * where 8 is sizeof(__m128i)/sizeof(uint16_t).
+ *
+ * With ROARING_DISPATCH, falls back on intersect_uint16 when the processor
+ * lacks SSE4.2.
  */
 int32_t intersect_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
                            size_t s_b, uint16_t *C);
 
+/**
+ * Same as intersect_vector16, but only computes the cardinality.
+ */
+int32_t intersect_vector16_cardinality(const uint16_t *A, size_t s_a,
+                                       const uint16_t *B, size_t s_b);
+
+/**
+ * Computes the difference A \ B and writes it to C, returning the number of
+ * values written. C may be A; otherwise C should have capacity s_a + 8.
+ * Only available with ROARING_VECTOR_DIFFERENCE_ENABLED. With
+ * ROARING_DISPATCH, falls back on difference_uint16 when the processor lacks
+ * SSE4.2.
+ */
+int32_t difference_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
+                            size_t s_b, uint16_t *C);
+
 /* Computes the intersection between one small and one large set of uint16_t.
  * Stores the result into buffer and return the number of elements. */
 int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
                                 const uint16_t *large, size_t size_l,
                                 uint16_t *buffer);
 
+/* Computes the size of the intersection between one small and one large set
+ * of uint16_t. */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l);
+
+/* Check whether a small and a large set of uint16_t have a common value. */
+bool intersect_skewed_uint16_nonempty(const uint16_t *small, size_t size_s,
+                                      const uint16_t *large, size_t size_l);
+
 /**
  * Generic intersection function. Passes unit tests.
  */
 int32_t intersect_uint16(const uint16_t *A, const size_t lenA,
                          const uint16_t *B, const size_t lenB, uint16_t *out);
 
+/**
+ * Generic intersection function, returns just the cardinality.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB);
+
+/**
+ * Generic intersection test, stops at the first common value.
+ */
+bool intersect_uint16_nonempty(const uint16_t *A, const size_t lenA,
+                               const uint16_t *B, const size_t lenB);
+
 /**
  * Generic union function.
  */
 size_t union_uint16(const uint16_t *set_1, size_t size_1, const uint16_t *set_2,
                     size_t size_2, uint16_t *buffer);
 
+/**
+ * Generic symmetric difference function.
+ */
+size_t xor_uint16(const uint16_t *set_1, size_t size_1, const uint16_t *set_2,
+                  size_t size_2, uint16_t *buffer);
+
+/**
+ * Generic difference function (A \ B), out may be A.
+ */
+int32_t difference_uint16(const uint16_t *A, const size_t lenA,
+                          const uint16_t *B, const size_t lenB, uint16_t *out);
+
 /**
  * Generic intersection function.
  */
@@ -60,6 +127,15 @@ size_t union_uint32(const uint32_t *set_1, size_t size_1, const uint32_t *set_2,
 uint32_t union_vector16(const uint16_t *set_1, uint32_t size_1,
                         const uint16_t *set_2, uint32_t size_2,
                         uint16_t *buffer);
+
+/**
+ * Same as union_vector16, but drops the values found in both sets. buffer
+ * should have capacity size_1 + size_2. Only available with
+ * ROARING_VECTOR_XOR_ENABLED.
+ */
+uint32_t xor_vector16(const uint16_t *set_1, uint32_t size_1,
+                      const uint16_t *set_2, uint32_t size_2,
+                      uint16_t *buffer);
 /**
  * Generic union function, returns just the cardinality.
  */
@@ -1,13 +1,27 @@
 #ifndef BITSET_UTIL_H
 #define BITSET_UTIL_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <roaring/portability.h>
 
 /*
  * Set all bits in indexes [begin,end) to true.
  */
 void bitset_set_range(uint64_t *bitmap, uint32_t start, uint32_t end);
 
+/*
+ * Count the set bits in indexes [begin,end).
+ */
+int bitset_range_cardinality(const uint64_t *bitmap, uint32_t start,
+                             uint32_t end);
+
+/*
+ * Check whether any bit in indexes [begin,end) is set.
+ */
+bool bitset_range_nonempty(const uint64_t *bitmap, uint32_t start,
+                           uint32_t end);
+
 /*
  * Flip all the bits in indexes [begin,end).
  */
@@ -32,11 +46,49 @@ void bitset_reset_range(uint64_t *bitmap, uint32_t start, uint32_t end);
  * when the density of the bitset is high.
  *
  * This function uses AVX2 decoding.
+ *
+ * With ROARING_DISPATCH, check roaring_hardware_support() before calling
+ * this function or the AVX-512 decoders below.
  */
 size_t bitset_extract_setbits_avx2(uint64_t *bitset, size_t length,
                                    uint32_t *out, size_t outcapacity,
                                    uint32_t base);
 
+#if defined(USEAVX512) || defined(ROARING_DISPATCH)
+/*
+ * Same as bitset_extract_setbits_avx2, but decodes 16 bits at a time with
+ * the AVX-512 compress instruction. Unlike the AVX2 decoder, it does not
+ * slow down on sparse bitsets. At most "outcapacity" values are written.
+ */
+size_t bitset_extract_setbits_avx512(uint64_t *bitset, size_t length,
+                                     uint32_t *out, size_t outcapacity,
+                                     uint32_t base);
+
+/*
+ * Same as bitset_extract_setbits_avx512, but writes 16-bit integers.
+ */
+size_t bitset_extract_setbits_avx512_uint16(const uint64_t *bitset,
+                                            size_t length, uint16_t *out,
+                                            size_t outcapacity, uint16_t base);
+#endif
+
+#ifdef USENEON
+/*
+ * Same as bitset_extract_setbits_avx2, using NEON. At most "outcapacity"
+ * values are written.
+ */
+size_t bitset_extract_setbits_neon(uint64_t *bitset, size_t length,
+                                   uint32_t *out, size_t outcapacity,
+                                   uint32_t base);
+
+/*
+ * Same as bitset_extract_setbits_sse_uint16, using NEON.
+ */
+size_t bitset_extract_setbits_neon_uint16(const uint64_t *bitset,
+                                          size_t length, uint16_t *out,
+                                          size_t outcapacity, uint16_t base);
+#endif
+
 /*
  * Given a bitset containing "length" 64-bit words, write out the position
  * of all the set bits to "out", values start at "base".
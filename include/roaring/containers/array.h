@@ -51,15 +51,35 @@ uint32_t array_container_serialization_len(array_container_t *container);
 
 void *array_container_deserialize(const char *buf, size_t buf_len);
 
-/* Add `pos' to `array'. Returns true if `pos' was not present. */
+/* Add `pos' to `array'. Returns true if `pos' was not present (and could be
+ * added: false is also returned if memory could not be allocated). */
 bool array_container_add(array_container_t *array, uint16_t pos);
 
+/* Add the `length' values of `list' to `array'. The list must be strictly
+ * increasing. The resulting cardinality may exceed DEFAULT_MAX_SIZE. Returns
+ * false, leaving `array' unchanged, if memory could not be allocated. */
+bool array_container_add_many(array_container_t *array, const uint16_t *list,
+                              int32_t length);
+
 /* Remove `pos' from `array'. Returns true if `pos' was present. */
 bool array_container_remove(array_container_t *array, uint16_t pos);
 
 /* Check whether `pos' is present in `array'.  */
 bool array_container_contains(const array_container_t *array, uint16_t pos);
 
+/* Add all values in [min, max] (included) to `array'. The resulting
+ * cardinality may exceed DEFAULT_MAX_SIZE. */
+void array_container_add_range(array_container_t *array, uint32_t min,
+                               uint32_t max);
+
+/* Remove all values in [min, max] (included) from `array'. */
+void array_container_remove_range(array_container_t *array, uint32_t min,
+                                  uint32_t max);
+
+/* Check whether all values in [min, max] (included) are present in `array'. */
+bool array_container_contains_range(const array_container_t *array,
+                                    uint32_t min, uint32_t max);
+
 /* Get the cardinality of `array'. */
 static inline int array_container_cardinality(const array_container_t *array) {
     return array->cardinality;
@@ -109,6 +129,14 @@ void array_container_intersection(const array_container_t *src_1,
                                   const array_container_t *src_2,
                                   array_container_t *dst);
 
+/* Compute the size of the intersection of src_1 and src_2. */
+int array_container_intersection_cardinality(const array_container_t *src_1,
+                                             const array_container_t *src_2);
+
+/* Check whether src_1 and src_2 have a common value. */
+bool array_container_intersect(const array_container_t *src_1,
+                               const array_container_t *src_2);
+
 /* computes the intersection of array1 and array2 and write the result to
  * array1.
  * */
@@ -167,9 +195,10 @@ static inline int32_t array_container_serialized_size_in_bytes(int32_t card) {
  * parameter.
  * If preserve is false,
  * then the new content will be uninitialized, otherwise the original data is
- * copied.
+ * copied. Returns false if memory could not be allocated, in which case the
+ * container is unchanged if preserve is true, and has no storage otherwise.
  */
-void array_container_grow(array_container_t *container, int32_t min,
+bool array_container_grow(array_container_t *container, int32_t min,
                           int32_t max, bool preserve);
 
 void array_container_iterate(const array_container_t *cont, uint32_t base,
@@ -232,6 +261,9 @@ static inline bool array_container_select(const array_container_t *container,
     }
 }
 
+/* Returns the number of values equal or smaller than x */
+int array_container_rank(const array_container_t *arr, uint16_t x);
+
 /* Computes the  difference of array1 and array2 and write the result
  * to array out.
  * Array out does not need to be distinct from array_1
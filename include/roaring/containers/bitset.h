@@ -218,6 +218,11 @@ static inline bool bitset_container_nonzero_cardinality(
     return bitset->cardinality > 0;
 }
 
+/* Returns true if bitsets `src_1' and `src_2' have at least one common element.
+ * Stops at the first common word. */
+bool bitset_container_intersect(const bitset_container_t *src_1,
+                                const bitset_container_t *src_2);
+
 /* Computes the union of bitsets `src_1' and `src_2' into `dst'  and return the
  * cardinality. */
 int bitset_container_or(const bitset_container_t *src_1,
@@ -396,4 +401,7 @@ bool bitset_container_select(const bitset_container_t *container,
                              uint32_t *start_rank, uint32_t rank,
                              uint32_t *element);
 
+/* Returns the number of values equal or smaller than x */
+int bitset_container_rank(const bitset_container_t *container, uint16_t x);
+
 #endif /* INCLUDE_CONTAINERS_BITSET_H_ */
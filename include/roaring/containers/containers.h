@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <roaring/bitset_util.h>
 #include <roaring/containers/array.h>
 #include <roaring/containers/bitset.h>
 #include <roaring/containers/convert.h>
@@ -34,7 +35,7 @@
 struct shared_container_s {
     void *container;
     uint8_t typecode;
-    uint32_t counter;  // to be managed atomically
+    uint32_t counter;  // updated atomically, see containers.c
 };
 
 typedef struct shared_container_s shared_container_t;
@@ -408,6 +409,58 @@ static inline void *container_add(void *container, uint16_t val,
     }
 }
 
+/**
+ * Add a strictly increasing list of values to a container, requires a
+ * typecode, fills in new_typecode and return (possibly different) container.
+ * This function may allocate a new container, and caller is responsible for
+ * memory deallocation. Returns NULL, leaving the container unchanged, if
+ * memory could not be allocated.
+ */
+static inline void *container_add_many(void *container, const uint16_t *list,
+                                       int32_t length, uint8_t typecode,
+                                       uint8_t *new_typecode) {
+    container = get_writable_copy_if_shared(container, &typecode);
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            bitset_container_t *bc = (bitset_container_t *)container;
+            bc->cardinality = (int32_t)bitset_set_list_withcard(
+                bc->array, bc->cardinality, list, length);
+            *new_typecode = BITSET_CONTAINER_TYPE_CODE;
+            return container;
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            array_container_t *ac = (array_container_t *)container;
+            if (ac->cardinality + length > DEFAULT_MAX_SIZE) {
+                // convert first, so that ac is unchanged if that fails
+                bitset_container_t *bc = bitset_container_from_array(ac);
+                if (bc == NULL) return NULL;
+                bc->cardinality = (int32_t)bitset_set_list_withcard(
+                    bc->array, bc->cardinality, list, length);
+                if (bc->cardinality > DEFAULT_MAX_SIZE) {
+                    *new_typecode = BITSET_CONTAINER_TYPE_CODE;
+                    return bc;
+                }
+                bitset_container_free(bc);  // mostly duplicates
+            }
+            if (!array_container_add_many(ac, list, length)) return NULL;
+            *new_typecode = ARRAY_CONTAINER_TYPE_CODE;
+            return ac;
+        } break;
+        case RUN_CONTAINER_TYPE_CODE:
+            // per Java, no container type adjustments are done (revisit?)
+            if (!run_container_add_many((run_container_t *)container, list,
+                                        length)) {
+                return NULL;
+            }
+            *new_typecode = RUN_CONTAINER_TYPE_CODE;
+            return container;
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return NULL;
+    }
+}
+
 /**
  * Remove a value from a container, requires a  typecode, fills in new_typecode
  * and
@@ -470,6 +523,124 @@ static inline bool container_contains(const void *container, uint16_t val,
     }
 }
 
+/**
+ * Add all values in [min, max] (included) to a container, requires a typecode,
+ * fills in new_typecode and return (possibly different) container.
+ * This function may allocate a new container, and caller is responsible for
+ * memory deallocation
+ */
+static inline void *container_add_range(void *container, uint8_t typecode,
+                                        uint32_t min, uint32_t max,
+                                        uint8_t *new_typecode) {
+    container = get_writable_copy_if_shared(container, &typecode);
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            bitset_container_t *bc = (bitset_container_t *)container;
+            bc->cardinality += (int32_t)(max - min + 1) -
+                               bitset_range_cardinality(bc->array, min,
+                                                        max + 1);
+            bitset_set_range(bc->array, min, max + 1);
+            *new_typecode = BITSET_CONTAINER_TYPE_CODE;
+            return container;
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            array_container_t *ac = (array_container_t *)container;
+            const int32_t nvals_less =
+                (min == 0) ? 0
+                           : array_container_rank(ac, (uint16_t)(min - 1));
+            const int32_t nvals_greater =
+                ac->cardinality - array_container_rank(ac, (uint16_t)max);
+            const int32_t union_cardinality =
+                nvals_less + (int32_t)(max - min + 1) + nvals_greater;
+            if (union_cardinality <= DEFAULT_MAX_SIZE) {
+                array_container_add_range(ac, min, max);
+                *new_typecode = ARRAY_CONTAINER_TYPE_CODE;
+                return ac;
+            }
+            // a long range is best merged as a run
+            run_container_t *rc = run_container_from_array(ac);
+            run_container_add_range(rc, min, max);
+            return convert_run_to_efficient_container_and_free(rc,
+                                                               new_typecode);
+        }
+        case RUN_CONTAINER_TYPE_CODE:
+            run_container_add_range((run_container_t *)container, min, max);
+            *new_typecode = RUN_CONTAINER_TYPE_CODE;
+            return container;
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return NULL;
+    }
+}
+
+/**
+ * Remove all values in [min, max] (included) from a container, requires a
+ * typecode, fills in new_typecode and return (possibly different) container.
+ * The result may be empty. This function may allocate a new container, and
+ * caller is responsible for memory deallocation
+ */
+static inline void *container_remove_range(void *container, uint8_t typecode,
+                                           uint32_t min, uint32_t max,
+                                           uint8_t *new_typecode) {
+    container = get_writable_copy_if_shared(container, &typecode);
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            bitset_container_t *bc = (bitset_container_t *)container;
+            bc->cardinality -=
+                bitset_range_cardinality(bc->array, min, max + 1);
+            bitset_reset_range(bc->array, min, max + 1);
+            if (bc->cardinality > DEFAULT_MAX_SIZE) {
+                *new_typecode = BITSET_CONTAINER_TYPE_CODE;
+                return container;
+            }
+            *new_typecode = ARRAY_CONTAINER_TYPE_CODE;
+            return array_container_from_bitset(bc);
+        }
+        case ARRAY_CONTAINER_TYPE_CODE:
+            array_container_remove_range((array_container_t *)container, min,
+                                         max);
+            *new_typecode = ARRAY_CONTAINER_TYPE_CODE;
+            return container;
+        case RUN_CONTAINER_TYPE_CODE: {
+            run_container_t *rc = (run_container_t *)container;
+            run_container_remove_range(rc, min, max);
+            if (rc->n_runs == 0) {
+                *new_typecode = RUN_CONTAINER_TYPE_CODE;
+                return container;
+            }
+            return convert_run_to_efficient_container(rc, new_typecode);
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return NULL;
+    }
+}
+
+/* Check whether all values in [min, max] (included) are in the container. */
+static inline bool container_contains_range(const void *container,
+                                            uint8_t typecode, uint32_t min,
+                                            uint32_t max) {
+    container = container_unwrap_shared(container, &typecode);
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE:
+            return bitset_range_cardinality(
+                       ((const bitset_container_t *)container)->array, min,
+                       max + 1) == (int)(max - min + 1);
+        case ARRAY_CONTAINER_TYPE_CODE:
+            return array_container_contains_range(
+                (const array_container_t *)container, min, max);
+        case RUN_CONTAINER_TYPE_CODE:
+            return run_container_contains_range(
+                (const run_container_t *)container, min, max);
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return false;
+    }
+}
+
 int32_t container_serialize(const void *container, uint8_t typecode,
                             char *buf) WARN_UNUSED;
 
@@ -530,6 +701,104 @@ static inline bool container_equals(const void *c1, uint8_t type1,
 
 // macro-izations possibilities for generic non-inplace binary-op dispatch
 
+/**
+ * Compute the size of the intersection between two containers.
+ * This function does not allocate memory.
+ */
+static inline int container_and_cardinality(const void *c1, uint8_t type1,
+                                            const void *c2, uint8_t type2) {
+    c1 = container_unwrap_shared(c1, &type1);
+    c2 = container_unwrap_shared(c2, &type2);
+    switch (CONTAINER_PAIR(type1, type2)) {
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return bitset_container_and_justcard(
+                (const bitset_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_container_intersection_cardinality(
+                (const array_container_t *)c1, (const array_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return run_container_intersection_cardinality(
+                (const run_container_t *)c1, (const run_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersection_cardinality(
+                (const array_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersection_cardinality(
+                (const array_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            RUN_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersection_cardinality(
+                (const run_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersection_cardinality(
+                (const run_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return array_run_container_intersection_cardinality(
+                (const array_container_t *)c1, (const run_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, ARRAY_CONTAINER_TYPE_CODE):
+            return array_run_container_intersection_cardinality(
+                (const array_container_t *)c2, (const run_container_t *)c1);
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return 0;
+    }
+}
+
+/**
+ * Check whether two containers intersect. This function stops at the first
+ * common value and does not allocate memory.
+ */
+static inline bool container_intersect(const void *c1, uint8_t type1,
+                                       const void *c2, uint8_t type2) {
+    c1 = container_unwrap_shared(c1, &type1);
+    c2 = container_unwrap_shared(c2, &type2);
+    switch (CONTAINER_PAIR(type1, type2)) {
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return bitset_container_intersect((const bitset_container_t *)c1,
+                                              (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_container_intersect((const array_container_t *)c1,
+                                             (const array_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return run_container_intersect((const run_container_t *)c1,
+                                           (const run_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersect(
+                (const array_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersect(
+                (const array_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            RUN_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersect(
+                (const run_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersect(
+                (const run_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return array_run_container_intersect((const array_container_t *)c1,
+                                                 (const run_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, ARRAY_CONTAINER_TYPE_CODE):
+            return array_run_container_intersect((const array_container_t *)c2,
+                                                 (const run_container_t *)c1);
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return false;
+    }
+}
+
 /**
  * Compute intersection between two containers, generate a new container (having
  * type result_type), requires a typecode. This allocates new memory, caller
@@ -552,6 +821,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
         case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
                             ARRAY_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             array_container_intersection((const array_container_t *)c1,
                                          (const array_container_t *)c2,
                                          (array_container_t *)result);
@@ -559,6 +829,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
             return result;
         case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
             result = run_container_create();
+            if (result == NULL) return NULL;
             run_container_intersection((const run_container_t *)c1,
                                        (const run_container_t *)c2,
                                        (run_container_t *)result);
@@ -567,6 +838,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
         case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
                             ARRAY_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             array_bitset_container_intersection((const array_container_t *)c2,
                                                 (const bitset_container_t *)c1,
                                                 (array_container_t *)result);
@@ -575,6 +847,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
         case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
                             BITSET_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             *result_type = ARRAY_CONTAINER_TYPE_CODE;  // never bitset
             array_bitset_container_intersection((const array_container_t *)c1,
                                                 (const bitset_container_t *)c2,
@@ -599,6 +872,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
             return result;
         case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             *result_type = ARRAY_CONTAINER_TYPE_CODE;  // never bitset
             array_run_container_intersection((const array_container_t *)c1,
                                              (const run_container_t *)c2,
@@ -607,6 +881,7 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
 
         case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, ARRAY_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             *result_type = ARRAY_CONTAINER_TYPE_CODE;  // never bitset
             array_run_container_intersection((const array_container_t *)c2,
                                              (const run_container_t *)c1,
@@ -650,6 +925,7 @@ static inline void *container_iand(void *c1, uint8_t type1, const void *c2,
             return c1;
         case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
             result = run_container_create();
+            if (result == NULL) return NULL;
             run_container_intersection((const run_container_t *)c1,
                                        (const run_container_t *)c2,
                                        (run_container_t *)result);
@@ -661,6 +937,7 @@ static inline void *container_iand(void *c1, uint8_t type1, const void *c2,
                             ARRAY_CONTAINER_TYPE_CODE):
             // c1 is a bitmap so no inplace possible
             result = array_container_create();
+            if (result == NULL) return NULL;
             array_bitset_container_intersection((const array_container_t *)c2,
                                                 (const bitset_container_t *)c1,
                                                 (array_container_t *)result);
@@ -693,6 +970,7 @@ static inline void *container_iand(void *c1, uint8_t type1, const void *c2,
             return result;
         case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             *result_type = ARRAY_CONTAINER_TYPE_CODE;  // never bitset
             array_run_container_intersection((const array_container_t *)c1,
                                              (const run_container_t *)c2,
@@ -701,6 +979,7 @@ static inline void *container_iand(void *c1, uint8_t type1, const void *c2,
 
         case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, ARRAY_CONTAINER_TYPE_CODE):
             result = array_container_create();
+            if (result == NULL) return NULL;
             *result_type = ARRAY_CONTAINER_TYPE_CODE;  // never bitset
             array_run_container_intersection((const array_container_t *)c2,
                                              (const run_container_t *)c1,
@@ -857,7 +1136,7 @@ static inline void *container_lazy_or(const void *c1, uint8_t type1,
                                 (run_container_t *)result);
             *result_type = RUN_CONTAINER_TYPE_CODE;
             // we are being lazy
-            result = convert_run_to_efficient_container(
+            result = convert_run_to_efficient_container_and_free(
                 (run_container_t *)result, result_type);
             return result;
         case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
@@ -1824,4 +2103,26 @@ static inline bool container_select(const void *container, uint8_t typecode,
     }
 }
 
+/**
+ * Returns the number of values equal or smaller than x in the container.
+ */
+static inline int container_rank(const void *container, uint8_t typecode,
+                                 uint16_t x) {
+    container = container_unwrap_shared(container, &typecode);
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE:
+            return bitset_container_rank((const bitset_container_t *)container,
+                                         x);
+        case ARRAY_CONTAINER_TYPE_CODE:
+            return array_container_rank((const array_container_t *)container,
+                                        x);
+        case RUN_CONTAINER_TYPE_CODE:
+            return run_container_rank((const run_container_t *)container, x);
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return 0;
+    }
+}
+
 #endif
@@ -65,12 +65,30 @@ void *run_container_deserialize(const char *buf, size_t buf_len);
 /* Add `pos' to `run'. Returns true if `pos' was not present. */
 bool run_container_add(run_container_t *run, uint16_t pos);
 
+/* Add the strictly increasing `list' of `length' values to `run', merging
+ * them with the existing runs in a single pass. Returns false, leaving `run'
+ * unchanged, if memory could not be allocated. */
+bool run_container_add_many(run_container_t *run, const uint16_t *list,
+                            int32_t length);
+
 /* Remove `pos' from `run'. Returns true if `pos' was present. */
 bool run_container_remove(run_container_t *run, uint16_t pos);
 
 /* Check whether `pos' is present in `run'.  */
 bool run_container_contains(const run_container_t *run, uint16_t pos);
 
+/* Add all values in [min, max] (included) to `run', fusing runs as needed. */
+void run_container_add_range(run_container_t *run, uint32_t min,
+                             uint32_t max);
+
+/* Remove all values in [min, max] (included) from `run'. */
+void run_container_remove_range(run_container_t *run, uint32_t min,
+                                uint32_t max);
+
+/* Check whether all values in [min, max] (included) are present in `run'. */
+bool run_container_contains_range(const run_container_t *run, uint32_t min,
+                                  uint32_t max);
+
 /* Get the cardinality of `run'. Requires an actual computation. */
 int run_container_cardinality(const run_container_t *run);
 
@@ -195,6 +213,14 @@ void run_container_intersection(const run_container_t *src_1,
                                 const run_container_t *src_2,
                                 run_container_t *dst);
 
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_container_intersection_cardinality(const run_container_t *src_1,
+                                           const run_container_t *src_2);
+
+/* Check whether src_1 and src_2 have a common value. */
+bool run_container_intersect(const run_container_t *src_1,
+                             const run_container_t *src_2);
+
 /* Compute the symmetric difference of `src_1' and `src_2' and write the result
  * to `dst'
  * It is assumed that `dst' is distinct from both `src_1' and `src_2'. */
@@ -301,6 +327,9 @@ bool run_container_select(const run_container_t *container,
                           uint32_t *start_rank, uint32_t rank,
                           uint32_t *element);
 
+/* Returns the number of values equal or smaller than x */
+int run_container_rank(const run_container_t *container, uint16_t x);
+
 /* Compute the difference of src_1 and src_2 and write the result to
  * dst. It is assumed that dst is distinct from both src_1 and src_2. */
 
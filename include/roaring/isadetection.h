@@ -0,0 +1,25 @@
+/*
+ * isadetection.h
+ *
+ */
+
+#ifndef INCLUDE_ISADETECTION_H_
+#define INCLUDE_ISADETECTION_H_
+
+#include <roaring/portability.h>
+
+/* Instruction sets the SIMD kernels are grouped by. */
+enum {
+    ROARING_SUPPORTS_SSE42 = 1,  /* SSE4.2 and POPCNT */
+    ROARING_SUPPORTS_AVX2 = 2,   /* AVX2, BMI1 and BMI2 */
+    ROARING_SUPPORTS_AVX512 = 4  /* AVX512F and AVX512VPOPCNTDQ */
+};
+
+/*
+ * Returns the ROARING_SUPPORTS_* flags of the running processor, as reported
+ * by cpuid and enabled by the operating system. The result is computed once
+ * and cached. Always 0 on non-x64 targets.
+ */
+int roaring_hardware_support(void);
+
+#endif /* INCLUDE_ISADETECTION_H_ */
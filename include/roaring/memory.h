@@ -0,0 +1,80 @@
+/*
+ * memory.h
+ *
+ */
+
+#ifndef INCLUDE_ROARING_MEMORY_H_
+#define INCLUDE_ROARING_MEMORY_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocator used for every container, roaring array and bitmap. The aligned
+ * functions are used for bitset words, which are 32-byte aligned for the SIMD
+ * kernels; aligned_free must accept what aligned_malloc returns.
+ */
+typedef struct roaring_memory_s {
+    void *(*malloc)(size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t count, size_t size);
+    void (*free)(void *ptr);
+    void *(*aligned_malloc)(size_t alignment, size_t size);
+    void (*aligned_free)(void *ptr);
+} roaring_memory_t;
+
+/*
+ * Installs memory_hook as the global allocator. All members must be set.
+ * This must happen before any bitmap is created or after all of them have
+ * been freed: memory is always released through the hook that is current at
+ * the time. free and aligned_free must accept NULL. Not thread-safe.
+ */
+void roaring_init_memory_hook(roaring_memory_t memory_hook);
+
+/* Restores the C library allocator. */
+void roaring_reset_memory_hook(void);
+
+void *roaring_malloc(size_t size);
+void *roaring_realloc(void *ptr, size_t size);
+void *roaring_calloc(size_t count, size_t size);
+void roaring_free(void *ptr);
+void *roaring_aligned_malloc(size_t alignment, size_t size);
+void roaring_aligned_free(void *ptr);
+
+/*
+ * Enables pooled allocation for the calling thread. Freed bitset words,
+ * container structs and small array and run payloads are then kept in
+ * per-thread free lists, up to max_cached_bytes in total, and handed out
+ * again by later allocations of the same size class. This mostly helps loops
+ * that create and free many temporary bitmaps. Calling it again changes the
+ * limit. Blocks freed on one thread may be reused by another.
+ */
+void roaring_pool_enable(size_t max_cached_bytes);
+
+/*
+ * Disables pooled allocation for the calling thread and returns its cached
+ * blocks to the allocator. Call it before the thread exits, and before
+ * changing the memory hook.
+ */
+void roaring_pool_disable(void);
+
+/*
+ * Size-class aware allocation used by the containers. When pooling is
+ * enabled, roaring_pool_round rounds a payload size up to its size class so
+ * that the block can be recycled. The size given to the free functions must
+ * be the size that was allocated.
+ */
+size_t roaring_pool_round(size_t size);
+void *roaring_pool_malloc(size_t size);
+void roaring_pool_free(void *ptr, size_t size);
+void *roaring_pool_aligned_malloc(size_t alignment, size_t size);
+void roaring_pool_aligned_free(void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_ROARING_MEMORY_H_ */
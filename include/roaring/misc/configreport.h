@@ -124,6 +124,9 @@ static inline void tellmeall() {
 #ifndef __AVX2__
     printf("AVX2 is NOT available.\n");
 #endif
+#ifdef ROARING_DISPATCH
+    printf("SIMD kernels are selected at runtime.\n");
+#endif
 
     if ((sizeof(int) != 4) || (sizeof(long) != 8)) {
         printf("number of bytes: int = %lu long = %lu \n", (long unsigned int) sizeof(size_t),
@@ -149,6 +152,9 @@ static inline void tellmeall() {
 #ifdef __arm__
     printf("ARM processor detected\n");
 #endif
+#ifdef USENEON
+    printf("NEON kernels are enabled.\n");
+#endif
 #ifdef __VERSION__
     printf(" compiler version: %s\t", __VERSION__);
 #endif
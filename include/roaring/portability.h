@@ -25,6 +25,34 @@
 #define USE_BMI //we assume that AVX2 and BMI go hand and hand
 #endif
 
+// AVX-512 kernels are used on top of AVX2 when the compiler targets
+// AVX512F with VPOPCNTDQ (e.g., -march=native on Ice Lake or later)
+#if defined(USEAVX) && defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+#define USEAVX512
+#endif
+
+// 64-bit ARM always has NEON; the array and bitset kernels then use it
+#if defined(__aarch64__) && defined(__ARM_NEON) && \
+    !defined(ROARING_DISABLE_NEON)
+#define USENEON
+#include <arm_neon.h>
+#endif
+
+// Without USEAVX, x64 builds compile every SIMD kernel with a per-function
+// target attribute and pick one at runtime (see isadetection.h), so that the
+// same binary runs on any x64 processor.
+#if defined(IS_X64) && !defined(USEAVX) && defined(__GNUC__) && \
+    !defined(ROARING_DISABLE_X64_DISPATCH)
+#define ROARING_DISPATCH
+#define ROARING_TARGET(x) __attribute__((target(x)))
+#else
+#define ROARING_TARGET(x)
+#endif
+#define ROARING_TARGET_SSE42 ROARING_TARGET("sse4.2,popcnt")
+#define ROARING_TARGET_AVX2 ROARING_TARGET("avx2,bmi,bmi2,popcnt,sse4.2")
+#define ROARING_TARGET_AVX512 \
+    ROARING_TARGET("avx512f,avx512vpopcntdq,avx2,bmi,bmi2,popcnt,sse4.2")
+
 #if defined(_MSC_VER)
 #define ALIGNED(x) __declspec(align(x))
 #else
@@ -39,6 +67,14 @@
 #define WARN_UNUSED
 #endif
 
+#if defined(_MSC_VER)
+#define ROARING_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define ROARING_NOINLINE __attribute__((noinline))
+#else
+#define ROARING_NOINLINE
+#endif
+
 #define IS_BIG_ENDIAN (*(uint16_t *)"\0\xff" < 0x100)
 
 
@@ -9,14 +9,21 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <roaring/memory.h>
 #include <roaring/roaring_array.h>
 #include <roaring/roaring_types.h>
 
 typedef struct roaring_bitmap_s {
     roaring_array_t *high_low_container;
     bool copy_on_write; /* copy_on_write: whether you want to use copy-on-write
-                         (saves memory and avoids
-                         copies but needs more care in a threaded context). */
+                         (saves memory and avoids copies). Copies share
+                         containers through atomic reference counts, so a
+                         bitmap and its copies may be used and freed on
+                         different threads, as long as each bitmap is only
+                         used by one thread at a time. */
+    uint64_t *rank_index; /* optional cumulative cardinalities of the
+                             containers, NULL unless built with
+                             roaring_bitmap_build_rank_index. */
 } roaring_bitmap_t;
 
 /**
@@ -59,6 +66,23 @@ roaring_bitmap_t *roaring_bitmap_of(size_t n, ...);
  */
 roaring_bitmap_t *roaring_bitmap_copy(const roaring_bitmap_t *r);
 
+/**
+ * Returns an immutable point-in-time view of r in time proportional to its
+ * number of containers: the containers of r become shared with the view, and
+ * the next change to any of them in r copies it first. Must be called by the
+ * thread that modifies r, which can keep doing so. The view can be passed
+ * wherever a const roaring_bitmap_t * is expected, by any number of threads
+ * at once, and taking a snapshot of a snapshot does not modify it. Returns
+ * NULL if memory is exhausted.
+ */
+const roaring_bitmap_t *roaring_bitmap_snapshot(roaring_bitmap_t *r);
+
+/**
+ * Release a view created by roaring_bitmap_snapshot, from any thread, once no
+ * thread reads it anymore.
+ */
+void roaring_bitmap_snapshot_free(const roaring_bitmap_t *snapshot);
+
 /**
  * Print the content of the bitmap.
  */
@@ -73,6 +97,50 @@ void roaring_bitmap_printf(const roaring_bitmap_t *ra);
 roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
                                      const roaring_bitmap_t *x2);
 
+/**
+ * Computes the size of the intersection between two bitmaps.
+ * This does not allocate memory.
+ */
+uint64_t roaring_bitmap_and_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2);
+
+/**
+ * Check whether two bitmaps intersect. This stops at the first common value
+ * and is faster than checking whether roaring_bitmap_and is empty.
+ */
+bool roaring_bitmap_intersect(const roaring_bitmap_t *x1,
+                              const roaring_bitmap_t *x2);
+
+/**
+ * Computes the Jaccard index between two bitmaps. (Also known as the Tanimoto
+ * distance, or the Jaccard similarity coefficient)
+ *
+ * The Jaccard index is undefined if both bitmaps are empty.
+ */
+double roaring_bitmap_jaccard_index(const roaring_bitmap_t *x1,
+                                    const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the union between two bitmaps.
+ * This does not allocate memory.
+ */
+uint64_t roaring_bitmap_or_cardinality(const roaring_bitmap_t *x1,
+                                       const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the difference (andnot) between two bitmaps.
+ * This does not allocate memory.
+ */
+uint64_t roaring_bitmap_andnot_cardinality(const roaring_bitmap_t *x1,
+                                           const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the symmetric difference (xor) between two bitmaps.
+ * This does not allocate memory.
+ */
+uint64_t roaring_bitmap_xor_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2);
+
 /**
  * Inplace version modifies x1.  TODO: decide whether x1 == x2 allowed
  */
@@ -113,6 +181,54 @@ roaring_bitmap_t *roaring_bitmap_or_many(size_t number,
 roaring_bitmap_t *roaring_bitmap_or_many_heap(uint32_t number,
                                               const roaring_bitmap_t **x);
 
+/**
+ * Compute the union of 'number' bitmaps key by key: the containers sharing a
+ * key are gathered across all inputs and merged in a single pass into one
+ * bitset (converted to an array when small), instead of updating the output
+ * once per input. Best with many inputs. Caller is responsible for freeing
+ * the result. Returns NULL on allocation failure.
+ */
+roaring_bitmap_t *roaring_bitmap_or_many_horizontal(
+    size_t number, const roaring_bitmap_t **x);
+
+/**
+ * Compute the intersection of 'number' bitmaps key by key, driven by the
+ * input with the fewest containers: a key is dropped as soon as one input
+ * lacks it, and the walk stops when any input runs out of keys. Caller is
+ * responsible for freeing the result. Returns NULL on allocation failure.
+ */
+roaring_bitmap_t *roaring_bitmap_and_many(size_t number,
+                                          const roaring_bitmap_t **x);
+
+/**
+ * A task of a parallel computation, called once for each index in
+ * [0, n_tasks) with the arg given to the roaring_parallel_for_t.
+ */
+typedef void (*roaring_parallel_task_t)(void *arg, size_t index);
+
+/**
+ * Executor callback: must call task(arg, i) once for every i in [0, n_tasks),
+ * in any order and possibly concurrently, and return only once all calls have
+ * completed. pool is passed through untouched.
+ */
+typedef void (*roaring_parallel_for_t)(void *pool,
+                                       roaring_parallel_task_t task,
+                                       void *arg, size_t n_tasks);
+
+/**
+ * Compute the union of 'number' bitmaps by splitting the 16-bit key space in
+ * n_partitions disjoint ranges (balanced on the number of containers) which
+ * are merged independently, one task each, through parallel_for. If
+ * parallel_for is NULL, the tasks run sequentially in the calling thread.
+ * The inputs are only read (copy-on-write is not used), so they may be
+ * shared by all tasks but must not be modified until the call returns.
+ * Caller is responsible for freeing the result. Returns NULL on allocation
+ * failure.
+ */
+roaring_bitmap_t *roaring_bitmap_or_many_parallel(
+    size_t number, const roaring_bitmap_t **x, size_t n_partitions,
+    roaring_parallel_for_t parallel_for, void *pool);
+
 /**
  * Computes the symmetric difference (xor) between two bitmaps
  * and returns new bitmap. The caller is responsible for memory management.
@@ -172,6 +288,17 @@ void roaring_bitmap_free(roaring_bitmap_t *r);
  */
 void roaring_bitmap_add(roaring_bitmap_t *r, uint32_t x);
 
+/**
+ * Add n_args values from vals, faster than repeatedly calling
+ * roaring_bitmap_add. Consecutive values sharing the same 16 most significant
+ * bits are inserted into their container in bulk, so sorted (or mostly
+ * sorted) input is best. Returns false if memory could not be allocated, in
+ * which case some of the new values may be missing from r (the values
+ * already in r are kept).
+ */
+bool roaring_bitmap_add_many(roaring_bitmap_t *r, size_t n_args,
+                             const uint32_t *vals);
+
 /**
  * Remove value x
  *
@@ -183,6 +310,27 @@ void roaring_bitmap_remove(roaring_bitmap_t *r, uint32_t x);
  */
 bool roaring_bitmap_contains(const roaring_bitmap_t *r, uint32_t x);
 
+/**
+ * Add all values in [min, max). The work is done per container, so adding a
+ * wide range costs time proportional to the number of containers it spans.
+ */
+void roaring_bitmap_add_range(roaring_bitmap_t *r, uint64_t min,
+                              uint64_t max);
+
+/**
+ * Remove all values in [min, max). Containers entirely covered by the range
+ * are dropped without being visited.
+ */
+void roaring_bitmap_remove_range(roaring_bitmap_t *r, uint64_t min,
+                                 uint64_t max);
+
+/**
+ * Check whether all values in [min, max) are present. An empty range is
+ * always contained.
+ */
+bool roaring_bitmap_contains_range(const roaring_bitmap_t *r, uint64_t min,
+                                   uint64_t max);
+
 /**
  * Get the cardinality of the bitmap (number of elements).
  */
@@ -217,6 +365,7 @@ bool roaring_bitmap_run_optimize(roaring_bitmap_t *r);
 
 // see roaring_bitmap_portable_serialize if you want a format that's compatible
 // with Java and Go implementations
+// The result is allocated with roaring_malloc: release it with roaring_free.
 char *roaring_bitmap_serialize(roaring_bitmap_t *ra, uint32_t *serialize_len);
 
 // see roaring_bitmap_portable_deserialize if you want a format that's
@@ -230,6 +379,34 @@ roaring_bitmap_t *roaring_bitmap_deserialize(const void *buf, uint32_t buf_len);
  */
 roaring_bitmap_t *roaring_bitmap_portable_deserialize(const char *buf);
 
+/**
+ * Same as roaring_bitmap_portable_deserialize, but reads at most maxbytes
+ * bytes and validates the input while loading it, so that it is safe to use
+ * on untrusted data. Returns NULL if the buffer is truncated or corrupted.
+ */
+roaring_bitmap_t *roaring_bitmap_portable_deserialize_safe(const char *buf,
+                                                        size_t maxbytes);
+
+/**
+ * Create a read-only view over a buffer written by
+ * roaring_bitmap_portable_serialize, without copying the containers: they
+ * point directly into buf, which must outlive the view. Container data that
+ * is not suitably aligned in buf (8 bytes for bitsets, 2 bytes for arrays and
+ * runs) is copied instead. The view can be passed wherever a const
+ * roaring_bitmap_t * is expected (contains, cardinality, and/or/andnot
+ * inputs, iterators, ...). Use roaring_bitmap_copy to obtain a mutable
+ * bitmap. Returns NULL if the cookie is not recognized or memory is
+ * exhausted.
+ */
+const roaring_bitmap_t *roaring_bitmap_portable_deserialize_frozen(
+    const char *buf);
+
+/**
+ * Release a view created by roaring_bitmap_portable_deserialize_frozen (do not
+ * use roaring_bitmap_free on it). The buffer itself is left alone.
+ */
+void roaring_bitmap_frozen_free(const roaring_bitmap_t *r);
+
 /**
  * How many bytes are required to serialize this bitmap (meant to be compatible
  * with Java and Go versions)
@@ -254,6 +431,92 @@ size_t roaring_bitmap_portable_serialize(const roaring_bitmap_t *ra, char *buf);
 void roaring_iterate(const roaring_bitmap_t *ra, roaring_iterator iterator,
                      void *ptr);
 
+/**
+ * A stateful iterator over the values of a bitmap, in increasing order. It can
+ * be moved forward, backward, or skipped ahead to a given value. The bitmap
+ * must not be modified while an iterator over it is in use.
+ *
+ * When has_value is true, current_value holds the value the iterator points
+ * at. The remaining fields are internal.
+ */
+typedef struct roaring_uint32_iterator_s {
+    const roaring_bitmap_t *parent;  // owner
+    int32_t container_index;         // index of the current container
+    int32_t in_container_index;  // position in an array or bitset container
+    int32_t run_index;           // position in a run container
+    uint32_t current_value;
+    bool has_value;
+    const void *container;  // current container (never a shared container)
+    uint8_t typecode;       // type of the current container
+    uint32_t highbits;      // key of the current container, shifted by 16
+} roaring_uint32_iterator_t;
+
+/**
+ * Initialize an iterator object that can be used to iterate through the
+ * values. If there is a value, then it->has_value is true and
+ * it->current_value is the smallest value.
+ */
+void roaring_init_iterator(const roaring_bitmap_t *ra,
+                           roaring_uint32_iterator_t *newit);
+
+/**
+ * Initialize an iterator object that can be used to iterate backwards through
+ * the values. If there is a value, then it->has_value is true and
+ * it->current_value is the largest value.
+ */
+void roaring_init_iterator_last(const roaring_bitmap_t *ra,
+                                roaring_uint32_iterator_t *newit);
+
+/**
+ * Create an iterator object positioned at the smallest value. The caller is
+ * responsible for calling roaring_free_uint32_iterator.
+ */
+roaring_uint32_iterator_t *roaring_create_iterator(const roaring_bitmap_t *ra);
+
+/**
+ * Advance the iterator. If there is a new value, then it->has_value is true.
+ * The new value is in it->current_value. Values are visited in increasing
+ * order.
+ */
+bool roaring_advance_uint32_iterator(roaring_uint32_iterator_t *it);
+
+/**
+ * Move the iterator back. If there is a new value, then it->has_value is true.
+ * The new value is in it->current_value. Values are visited in decreasing
+ * order.
+ */
+bool roaring_previous_uint32_iterator(roaring_uint32_iterator_t *it);
+
+/**
+ * Move the iterator to the first value >= val. If there is such a value, then
+ * it->has_value is true and it->current_value holds it. Moving forward from
+ * the current position gallops over keys and container content, so repeated
+ * calls with increasing values are cheap.
+ */
+bool roaring_move_uint32_iterator_equalorlarger(roaring_uint32_iterator_t *it,
+                                                uint32_t val);
+
+/**
+ * Creates a copy of an iterator. The caller must free it with
+ * roaring_free_uint32_iterator.
+ */
+roaring_uint32_iterator_t *roaring_copy_uint32_iterator(
+    const roaring_uint32_iterator_t *it);
+
+/**
+ * Free memory following roaring_create_iterator or
+ * roaring_copy_uint32_iterator.
+ */
+void roaring_free_uint32_iterator(roaring_uint32_iterator_t *it);
+
+/**
+ * Read up to 'count' values from the iterator into 'buf', starting at
+ * it->current_value, and advance the iterator past them. Returns the number
+ * of values read; fewer than 'count' means the iterator is exhausted.
+ */
+uint32_t roaring_read_uint32_iterator(roaring_uint32_iterator_t *it,
+                                      uint32_t *buf, uint32_t count);
+
 /**
  * Return true if the two bitmaps contain the same elements.
  */
@@ -338,6 +601,27 @@ void roaring_bitmap_flip_inplace(roaring_bitmap_t *x1, uint64_t range_start,
 bool roaring_bitmap_select(const roaring_bitmap_t *ra, uint32_t rank,
                            uint32_t *element);
 
+/**
+ * Returns the number of integers that are smaller or equal to x.
+ */
+uint64_t roaring_bitmap_rank(const roaring_bitmap_t *bm, uint32_t x);
+
+/**
+ * (For advanced users.)
+ * Build an index of the cumulative cardinalities of the containers, so that
+ * roaring_bitmap_rank and roaring_bitmap_select take logarithmic time in the
+ * number of containers. The index is dropped by any function that modifies
+ * the bitmap; modifying high_low_container directly requires calling
+ * roaring_bitmap_free_rank_index. Returns false if memory allocation fails.
+ */
+bool roaring_bitmap_build_rank_index(roaring_bitmap_t *r);
+
+/**
+ * (For advanced users.)
+ * Release the index built by roaring_bitmap_build_rank_index, if any.
+ */
+void roaring_bitmap_free_rank_index(roaring_bitmap_t *r);
+
 /**
 *  (For advanced users.)
 * Collect statistics about the bitmap, see roaring_types.h for
@@ -0,0 +1,172 @@
+/*
+ * roaring64.h
+ *
+ * Bitmaps of 64-bit integers: the high 32 bits of a value select a 32-bit
+ * roaring bitmap which holds its low 32 bits.
+ */
+
+#ifndef ROARING64_H
+#define ROARING64_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <roaring/roaring.h>
+
+typedef struct roaring64_bitmap_s {
+    int32_t size;            /* number of non-empty 32-bit bitmaps */
+    int32_t allocation_size; /* capacity of high_bits and bitmaps */
+    uint32_t *high_bits;     /* strictly increasing */
+    roaring_bitmap_t **bitmaps;
+} roaring64_bitmap_t;
+
+/**
+ * Creates a new bitmap (initially empty). Returns NULL on allocation failure.
+ */
+roaring64_bitmap_t *roaring64_bitmap_create(void);
+
+/**
+ * Creates a new bitmap from a list of n values. Returns NULL on allocation
+ * failure.
+ */
+roaring64_bitmap_t *roaring64_bitmap_of_ptr(size_t n, const uint64_t *vals);
+
+/**
+ * Copies a bitmap. Returns NULL on allocation failure.
+ */
+roaring64_bitmap_t *roaring64_bitmap_copy(const roaring64_bitmap_t *r);
+
+/**
+ * Frees the memory.
+ */
+void roaring64_bitmap_free(roaring64_bitmap_t *r);
+
+/**
+ * Add value x
+ */
+void roaring64_bitmap_add(roaring64_bitmap_t *r, uint64_t x);
+
+/**
+ * Add the n values of vals, faster than repeatedly calling
+ * roaring64_bitmap_add when consecutive values share their high 32 bits.
+ * If memory runs out, the remaining values are not added.
+ */
+void roaring64_bitmap_add_many(roaring64_bitmap_t *r, size_t n,
+                               const uint64_t *vals);
+
+/**
+ * Remove value x
+ */
+void roaring64_bitmap_remove(roaring64_bitmap_t *r, uint64_t x);
+
+/**
+ * Check if value x is present
+ */
+bool roaring64_bitmap_contains(const roaring64_bitmap_t *r, uint64_t x);
+
+/**
+ * Get the cardinality of the bitmap (number of elements).
+ */
+uint64_t roaring64_bitmap_get_cardinality(const roaring64_bitmap_t *r);
+
+/**
+ * Returns true if the bitmap is empty (cardinality is zero).
+ */
+bool roaring64_bitmap_is_empty(const roaring64_bitmap_t *r);
+
+/**
+ * Return true if the two bitmaps contain the same elements.
+ */
+bool roaring64_bitmap_equals(const roaring64_bitmap_t *r1,
+                             const roaring64_bitmap_t *r2);
+
+/**
+ * Computes the intersection between two bitmaps and returns new bitmap. The
+ * caller is responsible for memory management.
+ */
+roaring64_bitmap_t *roaring64_bitmap_and(const roaring64_bitmap_t *x1,
+                                         const roaring64_bitmap_t *x2);
+
+/**
+ * Computes the union between two bitmaps and returns new bitmap. The caller
+ * is responsible for memory management.
+ */
+roaring64_bitmap_t *roaring64_bitmap_or(const roaring64_bitmap_t *x1,
+                                        const roaring64_bitmap_t *x2);
+
+/**
+ * Computes the symmetric difference (xor) between two bitmaps and returns new
+ * bitmap. The caller is responsible for memory management.
+ */
+roaring64_bitmap_t *roaring64_bitmap_xor(const roaring64_bitmap_t *x1,
+                                         const roaring64_bitmap_t *x2);
+
+/**
+ * Computes the difference (andnot) between two bitmaps and returns new
+ * bitmap. The caller is responsible for memory management.
+ */
+roaring64_bitmap_t *roaring64_bitmap_andnot(const roaring64_bitmap_t *x1,
+                                            const roaring64_bitmap_t *x2);
+
+/**
+ * Inplace versions of the above, writing the result to x1. x1 and x2 must be
+ * distinct.
+ */
+void roaring64_bitmap_and_inplace(roaring64_bitmap_t *x1,
+                                  const roaring64_bitmap_t *x2);
+void roaring64_bitmap_or_inplace(roaring64_bitmap_t *x1,
+                                 const roaring64_bitmap_t *x2);
+void roaring64_bitmap_xor_inplace(roaring64_bitmap_t *x1,
+                                  const roaring64_bitmap_t *x2);
+void roaring64_bitmap_andnot_inplace(roaring64_bitmap_t *x1,
+                                     const roaring64_bitmap_t *x2);
+
+/**
+ * Convert the bitmap to an array. Write the output to "ans", caller is
+ * responsible to ensure that there is enough memory allocated
+ * (e.g., ans = roaring_malloc(roaring64_bitmap_get_cardinality(r) *
+ * sizeof(uint64_t)).
+ */
+void roaring64_bitmap_to_uint64_array(const roaring64_bitmap_t *r,
+                                      uint64_t *ans);
+
+/**
+ * Iterate over the bitmap elements in increasing order. The function
+ * iterator is called once for all the values with ptr (can be NULL) as the
+ * second parameter of each call.
+ */
+void roaring64_iterate(const roaring64_bitmap_t *r,
+                       roaring_iterator64 iterator, void *ptr);
+
+/**
+ * How many bytes are required to serialize this bitmap with
+ * roaring64_bitmap_portable_serialize.
+ */
+size_t roaring64_bitmap_portable_size_in_bytes(const roaring64_bitmap_t *r);
+
+/**
+ * Write a bitmap to a char buffer, in the portable 64-bit format of the Java
+ * and Go versions: the number of 32-bit bitmaps as a 64-bit integer, then for
+ * each of them, in increasing order, its high 32 bits followed by the bitmap
+ * as written by roaring_bitmap_portable_serialize. Returns how many bytes
+ * were written, which is roaring64_bitmap_portable_size_in_bytes(r).
+ */
+size_t roaring64_bitmap_portable_serialize(const roaring64_bitmap_t *r,
+                                           char *buf);
+
+/**
+ * Read a bitmap written by roaring64_bitmap_portable_serialize, reading at
+ * most maxbytes bytes from buf. Returns NULL if the input is truncated or
+ * corrupted, or on allocation failure.
+ */
+roaring64_bitmap_t *roaring64_bitmap_portable_deserialize_safe(
+    const char *buf, size_t maxbytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -189,6 +189,24 @@ size_t ra_portable_serialize(roaring_array_t *ra, char *buf);
  */
 roaring_array_t *ra_portable_deserialize(const char *buf);
 
+/**
+ * Same as ra_portable_deserialize, except that no more than maxbytes are
+ * read and the input is fully validated on the way (cookie, key order,
+ * container sizes, array order, run bounds and cardinalities). Returns NULL
+ * if the input is truncated or corrupted.
+ */
+roaring_array_t *ra_portable_deserialize_safe(const char *buf,
+                                              size_t maxbytes);
+
+/**
+ * Same as ra_portable_deserialize, except that the containers point directly
+ * into buf, which must outlive the result. Bitsets which are not 8-byte
+ * aligned and array or run data which is not 2-byte aligned within buf are
+ * copied. The result is a single allocation: release it with roaring_free(),
+ * never with ra_free(), and never modify it.
+ */
+roaring_array_t *ra_portable_deserialize_frozen(const char *buf);
+
 /**
  * How many bytes are required to serialize this bitmap (meant to be
  * compatible
@@ -235,4 +253,12 @@ void ra_remove_at_index_and_free(roaring_array_t *ra, int32_t i);
 void ra_copy_range(roaring_array_t *ra, uint32_t begin, uint32_t end,
                    uint32_t new_begin);
 
+/**
+ * Move the last `count' entries by `distance' slots (which may be negative)
+ * and adjust the size accordingly. When moving left, the overwritten
+ * containers must have been freed beforehand; when moving right, the
+ * vacated slots are left uninitialized for the caller to fill.
+ */
+void ra_shift_tail(roaring_array_t *ra, int32_t count, int32_t distance);
+
 #endif
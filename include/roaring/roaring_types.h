@@ -7,6 +7,8 @@
 
 typedef void (*roaring_iterator)(uint32_t value, void *param);
 
+typedef void (*roaring_iterator64)(uint64_t value, void *param);
+
 
 /**
 *  (For advanced users.)
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include <roaring/array_util.h>
+#include <roaring/isadetection.h>
 #include <roaring/portability.h>
 #include <roaring/utilasm.h>
 
@@ -73,9 +74,9 @@ int32_t advanceUntil(const uint16_t *array, int32_t pos, int32_t length,
     return upper;
 }
 
-#ifdef IS_X64
+#if defined(IS_X64) || defined(USENEON)
 
-// used by intersect_vector16
+// used by intersect_vector16 and difference_vector16
 static const uint8_t shuffle_mask16[] __attribute__((aligned(0x1000))) = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0,  1,  -1,
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2,  3,  -1, -1, -1, -1,
@@ -293,13 +294,27 @@ static const uint8_t shuffle_mask16[] __attribute__((aligned(0x1000))) = {
     -1, 0,  1,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, -1, -1, 2,  3,
     4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, -1, -1, 0,  1,  2,  3,  4,
     5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15};
+#endif
+
+#ifdef IS_X64
+
+// With ROARING_DISPATCH, the SSE4.2 kernels get a _sse42 suffix and the
+// public functions pick them or the scalar code at runtime.
+#ifdef ROARING_DISPATCH
+#define SSE42_KERNEL static ROARING_TARGET_SSE42
+#define SSE42_KERNEL_NAME(name) name##_sse42
+#else
+#define SSE42_KERNEL
+#define SSE42_KERNEL_NAME(name) name
+#endif
 
 /**
  * From Schlegel et al., Fast Sorted-Set Intersection using SIMD Instructions
  * Optimized by D. Lemire on May 3rd 2013
  */
-int32_t intersect_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
-                           size_t s_b, uint16_t *C) {
+SSE42_KERNEL int32_t SSE42_KERNEL_NAME(intersect_vector16)(
+    const uint16_t *A, size_t s_a, const uint16_t *B, size_t s_b,
+    uint16_t *C) {
     size_t count = 0;
     size_t i_a = 0, i_b = 0;
     const int vectorlength = sizeof(__m128i) / sizeof(uint16_t);
@@ -373,8 +388,407 @@ int32_t intersect_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
     }
     return count;
 }
+
+/**
+ * Same as intersect_vector16, but only computes the cardinality.
+ */
+SSE42_KERNEL int32_t SSE42_KERNEL_NAME(intersect_vector16_cardinality)(
+    const uint16_t *A, size_t s_a, const uint16_t *B, size_t s_b) {
+    size_t count = 0;
+    size_t i_a = 0, i_b = 0;
+    const int vectorlength = sizeof(__m128i) / sizeof(uint16_t);
+    const size_t st_a = (s_a / vectorlength) * vectorlength;
+    const size_t st_b = (s_b / vectorlength) * vectorlength;
+    __m128i v_a, v_b;
+    if ((i_a < st_a) && (i_b < st_b)) {
+        v_a = _mm_lddqu_si128((__m128i *)&A[i_a]);
+        v_b = _mm_lddqu_si128((__m128i *)&B[i_b]);
+        while ((A[i_a] == 0) || (B[i_b] == 0)) {
+            const __m128i res_v = _mm_cmpestrm(
+                v_b, vectorlength, v_a, vectorlength,
+                _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+            const int r = _mm_extract_epi32(res_v, 0);
+            count += _mm_popcnt_u32(r);
+            const uint16_t a_max = A[i_a + vectorlength - 1];
+            const uint16_t b_max = B[i_b + vectorlength - 1];
+            if (a_max <= b_max) {
+                i_a += vectorlength;
+                if (i_a == st_a) break;
+                v_a = _mm_lddqu_si128((__m128i *)&A[i_a]);
+            }
+            if (b_max <= a_max) {
+                i_b += vectorlength;
+                if (i_b == st_b) break;
+                v_b = _mm_lddqu_si128((__m128i *)&B[i_b]);
+            }
+        }
+        if ((i_a < st_a) && (i_b < st_b))
+            while (true) {
+                const __m128i res_v = _mm_cmpistrm(
+                    v_b, v_a,
+                    _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+                const int r = _mm_extract_epi32(res_v, 0);
+                count += _mm_popcnt_u32(r);
+                const uint16_t a_max = A[i_a + vectorlength - 1];
+                const uint16_t b_max = B[i_b + vectorlength - 1];
+                if (a_max <= b_max) {
+                    i_a += vectorlength;
+                    if (i_a == st_a) break;
+                    v_a = _mm_lddqu_si128((__m128i *)&A[i_a]);
+                }
+                if (b_max <= a_max) {
+                    i_b += vectorlength;
+                    if (i_b == st_b) break;
+                    v_b = _mm_lddqu_si128((__m128i *)&B[i_b]);
+                }
+            }
+    }
+    // intersect the tail using scalar intersection
+    while (i_a < s_a && i_b < s_b) {
+        uint16_t a = A[i_a];
+        uint16_t b = B[i_b];
+        if (a < b) {
+            i_a++;
+        } else if (b < a) {
+            i_b++;
+        } else {
+            count++;
+            i_a++;
+            i_b++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Each vector of A is written out, minus the values found in the vectors of
+ * B it overlaps, once no later vector of B can overlap it.
+ */
+SSE42_KERNEL int32_t SSE42_KERNEL_NAME(difference_vector16)(
+    const uint16_t *A, size_t s_a, const uint16_t *B, size_t s_b,
+    uint16_t *C) {
+    size_t count = 0;
+    size_t i_a = 0, i_b = 0;
+    const int vectorlength = sizeof(__m128i) / sizeof(uint16_t);
+    const size_t st_a = (s_a / vectorlength) * vectorlength;
+    const size_t st_b = (s_b / vectorlength) * vectorlength;
+    if ((i_a < st_a) && (i_b < st_b)) {
+        __m128i v_a = _mm_lddqu_si128((__m128i *)&A[i_a]);
+        __m128i v_b = _mm_lddqu_si128((__m128i *)&B[i_b]);
+        // lanes of v_a found in B so far
+        int found = 0;
+        while (true) {
+            // _mm_cmpistrm stops at the first zero, which can only lead a set
+            if ((A[i_a] == 0) || (B[i_b] == 0)) {
+                found |= _mm_extract_epi32(
+                    _mm_cmpestrm(v_b, vectorlength, v_a, vectorlength,
+                                 _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY |
+                                     _SIDD_BIT_MASK),
+                    0);
+            } else {
+                found |= _mm_extract_epi32(
+                    _mm_cmpistrm(v_b, v_a,
+                                 _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY |
+                                     _SIDD_BIT_MASK),
+                    0);
+            }
+            const uint16_t a_max = A[i_a + vectorlength - 1];
+            const uint16_t b_max = B[i_b + vectorlength - 1];
+            if (a_max <= b_max) {
+                // later vectors of B only hold larger values
+                const int r = found ^ 0xFF;
+                __m128i sm16 =
+                    _mm_load_si128((const __m128i *)shuffle_mask16 + r);
+                __m128i p = _mm_shuffle_epi8(v_a, sm16);
+                _mm_storeu_si128((__m128i *)&C[count], p);  // can overflow
+                count += _mm_popcnt_u32(r);
+                i_a += vectorlength;
+                if (i_a == st_a) break;
+                found = 0;
+                v_a = _mm_lddqu_si128((__m128i *)&A[i_a]);
+            }
+            if (b_max <= a_max) {
+                i_b += vectorlength;
+                if (i_b == st_b) break;
+                v_b = _mm_lddqu_si128((__m128i *)&B[i_b]);
+            }
+        }
+        if (i_a < st_a) {
+            // B ran out of full vectors while v_a is pending: compare it with
+            // the tail of B
+            uint16_t buffer[8] = {0};
+            memcpy(buffer, B + i_b, (s_b - i_b) * sizeof(uint16_t));
+            v_b = _mm_lddqu_si128((__m128i *)buffer);
+            found |= _mm_extract_epi32(
+                _mm_cmpestrm(v_b, (int)(s_b - i_b), v_a, vectorlength,
+                             _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY |
+                                 _SIDD_BIT_MASK),
+                0);
+            const int r = found ^ 0xFF;
+            __m128i sm16 = _mm_load_si128((const __m128i *)shuffle_mask16 + r);
+            __m128i p = _mm_shuffle_epi8(v_a, sm16);
+            _mm_storeu_si128((__m128i *)&C[count], p);  // can overflow
+            count += _mm_popcnt_u32(r);
+            i_a += vectorlength;
+        }
+    }
+    // do the tail using scalar code
+    while (i_a < s_a && i_b < s_b) {
+        uint16_t a = A[i_a];
+        uint16_t b = B[i_b];
+        if (b < a) {
+            i_b++;
+        } else if (a < b) {
+            C[count++] = a;
+            i_a++;
+        } else {
+            i_a++;
+            i_b++;
+        }
+    }
+    if (i_a < s_a) {
+        // C may be A
+        memmove(C + count, A + i_a, sizeof(uint16_t) * (s_a - i_a));
+        count += s_a - i_a;
+    }
+    return count;
+}
+
+#ifdef ROARING_DISPATCH
+typedef struct array_kernels_s {
+    int32_t (*intersect_fn)(const uint16_t *, size_t, const uint16_t *, size_t,
+                            uint16_t *);
+    int32_t (*intersect_cardinality_fn)(const uint16_t *, size_t,
+                                        const uint16_t *, size_t);
+    int32_t (*difference_fn)(const uint16_t *, size_t, const uint16_t *,
+                             size_t, uint16_t *);
+} array_kernels_t;
+
+static const array_kernels_t array_kernels_sse42 = {
+    intersect_vector16_sse42, intersect_vector16_cardinality_sse42,
+    difference_vector16_sse42};
+static const array_kernels_t array_kernels_scalar = {
+    intersect_uint16, intersect_uint16_cardinality, difference_uint16};
+
+/* Picks the kernel table on first use. Concurrent first calls all store the
+ * same pointer, atomically. */
+static const array_kernels_t *array_kernels(void) {
+    static const array_kernels_t *kernels = NULL;
+    const array_kernels_t *answer = __atomic_load_n(&kernels, __ATOMIC_RELAXED);
+    if (answer == NULL) {
+        answer = (roaring_hardware_support() & ROARING_SUPPORTS_SSE42)
+                     ? &array_kernels_sse42
+                     : &array_kernels_scalar;
+        __atomic_store_n(&kernels, answer, __ATOMIC_RELAXED);
+    }
+    return answer;
+}
+
+int32_t intersect_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
+                           size_t s_b, uint16_t *C) {
+    return array_kernels()->intersect_fn(A, s_a, B, s_b, C);
+}
+
+int32_t intersect_vector16_cardinality(const uint16_t *A, size_t s_a,
+                                       const uint16_t *B, size_t s_b) {
+    return array_kernels()->intersect_cardinality_fn(A, s_a, B, s_b);
+}
+
+int32_t difference_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
+                            size_t s_b, uint16_t *C) {
+    return array_kernels()->difference_fn(A, s_a, B, s_b, C);
+}
+#endif // ROARING_DISPATCH
 #endif // IS_X64
 
+#ifdef USENEON
+
+// bit k of the masks computed below stands for lane k
+static const uint16_t neon_lane_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+/* Returns a mask of the lanes of v_a that are equal to some lane of v_b. */
+static inline uint32_t neon_match_mask16(uint16x8_t v_a, uint16x8_t v_b) {
+    uint16x8_t eq = vceqq_u16(v_a, v_b);
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 1)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 2)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 3)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 4)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 5)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 6)));
+    eq = vorrq_u16(eq, vceqq_u16(v_a, vextq_u16(v_b, v_b, 7)));
+    return vaddvq_u16(vandq_u16(eq, vld1q_u16(neon_lane_bits)));
+}
+
+/* Writes the lanes of v selected by mask to out, in order, and returns how
+ * many were written. Always stores 8 values. */
+static inline int neon_store_masked16(uint16x8_t v, uint32_t mask,
+                                      uint16_t *out) {
+    const uint8x16_t sm16 = vld1q_u8(shuffle_mask16 + 16 * mask);
+    vst1q_u16(out,
+              vreinterpretq_u16_u8(vqtbl1q_u8(vreinterpretq_u8_u16(v), sm16)));
+    return __builtin_popcount(mask);
+}
+
+/**
+ * NEON version of the SSE intersection: each vector of A is compared with
+ * every rotation of the current vector of B.
+ */
+int32_t intersect_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
+                           size_t s_b, uint16_t *C) {
+    size_t count = 0;
+    size_t i_a = 0, i_b = 0;
+    const size_t vectorlength = sizeof(uint16x8_t) / sizeof(uint16_t);
+    const size_t st_a = (s_a / vectorlength) * vectorlength;
+    const size_t st_b = (s_b / vectorlength) * vectorlength;
+    if ((i_a < st_a) && (i_b < st_b)) {
+        uint16x8_t v_a = vld1q_u16(&A[i_a]);
+        uint16x8_t v_b = vld1q_u16(&B[i_b]);
+        while (true) {
+            const uint32_t r = neon_match_mask16(v_a, v_b);
+            count += neon_store_masked16(v_a, r, &C[count]);  // can overflow
+            const uint16_t a_max = A[i_a + vectorlength - 1];
+            const uint16_t b_max = B[i_b + vectorlength - 1];
+            if (a_max <= b_max) {
+                i_a += vectorlength;
+                if (i_a == st_a) break;
+                v_a = vld1q_u16(&A[i_a]);
+            }
+            if (b_max <= a_max) {
+                i_b += vectorlength;
+                if (i_b == st_b) break;
+                v_b = vld1q_u16(&B[i_b]);
+            }
+        }
+    }
+    // intersect the tail using scalar intersection
+    while (i_a < s_a && i_b < s_b) {
+        uint16_t a = A[i_a];
+        uint16_t b = B[i_b];
+        if (a < b) {
+            i_a++;
+        } else if (b < a) {
+            i_b++;
+        } else {
+            C[count] = a;  //==b;
+            count++;
+            i_a++;
+            i_b++;
+        }
+    }
+    return count;
+}
+
+int32_t intersect_vector16_cardinality(const uint16_t *A, size_t s_a,
+                                       const uint16_t *B, size_t s_b) {
+    size_t count = 0;
+    size_t i_a = 0, i_b = 0;
+    const size_t vectorlength = sizeof(uint16x8_t) / sizeof(uint16_t);
+    const size_t st_a = (s_a / vectorlength) * vectorlength;
+    const size_t st_b = (s_b / vectorlength) * vectorlength;
+    if ((i_a < st_a) && (i_b < st_b)) {
+        uint16x8_t v_a = vld1q_u16(&A[i_a]);
+        uint16x8_t v_b = vld1q_u16(&B[i_b]);
+        while (true) {
+            count += __builtin_popcount(neon_match_mask16(v_a, v_b));
+            const uint16_t a_max = A[i_a + vectorlength - 1];
+            const uint16_t b_max = B[i_b + vectorlength - 1];
+            if (a_max <= b_max) {
+                i_a += vectorlength;
+                if (i_a == st_a) break;
+                v_a = vld1q_u16(&A[i_a]);
+            }
+            if (b_max <= a_max) {
+                i_b += vectorlength;
+                if (i_b == st_b) break;
+                v_b = vld1q_u16(&B[i_b]);
+            }
+        }
+    }
+    // intersect the tail using scalar intersection
+    while (i_a < s_a && i_b < s_b) {
+        uint16_t a = A[i_a];
+        uint16_t b = B[i_b];
+        if (a < b) {
+            i_a++;
+        } else if (b < a) {
+            i_b++;
+        } else {
+            count++;
+            i_a++;
+            i_b++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Each vector of A is written out, minus the values found in the vectors of
+ * B it overlaps, once no later vector of B can overlap it.
+ */
+int32_t difference_vector16(const uint16_t *A, size_t s_a, const uint16_t *B,
+                            size_t s_b, uint16_t *C) {
+    size_t count = 0;
+    size_t i_a = 0, i_b = 0;
+    const size_t vectorlength = sizeof(uint16x8_t) / sizeof(uint16_t);
+    const size_t st_a = (s_a / vectorlength) * vectorlength;
+    const size_t st_b = (s_b / vectorlength) * vectorlength;
+    if ((i_a < st_a) && (i_b < st_b)) {
+        uint16x8_t v_a = vld1q_u16(&A[i_a]);
+        uint16x8_t v_b = vld1q_u16(&B[i_b]);
+        // lanes of v_a found in B so far
+        uint32_t found = 0;
+        while (true) {
+            found |= neon_match_mask16(v_a, v_b);
+            const uint16_t a_max = A[i_a + vectorlength - 1];
+            const uint16_t b_max = B[i_b + vectorlength - 1];
+            if (a_max <= b_max) {
+                // later vectors of B only hold larger values
+                count += neon_store_masked16(v_a, found ^ 0xFF, &C[count]);
+                i_a += vectorlength;
+                if (i_a == st_a) break;
+                found = 0;
+                v_a = vld1q_u16(&A[i_a]);
+            }
+            if (b_max <= a_max) {
+                i_b += vectorlength;
+                if (i_b == st_b) break;
+                v_b = vld1q_u16(&B[i_b]);
+            }
+        }
+        if (i_a < st_a) {
+            // B ran out of full vectors while v_a is pending: compare it with
+            // the tail of B, padded by repeating the last value of B
+            uint16_t buffer[8];
+            for (size_t k = 0; k < vectorlength; ++k)
+                buffer[k] = (i_b + k < s_b) ? B[i_b + k] : B[s_b - 1];
+            found |= neon_match_mask16(v_a, vld1q_u16(buffer));
+            count += neon_store_masked16(v_a, found ^ 0xFF, &C[count]);
+            i_a += vectorlength;
+        }
+    }
+    // do the tail using scalar code
+    while (i_a < s_a && i_b < s_b) {
+        uint16_t a = A[i_a];
+        uint16_t b = B[i_b];
+        if (b < a) {
+            i_b++;
+        } else if (a < b) {
+            C[count++] = a;
+            i_a++;
+        } else {
+            i_a++;
+            i_b++;
+        }
+    }
+    if (i_a < s_a) {
+        // C may be A
+        memmove(C + count, A + i_a, sizeof(uint16_t) * (s_a - i_a));
+        count += s_a - i_a;
+    }
+    return count;
+}
+#endif // USENEON
+
 
 /* Computes the intersection between one small and one large set of uint16_t.
  * Stores the result into buffer and return the number of elements. */
@@ -399,45 +813,163 @@ int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
             if (idx_s == size_s) break;
             val_s = small[idx_s];
         } else {
-            buffer[pos++] = val_s;
-            idx_s++;
-            if (idx_s == size_s) break;
-            val_s = small[idx_s];
-            idx_l = advanceUntil(large, idx_l, size_l, val_s);
-            if (idx_l == size_l) break;
-            val_l = large[idx_l];
+            buffer[pos++] = val_s;
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        }
+    }
+
+    return pos;
+}
+
+/* Same as intersect_skewed_uint16, but only computes the cardinality. */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l) {
+    size_t pos = 0, idx_l = 0, idx_s = 0;
+
+    if (0 == size_s) {
+        return 0;
+    }
+
+    uint16_t val_l = large[idx_l], val_s = small[idx_s];
+
+    while (true) {
+        if (val_l < val_s) {
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        } else if (val_s < val_l) {
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+        } else {
+            pos++;
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        }
+    }
+
+    return pos;
+}
+
+/* Check whether a small and a large set of uint16_t have a common value. */
+bool intersect_skewed_uint16_nonempty(const uint16_t *small, size_t size_s,
+                                      const uint16_t *large, size_t size_l) {
+    size_t idx_l = 0, idx_s = 0;
+
+    if (0 == size_s) {
+        return false;
+    }
+
+    uint16_t val_l = large[idx_l], val_s = small[idx_s];
+
+    while (true) {
+        if (val_l < val_s) {
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        } else if (val_s < val_l) {
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+        } else {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Generic intersection function. Passes unit tests.
+ */
+int32_t intersect_uint16(const uint16_t *A, const size_t lenA,
+                         const uint16_t *B, const size_t lenB, uint16_t *out) {
+    const uint16_t *initout = out;
+    if (lenA == 0 || lenB == 0) return 0;
+    const uint16_t *endA = A + lenA;
+    const uint16_t *endB = B + lenB;
+
+    while (1) {
+        while (*A < *B) {
+        SKIP_FIRST_COMPARE:
+            if (++A == endA) return (out - initout);
+        }
+        while (*A > *B) {
+            if (++B == endB) return (out - initout);
+        }
+        if (*A == *B) {
+            *out++ = *A;
+            if (++A == endA || ++B == endB) return (out - initout);
+        } else {
+            goto SKIP_FIRST_COMPARE;
+        }
+    }
+    return (out - initout);  // NOTREACHED
+}
+
+/**
+ * Generic intersection function, returns just the cardinality.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB) {
+    int32_t answer = 0;
+    if (lenA == 0 || lenB == 0) return 0;
+    const uint16_t *endA = A + lenA;
+    const uint16_t *endB = B + lenB;
+
+    while (1) {
+        while (*A < *B) {
+        SKIP_FIRST_COMPARE:
+            if (++A == endA) return answer;
+        }
+        while (*A > *B) {
+            if (++B == endB) return answer;
+        }
+        if (*A == *B) {
+            ++answer;
+            if (++A == endA || ++B == endB) return answer;
+        } else {
+            goto SKIP_FIRST_COMPARE;
         }
     }
-
-    return pos;
+    return answer;  // NOTREACHED
 }
 
 /**
- * Generic intersection function. Passes unit tests.
+ * Generic intersection test, stops at the first common value.
  */
-int32_t intersect_uint16(const uint16_t *A, const size_t lenA,
-                         const uint16_t *B, const size_t lenB, uint16_t *out) {
-    const uint16_t *initout = out;
-    if (lenA == 0 || lenB == 0) return 0;
+bool intersect_uint16_nonempty(const uint16_t *A, const size_t lenA,
+                               const uint16_t *B, const size_t lenB) {
+    if (lenA == 0 || lenB == 0) return false;
     const uint16_t *endA = A + lenA;
     const uint16_t *endB = B + lenB;
 
     while (1) {
         while (*A < *B) {
         SKIP_FIRST_COMPARE:
-            if (++A == endA) return (out - initout);
+            if (++A == endA) return false;
         }
         while (*A > *B) {
-            if (++B == endB) return (out - initout);
+            if (++B == endB) return false;
         }
         if (*A == *B) {
-            *out++ = *A;
-            if (++A == endA || ++B == endB) return (out - initout);
+            return true;
         } else {
             goto SKIP_FIRST_COMPARE;
         }
     }
-    return (out - initout);  // NOTREACHED
+    return false;  // NOTREACHED
 }
 
 /**
@@ -546,14 +1078,91 @@ size_t union_uint16(const uint16_t *set_1, size_t size_1, const uint16_t *set_2,
     return pos;
 }
 
-#if defined(USE_BMI)
+size_t xor_uint16(const uint16_t *set_1, size_t size_1, const uint16_t *set_2,
+                  size_t size_2, uint16_t *buffer) {
+    size_t pos = 0, idx_1 = 0, idx_2 = 0;
+    while (idx_1 < size_1 && idx_2 < size_2) {
+        const uint16_t val_1 = set_1[idx_1];
+        const uint16_t val_2 = set_2[idx_2];
+        if (val_1 < val_2) {
+            buffer[pos++] = val_1;
+            ++idx_1;
+        } else if (val_2 < val_1) {
+            buffer[pos++] = val_2;
+            ++idx_2;
+        } else {
+            ++idx_1;
+            ++idx_2;
+        }
+    }
+    if (idx_1 < size_1) {
+        const size_t n_elems = size_1 - idx_1;
+        memcpy(buffer + pos, set_1 + idx_1, n_elems * sizeof(uint16_t));
+        pos += n_elems;
+    } else if (idx_2 < size_2) {
+        const size_t n_elems = size_2 - idx_2;
+        memcpy(buffer + pos, set_2 + idx_2, n_elems * sizeof(uint16_t));
+        pos += n_elems;
+    }
+    return pos;
+}
+
+/* Based on Java implementation Util.unsignedDifference */
+int32_t difference_uint16(const uint16_t *A, const size_t lenA,
+                          const uint16_t *B, const size_t lenB, uint16_t *out) {
+    int32_t out_card = 0;
+    size_t k1 = 0, k2 = 0;
+
+    if (lenA == 0) return 0;
+
+    if (lenB == 0) {
+        if (A != out) memcpy(out, A, sizeof(uint16_t) * lenA);
+        return (int32_t)lenA;
+    }
+
+    uint16_t s1 = A[k1];
+    uint16_t s2 = B[k2];
+
+    while (true) {
+        if (s1 < s2) {
+            out[out_card++] = s1;
+            ++k1;
+            if (k1 >= lenA) {
+                break;
+            }
+            s1 = A[k1];
+        } else if (s1 == s2) {
+            ++k1;
+            ++k2;
+            if (k1 >= lenA) {
+                break;
+            }
+            if (k2 >= lenB) {
+                memmove(out + out_card, A + k1, sizeof(uint16_t) * (lenA - k1));
+                return out_card + (int32_t)(lenA - k1);
+            }
+            s1 = A[k1];
+            s2 = B[k2];
+        } else {  // if (val1>val2)
+            ++k2;
+            if (k2 >= lenB) {
+                memmove(out + out_card, A + k1, sizeof(uint16_t) * (lenA - k1));
+                return out_card + (int32_t)(lenA - k1);
+            }
+            s2 = B[k2];
+        }
+    }
+    return out_card;
+}
+
+#if defined(USE_BMI) || defined(USENEON)
 
-#define ROARING_VECTOR_UNION_ENABLED
 /***
  * start of the SIMD 16-bit union code
  *
  */
 
+#ifdef USE_BMI
 // Assuming that vInput1 and vInput2 are sorted, produces a sorted output going
 // from vecMin all the way to vecMax
 // developed originally for merge sort using SIMD instructions.
@@ -588,6 +1197,7 @@ static inline void sse_merge(const __m128i *vInput1,
     *vecMax = _mm_max_epu16(vecTmp, *vecMax);
     *vecMin = _mm_alignr_epi8(*vecMin, *vecMin, 2);
 }
+#endif
 
 // used by store_unique, generated by simdunion.py
 static uint8_t uniqshuf[] = {
@@ -934,6 +1544,7 @@ static uint8_t uniqshuf[] = {
     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
     0xFF, 0xFF, 0xFF, 0xFF};
 
+#ifdef USE_BMI
 // write vector new, while omitting repeated values assuming that previously
 // written vector was "old"
 static inline int store_unique(__m128i old, __m128i new, uint16_t *output) {
@@ -948,6 +1559,26 @@ static inline int store_unique(__m128i old, __m128i new, uint16_t *output) {
     return numberofnewvalues;
 }
 
+// write vector new, while omitting the values that appear twice, assuming
+// that previously written vector was "old". Since a value may be repeated in
+// the next vector, the last value of new is held back and the last value of
+// old is written instead.
+static inline int store_unique_xor(__m128i old, __m128i new,
+                                   uint16_t *output) {
+    __m128i vecTmp1 = _mm_alignr_epi8(new, old, 16 - 4);
+    __m128i vecTmp2 = _mm_alignr_epi8(new, old, 16 - 2);
+    __m128i equalleft = _mm_cmpeq_epi16(vecTmp2, vecTmp1);
+    __m128i equalright = _mm_cmpeq_epi16(vecTmp2, new);
+    int M = _mm_movemask_epi8(_mm_or_si128(equalleft, equalright));
+    M = _pext_u32(M, 0x5555);
+    int numberofnewvalues = 8 - _mm_popcnt_u32(M);
+    __m128i key = _mm_lddqu_si128((const __m128i *)uniqshuf + M);
+    __m128i val = _mm_shuffle_epi8(vecTmp2, key);
+    _mm_storeu_si128((__m128i *)output, val);
+    return numberofnewvalues;
+}
+#endif
+
 // working in-place, this function overwrites the repeated values
 // could be avoided?
 static inline uint32_t unique(uint16_t *out, uint32_t len) {
@@ -960,11 +1591,25 @@ static inline uint32_t unique(uint16_t *out, uint32_t len) {
     return pos;
 }
 
+// same as unique, but repeated values are dropped altogether
+static inline uint32_t unique_xor(uint16_t *out, uint32_t len) {
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        if ((i + 1 < len) && (out[i] == out[i + 1])) {
+            ++i;  // values are repeated at most once
+        } else {
+            out[pos++] = out[i];
+        }
+    }
+    return pos;
+}
+
 // use with qsort, could be avoided
 static int uint16_compare(const void *a, const void *b) {
     return (*(uint16_t *)a - *(uint16_t *)b);
 }
 
+#ifdef USE_BMI
 // a one-pass SSE union algorithm
 uint32_t union_vector16(const uint16_t *__restrict__ array1, uint32_t length1,
                         const uint16_t *__restrict__ array2, uint32_t length2,
@@ -1047,11 +1692,312 @@ uint32_t union_vector16(const uint16_t *__restrict__ array1, uint32_t length1,
     return len;
 }
 
+// a one-pass SSE symmetric difference algorithm, see union_vector16
+uint32_t xor_vector16(const uint16_t *__restrict__ array1, uint32_t length1,
+                      const uint16_t *__restrict__ array2, uint32_t length2,
+                      uint16_t *__restrict__ output) {
+    if ((length1 < 8) || (length2 < 8)) {
+        return xor_uint16(array1, length1, array2, length2, output);
+    }
+    __m128i vA, vB, V, vecMin, vecMax;
+    __m128i laststore;
+    uint16_t *initoutput = output;
+    uint32_t len1 = length1 / 8;
+    uint32_t len2 = length2 / 8;
+    uint32_t pos1 = 0;
+    uint32_t pos2 = 0;
+    // we start the machine
+    vA = _mm_lddqu_si128((const __m128i *)array1 + pos1);
+    pos1++;
+    vB = _mm_lddqu_si128((const __m128i *)array2 + pos2);
+    pos2++;
+    sse_merge(&vA, &vB, &vecMin, &vecMax);
+    // the held back value of laststore equals its neighbour, so it is
+    // dropped
+    laststore = _mm_set1_epi16(-1);
+    output += store_unique_xor(laststore, vecMin, output);
+    laststore = vecMin;
+    if ((pos1 < len1) && (pos2 < len2)) {
+        uint16_t curA, curB;
+        curA = array1[8 * pos1];
+        curB = array2[8 * pos2];
+        while (true) {
+            if (curA <= curB) {
+                V = _mm_lddqu_si128((const __m128i *)array1 + pos1);
+                pos1++;
+                if (pos1 < len1) {
+                    curA = array1[8 * pos1];
+                } else {
+                    break;
+                }
+            } else {
+                V = _mm_lddqu_si128((const __m128i *)array2 + pos2);
+                pos2++;
+                if (pos2 < len2) {
+                    curB = array2[8 * pos2];
+                } else {
+                    break;
+                }
+            }
+            sse_merge(&V, &vecMax, &vecMin, &vecMax);
+            output += store_unique_xor(laststore, vecMin, output);
+            laststore = vecMin;
+        }
+        sse_merge(&V, &vecMax, &vecMin, &vecMax);
+        output += store_unique_xor(laststore, vecMin, output);
+        laststore = vecMin;
+    }
+    // we finish the rest off using a scalar algorithm
+    uint32_t len = (uint32_t)(output - initoutput);
+    uint16_t buffer[16];
+    uint32_t leftoversize = store_unique_xor(laststore, vecMax, buffer);
+    const uint16_t vec7 = (uint16_t)_mm_extract_epi16(vecMax, 7);
+    const uint16_t vec6 = (uint16_t)_mm_extract_epi16(vecMax, 6);
+    if (vec7 != vec6) buffer[leftoversize++] = vec7;
+    if (pos1 == len1) {
+        memcpy(buffer + leftoversize, array1 + 8 * pos1,
+               (length1 - 8 * len1) * sizeof(uint16_t));
+        leftoversize += length1 - 8 * len1;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+        leftoversize = unique_xor(buffer, leftoversize);
+        len += xor_uint16(buffer, leftoversize, array2 + 8 * pos2,
+                          length2 - 8 * pos2, output);
+    } else {
+        memcpy(buffer + leftoversize, array2 + 8 * pos2,
+               (length2 - 8 * len2) * sizeof(uint16_t));
+        leftoversize += length2 - 8 * len2;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+        leftoversize = unique_xor(buffer, leftoversize);
+        len += xor_uint16(buffer, leftoversize, array1 + 8 * pos1,
+                          length1 - 8 * pos1, output);
+    }
+    return len;
+}
+#endif // USE_BMI
+
+#ifdef USENEON
+// same as sse_merge
+static inline void neon_merge(const uint16x8_t *vInput1,
+                              const uint16x8_t *vInput2,
+                              uint16x8_t *vecMin, uint16x8_t *vecMax) {
+    uint16x8_t vecTmp;
+    vecTmp = vminq_u16(*vInput1, *vInput2);
+    *vecMax = vmaxq_u16(*vInput1, *vInput2);
+    vecTmp = vextq_u16(vecTmp, vecTmp, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    vecTmp = vextq_u16(*vecMin, *vecMin, 1);
+    *vecMin = vminq_u16(vecTmp, *vecMax);
+    *vecMax = vmaxq_u16(vecTmp, *vecMax);
+    *vecMin = vextq_u16(*vecMin, *vecMin, 1);
+}
+
+// same as store_unique
+static inline int neon_store_unique(uint16x8_t old, uint16x8_t new,
+                                    uint16_t *output) {
+    const uint16x8_t vecTmp = vextq_u16(old, new, 7);
+    const uint32_t M = vaddvq_u16(
+        vandq_u16(vceqq_u16(vecTmp, new), vld1q_u16(neon_lane_bits)));
+    const uint8x16_t key = vld1q_u8(uniqshuf + 16 * M);
+    vst1q_u16(output, vreinterpretq_u16_u8(
+                          vqtbl1q_u8(vreinterpretq_u8_u16(new), key)));
+    return 8 - __builtin_popcount(M);
+}
+
+// same as store_unique_xor
+static inline int neon_store_unique_xor(uint16x8_t old, uint16x8_t new,
+                                        uint16_t *output) {
+    const uint16x8_t vecTmp1 = vextq_u16(old, new, 6);
+    const uint16x8_t vecTmp2 = vextq_u16(old, new, 7);
+    const uint16x8_t eq = vorrq_u16(vceqq_u16(vecTmp2, vecTmp1),
+                                    vceqq_u16(vecTmp2, new));
+    const uint32_t M = vaddvq_u16(vandq_u16(eq, vld1q_u16(neon_lane_bits)));
+    const uint8x16_t key = vld1q_u8(uniqshuf + 16 * M);
+    vst1q_u16(output, vreinterpretq_u16_u8(
+                          vqtbl1q_u8(vreinterpretq_u8_u16(vecTmp2), key)));
+    return 8 - __builtin_popcount(M);
+}
+
+// a one-pass NEON union algorithm, see the SSE version
+uint32_t union_vector16(const uint16_t *__restrict__ array1, uint32_t length1,
+                        const uint16_t *__restrict__ array2, uint32_t length2,
+                        uint16_t *__restrict__ output) {
+    if ((length1 < 8) || (length2 < 8)) {
+        return union_uint16(array1, length1, array2, length2, output);
+    }
+    uint16x8_t vA, vB, V, vecMin, vecMax;
+    uint16x8_t laststore;
+    uint16_t *initoutput = output;
+    uint32_t len1 = length1 / 8;
+    uint32_t len2 = length2 / 8;
+    uint32_t pos1 = 0;
+    uint32_t pos2 = 0;
+    // we start the machine
+    vA = vld1q_u16(array1 + 8 * pos1);
+    pos1++;
+    vB = vld1q_u16(array2 + 8 * pos2);
+    pos2++;
+    neon_merge(&vA, &vB, &vecMin, &vecMax);
+    laststore = vdupq_n_u16(
+        (uint16_t)(array1[0] < array2[0] ? array1[0] - 1 : array2[0] - 1));
+    output += neon_store_unique(laststore, vecMin, output);
+    laststore = vecMin;
+    if ((pos1 < len1) && (pos2 < len2)) {
+        uint16_t curA, curB;
+        curA = array1[8 * pos1];
+        curB = array2[8 * pos2];
+        while (true) {
+            if (curA <= curB) {
+                V = vld1q_u16(array1 + 8 * pos1);
+                pos1++;
+                if (pos1 < len1) {
+                    curA = array1[8 * pos1];
+                } else {
+                    break;
+                }
+            } else {
+                V = vld1q_u16(array2 + 8 * pos2);
+                pos2++;
+                if (pos2 < len2) {
+                    curB = array2[8 * pos2];
+                } else {
+                    break;
+                }
+            }
+            neon_merge(&V, &vecMax, &vecMin, &vecMax);
+            output += neon_store_unique(laststore, vecMin, output);
+            laststore = vecMin;
+        }
+        neon_merge(&V, &vecMax, &vecMin, &vecMax);
+        output += neon_store_unique(laststore, vecMin, output);
+        laststore = vecMin;
+    }
+    // we finish the rest off using a scalar algorithm
+    uint32_t len = (uint32_t)(output - initoutput);
+    uint16_t buffer[16];
+    uint32_t leftoversize = neon_store_unique(laststore, vecMax, buffer);
+    if (pos1 == len1) {
+        memcpy(buffer + leftoversize, array1 + 8 * pos1,
+               (length1 - 8 * len1) * sizeof(uint16_t));
+        leftoversize += length1 - 8 * len1;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+
+        leftoversize = unique(buffer, leftoversize);
+        len += union_uint16(buffer, leftoversize, array2 + 8 * pos2,
+                            length2 - 8 * pos2, output);
+    } else {
+        memcpy(buffer + leftoversize, array2 + 8 * pos2,
+               (length2 - 8 * len2) * sizeof(uint16_t));
+        leftoversize += length2 - 8 * len2;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+        leftoversize = unique(buffer, leftoversize);
+        len += union_uint16(buffer, leftoversize, array1 + 8 * pos1,
+                            length1 - 8 * pos1, output);
+    }
+    return len;
+}
+
+// a one-pass NEON symmetric difference algorithm, see the SSE version
+uint32_t xor_vector16(const uint16_t *__restrict__ array1, uint32_t length1,
+                      const uint16_t *__restrict__ array2, uint32_t length2,
+                      uint16_t *__restrict__ output) {
+    if ((length1 < 8) || (length2 < 8)) {
+        return xor_uint16(array1, length1, array2, length2, output);
+    }
+    uint16x8_t vA, vB, V, vecMin, vecMax;
+    uint16x8_t laststore;
+    uint16_t *initoutput = output;
+    uint32_t len1 = length1 / 8;
+    uint32_t len2 = length2 / 8;
+    uint32_t pos1 = 0;
+    uint32_t pos2 = 0;
+    // we start the machine
+    vA = vld1q_u16(array1 + 8 * pos1);
+    pos1++;
+    vB = vld1q_u16(array2 + 8 * pos2);
+    pos2++;
+    neon_merge(&vA, &vB, &vecMin, &vecMax);
+    laststore = vdupq_n_u16(0xFFFF);
+    output += neon_store_unique_xor(laststore, vecMin, output);
+    laststore = vecMin;
+    if ((pos1 < len1) && (pos2 < len2)) {
+        uint16_t curA, curB;
+        curA = array1[8 * pos1];
+        curB = array2[8 * pos2];
+        while (true) {
+            if (curA <= curB) {
+                V = vld1q_u16(array1 + 8 * pos1);
+                pos1++;
+                if (pos1 < len1) {
+                    curA = array1[8 * pos1];
+                } else {
+                    break;
+                }
+            } else {
+                V = vld1q_u16(array2 + 8 * pos2);
+                pos2++;
+                if (pos2 < len2) {
+                    curB = array2[8 * pos2];
+                } else {
+                    break;
+                }
+            }
+            neon_merge(&V, &vecMax, &vecMin, &vecMax);
+            output += neon_store_unique_xor(laststore, vecMin, output);
+            laststore = vecMin;
+        }
+        neon_merge(&V, &vecMax, &vecMin, &vecMax);
+        output += neon_store_unique_xor(laststore, vecMin, output);
+        laststore = vecMin;
+    }
+    // we finish the rest off using a scalar algorithm
+    uint32_t len = (uint32_t)(output - initoutput);
+    uint16_t buffer[16];
+    uint32_t leftoversize = neon_store_unique_xor(laststore, vecMax, buffer);
+    const uint16_t vec7 = vgetq_lane_u16(vecMax, 7);
+    const uint16_t vec6 = vgetq_lane_u16(vecMax, 6);
+    if (vec7 != vec6) buffer[leftoversize++] = vec7;
+    if (pos1 == len1) {
+        memcpy(buffer + leftoversize, array1 + 8 * pos1,
+               (length1 - 8 * len1) * sizeof(uint16_t));
+        leftoversize += length1 - 8 * len1;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+        leftoversize = unique_xor(buffer, leftoversize);
+        len += xor_uint16(buffer, leftoversize, array2 + 8 * pos2,
+                          length2 - 8 * pos2, output);
+    } else {
+        memcpy(buffer + leftoversize, array2 + 8 * pos2,
+               (length2 - 8 * len2) * sizeof(uint16_t));
+        leftoversize += length2 - 8 * len2;
+        qsort(buffer, leftoversize, sizeof(uint16_t), uint16_compare);
+        leftoversize = unique_xor(buffer, leftoversize);
+        len += xor_uint16(buffer, leftoversize, array1 + 8 * pos1,
+                          length1 - 8 * pos1, output);
+    }
+    return len;
+}
+#endif // USENEON
+
 /**
  * End of the SIMD 16-bit union code
  *
  */
-#endif // IS_X64
+#endif // USE_BMI || USENEON
 
 size_t union_uint32(const uint32_t *set_1, size_t size_1, const uint32_t *set_2,
                     size_t size_2, uint32_t *buffer) {
@@ -8,7 +8,7 @@
 #include <roaring/portability.h>
 #include <roaring/utilasm.h>
 
-#if defined(IS_X64) || defined(USEAVX)
+#if defined(IS_X64) || defined(USEAVX) || defined(USENEON)
 
 static uint8_t lengthTable[256] = {
     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
@@ -24,7 +24,7 @@ static uint8_t lengthTable[256] = {
     4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
 #endif
 
-#ifdef USEAVX
+#if defined(USEAVX) || defined(ROARING_DISPATCH) || defined(USENEON)
 static uint32_t vecDecodeTable[256][8] ALIGNED(32) = {
     {0, 0, 0, 0, 0, 0, 0, 0}, /* 0x00 (00000000) */
     {1, 0, 0, 0, 0, 0, 0, 0}, /* 0x01 (00000001) */
@@ -284,9 +284,9 @@ static uint32_t vecDecodeTable[256][8] ALIGNED(32) = {
     {1, 2, 3, 4, 5, 6, 7, 8}  /* 0xFF (11111111) */
 };
 
-#endif  // #ifdef USEAVX
+#endif  // USEAVX || ROARING_DISPATCH || USENEON
 
-#ifdef IS_X64
+#if defined(IS_X64) || defined(USENEON)
 // same as vecDecodeTable but in 16 bits
 static uint16_t vecDecodeTable_uint16[256][8] ALIGNED(32) = {
     {0, 0, 0, 0, 0, 0, 0, 0}, /* 0x00 (00000000) */
@@ -549,8 +549,9 @@ static uint16_t vecDecodeTable_uint16[256][8] ALIGNED(32) = {
 
 #endif
 
-#if USEAVX
+#if defined(USEAVX) || defined(ROARING_DISPATCH)
 
+ROARING_TARGET_AVX2
 size_t bitset_extract_setbits_avx2(uint64_t *array, size_t length,
                                    uint32_t *out, size_t outcapacity,
                                    uint32_t base) {
@@ -600,7 +601,181 @@ size_t bitset_extract_setbits_avx2(uint64_t *array, size_t length,
     }
     return out - initout;
 }
-#endif  // USEAVX
+#endif  // USEAVX || ROARING_DISPATCH
+
+#if defined(USEAVX512) || defined(ROARING_DISPATCH)
+
+ROARING_TARGET_AVX512
+size_t bitset_extract_setbits_avx512(uint64_t *array, size_t length,
+                                     uint32_t *out, size_t outcapacity,
+                                     uint32_t base) {
+    uint32_t *initout = out;
+    __m512i baseVec = _mm512_add_epi32(
+        _mm512_set1_epi32(base),
+        _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    const __m512i inc16 = _mm512_set1_epi32(16);
+    const __m512i inc64 = _mm512_set1_epi32(64);
+    uint32_t *safeout = out + outcapacity;
+    size_t i = 0;
+    for (; (i < length) && (out + 64 <= safeout); ++i) {
+        uint64_t w = array[i];
+        if (w == 0) {
+            baseVec = _mm512_add_epi32(baseVec, inc64);
+        } else {
+            for (int k = 0; k < 4; ++k) {
+                const __mmask16 mask = (__mmask16)w;
+                w >>= 16;
+                _mm512_storeu_si512(out,
+                                    _mm512_maskz_compress_epi32(mask, baseVec));
+                out += __builtin_popcount(mask);
+                baseVec = _mm512_add_epi32(baseVec, inc16);
+            }
+        }
+    }
+    base += i * 64;
+    for (; (i < length) && (out < safeout); ++i) {
+        uint64_t w = array[i];
+        while ((w != 0) && (out < safeout)) {
+            uint64_t t = w & -w;
+            int r = __builtin_ctzll(w);
+            *out = r + base;
+            out++;
+            w ^= t;
+        }
+        base += 64;
+    }
+    return out - initout;
+}
+
+ROARING_TARGET_AVX512
+size_t bitset_extract_setbits_avx512_uint16(const uint64_t *array,
+                                            size_t length, uint16_t *out,
+                                            size_t outcapacity,
+                                            uint16_t base) {
+    uint16_t *initout = out;
+    __m512i baseVec = _mm512_add_epi32(
+        _mm512_set1_epi32(base),
+        _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    const __m512i inc16 = _mm512_set1_epi32(16);
+    const __m512i inc64 = _mm512_set1_epi32(64);
+    uint16_t *safeout = out + outcapacity;
+    size_t i = 0;
+    for (; (i < length) && (out + 64 <= safeout); ++i) {
+        uint64_t w = array[i];
+        if (w == 0) {
+            baseVec = _mm512_add_epi32(baseVec, inc64);
+        } else {
+            for (int k = 0; k < 4; ++k) {
+                const __mmask16 mask = (__mmask16)w;
+                w >>= 16;
+                // values are below 1<<16, so narrowing to 16 bits is exact
+                _mm256_storeu_si256(
+                    (__m256i *)out,
+                    _mm512_cvtepi32_epi16(
+                        _mm512_maskz_compress_epi32(mask, baseVec)));
+                out += __builtin_popcount(mask);
+                baseVec = _mm512_add_epi32(baseVec, inc16);
+            }
+        }
+    }
+    base += i * 64;
+    for (; (i < length) && (out < safeout); ++i) {
+        uint64_t w = array[i];
+        while ((w != 0) && (out < safeout)) {
+            uint64_t t = w & -w;
+            int r = __builtin_ctzll(w);
+            *out = r + base;
+            out++;
+            w ^= t;
+        }
+        base += 64;
+    }
+    return out - initout;
+}
+#endif  // USEAVX512 || ROARING_DISPATCH
+
+#ifdef USENEON
+size_t bitset_extract_setbits_neon(uint64_t *array, size_t length,
+                                   uint32_t *out, size_t outcapacity,
+                                   uint32_t base) {
+    uint32_t *initout = out;
+    uint32x4_t baseVec = vdupq_n_u32(base - 1);
+    const uint32x4_t incVec = vdupq_n_u32(64);
+    const uint32x4_t add8 = vdupq_n_u32(8);
+    uint32_t *safeout = out + outcapacity;
+    size_t i = 0;
+    for (; (i < length) && (out + 64 <= safeout); ++i) {
+        uint64_t w = array[i];
+        if (w == 0) {
+            baseVec = vaddq_u32(baseVec, incVec);
+        } else {
+            for (int k = 0; k < 8; ++k) {
+                uint8_t byte = (uint8_t)w;
+                w >>= 8;
+                // the 8 decoded values of a byte span two vectors
+                uint32x4_t vecLo = vld1q_u32(vecDecodeTable[byte]);
+                uint32x4_t vecHi = vld1q_u32(vecDecodeTable[byte] + 4);
+                vst1q_u32(out, vaddq_u32(baseVec, vecLo));
+                vst1q_u32(out + 4, vaddq_u32(baseVec, vecHi));
+                out += lengthTable[byte];
+                baseVec = vaddq_u32(baseVec, add8);
+            }
+        }
+    }
+    base += i * 64;
+    for (; (i < length) && (out < safeout); ++i) {
+        uint64_t w = array[i];
+        while ((w != 0) && (out < safeout)) {
+            uint64_t t = w & -w;
+            int r = __builtin_ctzll(w);
+            *out = r + base;
+            out++;
+            w ^= t;
+        }
+        base += 64;
+    }
+    return out - initout;
+}
+
+size_t bitset_extract_setbits_neon_uint16(const uint64_t *array,
+                                          size_t length, uint16_t *out,
+                                          size_t outcapacity, uint16_t base) {
+    uint16_t *initout = out;
+    uint16x8_t baseVec = vdupq_n_u16(base - 1);
+    const uint16x8_t incVec = vdupq_n_u16(64);
+    const uint16x8_t add8 = vdupq_n_u16(8);
+    uint16_t *safeout = out + outcapacity;
+    size_t i = 0;
+    for (; (i < length) && (out + 64 <= safeout); ++i) {
+        uint64_t w = array[i];
+        if (w == 0) {
+            baseVec = vaddq_u16(baseVec, incVec);
+        } else {
+            for (int k = 0; k < 8; ++k) {
+                uint8_t byte = (uint8_t)w;
+                w >>= 8;
+                uint16x8_t vec = vld1q_u16(vecDecodeTable_uint16[byte]);
+                vst1q_u16(out, vaddq_u16(baseVec, vec));
+                out += lengthTable[byte];
+                baseVec = vaddq_u16(baseVec, add8);
+            }
+        }
+    }
+    base += i * 64;
+    for (; (i < length) && (out < safeout); ++i) {
+        uint64_t w = array[i];
+        while ((w != 0) && (out < safeout)) {
+            uint64_t t = w & -w;
+            int r = __builtin_ctzll(w);
+            *out = r + base;
+            out++;
+            w ^= t;
+        }
+        base += 64;
+    }
+    return out - initout;
+}
+#endif  // USENEON
 
 size_t bitset_extract_setbits(uint64_t *bitset, size_t length, uint32_t *out,
                               uint32_t base) {
@@ -907,6 +1082,46 @@ void bitset_set_range(uint64_t *bitmap, uint32_t start, uint32_t end) {
     bitmap[endword] |= (~UINT64_C(0)) >> ((-end) % 64);
 }
 
+/*
+ * Count the set bits in indexes [begin,end).
+ */
+int bitset_range_cardinality(const uint64_t *bitmap, uint32_t start,
+                             uint32_t end) {
+    if (start == end) return 0;
+    uint32_t firstword = start / 64;
+    uint32_t endword = (end - 1) / 64;
+    if (firstword == endword) {
+        return hamming(bitmap[firstword] & ((~UINT64_C(0)) << (start % 64)) &
+                       ((~UINT64_C(0)) >> ((-end) % 64)));
+    }
+    int answer = hamming(bitmap[firstword] & ((~UINT64_C(0)) << (start % 64)));
+    for (uint32_t i = firstword + 1; i < endword; i++) {
+        answer += hamming(bitmap[i]);
+    }
+    answer += hamming(bitmap[endword] & ((~UINT64_C(0)) >> ((-end) % 64)));
+    return answer;
+}
+
+/*
+ * Check whether any bit in indexes [begin,end) is set.
+ */
+bool bitset_range_nonempty(const uint64_t *bitmap, uint32_t start,
+                           uint32_t end) {
+    if (start == end) return false;
+    uint32_t firstword = start / 64;
+    uint32_t endword = (end - 1) / 64;
+    if (firstword == endword) {
+        return (bitmap[firstword] & ((~UINT64_C(0)) << (start % 64)) &
+                ((~UINT64_C(0)) >> ((-end) % 64))) != 0;
+    }
+    if ((bitmap[firstword] & ((~UINT64_C(0)) << (start % 64))) != 0)
+        return true;
+    for (uint32_t i = firstword + 1; i < endword; i++) {
+        if (bitmap[i] != 0) return true;
+    }
+    return (bitmap[endword] & ((~UINT64_C(0)) >> ((-end) % 64))) != 0;
+}
+
 /*
  * Flip all the bits in indexes [begin,end).
  */
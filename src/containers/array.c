@@ -10,6 +10,7 @@
 #include <roaring/portability.h>
 #include <roaring/array_util.h>
 #include <roaring/containers/array.h>
+#include <roaring/memory.h>
 
 enum { DEFAULT_INIT_SIZE = 16 };
 
@@ -24,12 +25,15 @@ extern bool array_container_full(const array_container_t *array);
 array_container_t *array_container_create_given_capacity(int32_t size) {
     array_container_t *container;
 
-    if ((container = malloc(sizeof(array_container_t))) == NULL) {
+    if ((container = roaring_pool_malloc(sizeof(array_container_t))) == NULL) {
         return NULL;
     }
 
-    if ((container->array = malloc(sizeof(uint16_t) * size)) == NULL) {
-        free(container);
+    // round up to a size class so the payload can be recycled
+    size = roaring_pool_round(sizeof(uint16_t) * size) / sizeof(uint16_t);
+    container->array = roaring_pool_malloc(sizeof(uint16_t) * size);
+    if (container->array == NULL) {
+        roaring_pool_free(container, sizeof(array_container_t));
         return NULL;
     }
 
@@ -59,9 +63,9 @@ array_container_t *array_container_clone(const array_container_t *src) {
 
 /* Free memory. */
 void array_container_free(array_container_t *arr) {
-    free(arr->array);
+    roaring_pool_free(arr->array, sizeof(uint16_t) * arr->capacity);
     arr->array = NULL;
-    free(arr);
+    roaring_pool_free(arr, sizeof(array_container_t));
 }
 
 static inline int32_t grow_capacity(int32_t capacity) {
@@ -80,9 +84,10 @@ static inline int32_t clamp(int32_t val, int32_t min, int32_t max) {
  * existing data needs to be copied over depends on the "preserve" parameter. If
  * preserve is false,
  * then the new content will be uninitialized, otherwise the old content is
- * copie.
+ * copied. Returns false if memory could not be allocated: the container is
+ * then left unchanged if preserve is true, and without storage otherwise.
  */
-void array_container_grow(array_container_t *container, int32_t min,
+bool array_container_grow(array_container_t *container, int32_t min,
                           int32_t max, bool preserve) {
     int32_t new_capacity = clamp(grow_capacity(container->capacity), min, max);
 
@@ -90,20 +95,32 @@ void array_container_grow(array_container_t *container, int32_t min,
     // then.
     // if we are within 1/16th of the max, go to max
     if (new_capacity > max - max / 16) new_capacity = max;
+    // round up to a size class so the payload can be recycled, within max
+    const int32_t rounded = (int32_t)(
+        roaring_pool_round(sizeof(uint16_t) * new_capacity) / sizeof(uint16_t));
+    if (rounded <= max) new_capacity = rounded;
 
-    container->capacity = new_capacity;
+    const int32_t old_capacity = container->capacity;
     uint16_t *array = container->array;
 
+    // grow into a new buffer, so that the old one is still there on failure
+    uint16_t *new_array = roaring_pool_malloc(new_capacity * sizeof(uint16_t));
+    if (new_array == NULL) {
+        if (!preserve) {
+            roaring_pool_free(array, old_capacity * sizeof(uint16_t));
+            container->array = NULL;
+            container->capacity = 0;
+            container->cardinality = 0;
+        }
+        return false;
+    }
     if (preserve) {
-        container->array = realloc(array, new_capacity * sizeof(uint16_t));
-        if (container->array == NULL) free(array);
-    } else {
-        free(array);
-        container->array = malloc(new_capacity * sizeof(uint16_t));
+        memcpy(new_array, array, container->cardinality * sizeof(uint16_t));
     }
-
-    // TODO: handle the case where realloc fails
-    assert(container->array != NULL);
+    roaring_pool_free(array, old_capacity * sizeof(uint16_t));
+    container->array = new_array;
+    container->capacity = new_capacity;
+    return true;
 }
 
 /* Copy one container into another. We assume that they are distinct. */
@@ -118,14 +135,17 @@ void array_container_copy(const array_container_t *src,
     memcpy(dst->array, src->array, cardinality * sizeof(uint16_t));
 }
 
-static void array_container_append(array_container_t *arr, uint16_t pos) {
+/* Returns false if memory could not be allocated. */
+static bool array_container_append(array_container_t *arr, uint16_t pos) {
     const int32_t capacity = arr->capacity;
 
-    if (array_container_full(arr)) {
-        array_container_grow(arr, capacity + 1, INT32_MAX, true);
+    if (array_container_full(arr) &&
+        !array_container_grow(arr, capacity + 1, INT32_MAX, true)) {
+        return false;
     }
 
     arr->array[arr->cardinality++] = pos;
+    return true;
 }
 
 void array_container_add_from_range(array_container_t *arr, uint32_t min,
@@ -141,16 +161,16 @@ bool array_container_add(array_container_t *arr, uint16_t pos) {
 
     // best case, we can append.
     if (array_container_empty(arr) || (arr->array[cardinality - 1] < pos)) {
-        array_container_append(arr, pos);
-        return true;
+        return array_container_append(arr, pos);
     }
 
     const int32_t loc = binarySearch(arr->array, cardinality, pos);
     const bool not_found = loc < 0;
 
     if (not_found) {
-        if (array_container_full(arr)) {
-            array_container_grow(arr, arr->capacity + 1, INT32_MAX, true);
+        if (array_container_full(arr) &&
+            !array_container_grow(arr, arr->capacity + 1, INT32_MAX, true)) {
+            return false;
         }
         const int32_t insert_idx = -loc - 1;
         memmove(arr->array + insert_idx + 1, arr->array + insert_idx,
@@ -162,6 +182,59 @@ bool array_container_add(array_container_t *arr, uint16_t pos) {
     return not_found;
 }
 
+/* Add all values of a strictly increasing list to the set. */
+bool array_container_add_many(array_container_t *arr, const uint16_t *list,
+                              int32_t length) {
+    const int32_t cardinality = arr->cardinality;
+    if (length == 0) return true;
+    if (length == 1) {
+        // make room first, so that array_container_add cannot fail
+        if (array_container_full(arr) &&
+            !array_container_grow(arr, cardinality + 1, INT32_MAX, true)) {
+            return false;
+        }
+        array_container_add(arr, list[0]);
+        return true;
+    }
+
+    if (arr->capacity < cardinality + length &&
+        !array_container_grow(arr, cardinality + length, INT32_MAX, true)) {
+        return false;
+    }
+
+    // best case, the whole list goes after the current content
+    if (array_container_empty(arr) || (arr->array[cardinality - 1] < list[0])) {
+        memcpy(arr->array + cardinality, list, length * sizeof(uint16_t));
+        arr->cardinality += length;
+        return true;
+    }
+
+    // merge backward from the tail, so that no value is overwritten before
+    // it is read; duplicates leave a gap at the front that we close at the end
+    uint16_t *array = arr->array;
+    int32_t i = cardinality - 1, j = length - 1;
+    int32_t out = cardinality + length;
+    while (i >= 0 && j >= 0) {
+        if (array[i] > list[j]) {
+            array[--out] = array[i--];
+        } else if (array[i] < list[j]) {
+            array[--out] = list[j--];
+        } else {
+            array[--out] = array[i--];
+            j--;
+        }
+    }
+    while (j >= 0) array[--out] = list[j--];
+    // the remaining array[0..i] are already in place when out == i + 1
+    const int32_t union_cardinality = cardinality + length - out + (i + 1);
+    if (out != i + 1) {
+        memmove(array + i + 1, array + out,
+                (cardinality + length - out) * sizeof(uint16_t));
+    }
+    arr->cardinality = union_cardinality;
+    return true;
+}
+
 /* Remove x from the set. Returns true if x was present.  */
 bool array_container_remove(array_container_t *arr, uint16_t pos) {
     const int32_t idx = binarySearch(arr->array, arr->cardinality, pos);
@@ -175,11 +248,67 @@ bool array_container_remove(array_container_t *arr, uint16_t pos) {
     return is_present;
 }
 
+/* Returns the number of values equal or smaller than x */
+int array_container_rank(const array_container_t *arr, uint16_t x) {
+    const int32_t idx = binarySearch(arr->array, arr->cardinality, x);
+    const bool is_present = idx >= 0;
+    if (is_present) {
+        return idx + 1;
+    } else {
+        return -idx - 1;
+    }
+}
+
 /* Check whether x is present.  */
 bool array_container_contains(const array_container_t *arr, uint16_t pos) {
     return binarySearch(arr->array, arr->cardinality, pos) >= 0;
 }
 
+/* Add all values in [min, max] (included) to `arr'. The resulting
+ * cardinality may exceed DEFAULT_MAX_SIZE. */
+void array_container_add_range(array_container_t *arr, uint32_t min,
+                               uint32_t max) {
+    const int32_t nvals_less =
+        (min == 0) ? 0 : array_container_rank(arr, (uint16_t)(min - 1));
+    const int32_t nvals_greater =
+        arr->cardinality - array_container_rank(arr, (uint16_t)max);
+    const int32_t union_cardinality =
+        nvals_less + (int32_t)(max - min + 1) + nvals_greater;
+    if (union_cardinality > arr->capacity) {
+        array_container_grow(arr, union_cardinality, INT32_MAX, true);
+    }
+    memmove(arr->array + union_cardinality - nvals_greater,
+            arr->array + arr->cardinality - nvals_greater,
+            nvals_greater * sizeof(uint16_t));
+    for (uint32_t i = 0; i <= max - min; ++i) {
+        arr->array[nvals_less + i] = (uint16_t)(min + i);
+    }
+    arr->cardinality = union_cardinality;
+}
+
+/* Remove all values in [min, max] (included) from `arr'. */
+void array_container_remove_range(array_container_t *arr, uint32_t min,
+                                  uint32_t max) {
+    const int32_t begin =
+        (min == 0) ? 0 : array_container_rank(arr, (uint16_t)(min - 1));
+    const int32_t end = array_container_rank(arr, (uint16_t)max);
+    memmove(arr->array + begin, arr->array + end,
+            (arr->cardinality - end) * sizeof(uint16_t));
+    arr->cardinality -= end - begin;
+}
+
+/* Check whether all values in [min, max] (included) are present in `arr'. */
+bool array_container_contains_range(const array_container_t *arr,
+                                    uint32_t min, uint32_t max) {
+    const int32_t idx = binarySearch(arr->array, arr->cardinality,
+                                     (uint16_t)min);
+    if (idx < 0) return false;
+    // values are distinct and sorted, so the range is dense iff it ends
+    // exactly (max - min) positions further
+    const int32_t last = idx + (int32_t)(max - min);
+    return last < arr->cardinality && arr->array[last] == max;
+}
+
 /* Computes the union of array1 and array2 and write the result to arrayout.
  * It is assumed that arrayout is distinct from both array1 and array2.
  */
@@ -212,64 +341,6 @@ void array_container_union(const array_container_t *array_1,
 #endif
 }
 
-/* helper. a_out must be a valid array container with adequate capacity.
- * and may be same as a1.
- * Returns the cardinality of the output container. Based on Java
- * implementation Util.unsignedDifference
- */
-
-static int array_array_array_subtract(const array_container_t *a1,
-                                      const array_container_t *a2,
-                                      array_container_t *a_out) {
-    int out_card = 0;
-    int k1 = 0, k2 = 0;
-    int length1 = a1->cardinality, length2 = a2->cardinality;
-
-    if (length1 == 0) return 0;
-
-    if (length2 == 0) {
-        if (a1 != a_out)
-            memcpy(a_out->array, a1->array, sizeof(uint16_t) * length1);
-        return length1;
-    }
-
-    uint16_t s1 = a1->array[k1];
-    uint16_t s2 = a2->array[k2];
-
-    while (true) {
-        if (s1 < s2) {
-            a_out->array[out_card++] = s1;
-            ++k1;
-            if (k1 >= length1) {
-                break;
-            }
-            s1 = a1->array[k1];
-        } else if (s1 == s2) {
-            ++k1;
-            ++k2;
-            if (k1 >= length1) {
-                break;
-            }
-            if (k2 >= length2) {
-                memmove(a_out->array + out_card, a1->array + k1,
-                        sizeof(uint16_t) * (length1 - k1));
-                return out_card + length1 - k1;
-            }
-            s1 = a1->array[k1];
-            s2 = a2->array[k2];
-        } else {  // if (val1>val2)
-            ++k2;
-            if (k2 >= length2) {
-                memmove(a_out->array + out_card, a1->array + k1,
-                        sizeof(uint16_t) * (length1 - k1));
-                return out_card + length1 - k1;
-            }
-            s2 = a2->array[k2];
-        }
-    }
-    return out_card;
-}
-
 /* Computes the  difference of array1 and array2 and write the result
  * to array out.
  * Array out does not need to be distinct from array_1
@@ -277,9 +348,22 @@ static int array_array_array_subtract(const array_container_t *a1,
 void array_container_andnot(const array_container_t *array_1,
                             const array_container_t *array_2,
                             array_container_t *out) {
+#ifdef ROARING_VECTOR_DIFFERENCE_ENABLED
+    // the vectorized kernel may write one 128-bit vector past the end
+    int32_t min_capacity = array_1->cardinality;
+    if (out != array_1) min_capacity += 8;
+    if (out->capacity < min_capacity)
+        array_container_grow(out, min_capacity, INT32_MAX, false);
+    out->cardinality =
+        difference_vector16(array_1->array, array_1->cardinality,
+                            array_2->array, array_2->cardinality, out->array);
+#else
     if (out->capacity < array_1->cardinality)
         array_container_grow(out, array_1->cardinality, INT32_MAX, false);
-    out->cardinality = array_array_array_subtract(array_1, array_2, out);
+    out->cardinality =
+        difference_uint16(array_1->array, array_1->cardinality,
+                          array_2->array, array_2->cardinality, out->array);
+#endif
 }
 
 /* Computes the symmetric difference of array1 and array2 and write the
@@ -296,33 +380,13 @@ void array_container_xor(const array_container_t *array_1,
     if (out->capacity < max_cardinality)
         array_container_grow(out, max_cardinality, INT32_MAX, false);
 
-    // TODO something clever like the AVX union in array_util.c
-    // except where *both* occurrences of a duplicate in a sorted sequence
-    // are removed.
-
-    // just a merge for now (see TODO)
-    int pos1 = 0, pos2 = 0, pos_out = 0;
-    while (pos1 < card_1 && pos2 < card_2) {
-        const uint16_t v1 = array_1->array[pos1];
-        const uint16_t v2 = array_2->array[pos2];
-        if (v1 == v2) {
-            ++pos1;
-            ++pos2;
-            continue;
-        }
-        if (v1 < v2) {
-            out->array[pos_out++] = v1;
-            ++pos1;
-        } else {
-            out->array[pos_out++] = v2;
-            ++pos2;
-        }
-    }
-    // todo: memcpys instead
-    while (pos1 < card_1) out->array[pos_out++] = array_1->array[pos1++];
-    while (pos2 < card_2) out->array[pos_out++] = array_2->array[pos2++];
-
-    out->cardinality = pos_out;
+#ifdef ROARING_VECTOR_XOR_ENABLED
+    out->cardinality = xor_vector16(array_1->array, card_1, array_2->array,
+                                    card_2, out->array);
+#else
+    out->cardinality = xor_uint16(array_1->array, card_1, array_2->array,
+                                  card_2, out->array);
+#endif
 }
 
 static inline int32_t minimum(int32_t a, int32_t b) { return (a < b) ? a : b; }
@@ -337,8 +401,8 @@ void array_container_intersection(const array_container_t *array1,
     int32_t card_1 = array1->cardinality, card_2 = array2->cardinality,
             min_card = minimum(card_1, card_2);
     const int threshold = 64;  // subject to tuning
-#ifdef USEAVX
-    min_card += sizeof(__m128i) / sizeof(uint16_t);
+#ifdef ROARING_VECTOR_INTERSECTION_ENABLED
+    min_card += 8;  // room for one 128-bit vector of uint16_t
 #endif
     if (out->capacity < min_card)
         array_container_grow(out, min_card, INT32_MAX, false);
@@ -349,7 +413,7 @@ void array_container_intersection(const array_container_t *array1,
         out->cardinality = intersect_skewed_uint16(
             array2->array, card_2, array1->array, card_1, out->array);
     } else {
-#ifdef USEAVX
+#ifdef ROARING_VECTOR_INTERSECTION_ENABLED
         out->cardinality = intersect_vector16(
             array1->array, card_1, array2->array, card_2, out->array);
 #else
@@ -359,6 +423,46 @@ void array_container_intersection(const array_container_t *array1,
     }
 }
 
+/* computes the size of the intersection of array1 and array2
+ * */
+int array_container_intersection_cardinality(const array_container_t *array1,
+                                             const array_container_t *array2) {
+    int32_t card_1 = array1->cardinality, card_2 = array2->cardinality;
+    const int threshold = 64;  // subject to tuning
+    if (card_1 * threshold < card_2) {
+        return intersect_skewed_uint16_cardinality(array1->array, card_1,
+                                                   array2->array, card_2);
+    } else if (card_2 * threshold < card_1) {
+        return intersect_skewed_uint16_cardinality(array2->array, card_2,
+                                                   array1->array, card_1);
+    } else {
+#ifdef ROARING_VECTOR_INTERSECTION_ENABLED
+        return intersect_vector16_cardinality(array1->array, card_1,
+                                              array2->array, card_2);
+#else
+        return intersect_uint16_cardinality(array1->array, card_1,
+                                            array2->array, card_2);
+#endif
+    }
+}
+
+/* Check whether array1 and array2 have a common value. */
+bool array_container_intersect(const array_container_t *array1,
+                               const array_container_t *array2) {
+    int32_t card_1 = array1->cardinality, card_2 = array2->cardinality;
+    const int threshold = 64;  // subject to tuning
+    if (card_1 * threshold < card_2) {
+        return intersect_skewed_uint16_nonempty(array1->array, card_1,
+                                                array2->array, card_2);
+    } else if (card_2 * threshold < card_1) {
+        return intersect_skewed_uint16_nonempty(array2->array, card_2,
+                                                array1->array, card_1);
+    } else {
+        return intersect_uint16_nonempty(array1->array, card_1, array2->array,
+                                         card_2);
+    }
+}
+
 /* computes the intersection of array1 and array2 and write the result to
  * array1.
  * */
@@ -495,7 +599,7 @@ void *array_container_deserialize(const char *buf, size_t buf_len) {
     else
         buf_len -= 2;
 
-    if ((ptr = malloc(sizeof(array_container_t))) != NULL) {
+    if ((ptr = roaring_malloc(sizeof(array_container_t))) != NULL) {
         size_t len;
         int32_t off;
         uint16_t cardinality;
@@ -506,12 +610,13 @@ void *array_container_deserialize(const char *buf, size_t buf_len) {
         len = sizeof(uint16_t) * ptr->cardinality;
 
         if (len != buf_len) {
-            free(ptr);
+            roaring_free(ptr);
             return (NULL);
         }
 
-        if ((ptr->array = malloc(sizeof(uint16_t) * ptr->capacity)) == NULL) {
-            free(ptr);
+        ptr->array = roaring_malloc(sizeof(uint16_t) * ptr->capacity);
+        if (ptr->array == NULL) {
+            roaring_free(ptr);
             return (NULL);
         }
 
@@ -520,8 +625,8 @@ void *array_container_deserialize(const char *buf, size_t buf_len) {
         /* Check if returned values are monotonically increasing */
         for (int32_t i = 0, j = 0; i < ptr->cardinality; i++) {
             if (ptr->array[i] < j) {
-                free(ptr->array);
-                free(ptr);
+                roaring_free(ptr->array);
+                roaring_free(ptr);
                 return (NULL);
             } else
                 j = ptr->array[i];
@@ -2,9 +2,6 @@
  * bitset.c
  *
  */
-#ifndef _POSIX_C_SOURCE
-#define _POSIX_C_SOURCE 200809L
-#endif
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,6 +9,8 @@
 
 #include <roaring/bitset_util.h>
 #include <roaring/containers/bitset.h>
+#include <roaring/isadetection.h>
+#include <roaring/memory.h>
 #include <roaring/utilasm.h>
 
 extern int bitset_container_cardinality(const bitset_container_t *bitset);
@@ -39,15 +38,17 @@ void bitset_container_set_all(bitset_container_t *bitset) {
 
 /* Create a new bitset. Return NULL in case of failure. */
 bitset_container_t *bitset_container_create(void) {
-    bitset_container_t *bitset = calloc(1, sizeof(bitset_container_t));
+    bitset_container_t *bitset =
+        roaring_pool_malloc(sizeof(bitset_container_t));
 
     if (!bitset) {
         return NULL;
     }
     // sizeof(__m256i) == 32
-    if (posix_memalign((void **)&bitset->array, 32,
-                       sizeof(uint64_t) * BITSET_CONTAINER_SIZE_IN_WORDS)) {
-        free(bitset);
+    bitset->array = roaring_pool_aligned_malloc(
+        32, sizeof(uint64_t) * BITSET_CONTAINER_SIZE_IN_WORDS);
+    if (bitset->array == NULL) {
+        roaring_pool_free(bitset, sizeof(bitset_container_t));
         return NULL;
     }
     bitset_container_clear(bitset);
@@ -92,22 +93,25 @@ void bitset_container_add_from_range(bitset_container_t *bitset, uint32_t min,
 
 /* Free memory. */
 void bitset_container_free(bitset_container_t *bitset) {
-    free(bitset->array);
+    roaring_pool_aligned_free(bitset->array,
+                              sizeof(uint64_t) * BITSET_CONTAINER_SIZE_IN_WORDS);
     bitset->array = NULL;
-    free(bitset);
+    roaring_pool_free(bitset, sizeof(bitset_container_t));
 }
 
 /* duplicate container. */
 bitset_container_t *bitset_container_clone(const bitset_container_t *src) {
-    bitset_container_t *bitset = calloc(1, sizeof(bitset_container_t));
+    bitset_container_t *bitset =
+        roaring_pool_malloc(sizeof(bitset_container_t));
 
     if (!bitset) {
         return NULL;
     }
     // sizeof(__m256i) == 32
-    if (posix_memalign((void **)&bitset->array, 32,
-                       sizeof(uint64_t) * BITSET_CONTAINER_SIZE_IN_WORDS)) {
-        free(bitset);
+    bitset->array = roaring_pool_aligned_malloc(
+        32, sizeof(uint64_t) * BITSET_CONTAINER_SIZE_IN_WORDS);
+    if (bitset->array == NULL) {
+        roaring_pool_free(bitset, sizeof(bitset_container_t));
         return NULL;
     }
     bitset->cardinality = src->cardinality;
@@ -123,13 +127,83 @@ void bitset_container_set_range(bitset_container_t *bitset, uint32_t begin,
         bitset_container_compute_cardinality(bitset);  // could be smarter
 }
 
+/* Which kernel families are compiled: all of them when the kernel is picked
+ * at runtime (ROARING_DISPATCH), otherwise only the one the compiler targets.
+ * BITSET_KERNEL(name) designates the kernel the public functions call. */
+#if defined(ROARING_DISPATCH)
+#define BITSET_AVX512_KERNELS
+#define BITSET_AVX2_KERNELS
+#define BITSET_SCALAR_KERNELS
+#define BITSET_KERNEL(name) (bitset_kernels()->name##_fn)
+#elif defined(USEAVX512)
+#define BITSET_AVX512_KERNELS
+#define BITSET_KERNEL(name) bitset_container_##name##_avx512
+#elif defined(USEAVX)
+#define BITSET_AVX2_KERNELS
+#define BITSET_KERNEL(name) bitset_container_##name##_avx2
+#elif defined(USENEON)
+#define BITSET_NEON_KERNELS
+#define BITSET_KERNEL(name) bitset_container_##name##_neon
+#else
+#define BITSET_SCALAR_KERNELS
+#define BITSET_KERNEL(name) bitset_container_##name##_scalar
+#endif
+
+#define BITSET_AVX512_KERNEL static ROARING_TARGET_AVX512
+#define BITSET_AVX2_KERNEL static ROARING_TARGET_AVX2
+
+#ifdef ROARING_DISPATCH
+typedef int (*bitset_container_op_fn)(const bitset_container_t *,
+                                      const bitset_container_t *,
+                                      bitset_container_t *);
+typedef int (*bitset_container_justcard_fn)(const bitset_container_t *,
+                                            const bitset_container_t *);
+
+#define BITSET_OP_KERNEL_FIELDS(opname)            \
+    bitset_container_op_fn opname##_fn;            \
+    bitset_container_op_fn opname##_nocard_fn;     \
+    bitset_container_justcard_fn opname##_justcard_fn;
+
+/* One table per kernel family, see bitset_kernels() */
+typedef struct bitset_kernels_s {
+    int (*compute_cardinality_fn)(const bitset_container_t *);
+    bool (*intersect_fn)(const bitset_container_t *,
+                         const bitset_container_t *);
+    int (*to_uint32_array_fn)(uint32_t *, const bitset_container_t *,
+                              uint32_t);
+    BITSET_OP_KERNEL_FIELDS(or)
+    BITSET_OP_KERNEL_FIELDS(union)
+    BITSET_OP_KERNEL_FIELDS(and)
+    BITSET_OP_KERNEL_FIELDS(intersection)
+    BITSET_OP_KERNEL_FIELDS(xor)
+    BITSET_OP_KERNEL_FIELDS(andnot)
+} bitset_kernels_t;
+
+static const bitset_kernels_t *bitset_kernels(void);
+#endif
+
 //#define USEPOPCNT // when this is disabled
 // bitset_container_compute_cardinality uses AVX to compute hamming weight
 
-#ifdef USEAVX
+#ifdef BITSET_AVX512_KERNELS
 
-/* Get the number of bits set (force computation) */
-int bitset_container_compute_cardinality(const bitset_container_t *bitset) {
+BITSET_AVX512_KERNEL int bitset_container_compute_cardinality_avx512(
+    const bitset_container_t *bitset) {
+    const uint64_t *array = bitset->array;
+    __m512i total = _mm512_setzero_si512();
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS;
+         i += sizeof(__m512i) / sizeof(uint64_t)) {
+        total = _mm512_add_epi64(
+            total, _mm512_popcnt_epi64(_mm512_loadu_si512(array + i)));
+    }
+    return (int)_mm512_reduce_add_epi64(total);
+}
+#endif
+
+#ifdef BITSET_AVX2_KERNELS
+
+BITSET_AVX2_KERNEL int bitset_container_compute_cardinality_avx2(
+    const bitset_container_t *bitset) {
     const uint64_t *array = bitset->array;
     // these are precomputed hamming weights (weight(0), weight(1)...)
     const __m256i shuf =
@@ -173,10 +247,38 @@ int bitset_container_compute_cardinality(const bitset_container_t *bitset) {
     return _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) +
            _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3);
 }
-#else
+#endif
 
-/* Get the number of bits set (force computation) */
-int bitset_container_compute_cardinality(const bitset_container_t *bitset) {
+#ifdef BITSET_NEON_KERNELS
+
+/* Adds the number of bits set in v to the 16-bit counters of total; each
+ * counter grows by at most 16 per call. */
+static inline uint16x8_t neon_popcount_accumulate(uint16x8_t total,
+                                                  uint64x2_t v) {
+    return vpadalq_u8(total, vcntq_u8(vreinterpretq_u8_u64(v)));
+}
+
+static inline int neon_popcount_total(uint16x8_t total) {
+    return (int)vaddvq_u32(vpaddlq_u16(total));
+}
+
+static int bitset_container_compute_cardinality_neon(
+    const bitset_container_t *bitset) {
+    const uint64_t *array = bitset->array;
+    // a bitset holds 512 vectors, so the counters stay below 1 << 13
+    uint16x8_t total = vdupq_n_u16(0);
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i += 4) {
+        total = neon_popcount_accumulate(total, vld1q_u64(array + i));
+        total = neon_popcount_accumulate(total, vld1q_u64(array + i + 2));
+    }
+    return neon_popcount_total(total);
+}
+#endif
+
+#ifdef BITSET_SCALAR_KERNELS
+
+static int bitset_container_compute_cardinality_scalar(
+    const bitset_container_t *bitset) {
     const uint64_t *array = bitset->array;
     int32_t sum = 0;
     for (int i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i += 4) {
@@ -190,21 +292,93 @@ int bitset_container_compute_cardinality(const bitset_container_t *bitset) {
 
 #endif
 
-#ifdef USEAVX
+/* Get the number of bits set (force computation) */
+int bitset_container_compute_cardinality(const bitset_container_t *bitset) {
+    return BITSET_KERNEL(compute_cardinality)(bitset);
+}
+
+#ifdef BITSET_AVX2_KERNELS
 
 #define BITSET_CONTAINER_FN_REPEAT 8
 #define WORDS_IN_AVX2_REG sizeof(__m256i) / sizeof(uint64_t)
 #define LOOP_SIZE                    \
     BITSET_CONTAINER_SIZE_IN_WORDS / \
         (WORDS_IN_AVX2_REG * BITSET_CONTAINER_FN_REPEAT)
+#endif
+
+#ifdef BITSET_AVX512_KERNELS
+
+#define WORDS_IN_AVX512_REG (sizeof(__m512i) / sizeof(uint64_t))
+
+/* Computes a binary operation (eg union) on bitset1 and bitset2 and write the
+   result to bitsetout, 512 bits at a time, counting with VPOPCNTDQ */
+// clang-format off
+#define BITSET_CONTAINER_FN_AVX512(opname, avx512_intrinsic)             \
+BITSET_AVX512_KERNEL int bitset_container_##opname##_nocard_avx512(       \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    uint64_t *out = dst->array;                                           \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS;                \
+         i += 2 * WORDS_IN_AVX512_REG) {                                  \
+        __m512i A1 = _mm512_loadu_si512(array_1 + i);                     \
+        __m512i A2 = _mm512_loadu_si512(array_2 + i);                     \
+        _mm512_storeu_si512(out + i, avx512_intrinsic(A2, A1));           \
+        A1 = _mm512_loadu_si512(array_1 + i + WORDS_IN_AVX512_REG);       \
+        A2 = _mm512_loadu_si512(array_2 + i + WORDS_IN_AVX512_REG);       \
+        _mm512_storeu_si512(out + i + WORDS_IN_AVX512_REG,                \
+                            avx512_intrinsic(A2, A1));                    \
+    }                                                                     \
+    dst->cardinality = BITSET_UNKNOWN_CARDINALITY;                        \
+    return dst->cardinality;                                              \
+}                                                                         \
+/* next, a version that updates cardinality*/                             \
+BITSET_AVX512_KERNEL int bitset_container_##opname##_avx512(              \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    uint64_t *out = dst->array;                                           \
+    __m512i total = _mm512_setzero_si512();                               \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS;                \
+         i += WORDS_IN_AVX512_REG) {                                      \
+        const __m512i A = avx512_intrinsic(_mm512_loadu_si512(array_2 + i), \
+                                           _mm512_loadu_si512(array_1 + i)); \
+        _mm512_storeu_si512(out + i, A);                                  \
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(A));          \
+    }                                                                     \
+    dst->cardinality = (int32_t)_mm512_reduce_add_epi64(total);           \
+    return dst->cardinality;                                              \
+}                                                                         \
+/* next, a version that just computes the cardinality*/                   \
+BITSET_AVX512_KERNEL int bitset_container_##opname##_justcard_avx512(     \
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {   \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    __m512i total = _mm512_setzero_si512();                               \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS;                \
+         i += WORDS_IN_AVX512_REG) {                                      \
+        const __m512i A = avx512_intrinsic(_mm512_loadu_si512(array_2 + i), \
+                                           _mm512_loadu_si512(array_1 + i)); \
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(A));          \
+    }                                                                     \
+    return (int)_mm512_reduce_add_epi64(total);                           \
+}
+// clang-format on
+#else
+#define BITSET_CONTAINER_FN_AVX512(opname, avx512_intrinsic)
+#endif
+
+#ifdef BITSET_AVX2_KERNELS
 
 /* Computes a binary operation (eg union) on bitset1 and bitset2 and write the
    result to bitsetout */
 // clang-format off
-#define BITSET_CONTAINER_FN(opname, opsymbol, avx_intrinsic)            \
-int bitset_container_##opname##_nocard(const bitset_container_t *src_1, \
-                                       const bitset_container_t *src_2, \
-                                       bitset_container_t *dst) {       \
+#define BITSET_CONTAINER_FN_AVX2(opname, avx_intrinsic)                \
+BITSET_AVX2_KERNEL int bitset_container_##opname##_nocard_avx2(           \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
     const uint8_t *array_1 = (const uint8_t *)src_1->array;             \
     const uint8_t *array_2 = (const uint8_t *)src_2->array;             \
     /* not using the blocking optimization for some reason*/            \
@@ -254,9 +428,9 @@ int bitset_container_##opname##_nocard(const bitset_container_t *src_1, \
     return dst->cardinality;                                            \
 }                                                                       \
 /* next, a version that updates cardinality*/                           \
-int bitset_container_##opname(const bitset_container_t *src_1,          \
-                              const bitset_container_t *src_2,          \
-                              bitset_container_t *dst) {                \
+BITSET_AVX2_KERNEL int bitset_container_##opname##_avx2(                  \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
     const uint64_t *array_1 = src_1->array;                             \
     const uint64_t *array_2 = src_2->array;                             \
     uint64_t *out = dst->array;                                         \
@@ -323,8 +497,8 @@ int bitset_container_##opname(const bitset_container_t *src_1,          \
     return dst->cardinality;                                            \
 }                                                                       \
 /* next, a version that just computes the cardinality*/                 \
-int bitset_container_##opname##_justcard(const bitset_container_t *src_1, \
-                              const bitset_container_t *src_2) {        \
+BITSET_AVX2_KERNEL int bitset_container_##opname##_justcard_avx2(         \
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {   \
     const uint64_t *array_1 = src_1->array;                             \
     const uint64_t *array_2 = src_2->array;                             \
     const __m256i shuf =                                                \
@@ -388,12 +562,79 @@ int bitset_container_##opname##_justcard(const bitset_container_t *src_1, \
 
 
 
-#else /* not USEAVX  */
+#else
+#define BITSET_CONTAINER_FN_AVX2(opname, avx_intrinsic)
+#endif
+
+#ifdef BITSET_NEON_KERNELS
 
-#define BITSET_CONTAINER_FN(opname, opsymbol, avxintrinsic)               \
-int bitset_container_##opname(const bitset_container_t *src_1,            \
-                              const bitset_container_t *src_2,            \
-                              bitset_container_t *dst) {                  \
+/* Computes a binary operation (eg union) on bitset1 and bitset2 and write the
+   result to bitsetout, 128 bits at a time */
+// clang-format off
+#define BITSET_CONTAINER_FN_NEON(opname, neon_intrinsic)                 \
+static int bitset_container_##opname##_nocard_neon(                       \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    uint64_t *out = dst->array;                                           \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i += 4) {      \
+        vst1q_u64(out + i, neon_intrinsic(vld1q_u64(array_1 + i),         \
+                                          vld1q_u64(array_2 + i)));       \
+        vst1q_u64(out + i + 2, neon_intrinsic(vld1q_u64(array_1 + i + 2), \
+                                              vld1q_u64(array_2 + i + 2))); \
+    }                                                                     \
+    dst->cardinality = BITSET_UNKNOWN_CARDINALITY;                        \
+    return dst->cardinality;                                              \
+}                                                                         \
+/* next, a version that updates cardinality*/                             \
+static int bitset_container_##opname##_neon(                              \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    uint64_t *out = dst->array;                                           \
+    uint16x8_t total = vdupq_n_u16(0);                                    \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i += 4) {      \
+        const uint64x2_t A1 = neon_intrinsic(vld1q_u64(array_1 + i),      \
+                                             vld1q_u64(array_2 + i));     \
+        const uint64x2_t A2 = neon_intrinsic(vld1q_u64(array_1 + i + 2),  \
+                                             vld1q_u64(array_2 + i + 2)); \
+        vst1q_u64(out + i, A1);                                           \
+        vst1q_u64(out + i + 2, A2);                                       \
+        total = neon_popcount_accumulate(total, A1);                      \
+        total = neon_popcount_accumulate(total, A2);                      \
+    }                                                                     \
+    dst->cardinality = neon_popcount_total(total);                        \
+    return dst->cardinality;                                              \
+}                                                                         \
+/* next, a version that just computes the cardinality*/                   \
+static int bitset_container_##opname##_justcard_neon(                     \
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {   \
+    const uint64_t *array_1 = src_1->array;                               \
+    const uint64_t *array_2 = src_2->array;                               \
+    uint16x8_t total = vdupq_n_u16(0);                                    \
+    for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i += 4) {      \
+        total = neon_popcount_accumulate(                                 \
+            total, neon_intrinsic(vld1q_u64(array_1 + i),                 \
+                                  vld1q_u64(array_2 + i)));               \
+        total = neon_popcount_accumulate(                                 \
+            total, neon_intrinsic(vld1q_u64(array_1 + i + 2),             \
+                                  vld1q_u64(array_2 + i + 2)));           \
+    }                                                                     \
+    return neon_popcount_total(total);                                    \
+}
+// clang-format on
+#else
+#define BITSET_CONTAINER_FN_NEON(opname, neon_intrinsic)
+#endif
+
+#ifdef BITSET_SCALAR_KERNELS
+
+#define BITSET_CONTAINER_FN_SCALAR(opname, opsymbol)                     \
+static int bitset_container_##opname##_scalar(                            \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
     const uint64_t *array_1 = src_1->array;                               \
     const uint64_t *array_2 = src_2->array;                               \
     uint64_t *out = dst->array;                                           \
@@ -409,9 +650,9 @@ int bitset_container_##opname(const bitset_container_t *src_1,            \
     dst->cardinality = sum;                                               \
     return dst->cardinality;                                              \
 }                                                                         \
-int bitset_container_##opname##_nocard(const bitset_container_t *src_1,   \
-                                       const bitset_container_t *src_2,   \
-                                       bitset_container_t *dst) {         \
+static int bitset_container_##opname##_nocard_scalar(                     \
+    const bitset_container_t *src_1, const bitset_container_t *src_2,     \
+    bitset_container_t *dst) {                                            \
     const uint64_t *array_1 = src_1->array, *array_2 = src_2->array;      \
     uint64_t *out = dst->array;                                           \
     for (size_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; i++) {         \
@@ -420,8 +661,8 @@ int bitset_container_##opname##_nocard(const bitset_container_t *src_1,   \
     dst->cardinality = BITSET_UNKNOWN_CARDINALITY;                                                \
     return dst->cardinality;                                              \
 }                                                                         \
-int bitset_container_##opname##_justcard(const bitset_container_t *src_1,   \
-                              const bitset_container_t *src_2) {          \
+static int bitset_container_##opname##_justcard_scalar(                   \
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {   \
     const uint64_t *array_1 = src_1->array;                               \
     const uint64_t *array_2 = src_2->array;                               \
     int32_t sum = 0;                                                      \
@@ -434,36 +675,212 @@ int bitset_container_##opname##_justcard(const bitset_container_t *src_1,   \
     return sum;                                                           \
 }
 
+#else
+#define BITSET_CONTAINER_FN_SCALAR(opname, opsymbol)
 #endif
 
+/* Instantiates the compiled kernels of a binary operation, along with the
+   public functions calling them */
+#define BITSET_CONTAINER_FN(opname, opsymbol, avx_intrinsic,              \
+                            avx512_intrinsic, neon_intrinsic)             \
+BITSET_CONTAINER_FN_AVX512(opname, avx512_intrinsic)                      \
+BITSET_CONTAINER_FN_AVX2(opname, avx_intrinsic)                           \
+BITSET_CONTAINER_FN_NEON(opname, neon_intrinsic)                          \
+BITSET_CONTAINER_FN_SCALAR(opname, opsymbol)                              \
+int bitset_container_##opname(const bitset_container_t *src_1,            \
+                              const bitset_container_t *src_2,            \
+                              bitset_container_t *dst) {                  \
+    return BITSET_KERNEL(opname)(src_1, src_2, dst);                      \
+}                                                                         \
+int bitset_container_##opname##_nocard(const bitset_container_t *src_1,   \
+                                       const bitset_container_t *src_2,   \
+                                       bitset_container_t *dst) {         \
+    return BITSET_KERNEL(opname##_nocard)(src_1, src_2, dst);             \
+}                                                                         \
+int bitset_container_##opname##_justcard(const bitset_container_t *src_1, \
+                                         const bitset_container_t *src_2) { \
+    return BITSET_KERNEL(opname##_justcard)(src_1, src_2);                \
+}
+
 // we duplicate the function because other containers use the "or" term, makes API more consistent
-BITSET_CONTAINER_FN(or, |, _mm256_or_si256)
-BITSET_CONTAINER_FN(union, |, _mm256_or_si256)
+BITSET_CONTAINER_FN(or, |, _mm256_or_si256, _mm512_or_si512, vorrq_u64)
+BITSET_CONTAINER_FN(union, |, _mm256_or_si256, _mm512_or_si512, vorrq_u64)
 
 // we duplicate the function because other containers use the "intersection" term, makes API more consistent
-BITSET_CONTAINER_FN(and, &, _mm256_and_si256)
-BITSET_CONTAINER_FN(intersection, &, _mm256_and_si256)
+BITSET_CONTAINER_FN(and, &, _mm256_and_si256, _mm512_and_si512, vandq_u64)
+BITSET_CONTAINER_FN(intersection, &, _mm256_and_si256, _mm512_and_si512,
+                    vandq_u64)
 
-BITSET_CONTAINER_FN(xor, ^, _mm256_xor_si256)
-BITSET_CONTAINER_FN(andnot, &~, _mm256_andnot_si256)
+BITSET_CONTAINER_FN(xor, ^, _mm256_xor_si256, _mm512_xor_si512, veorq_u64)
+// vbicq_u64(a, b) is a & ~b
+BITSET_CONTAINER_FN(andnot, &~, _mm256_andnot_si256, _mm512_andnot_si512,
+                    vbicq_u64)
 // clang-format On
 
+#ifdef BITSET_AVX512_KERNELS
+BITSET_AVX512_KERNEL bool bitset_container_intersect_avx512(
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {
+    const uint64_t *array_1 = src_1->array;
+    const uint64_t *array_2 = src_2->array;
+    for (size_t idx = 0; idx < BITSET_CONTAINER_SIZE_IN_WORDS;
+         idx += 2 * WORDS_IN_AVX512_REG) {
+        const __m512i acc = _mm512_or_si512(
+            _mm512_and_si512(_mm512_loadu_si512(array_1 + idx),
+                             _mm512_loadu_si512(array_2 + idx)),
+            _mm512_and_si512(
+                _mm512_loadu_si512(array_1 + idx + WORDS_IN_AVX512_REG),
+                _mm512_loadu_si512(array_2 + idx + WORDS_IN_AVX512_REG)));
+        if (_mm512_test_epi64_mask(acc, acc) != 0) return true;
+    }
+    return false;
+}
 
-#ifdef USEAVX
-#define USEAVX2FORDECODING// optimization
+static int bitset_container_to_uint32_array_avx512(
+    uint32_t *out, const bitset_container_t *cont, uint32_t base) {
+    // the compress-based decoder is fast at any density
+    return (int)bitset_extract_setbits_avx512(
+        cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out, cont->cardinality,
+        base);
+}
 #endif
 
-int bitset_container_to_uint32_array( uint32_t *out, const bitset_container_t *cont, uint32_t base) {
-#ifdef USEAVX2FORDECODING
-	if(cont->cardinality >= 8192)// heuristic
-		return (int) bitset_extract_setbits_avx2(cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out,cont->cardinality,base);
-	else
-		return (int) bitset_extract_setbits(cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out,base);
-#else
-	return (int) bitset_extract_setbits(cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out,base);
+#ifdef BITSET_AVX2_KERNELS
+BITSET_AVX2_KERNEL bool bitset_container_intersect_avx2(
+    const bitset_container_t *src_1, const bitset_container_t *src_2) {
+    const uint64_t *array_1 = src_1->array;
+    const uint64_t *array_2 = src_2->array;
+    for (size_t idx = 0; idx < BITSET_CONTAINER_SIZE_IN_WORDS;
+         idx += 4 * WORDS_IN_AVX2_REG) {
+        __m256i A1, A2, acc;
+        A1 = _mm256_lddqu_si256((const __m256i *)(array_1 + idx));
+        A2 = _mm256_lddqu_si256((const __m256i *)(array_2 + idx));
+        acc = _mm256_and_si256(A1, A2);
+        A1 = _mm256_lddqu_si256((const __m256i *)(array_1 + idx + 4));
+        A2 = _mm256_lddqu_si256((const __m256i *)(array_2 + idx + 4));
+        acc = _mm256_or_si256(acc, _mm256_and_si256(A1, A2));
+        A1 = _mm256_lddqu_si256((const __m256i *)(array_1 + idx + 8));
+        A2 = _mm256_lddqu_si256((const __m256i *)(array_2 + idx + 8));
+        acc = _mm256_or_si256(acc, _mm256_and_si256(A1, A2));
+        A1 = _mm256_lddqu_si256((const __m256i *)(array_1 + idx + 12));
+        A2 = _mm256_lddqu_si256((const __m256i *)(array_2 + idx + 12));
+        acc = _mm256_or_si256(acc, _mm256_and_si256(A1, A2));
+        if (!_mm256_testz_si256(acc, acc)) return true;
+    }
+    return false;
+}
+
+static int bitset_container_to_uint32_array_avx2(
+    uint32_t *out, const bitset_container_t *cont, uint32_t base) {
+    if (cont->cardinality >= 8192)  // heuristic
+        return (int)bitset_extract_setbits_avx2(
+            cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out,
+            cont->cardinality, base);
+    else
+        return (int)bitset_extract_setbits(
+            cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out, base);
+}
+#endif
+
+#ifdef BITSET_NEON_KERNELS
+static bool bitset_container_intersect_neon(const bitset_container_t *src_1,
+                                            const bitset_container_t *src_2) {
+    const uint64_t *array_1 = src_1->array;
+    const uint64_t *array_2 = src_2->array;
+    for (size_t idx = 0; idx < BITSET_CONTAINER_SIZE_IN_WORDS; idx += 8) {
+        uint64x2_t acc = vandq_u64(vld1q_u64(array_1 + idx),
+                                   vld1q_u64(array_2 + idx));
+        acc = vorrq_u64(acc, vandq_u64(vld1q_u64(array_1 + idx + 2),
+                                       vld1q_u64(array_2 + idx + 2)));
+        acc = vorrq_u64(acc, vandq_u64(vld1q_u64(array_1 + idx + 4),
+                                       vld1q_u64(array_2 + idx + 4)));
+        acc = vorrq_u64(acc, vandq_u64(vld1q_u64(array_1 + idx + 6),
+                                       vld1q_u64(array_2 + idx + 6)));
+        if (vmaxvq_u32(vreinterpretq_u32_u64(acc)) != 0) return true;
+    }
+    return false;
+}
+
+static int bitset_container_to_uint32_array_neon(
+    uint32_t *out, const bitset_container_t *cont, uint32_t base) {
+    if (cont->cardinality >= 8192)  // heuristic
+        return (int)bitset_extract_setbits_neon(
+            cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out,
+            cont->cardinality, base);
+    else
+        return (int)bitset_extract_setbits(
+            cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out, base);
+}
 #endif
+
+#ifdef BITSET_SCALAR_KERNELS
+static bool bitset_container_intersect_scalar(const bitset_container_t *src_1,
+                                              const bitset_container_t *src_2) {
+    const uint64_t *array_1 = src_1->array;
+    const uint64_t *array_2 = src_2->array;
+    for (int32_t i = 0; i < BITSET_CONTAINER_SIZE_IN_WORDS; ++i) {
+        if ((array_1[i] & array_2[i]) != 0) return true;
+    }
+    return false;
+}
+
+static int bitset_container_to_uint32_array_scalar(
+    uint32_t *out, const bitset_container_t *cont, uint32_t base) {
+    return (int)bitset_extract_setbits(
+        cont->array, BITSET_CONTAINER_SIZE_IN_WORDS, out, base);
+}
+#endif
+
+/* Check whether src_1 and src_2 have a common element, stopping early. */
+bool bitset_container_intersect(const bitset_container_t *src_1,
+                                const bitset_container_t *src_2) {
+    return BITSET_KERNEL(intersect)(src_1, src_2);
 }
 
+int bitset_container_to_uint32_array( uint32_t *out, const bitset_container_t *cont, uint32_t base) {
+	return BITSET_KERNEL(to_uint32_array)(out, cont, base);
+}
+
+#ifdef ROARING_DISPATCH
+#define BITSET_OP_KERNELS(opname, family)                              \
+    bitset_container_##opname##_##family,                              \
+        bitset_container_##opname##_nocard_##family,                   \
+        bitset_container_##opname##_justcard_##family
+
+#define BITSET_KERNELS(family)                                          \
+    {                                                                   \
+        bitset_container_compute_cardinality_##family,                  \
+            bitset_container_intersect_##family,                        \
+            bitset_container_to_uint32_array_##family,                  \
+            BITSET_OP_KERNELS(or, family), BITSET_OP_KERNELS(union, family), \
+            BITSET_OP_KERNELS(and, family),                             \
+            BITSET_OP_KERNELS(intersection, family),                    \
+            BITSET_OP_KERNELS(xor, family), BITSET_OP_KERNELS(andnot, family) \
+    }
+
+static const bitset_kernels_t bitset_kernels_avx512 = BITSET_KERNELS(avx512);
+static const bitset_kernels_t bitset_kernels_avx2 = BITSET_KERNELS(avx2);
+static const bitset_kernels_t bitset_kernels_scalar = BITSET_KERNELS(scalar);
+
+/* Picks the kernel table on first use. Concurrent first calls all store the
+ * same pointer, atomically. */
+static const bitset_kernels_t *bitset_kernels(void) {
+    static const bitset_kernels_t *kernels = NULL;
+    const bitset_kernels_t *answer =
+        __atomic_load_n(&kernels, __ATOMIC_RELAXED);
+    if (answer == NULL) {
+        const int support = roaring_hardware_support();
+        if (support & ROARING_SUPPORTS_AVX512)
+            answer = &bitset_kernels_avx512;
+        else if (support & ROARING_SUPPORTS_AVX2)
+            answer = &bitset_kernels_avx2;
+        else
+            answer = &bitset_kernels_scalar;
+        __atomic_store_n(&kernels, answer, __ATOMIC_RELAXED);
+    }
+    return answer;
+}
+#endif
+
 /*
  * Print this container using printf (useful for debugging).
  */
@@ -575,11 +992,13 @@ void* bitset_container_deserialize(const char *buf, size_t buf_len) {
   if(l != buf_len)
     return(NULL);
 
-  if((ptr = (bitset_container_t *)malloc(sizeof(bitset_container_t))) != NULL) {
+  ptr = (bitset_container_t *)roaring_malloc(sizeof(bitset_container_t));
+  if(ptr != NULL) {
     memcpy(ptr, buf, sizeof(bitset_container_t));
     // sizeof(__m256i) == 32
-    if(posix_memalign((void **)&ptr->array, 32, l)) {
-      free(ptr);
+    ptr->array = roaring_aligned_malloc(32, l);
+    if(ptr->array == NULL) {
+      roaring_free(ptr);
       return(NULL);
     }
 
@@ -648,3 +1067,18 @@ bool bitset_container_select(const bitset_container_t *container, uint32_t *star
     assert(false);
     __builtin_unreachable();
 }
+
+/* Returns the number of values equal or smaller than x */
+int bitset_container_rank(const bitset_container_t *container, uint16_t x) {
+    const uint64_t *array = container->array;
+    int sum = 0;
+    int i = 0;
+    for (int end = x / 64; i < end; i++) {
+        sum += hamming(array[i]);
+    }
+    uint64_t lastword = array[i];
+    uint64_t lastpos = UINT64_C(1) << (x % 64);
+    uint64_t mask = lastpos + lastpos - 1;  // smear right
+    sum += hamming(lastword & mask);
+    return sum;
+}
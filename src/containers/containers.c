@@ -1,5 +1,10 @@
 
 #include <roaring/containers/containers.h>
+#include <roaring/memory.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
 
 extern const char *get_container_name(uint8_t typecode);
 
@@ -135,18 +140,52 @@ extern void *container_or(const void *c1, uint8_t type1, const void *c2,
 extern void *container_xor(const void *c1, uint8_t type1, const void *c2,
                            uint8_t type2, uint8_t *result_type);
 
+/*
+ * The counter of a shared container is updated atomically, so that the
+ * bitmaps sharing it can be copied and freed from different threads. Only a
+ * holder of a reference may add one, so a count of one means that the caller
+ * is the sole owner.
+ */
+static inline void shared_counter_increment(shared_container_t *container) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    _InterlockedIncrement((volatile long *)&container->counter);
+#else
+    __atomic_fetch_add(&container->counter, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Returns the new count. Releases our writes, acquires the others' at 0. */
+static inline uint32_t shared_counter_decrement(
+    shared_container_t *container) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedDecrement(
+        (volatile long *)&container->counter);
+#else
+    return __atomic_sub_fetch(&container->counter, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static inline uint32_t shared_counter_load(shared_container_t *container) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedOr((volatile long *)&container->counter, 0);
+#else
+    return __atomic_load_n(&container->counter, __ATOMIC_ACQUIRE);
+#endif
+}
+
 void *get_copy_of_container(void *container, uint8_t *typecode,
                             bool copy_on_write) {
     if (copy_on_write) {
         shared_container_t *shared_container;
         if (*typecode == SHARED_CONTAINER_TYPE_CODE) {
             shared_container = (shared_container_t *)container;
-            shared_container->counter += 1;
+            shared_counter_increment(shared_container);
             return shared_container;
         }
         assert(*typecode != SHARED_CONTAINER_TYPE_CODE);
 
-        if ((shared_container = malloc(sizeof(shared_container_t))) == NULL) {
+        shared_container = roaring_malloc(sizeof(shared_container_t));
+        if (shared_container == NULL) {
             return NULL;
         }
 
@@ -190,30 +229,29 @@ void *container_clone(const void *container, uint8_t typecode) {
 
 void *shared_container_extract_copy(shared_container_t *container,
                                     uint8_t *typecode) {
-    assert(container->counter > 0);
     assert(container->typecode != SHARED_CONTAINER_TYPE_CODE);
-    container->counter--;
     *typecode = container->typecode;
     void *answer;
-    if (container->counter == 0) {
+    if (shared_counter_load(container) == 1) {
         answer = container->container;
         container->container = NULL;  // paranoid
-        free(container);
+        roaring_free(container);
     } else {
+        // clone before letting go: another owner may free it right after
         answer = container_clone(container->container, *typecode);
+        shared_container_free(container);
     }
     assert(*typecode != SHARED_CONTAINER_TYPE_CODE);
     return answer;
 }
 
 void shared_container_free(shared_container_t *container) {
-    assert(container->counter > 0);
-    container->counter--;
-    if (container->counter == 0) {
+    assert(shared_counter_load(container) > 0);
+    if (shared_counter_decrement(container) == 0) {
         assert(container->typecode != SHARED_CONTAINER_TYPE_CODE);
         container_free(container->container, container->typecode);
         container->container = NULL;  // paranoid
-        free(container);
+        roaring_free(container);
     }
 }
 
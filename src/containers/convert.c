@@ -4,11 +4,13 @@
 #include <roaring/containers/containers.h>
 #include <roaring/containers/convert.h>
 #include <roaring/containers/perfparameters.h>
+#include <roaring/isadetection.h>
 
 // file contains grubby stuff that must know impl. details of all container
 // types.
 bitset_container_t *bitset_container_from_array(const array_container_t *a) {
     bitset_container_t *ans = bitset_container_create();
+    if (ans == NULL) return NULL;
     int limit = array_container_cardinality(a);
     for (int i = 0; i < limit; ++i) bitset_container_set(ans, a->array[i]);
     return ans;
@@ -17,6 +19,7 @@ bitset_container_t *bitset_container_from_array(const array_container_t *a) {
 bitset_container_t *bitset_container_from_run(const run_container_t *arr) {
     int card = run_container_cardinality(arr);
     bitset_container_t *answer = bitset_container_create();
+    if (answer == NULL) return NULL;
     for (int rlepos = 0; rlepos < arr->n_runs; ++rlepos) {
         rle16_t vl = arr->runs[rlepos];
         bitset_set_range(answer->array, vl.value, vl.value + vl.length + 1);
@@ -28,6 +31,7 @@ bitset_container_t *bitset_container_from_run(const run_container_t *arr) {
 array_container_t *array_container_from_run(const run_container_t *arr) {
     array_container_t *answer =
         array_container_create_given_capacity(run_container_cardinality(arr));
+    if (answer == NULL) return NULL;
     answer->cardinality = 0;
     for (int rlepos = 0; rlepos < arr->n_runs; ++rlepos) {
         int run_start = arr->runs[rlepos].value;
@@ -43,7 +47,21 @@ array_container_t *array_container_from_run(const run_container_t *arr) {
 array_container_t *array_container_from_bitset(const bitset_container_t *bits) {
     array_container_t *result =
         array_container_create_given_capacity(bits->cardinality);
+    if (result == NULL) return NULL;
     result->cardinality = bits->cardinality;
+#if defined(USEAVX512) || defined(ROARING_DISPATCH)
+#ifdef ROARING_DISPATCH
+    if (roaring_hardware_support() & ROARING_SUPPORTS_AVX512)
+#endif
+    {
+        // unlike the sse version, the compress-based decoder handles sparse
+        // data
+        bitset_extract_setbits_avx512_uint16(
+            bits->array, BITSET_CONTAINER_SIZE_IN_WORDS, result->array,
+            result->cardinality, 0);
+        return result;
+    }
+#endif
     //  sse version ends up being slower here
     // (bitset_extract_setbits_sse_uint16)
     // because of the sparsity of the data
@@ -3,6 +3,8 @@
  *
  */
 
+#include <string.h>
+
 #include <roaring/containers/mixed_intersection.h>
 #include <roaring/array_util.h>
 #include <roaring/bitset_util.h>
@@ -28,39 +30,81 @@ void array_bitset_container_intersection(const array_container_t *src_1,
     dst->cardinality = newcard;
 }
 
+/* Returns the index of the first run at or after pos that ends at or after
+ * min, or length if there is none. Gallops like advanceUntil, so that
+ * skipping many runs costs a logarithmic number of probes. */
+static inline int32_t run_advance_until(const rle16_t *runs, int32_t pos,
+                                        int32_t length, uint16_t min) {
+    if ((pos >= length) ||
+        ((uint32_t)runs[pos].value + runs[pos].length >= min))
+        return pos;
+    int32_t lower = pos;  // runs[lower] ends before min
+    int32_t spansize = 1;
+    while ((lower + spansize < length) &&
+           ((uint32_t)runs[lower + spansize].value +
+                runs[lower + spansize].length <
+            min)) {
+        spansize <<= 1;
+    }
+    // runs[upper] ends at or after min, or upper == length
+    int32_t upper = (lower + spansize < length) ? lower + spansize : length;
+    lower += (spansize >> 1);
+    while (lower + 1 < upper) {
+        const int32_t mid = (lower + upper) >> 1;
+        if ((uint32_t)runs[mid].value + runs[mid].length < min) {
+            lower = mid;
+        } else {
+            upper = mid;
+        }
+    }
+    return upper;
+}
+
+/* Returns the index of the first value of array, at or after pos, that lies
+ * past the run rle. array[pos] must be in the run. */
+static inline int32_t array_advance_past_run(const uint16_t *array,
+                                             int32_t pos, int32_t length,
+                                             rle16_t rle) {
+    const uint32_t end = (uint32_t)rle.value + rle.length;
+    if (end >= UINT16_MAX) return length;
+    return advanceUntil(array, pos, length, (uint16_t)(end + 1));
+}
+
 /* Compute the intersection of src_1 and src_2 and write the result to
  * dst. It is allowed for dst to be equal to src_1. We assume that dst is a
  * valid container. */
 void array_run_container_intersection(const array_container_t *src_1,
                                       const run_container_t *src_2,
                                       array_container_t *dst) {
-    if (dst->capacity < src_1->cardinality)
-        array_container_grow(dst, src_1->cardinality, INT32_MAX, false);
-    if (src_2->n_runs == 0) {
+    if (run_container_is_full(src_2)) {
+        if (dst != src_1) array_container_copy(src_1, dst);
         return;
     }
+    if (dst->capacity < src_1->cardinality)
+        array_container_grow(dst, src_1->cardinality, INT32_MAX, false);
+    // both sides gallop, so that a small array against many runs, or a
+    // few runs against a large array, costs O(small * log(large))
+    const int32_t card = src_1->cardinality;
     int32_t rlepos = 0;
     int32_t arraypos = 0;
-    rle16_t rle = src_2->runs[rlepos];
-    int32_t newcard = 0;
-    while (arraypos < src_1->cardinality) {
+    int32_t newcard = 0;  // dst could be src_1
+    while (arraypos < card) {
         const uint16_t arrayval = src_1->array[arraypos];
-        while (rle.value + rle.length <
-               arrayval) {  // this will frequently be false
-            ++rlepos;
-            if (rlepos == src_2->n_runs) {
-                dst->cardinality = newcard;
-                return;  // we are done
-            }
-            rle = src_2->runs[rlepos];
-        }
+        rlepos =
+            run_advance_until(src_2->runs, rlepos, src_2->n_runs, arrayval);
+        if (rlepos == src_2->n_runs) break;  // we are done
+        const rle16_t rle = src_2->runs[rlepos];
         if (rle.value > arrayval) {
-            arraypos = advanceUntil(src_1->array, arraypos, src_1->cardinality,
-                                    rle.value);
+            arraypos = advanceUntil(src_1->array, arraypos, card, rle.value);
         } else {
-            dst->array[newcard] = arrayval;
-            newcard++;
-            arraypos++;
+            // the values of the array within the run are contiguous
+            const int32_t endpos =
+                array_advance_past_run(src_1->array, arraypos, card, rle);
+            memmove(dst->array + newcard, src_1->array + arraypos,
+                    (endpos - arraypos) * sizeof(uint16_t));
+            newcard += endpos - arraypos;
+            arraypos = endpos;
+            rlepos++;
         }
     }
     dst->cardinality = newcard;
@@ -201,3 +245,106 @@ bool bitset_bitset_container_intersection_inplace(
     }
     return false;  // not a bitset
 }
+
+/* Compute the size of the intersection of src_1 and src_2. */
+int array_bitset_container_intersection_cardinality(
+    const array_container_t *src_1, const bitset_container_t *src_2) {
+    int32_t newcard = 0;
+    const int32_t origcard = src_1->cardinality;
+    for (int i = 0; i < origcard; ++i) {
+        uint16_t key = src_1->array[i];
+        newcard += bitset_container_contains(src_2, key);
+    }
+    return newcard;
+}
+
+/* Compute the size of the intersection of src_1 and src_2. */
+int array_run_container_intersection_cardinality(const array_container_t *src_1,
+                                                 const run_container_t *src_2) {
+    if (run_container_is_full(src_2)) {
+        return src_1->cardinality;
+    }
+    const int32_t card = src_1->cardinality;
+    int32_t rlepos = 0;
+    int32_t arraypos = 0;
+    int32_t newcard = 0;
+    while (arraypos < card) {
+        const uint16_t arrayval = src_1->array[arraypos];
+        rlepos =
+            run_advance_until(src_2->runs, rlepos, src_2->n_runs, arrayval);
+        if (rlepos == src_2->n_runs) break;  // we are done
+        const rle16_t rle = src_2->runs[rlepos];
+        if (rle.value > arrayval) {
+            arraypos = advanceUntil(src_1->array, arraypos, card, rle.value);
+        } else {
+            const int32_t endpos =
+                array_advance_past_run(src_1->array, arraypos, card, rle);
+            newcard += endpos - arraypos;
+            arraypos = endpos;
+            rlepos++;
+        }
+    }
+    return newcard;
+}
+
+/* Compute the size of the intersection  between src_1 and src_2 . */
+int run_bitset_container_intersection_cardinality(
+    const run_container_t *src_1, const bitset_container_t *src_2) {
+    if (run_container_is_full(src_1)) {
+        return bitset_container_cardinality(src_2);
+    }
+    int answer = 0;
+    for (int32_t rlepos = 0; rlepos < src_1->n_runs; ++rlepos) {
+        rle16_t rle = src_1->runs[rlepos];
+        const uint32_t endofrun = (uint32_t)rle.value + rle.length + 1;
+        answer += bitset_range_cardinality(src_2->array, rle.value, endofrun);
+    }
+    return answer;
+}
+
+/* Check whether src_1 and src_2 have a common value. */
+bool array_bitset_container_intersect(const array_container_t *src_1,
+                                      const bitset_container_t *src_2) {
+    const int32_t origcard = src_1->cardinality;
+    for (int i = 0; i < origcard; ++i) {
+        uint16_t key = src_1->array[i];
+        if (bitset_container_contains(src_2, key)) return true;
+    }
+    return false;
+}
+
+/* Check whether src_1 and src_2 have a common value. */
+bool array_run_container_intersect(const array_container_t *src_1,
+                                   const run_container_t *src_2) {
+    if (run_container_is_full(src_2)) {
+        return !array_container_empty(src_1);
+    }
+    const int32_t card = src_1->cardinality;
+    int32_t rlepos = 0;
+    int32_t arraypos = 0;
+    while (arraypos < card) {
+        const uint16_t arrayval = src_1->array[arraypos];
+        rlepos =
+            run_advance_until(src_2->runs, rlepos, src_2->n_runs, arrayval);
+        if (rlepos == src_2->n_runs) return false;  // we are done
+        const rle16_t rle = src_2->runs[rlepos];
+        if (rle.value > arrayval) {
+            arraypos = advanceUntil(src_1->array, arraypos, card, rle.value);
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Check whether src_1 and src_2 have a common value. */
+bool run_bitset_container_intersect(const run_container_t *src_1,
+                                    const bitset_container_t *src_2) {
+    for (int32_t rlepos = 0; rlepos < src_1->n_runs; ++rlepos) {
+        rle16_t rle = src_1->runs[rlepos];
+        const uint32_t endofrun = (uint32_t)rle.value + rle.length + 1;
+        if (bitset_range_nonempty(src_2->array, rle.value, endofrun))
+            return true;
+    }
+    return false;
+}
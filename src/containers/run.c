@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include <roaring/containers/run.h>
+#include <roaring/memory.h>
 #include <roaring/portability.h>
 #ifdef IS_X64
 #include <x86intrin.h>
@@ -27,11 +28,13 @@ enum { DEFAULT_INIT_SIZE = 4 };
 run_container_t *run_container_create_given_capacity(int32_t size) {
     run_container_t *run;
     /* Allocate the run container itself. */
-    if ((run = malloc(sizeof(run_container_t))) == NULL) {
+    if ((run = roaring_pool_malloc(sizeof(run_container_t))) == NULL) {
         return NULL;
     }
-    if ((run->runs = malloc(sizeof(rle16_t) * size)) == NULL) {
-        free(run);
+    // round up to a size class so the payload can be recycled
+    size = roaring_pool_round(sizeof(rle16_t) * size) / sizeof(rle16_t);
+    if ((run->runs = roaring_pool_malloc(sizeof(rle16_t) * size)) == NULL) {
+        roaring_pool_free(run, sizeof(run_container_t));
         return NULL;
     }
     run->capacity = size;
@@ -47,7 +50,6 @@ run_container_t *run_container_create(void) {
 run_container_t *run_container_clone(const run_container_t *src) {
     run_container_t *run = run_container_create_given_capacity(src->capacity);
     if (run == NULL) return NULL;
-    run->capacity = src->capacity;
     run->n_runs = src->n_runs;
     memcpy(run->runs, src->runs, src->n_runs * sizeof(rle16_t));
     return run;
@@ -55,9 +57,9 @@ run_container_t *run_container_clone(const run_container_t *src) {
 
 /* Free memory. */
 void run_container_free(run_container_t *run) {
-    free(run->runs);
+    roaring_pool_free(run->runs, sizeof(rle16_t) * run->capacity);
     run->runs = NULL;  // pedantic
-    free(run);
+    roaring_pool_free(run, sizeof(run_container_t));
 }
 
 #ifdef USEAVX
@@ -119,15 +121,16 @@ void run_container_grow(run_container_t *run, int32_t min, bool copy) {
                                  : run->capacity < 1024 ? run->capacity * 3 / 2
                                                         : run->capacity * 5 / 4;
     if (newCapacity < min) newCapacity = min;
+    const int32_t oldCapacity = run->capacity;
     run->capacity = newCapacity;
     assert(run->capacity >= min);
     if (copy) {
         rle16_t *oldruns = run->runs;
-        run->runs = realloc(oldruns, run->capacity * sizeof(rle16_t));
-        if (run->runs == NULL) free(oldruns);
+        run->runs = roaring_realloc(oldruns, run->capacity * sizeof(rle16_t));
+        if (run->runs == NULL) roaring_free(oldruns);
     } else {
-        free(run->runs);
-        run->runs = malloc(run->capacity * sizeof(rle16_t));
+        roaring_pool_free(run->runs, oldCapacity * sizeof(rle16_t));
+        run->runs = roaring_pool_malloc(run->capacity * sizeof(rle16_t));
     }
     // TODO: handle the case where realloc fails
     if (run->runs == NULL) {
@@ -257,6 +260,52 @@ bool run_container_add(run_container_t *run, uint16_t pos) {
     return true;
 }
 
+/* Add the strictly increasing `list' of `length' values to `run'. */
+bool run_container_add_many(run_container_t *run, const uint16_t *list,
+                            int32_t length) {
+    if (length == 0) return true;
+    if ((length <= 8) && (run->n_runs + length <= run->capacity)) {
+        // a few values fit without growing: insert them in place
+        for (int32_t i = 0; i < length; ++i) run_container_add(run, list[i]);
+        return true;
+    }
+    int32_t list_runs = 1;
+    for (int32_t i = 1; i < length; ++i) {
+        list_runs += (list[i] != list[i - 1] + 1);
+    }
+    // merge into a new buffer, so that `run' is untouched on failure
+    run_container_t merged;
+    merged.n_runs = 0;
+    const size_t needed = sizeof(rle16_t) * (run->n_runs + list_runs);
+    merged.capacity = (int32_t)(roaring_pool_round(needed) / sizeof(rle16_t));
+    merged.runs = roaring_pool_malloc(sizeof(rle16_t) * merged.capacity);
+    if (merged.runs == NULL) return false;
+    int32_t rlepos = 0;
+    int32_t i = 0;
+    rle16_t previousrle;
+    if ((run->n_runs > 0) && (run->runs[0].value <= list[0])) {
+        previousrle = run_container_append_first(&merged, run->runs[rlepos++]);
+    } else {
+        previousrle = run_container_append_value_first(&merged, list[i++]);
+    }
+    while ((rlepos < run->n_runs) && (i < length)) {
+        if (run->runs[rlepos].value <= list[i]) {
+            run_container_append(&merged, run->runs[rlepos++], &previousrle);
+        } else {
+            run_container_append_value(&merged, list[i++], &previousrle);
+        }
+    }
+    while (rlepos < run->n_runs) {
+        run_container_append(&merged, run->runs[rlepos++], &previousrle);
+    }
+    while (i < length) {
+        run_container_append_value(&merged, list[i++], &previousrle);
+    }
+    roaring_pool_free(run->runs, sizeof(rle16_t) * run->capacity);
+    *run = merged;
+    return true;
+}
+
 /* Remove `pos' from `run'. Returns true if `pos' was present. */
 bool run_container_remove(run_container_t *run, uint16_t pos) {
     int32_t index = interleavedBinarySearch(run->runs, run->n_runs, pos);
@@ -307,6 +356,107 @@ bool run_container_contains(const run_container_t *run, uint16_t pos) {
     return false;
 }
 
+/* Returns the index of the first run ending at or after `x', or n if none. */
+static int32_t rle16_find_run_ending_at_or_after(const rle16_t *runs,
+                                                 int32_t n, uint32_t x) {
+    int32_t low = 0, high = n;
+    while (low < high) {
+        int32_t mid = (low + high) >> 1;
+        if ((uint32_t)runs[mid].value + runs[mid].length < x) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Returns the index of the first run starting after `x', or n if none. */
+static int32_t rle16_find_run_starting_after(const rle16_t *runs, int32_t n,
+                                             uint32_t x) {
+    int32_t low = 0, high = n;
+    while (low < high) {
+        int32_t mid = (low + high) >> 1;
+        if (runs[mid].value <= x) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Add all values in [min, max] (included) to `run'. */
+void run_container_add_range(run_container_t *run, uint32_t min,
+                             uint32_t max) {
+    // runs overlapping or adjacent to [min, max] get fused with it
+    const int32_t first = rle16_find_run_ending_at_or_after(
+        run->runs, run->n_runs, min == 0 ? 0 : min - 1);
+    const int32_t last =
+        rle16_find_run_starting_after(run->runs, run->n_runs, max + 1) - 1;
+    if (first > last) {
+        makeRoomAtIndex(run, (uint16_t)first);
+        run->runs[first].value = (uint16_t)min;
+        run->runs[first].length = (uint16_t)(max - min);
+        return;
+    }
+    uint32_t newmin = run->runs[first].value;
+    uint32_t newmax =
+        (uint32_t)run->runs[last].value + run->runs[last].length;
+    if (min < newmin) newmin = min;
+    if (max > newmax) newmax = max;
+    run->runs[first].value = (uint16_t)newmin;
+    run->runs[first].length = (uint16_t)(newmax - newmin);
+    memmove(run->runs + first + 1, run->runs + last + 1,
+            (run->n_runs - last - 1) * sizeof(rle16_t));
+    run->n_runs -= last - first;
+}
+
+/* Remove all values in [min, max] (included) from `run'. */
+void run_container_remove_range(run_container_t *run, uint32_t min,
+                                uint32_t max) {
+    const int32_t first =
+        rle16_find_run_ending_at_or_after(run->runs, run->n_runs, min);
+    const int32_t last =
+        rle16_find_run_starting_after(run->runs, run->n_runs, max) - 1;
+    if (first > last) return;
+    // at most a head of the first run and a tail of the last run survive
+    const uint32_t first_start = run->runs[first].value;
+    const uint32_t last_end =
+        (uint32_t)run->runs[last].value + run->runs[last].length;
+    rle16_t kept[2];
+    int32_t nkept = 0;
+    if (first_start < min) {
+        kept[nkept].value = (uint16_t)first_start;
+        kept[nkept].length = (uint16_t)(min - 1 - first_start);
+        nkept++;
+    }
+    if (last_end > max) {
+        kept[nkept].value = (uint16_t)(max + 1);
+        kept[nkept].length = (uint16_t)(last_end - max - 1);
+        nkept++;
+    }
+    const int32_t nremoved = last - first + 1;
+    if (nkept > nremoved) {  // a single run is split in two
+        makeRoomAtIndex(run, (uint16_t)first);
+    } else {
+        memmove(run->runs + first + nkept, run->runs + last + 1,
+                (run->n_runs - last - 1) * sizeof(rle16_t));
+        run->n_runs -= nremoved - nkept;
+    }
+    memcpy(run->runs + first, kept, nkept * sizeof(rle16_t));
+}
+
+/* Check whether all values in [min, max] (included) are present in `run'. */
+bool run_container_contains_range(const run_container_t *run, uint32_t min,
+                                  uint32_t max) {
+    int32_t index =
+        interleavedBinarySearch(run->runs, run->n_runs, (uint16_t)min);
+    if (index < 0) index = -index - 2;  // preceding run, possibly -1
+    if (index < 0) return false;
+    return (uint32_t)run->runs[index].value + run->runs[index].length >= max;
+}
+
 /* Compute the union of `src_1' and `src_2' and write the result to `dst'
  * It is assumed that `dst' is distinct from both `src_1' and `src_2'. */
 void run_container_union(const run_container_t *src_1,
@@ -542,6 +692,107 @@ void run_container_intersection(const run_container_t *src_1,
     }
 }
 
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_container_intersection_cardinality(const run_container_t *src_1,
+                                           const run_container_t *src_2) {
+    const bool if1 = run_container_is_full(src_1);
+    const bool if2 = run_container_is_full(src_2);
+    if (if1 || if2) {
+        if (if1) {
+            return run_container_cardinality(src_2);
+        }
+        if (if2) {
+            return run_container_cardinality(src_1);
+        }
+    }
+    int answer = 0;
+    int32_t rlepos = 0;
+    int32_t xrlepos = 0;
+    int32_t start = src_1->runs[rlepos].value;
+    int32_t end = start + src_1->runs[rlepos].length + 1;
+    int32_t xstart = src_2->runs[xrlepos].value;
+    int32_t xend = xstart + src_2->runs[xrlepos].length + 1;
+    while ((rlepos < src_1->n_runs) && (xrlepos < src_2->n_runs)) {
+        if (end <= xstart) {
+            ++rlepos;
+            if (rlepos < src_1->n_runs) {
+                start = src_1->runs[rlepos].value;
+                end = start + src_1->runs[rlepos].length + 1;
+            }
+        } else if (xend <= start) {
+            ++xrlepos;
+            if (xrlepos < src_2->n_runs) {
+                xstart = src_2->runs[xrlepos].value;
+                xend = xstart + src_2->runs[xrlepos].length + 1;
+            }
+        } else {  // they overlap
+            const int32_t lateststart = start > xstart ? start : xstart;
+            int32_t earliestend;
+            if (end == xend) {  // improbable
+                earliestend = end;
+                rlepos++;
+                xrlepos++;
+                if (rlepos < src_1->n_runs) {
+                    start = src_1->runs[rlepos].value;
+                    end = start + src_1->runs[rlepos].length + 1;
+                }
+                if (xrlepos < src_2->n_runs) {
+                    xstart = src_2->runs[xrlepos].value;
+                    xend = xstart + src_2->runs[xrlepos].length + 1;
+                }
+            } else if (end < xend) {
+                earliestend = end;
+                rlepos++;
+                if (rlepos < src_1->n_runs) {
+                    start = src_1->runs[rlepos].value;
+                    end = start + src_1->runs[rlepos].length + 1;
+                }
+
+            } else {  // end > xend
+                earliestend = xend;
+                xrlepos++;
+                if (xrlepos < src_2->n_runs) {
+                    xstart = src_2->runs[xrlepos].value;
+                    xend = xstart + src_2->runs[xrlepos].length + 1;
+                }
+            }
+            answer += earliestend - lateststart;
+        }
+    }
+    return answer;
+}
+
+/* Check whether src_1 and src_2 have a common value. */
+bool run_container_intersect(const run_container_t *src_1,
+                             const run_container_t *src_2) {
+    const bool if1 = run_container_is_full(src_1);
+    const bool if2 = run_container_is_full(src_2);
+    if (if1 || if2) {
+        if (if1) {
+            return run_container_nonzero_cardinality(src_2);
+        }
+        if (if2) {
+            return run_container_nonzero_cardinality(src_1);
+        }
+    }
+    int32_t rlepos = 0;
+    int32_t xrlepos = 0;
+    while ((rlepos < src_1->n_runs) && (xrlepos < src_2->n_runs)) {
+        const int32_t start = src_1->runs[rlepos].value;
+        const int32_t end = start + src_1->runs[rlepos].length + 1;
+        const int32_t xstart = src_2->runs[xrlepos].value;
+        const int32_t xend = xstart + src_2->runs[xrlepos].length + 1;
+        if (end <= xstart) {
+            ++rlepos;
+        } else if (xend <= start) {
+            ++xrlepos;
+        } else {  // they overlap
+            return true;
+        }
+    }
+    return false;
+}
+
 /* Compute the difference of src_1 and src_2 and write the result to
  * dst. It is assumed that dst is distinct from both src_1 and src_2. */
 void run_container_andnot(const run_container_t *src_1,
@@ -704,7 +955,7 @@ void *run_container_deserialize(const char *buf, size_t buf_len) {
     else
         buf_len -= 8;
 
-    if ((ptr = malloc(sizeof(run_container_t))) != NULL) {
+    if ((ptr = roaring_malloc(sizeof(run_container_t))) != NULL) {
         size_t len;
         int32_t off;
 
@@ -713,14 +964,15 @@ void *run_container_deserialize(const char *buf, size_t buf_len) {
         off += 4;
 
         len = sizeof(rle16_t) * ptr->n_runs;
+        ptr->capacity = ptr->n_runs;  // the size of the payload allocated below
 
         if (len != buf_len) {
-            free(ptr);
+            roaring_free(ptr);
             return (NULL);
         }
 
-        if ((ptr->runs = malloc(len)) == NULL) {
-            free(ptr);
+        if ((ptr->runs = roaring_malloc(len)) == NULL) {
+            roaring_free(ptr);
             return (NULL);
         }
 
@@ -729,8 +981,8 @@ void *run_container_deserialize(const char *buf, size_t buf_len) {
         /* Check if returned values are monotonically increasing */
         for (int32_t i = 0, j = 0; i < ptr->n_runs; i++) {
             if (ptr->runs[i].value < j) {
-                free(ptr->runs);
-                free(ptr);
+                roaring_free(ptr->runs);
+                roaring_free(ptr);
                 return (NULL);
             } else
                 j = ptr->runs[i].value;
@@ -831,3 +1083,21 @@ bool run_container_select(const run_container_t *container,
     }
     return false;
 }
+
+/* Returns the number of values equal or smaller than x */
+int run_container_rank(const run_container_t *container, uint16_t x) {
+    int sum = 0;
+    uint32_t x32 = x;
+    for (int i = 0; i < container->n_runs; i++) {
+        uint32_t startpoint = container->runs[i].value;
+        uint32_t length = container->runs[i].length;
+        uint32_t endpoint = length + startpoint;
+        if (x32 <= endpoint) {
+            if (x32 < startpoint) break;
+            return sum + (x32 - startpoint) + 1;
+        } else {
+            sum += length + 1;
+        }
+    }
+    return sum;
+}
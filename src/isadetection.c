@@ -0,0 +1,72 @@
+/*
+ * isadetection.c
+ *
+ */
+
+#include <stdbool.h>
+
+#include <roaring/isadetection.h>
+
+#if defined(IS_X64) && defined(__GNUC__)
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                         uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+/* Reads the XCR0 register: which register states the OS saves and restores */
+static inline uint64_t xgetbv(void) {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+}
+
+static int detect_hardware_support(void) {
+    uint32_t eax, ebx, ecx, edx;
+    int answer = 0;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    const uint32_t max_leaf = eax;
+    if (max_leaf < 1) return 0;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    const bool sse42 = (ecx & (1 << 20)) != 0;
+    const bool popcnt = (ecx & (1 << 23)) != 0;
+    const bool osxsave = (ecx & (1 << 27)) != 0;
+    if (sse42 && popcnt) answer |= ROARING_SUPPORTS_SSE42;
+    if (!osxsave || (max_leaf < 7)) return answer;
+    const uint64_t xcr0 = xgetbv();
+    // XMM and YMM state, then opmask and ZMM state
+    const bool os_avx = (xcr0 & 0x6) == 0x6;
+    const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+    cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+    const bool bmi1 = (ebx & (1 << 3)) != 0;
+    const bool avx2 = (ebx & (1 << 5)) != 0;
+    const bool bmi2 = (ebx & (1 << 8)) != 0;
+    const bool avx512f = (ebx & (1 << 16)) != 0;
+    const bool avx512vpopcntdq = (ecx & (1 << 14)) != 0;
+    if ((answer & ROARING_SUPPORTS_SSE42) && os_avx && avx2 && bmi1 && bmi2) {
+        answer |= ROARING_SUPPORTS_AVX2;
+        if (os_avx512 && avx512f && avx512vpopcntdq)
+            answer |= ROARING_SUPPORTS_AVX512;
+    }
+    return answer;
+}
+
+int roaring_hardware_support(void) {
+    // concurrent first calls all store the same value; the accesses are
+    // atomic so that this is not a data race
+    static int support = -1;
+    int answer = __atomic_load_n(&support, __ATOMIC_RELAXED);
+    if (answer < 0) {
+        answer = detect_hardware_support();
+        __atomic_store_n(&support, answer, __ATOMIC_RELAXED);
+    }
+    return answer;
+}
+
+#else
+
+int roaring_hardware_support(void) { return 0; }
+
+#endif
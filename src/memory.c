@@ -0,0 +1,174 @@
+/*
+ * memory.c
+ *
+ */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <roaring/memory.h>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+static void *default_aligned_malloc(size_t alignment, size_t size) {
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, alignment);
+#else
+    void *p;
+    if (posix_memalign(&p, alignment, size) != 0) return NULL;
+    return p;
+#endif
+}
+
+static void default_aligned_free(void *ptr) {
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+static const roaring_memory_t default_memory_hook = {
+    malloc, realloc, calloc, free, default_aligned_malloc,
+    default_aligned_free};
+
+static roaring_memory_t global_memory_hook = {
+    malloc, realloc, calloc, free, default_aligned_malloc,
+    default_aligned_free};
+
+void roaring_init_memory_hook(roaring_memory_t memory_hook) {
+    global_memory_hook = memory_hook;
+}
+
+void roaring_reset_memory_hook(void) {
+    global_memory_hook = default_memory_hook;
+}
+
+void *roaring_malloc(size_t size) { return global_memory_hook.malloc(size); }
+
+void *roaring_realloc(void *ptr, size_t size) {
+    return global_memory_hook.realloc(ptr, size);
+}
+
+void *roaring_calloc(size_t count, size_t size) {
+    return global_memory_hook.calloc(count, size);
+}
+
+void roaring_free(void *ptr) { global_memory_hook.free(ptr); }
+
+void *roaring_aligned_malloc(size_t alignment, size_t size) {
+    return global_memory_hook.aligned_malloc(alignment, size);
+}
+
+void roaring_aligned_free(void *ptr) { global_memory_hook.aligned_free(ptr); }
+
+#if defined(_MSC_VER)
+#define ROARING_THREAD_LOCAL __declspec(thread)
+#else
+#define ROARING_THREAD_LOCAL _Thread_local
+#endif
+
+/* size classes are the powers of two from 16 bytes to 8 KB */
+enum { POOL_MIN_SIZE = 16, POOL_MAX_SIZE = 8192, POOL_CLASSES = 10 };
+
+typedef struct roaring_pool_s {
+    size_t max_cached_bytes; /* 0 while pooling is disabled */
+    size_t cached_bytes;
+    /* singly-linked free lists, the next pointer is stored in the block */
+    void *plain[POOL_CLASSES];
+    void *aligned[POOL_CLASSES];
+} roaring_pool_t;
+
+static ROARING_THREAD_LOCAL roaring_pool_t pool;
+
+/* Returns the class of a block of exactly size bytes, or -1 */
+static int pool_class(size_t size) {
+    if (size < POOL_MIN_SIZE || size > POOL_MAX_SIZE) return -1;
+    if ((size & (size - 1)) != 0) return -1;
+    int c = 0;
+    while (((size_t)POOL_MIN_SIZE << c) < size) c++;
+    return c;
+}
+
+static void pool_release(void) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        while (pool.plain[c] != NULL) {
+            void *next = *(void **)pool.plain[c];
+            roaring_free(pool.plain[c]);
+            pool.plain[c] = next;
+        }
+        while (pool.aligned[c] != NULL) {
+            void *next = *(void **)pool.aligned[c];
+            roaring_aligned_free(pool.aligned[c]);
+            pool.aligned[c] = next;
+        }
+    }
+    pool.cached_bytes = 0;
+}
+
+void roaring_pool_enable(size_t max_cached_bytes) {
+    if (pool.cached_bytes > max_cached_bytes) pool_release();
+    pool.max_cached_bytes = max_cached_bytes;
+}
+
+void roaring_pool_disable(void) {
+    pool_release();
+    pool.max_cached_bytes = 0;
+}
+
+size_t roaring_pool_round(size_t size) {
+    if (pool.max_cached_bytes == 0 || size > POOL_MAX_SIZE) return size;
+    size_t rounded = POOL_MIN_SIZE;
+    while (rounded < size) rounded <<= 1;
+    return rounded;
+}
+
+void *roaring_pool_malloc(size_t size) {
+    const int c = pool_class(size);
+    if (c >= 0 && pool.plain[c] != NULL) {
+        void *p = pool.plain[c];
+        pool.plain[c] = *(void **)p;
+        pool.cached_bytes -= size;
+        return p;
+    }
+    return roaring_malloc(size);
+}
+
+void roaring_pool_free(void *ptr, size_t size) {
+    const int c = pool_class(size);
+    if (ptr == NULL || c < 0 ||
+        pool.cached_bytes + size > pool.max_cached_bytes) {
+        roaring_free(ptr);
+        return;
+    }
+    *(void **)ptr = pool.plain[c];
+    pool.plain[c] = ptr;
+    pool.cached_bytes += size;
+}
+
+void *roaring_pool_aligned_malloc(size_t alignment, size_t size) {
+    const int c = pool_class(size);
+    void *p = c >= 0 ? pool.aligned[c] : NULL;
+    if (p != NULL && (uintptr_t)p % alignment == 0) {
+        pool.aligned[c] = *(void **)p;
+        pool.cached_bytes -= size;
+        return p;
+    }
+    return roaring_aligned_malloc(alignment, size);
+}
+
+void roaring_pool_aligned_free(void *ptr, size_t size) {
+    const int c = pool_class(size);
+    if (ptr == NULL || c < 0 ||
+        pool.cached_bytes + size > pool.max_cached_bytes) {
+        roaring_aligned_free(ptr);
+        return;
+    }
+    *(void **)ptr = pool.aligned[c];
+    pool.aligned[c] = ptr;
+    pool.cached_bytes += size;
+}
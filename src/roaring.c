@@ -9,39 +9,44 @@
 
 roaring_bitmap_t *roaring_bitmap_create() {
     roaring_bitmap_t *ans =
-        (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
     if (!ans) {
         return NULL;
     }
     ans->high_low_container = ra_create();
     if (!ans->high_low_container) {
-        free(ans);
+        roaring_free(ans);
         return NULL;
     }
     ans->copy_on_write = false;
+    ans->rank_index = NULL;
     return ans;
 }
 
 roaring_bitmap_t *roaring_bitmap_create_with_capacity(uint32_t cap) {
     roaring_bitmap_t *ans =
-        (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
     if (!ans) {
         return NULL;
     }
     ans->high_low_container = ra_create_with_capacity(cap);
     if (!ans->high_low_container) {
-        free(ans);
+        roaring_free(ans);
         return NULL;
     }
     ans->copy_on_write = false;
+    ans->rank_index = NULL;
     return ans;
 }
 
 roaring_bitmap_t *roaring_bitmap_of_ptr(size_t n_args, const uint32_t *vals) {
-    // todo: could be greatly optimized
     roaring_bitmap_t *answer = roaring_bitmap_create();
-    for (size_t i = 0; i < n_args; i++) {
-        roaring_bitmap_add(answer, vals[i]);
+    if (!answer) {
+        return NULL;
+    }
+    if (!roaring_bitmap_add_many(answer, n_args, vals)) {
+        roaring_bitmap_free(answer);
+        return NULL;
     }
     return answer;
 }
@@ -189,21 +194,54 @@ void roaring_bitmap_statistics(const roaring_bitmap_t *ra,
 
 roaring_bitmap_t *roaring_bitmap_copy(const roaring_bitmap_t *r) {
     roaring_bitmap_t *ans =
-        (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
     if (!ans) {
         return NULL;
     }
     ans->high_low_container = ra_copy(r->high_low_container, r->copy_on_write);
     if (!ans->high_low_container) {
-        free(ans);
+        roaring_free(ans);
         return NULL;
     }
     ans->copy_on_write = r->copy_on_write;
+    ans->rank_index = NULL;
+    return ans;
+}
+
+const roaring_bitmap_t *roaring_bitmap_snapshot(roaring_bitmap_t *r) {
+    roaring_bitmap_t *ans =
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
+    if (!ans) {
+        return NULL;
+    }
+    ans->high_low_container = ra_copy(r->high_low_container, true);
+    if (!ans->high_low_container) {
+        roaring_free(ans);
+        return NULL;
+    }
+    // without copy-on-write, reading the view never writes to it
+    ans->copy_on_write = false;
+    ans->rank_index = NULL;
+    if (r->rank_index != NULL) {
+        const int32_t size = r->high_low_container->size;
+        ans->rank_index = (uint64_t *)roaring_malloc(
+            (size > 0 ? size : 1) * sizeof(uint64_t));
+        if (ans->rank_index == NULL) {
+            roaring_bitmap_free(ans);
+            return NULL;
+        }
+        memcpy(ans->rank_index, r->rank_index, size * sizeof(uint64_t));
+    }
     return ans;
 }
 
+void roaring_bitmap_snapshot_free(const roaring_bitmap_t *snapshot) {
+    roaring_bitmap_free((roaring_bitmap_t *)snapshot);
+}
+
 static void roaring_bitmap_overwrite(roaring_bitmap_t *dest,
                                      const roaring_bitmap_t *src) {
+    roaring_bitmap_free_rank_index(dest);
     ra_free(dest->high_low_container);
     dest->high_low_container =
         ra_copy(src->high_low_container, src->copy_on_write);
@@ -212,12 +250,14 @@ static void roaring_bitmap_overwrite(roaring_bitmap_t *dest,
 }
 
 void roaring_bitmap_free(roaring_bitmap_t *r) {
+    roaring_bitmap_free_rank_index(r);
     ra_free(r->high_low_container);
     r->high_low_container = NULL;  // paranoid
-    free(r);
+    roaring_free(r);
 }
 
 void roaring_bitmap_add(roaring_bitmap_t *r, uint32_t val) {
+    roaring_bitmap_free_rank_index(r);
     const uint16_t hb = val >> 16;
     const int i = ra_get_index(r->high_low_container, hb);
     uint8_t typecode;
@@ -243,7 +283,60 @@ void roaring_bitmap_add(roaring_bitmap_t *r, uint32_t val) {
     }
 }
 
+bool roaring_bitmap_add_many(roaring_bitmap_t *r, size_t n_args,
+                             const uint32_t *vals) {
+    roaring_bitmap_free_rank_index(r);
+    roaring_array_t *ra = r->high_low_container;
+    uint16_t buffer[DEFAULT_MAX_SIZE];
+    int32_t i = -1;  // index of the container with key hb, if any
+    uint16_t hb = 0;
+    size_t pos = 0;
+    while (pos < n_args) {
+        const uint16_t key = vals[pos] >> 16;
+        if ((i < 0) || (key != hb)) {
+            hb = key;
+            i = ra_get_index(ra, hb);
+            if (i < 0) {
+                array_container_t *ac = array_container_create();
+                if (ac == NULL) return false;
+                i = -i - 1;
+                ra_insert_new_key_value_at(ra, i, hb, ac,
+                                           ARRAY_CONTAINER_TYPE_CODE);
+            } else {
+                ra_unshare_container_at_index(ra, i);
+            }
+        }
+        // gather the longest strictly increasing run of values sharing hb
+        int32_t length = 0;
+        buffer[length++] = vals[pos++] & 0xFFFF;
+        while ((pos < n_args) && (length < DEFAULT_MAX_SIZE) &&
+               ((vals[pos] >> 16) == hb) &&
+               ((uint16_t)(vals[pos] & 0xFFFF) > buffer[length - 1])) {
+            buffer[length++] = vals[pos++] & 0xFFFF;
+        }
+        uint8_t typecode;
+        void *container = ra_get_container_at_index(ra, i, &typecode);
+        uint8_t newtypecode = typecode;
+        void *container2 =
+            container_add_many(container, buffer, length, typecode,
+                               &newtypecode);
+        if (container2 == NULL) {
+            // the container is unchanged; drop it only if we just created it
+            if (container_get_cardinality(container, typecode) == 0) {
+                ra_remove_at_index_and_free(ra, i);
+            }
+            return false;
+        }
+        if (container2 != container) {
+            container_free(container, typecode);
+            ra_set_container_at_index(ra, i, container2, newtypecode);
+        }
+    }
+    return true;
+}
+
 void roaring_bitmap_remove(roaring_bitmap_t *r, uint32_t val) {
+    roaring_bitmap_free_rank_index(r);
     const uint16_t hb = val >> 16;
     const int i = ra_get_index(r->high_low_container, hb);
     uint8_t typecode;
@@ -281,6 +374,128 @@ bool roaring_bitmap_contains(const roaring_bitmap_t *r, uint32_t val) {
     }
 }
 
+void roaring_bitmap_add_range(roaring_bitmap_t *r, uint64_t min,
+                              uint64_t max) {
+    if (max > (uint64_t)UINT32_MAX + 1) max = (uint64_t)UINT32_MAX + 1;
+    if (min >= max) return;
+    roaring_bitmap_free_rank_index(r);
+    roaring_array_t *ra = r->high_low_container;
+    const int32_t min_key = (int32_t)(min >> 16);
+    const int32_t max_key = (int32_t)((max - 1) >> 16);
+    const int32_t i = ra_get_index(ra, (uint16_t)min_key);
+    const int32_t src_begin = (i >= 0) ? i : -i - 1;
+    const int32_t src_end =
+        (max_key == 0xFFFF)
+            ? ra_get_size(ra)
+            : ra_advance_until(ra, (uint16_t)(max_key + 1), src_begin - 1);
+    // make room for all the missing keys at once, then walk backward so that
+    // existing containers only ever move right
+    const int32_t num_missing = (max_key - min_key + 1) - (src_end - src_begin);
+    if (num_missing > 0) {
+        ra_shift_tail(ra, ra_get_size(ra) - src_end, num_missing);
+    }
+    int32_t src = src_end - 1;
+    for (int32_t key = max_key; key >= min_key; --key) {
+        const uint32_t lo = (key == min_key) ? (uint32_t)(min & 0xFFFF) : 0;
+        const uint32_t hi =
+            (key == max_key) ? (uint32_t)((max - 1) & 0xFFFF) : 0xFFFF;
+        void *container;
+        uint8_t typecode;
+        if (src >= src_begin && ra_get_key_at_index(ra, (uint16_t)src) == key) {
+            ra_unshare_container_at_index(ra, (uint16_t)src);
+            void *old = ra_get_container_at_index(ra, (uint16_t)src, &typecode);
+            if (lo == 0 && hi == 0xFFFF) {
+                container_free(old, typecode);
+                container = container_from_range(&typecode, 0, 1 << 16, 1);
+            } else {
+                uint8_t newtypecode = typecode;
+                container =
+                    container_add_range(old, typecode, lo, hi, &newtypecode);
+                if (container != old) container_free(old, typecode);
+                typecode = newtypecode;
+            }
+            src--;
+        } else {
+            container = container_from_range(&typecode, lo, hi + 1, 1);
+        }
+        ra_replace_key_and_container_at_index(
+            ra, src_begin + (key - min_key), (uint16_t)key, container,
+            typecode);
+    }
+}
+
+void roaring_bitmap_remove_range(roaring_bitmap_t *r, uint64_t min,
+                                 uint64_t max) {
+    if (max > (uint64_t)UINT32_MAX + 1) max = (uint64_t)UINT32_MAX + 1;
+    if (min >= max) return;
+    roaring_bitmap_free_rank_index(r);
+    roaring_array_t *ra = r->high_low_container;
+    const int32_t min_key = (int32_t)(min >> 16);
+    const int32_t max_key = (int32_t)((max - 1) >> 16);
+    const int32_t i = ra_get_index(ra, (uint16_t)min_key);
+    const int32_t src_begin = (i >= 0) ? i : -i - 1;
+    const int32_t src_end =
+        (max_key == 0xFFFF)
+            ? ra_get_size(ra)
+            : ra_advance_until(ra, (uint16_t)(max_key + 1), src_begin - 1);
+    int32_t dst = src_begin;
+    for (int32_t src = src_begin; src < src_end; ++src) {
+        const int32_t key = ra_get_key_at_index(ra, (uint16_t)src);
+        const uint32_t lo = (key == min_key) ? (uint32_t)(min & 0xFFFF) : 0;
+        const uint32_t hi =
+            (key == max_key) ? (uint32_t)((max - 1) & 0xFFFF) : 0xFFFF;
+        uint8_t typecode;
+        if (lo == 0 && hi == 0xFFFF) {
+            void *old = ra_get_container_at_index(ra, (uint16_t)src, &typecode);
+            container_free(old, typecode);
+            continue;
+        }
+        ra_unshare_container_at_index(ra, (uint16_t)src);
+        void *old = ra_get_container_at_index(ra, (uint16_t)src, &typecode);
+        uint8_t newtypecode = typecode;
+        void *container =
+            container_remove_range(old, typecode, lo, hi, &newtypecode);
+        if (container != old) container_free(old, typecode);
+        if (container_nonzero_cardinality(container, newtypecode)) {
+            ra_replace_key_and_container_at_index(ra, dst++, (uint16_t)key,
+                                                  container, newtypecode);
+        } else {
+            container_free(container, newtypecode);
+        }
+    }
+    if (dst < src_end) {
+        ra_shift_tail(ra, ra_get_size(ra) - src_end, dst - src_end);
+    }
+}
+
+bool roaring_bitmap_contains_range(const roaring_bitmap_t *r, uint64_t min,
+                                   uint64_t max) {
+    if (max > (uint64_t)UINT32_MAX + 1) max = (uint64_t)UINT32_MAX + 1;
+    if (min >= max) return true;
+    roaring_array_t *ra = r->high_low_container;
+    const int32_t min_key = (int32_t)(min >> 16);
+    const int32_t max_key = (int32_t)((max - 1) >> 16);
+    const int32_t span = max_key - min_key + 1;
+    const int32_t begin = ra_get_index(ra, (uint16_t)min_key);
+    // keys are sorted and distinct, so every key in between must be present
+    if (begin < 0 || ra_get_size(ra) - begin < span ||
+        ra_get_key_at_index(ra, (uint16_t)(begin + span - 1)) != max_key) {
+        return false;
+    }
+    for (int32_t j = 0; j < span; ++j) {
+        const uint32_t lo = (j == 0) ? (uint32_t)(min & 0xFFFF) : 0;
+        const uint32_t hi =
+            (j == span - 1) ? (uint32_t)((max - 1) & 0xFFFF) : 0xFFFF;
+        uint8_t typecode;
+        void *container =
+            ra_get_container_at_index(ra, (uint16_t)(begin + j), &typecode);
+        if (!container_contains_range(container, typecode, lo, hi)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // there should be some SIMD optimizations possible here
 roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
                                      const roaring_bitmap_t *x2) {
@@ -323,6 +538,98 @@ roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
     return answer;
 }
 
+uint64_t roaring_bitmap_and_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2) {
+    const int length1 = x1->high_low_container->size,
+              length2 = x2->high_low_container->size;
+    uint64_t answer = 0;
+    int pos1 = 0, pos2 = 0;
+
+    while (pos1 < length1 && pos2 < length2) {
+        const uint16_t s1 = ra_get_key_at_index(x1->high_low_container, pos1);
+        const uint16_t s2 = ra_get_key_at_index(x2->high_low_container, pos2);
+
+        if (s1 == s2) {
+            uint8_t container_type_1, container_type_2;
+            void *c1 = ra_get_container_at_index(x1->high_low_container, pos1,
+                                                 &container_type_1);
+            void *c2 = ra_get_container_at_index(x2->high_low_container, pos2,
+                                                 &container_type_2);
+            answer += container_and_cardinality(c1, container_type_1, c2,
+                                                container_type_2);
+            ++pos1;
+            ++pos2;
+        } else if (s1 < s2) {  // s1 < s2
+            pos1 = ra_advance_until(x1->high_low_container, s2, pos1);
+        } else {  // s1 > s2
+            pos2 = ra_advance_until(x2->high_low_container, s1, pos2);
+        }
+    }
+    return answer;
+}
+
+bool roaring_bitmap_intersect(const roaring_bitmap_t *x1,
+                              const roaring_bitmap_t *x2) {
+    const int length1 = x1->high_low_container->size,
+              length2 = x2->high_low_container->size;
+    int pos1 = 0, pos2 = 0;
+
+    while (pos1 < length1 && pos2 < length2) {
+        const uint16_t s1 = ra_get_key_at_index(x1->high_low_container, pos1);
+        const uint16_t s2 = ra_get_key_at_index(x2->high_low_container, pos2);
+
+        if (s1 == s2) {
+            uint8_t container_type_1, container_type_2;
+            void *c1 = ra_get_container_at_index(x1->high_low_container, pos1,
+                                                 &container_type_1);
+            void *c2 = ra_get_container_at_index(x2->high_low_container, pos2,
+                                                 &container_type_2);
+            if (container_intersect(c1, container_type_1, c2,
+                                    container_type_2)) {
+                return true;
+            }
+            ++pos1;
+            ++pos2;
+        } else if (s1 < s2) {  // s1 < s2
+            pos1 = ra_advance_until(x1->high_low_container, s2, pos1);
+        } else {  // s1 > s2
+            pos2 = ra_advance_until(x2->high_low_container, s1, pos2);
+        }
+    }
+    return false;
+}
+
+uint64_t roaring_bitmap_or_cardinality(const roaring_bitmap_t *x1,
+                                       const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t c2 = roaring_bitmap_get_cardinality(x2);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 + c2 - inter;
+}
+
+uint64_t roaring_bitmap_andnot_cardinality(const roaring_bitmap_t *x1,
+                                           const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 - inter;
+}
+
+uint64_t roaring_bitmap_xor_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t c2 = roaring_bitmap_get_cardinality(x2);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 + c2 - 2 * inter;
+}
+
+double roaring_bitmap_jaccard_index(const roaring_bitmap_t *x1,
+                                    const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t c2 = roaring_bitmap_get_cardinality(x2);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return (double)inter / (double)(c1 + c2 - inter);
+}
+
 /**
  * Compute the union of 'number' bitmaps.
  */
@@ -342,6 +649,325 @@ roaring_bitmap_t *roaring_bitmap_or_many(size_t number,
     return answer;
 }
 
+/* work shared by the tasks of roaring_bitmap_or_many_parallel */
+typedef struct or_many_partitions_s {
+    size_t number;
+    const roaring_bitmap_t **x;
+    const uint32_t *boundaries; /* partition i owns keys in
+                                   [boundaries[i], boundaries[i + 1]) */
+    roaring_bitmap_t **partial; /* one result per partition */
+} or_many_partitions_t;
+
+/* First index in ra whose key is at least key (key may be 1 << 16). */
+static int32_t ra_lower_bound(const roaring_array_t *ra, uint32_t key) {
+    if (key > 0xFFFF) return ra->size;
+    const int32_t i = ra_get_index((roaring_array_t *)ra, (uint16_t)key);
+    return (i >= 0) ? i : -i - 1;
+}
+
+static void or_many_partition_task(void *arg, size_t index) {
+    or_many_partitions_t *work = (or_many_partitions_t *)arg;
+    const uint32_t lo = work->boundaries[index];
+    const uint32_t hi = work->boundaries[index + 1];
+    // each input is seen through a view restricted to [lo, hi); views never
+    // use copy-on-write, so the inputs are only ever read
+    roaring_array_t *arrays =
+        roaring_malloc(work->number * sizeof(roaring_array_t));
+    roaring_bitmap_t *views =
+        roaring_malloc(work->number * sizeof(roaring_bitmap_t));
+    const roaring_bitmap_t **nonempty =
+        roaring_malloc(work->number * sizeof(roaring_bitmap_t *));
+    if (arrays == NULL || views == NULL || nonempty == NULL) {
+        work->partial[index] = NULL;
+        roaring_free(arrays);
+        roaring_free(views);
+        roaring_free(nonempty);
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < work->number; ++i) {
+        const roaring_array_t *ra = work->x[i]->high_low_container;
+        const int32_t begin = ra_lower_bound(ra, lo);
+        const int32_t end = ra_lower_bound(ra, hi);
+        if (begin == end) continue;
+        arrays[count].size = end - begin;
+        arrays[count].allocation_size = end - begin;
+        arrays[count].keys = ra->keys + begin;
+        arrays[count].containers = ra->containers + begin;
+        arrays[count].typecodes = ra->typecodes + begin;
+        arrays[count].shared = NULL;
+        views[count].high_low_container = &arrays[count];
+        views[count].copy_on_write = false;
+        views[count].rank_index = NULL;
+        nonempty[count] = &views[count];
+        count++;
+    }
+    work->partial[index] = roaring_bitmap_or_many(count, nonempty);
+    roaring_free(arrays);
+    roaring_free(views);
+    roaring_free(nonempty);
+}
+
+/* Runs every task in the calling thread. */
+static void roaring_parallel_for_sequential(void *pool,
+                                            roaring_parallel_task_t task,
+                                            void *arg, size_t n_tasks) {
+    (void)pool;
+    for (size_t i = 0; i < n_tasks; ++i) task(arg, i);
+}
+
+roaring_bitmap_t *roaring_bitmap_or_many_parallel(
+    size_t number, const roaring_bitmap_t **x, size_t n_partitions,
+    roaring_parallel_for_t parallel_for, void *pool) {
+    if (parallel_for == NULL) parallel_for = roaring_parallel_for_sequential;
+    if (n_partitions == 0) n_partitions = 1;
+    if (n_partitions > (1 << 16)) n_partitions = 1 << 16;
+
+    // Balance the partitions on the number of containers per key, which is
+    // a good proxy for the work needed to merge them.
+    uint32_t *weights = roaring_calloc(1 << 16, sizeof(uint32_t));
+    uint32_t *boundaries =
+        roaring_malloc((n_partitions + 1) * sizeof(uint32_t));
+    roaring_bitmap_t **partial = roaring_calloc(n_partitions, sizeof(*partial));
+    roaring_bitmap_t *answer = NULL;
+    if (weights == NULL || boundaries == NULL || partial == NULL) goto done;
+    uint64_t total = 0;
+    for (size_t i = 0; i < number; ++i) {
+        const roaring_array_t *ra = x[i]->high_low_container;
+        for (int32_t k = 0; k < ra->size; ++k) weights[ra->keys[k]]++;
+        total += ra->size;
+    }
+    size_t p = 0;
+    uint64_t seen = 0;
+    boundaries[0] = 0;
+    for (uint32_t key = 0; key < (1 << 16) && p + 1 < n_partitions; ++key) {
+        seen += weights[key];
+        if (seen * n_partitions >= total * (p + 1)) boundaries[++p] = key + 1;
+    }
+    while (p < n_partitions) boundaries[++p] = 1 << 16;
+
+    or_many_partitions_t work = {number, x, boundaries, partial};
+    parallel_for(pool, or_many_partition_task, &work, n_partitions);
+
+    int32_t size = 0;
+    for (size_t i = 0; i < n_partitions; ++i) {
+        if (partial[i] == NULL) goto done;
+        size += partial[i]->high_low_container->size;
+    }
+    answer = roaring_bitmap_create_with_capacity(size);
+    if (answer == NULL) goto done;
+    // the partitions cover increasing key ranges: concatenate them
+    for (size_t i = 0; i < n_partitions; ++i) {
+        roaring_array_t *ra = partial[i]->high_low_container;
+        for (int32_t k = 0; k < ra->size; ++k) {
+            ra_append(answer->high_low_container, ra->keys[k],
+                      ra->containers[k], ra->typecodes[k]);
+        }
+        ra->size = 0;  // the containers now belong to answer
+    }
+
+done:
+    if (partial != NULL) {
+        for (size_t i = 0; i < n_partitions; ++i) {
+            if (partial[i] != NULL) roaring_bitmap_free(partial[i]);
+        }
+    }
+    roaring_free(partial);
+    roaring_free(boundaries);
+    roaring_free(weights);
+    return answer;
+}
+
+/* Union of n containers sharing a key, computed into a single bitset, then
+ * converted to an array if it is small enough. */
+static void *container_or_many(const void **containers, const uint8_t *types,
+                               uint32_t n, uint8_t *result_type) {
+    bitset_container_t *bc = bitset_container_create();
+    if (bc == NULL) return NULL;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint8_t type = types[i];
+        const void *c = container_unwrap_shared(containers[i], &type);
+        switch (type) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                bitset_container_or_nocard((const bitset_container_t *)c, bc,
+                                           bc);
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE: {
+                const array_container_t *ac = (const array_container_t *)c;
+                bitset_set_list(bc->array, ac->array, ac->cardinality);
+            } break;
+            case RUN_CONTAINER_TYPE_CODE: {
+                const run_container_t *rc = (const run_container_t *)c;
+                if (run_container_is_full(rc)) {
+                    bitset_container_free(bc);
+                    *result_type = RUN_CONTAINER_TYPE_CODE;
+                    return run_container_clone(rc);
+                }
+                for (int32_t r = 0; r < rc->n_runs; ++r) {
+                    const uint32_t start = rc->runs[r].value;
+                    bitset_set_range(bc->array, start,
+                                     start + rc->runs[r].length + 1);
+                }
+            } break;
+            default:
+                assert(false);
+                __builtin_unreachable();
+        }
+    }
+    bc->cardinality = bitset_container_compute_cardinality(bc);
+    if (bc->cardinality > DEFAULT_MAX_SIZE) {
+        *result_type = BITSET_CONTAINER_TYPE_CODE;
+        return bc;
+    }
+    array_container_t *ac = array_container_from_bitset(bc);
+    bitset_container_free(bc);
+    *result_type = ARRAY_CONTAINER_TYPE_CODE;
+    return ac;
+}
+
+roaring_bitmap_t *roaring_bitmap_or_many_horizontal(
+    size_t number, const roaring_bitmap_t **x) {
+    // Bucket all the input containers by key (counting sort), so that every
+    // output container is built exactly once.
+    uint32_t *ends = roaring_calloc((1 << 16) + 1, sizeof(uint32_t));
+    if (ends == NULL) return NULL;
+    uint32_t total = 0;
+    int32_t distinct_keys = 0;
+    for (size_t i = 0; i < number; ++i) {
+        const roaring_array_t *ra = x[i]->high_low_container;
+        for (int32_t k = 0; k < ra->size; ++k) {
+            if (ends[ra->keys[k] + 1]++ == 0) distinct_keys++;
+        }
+        total += ra->size;
+    }
+    if (total == 0) {
+        roaring_free(ends);
+        return roaring_bitmap_create();
+    }
+    for (uint32_t key = 0; key < (1 << 16); ++key) ends[key + 1] += ends[key];
+    const void **containers = roaring_malloc(total * sizeof(void *));
+    uint8_t *types = roaring_malloc(total * sizeof(uint8_t));
+    roaring_bitmap_t *answer =
+        roaring_bitmap_create_with_capacity(distinct_keys);
+    if (containers == NULL || types == NULL || answer == NULL) {
+        roaring_free(containers);
+        roaring_free(types);
+        roaring_free(ends);
+        if (answer != NULL) roaring_bitmap_free(answer);
+        return NULL;
+    }
+    // ends[key] starts as the beginning of the bucket and ends as its end
+    for (size_t i = 0; i < number; ++i) {
+        const roaring_array_t *ra = x[i]->high_low_container;
+        for (int32_t k = 0; k < ra->size; ++k) {
+            const uint32_t pos = ends[ra->keys[k]]++;
+            containers[pos] = ra->containers[k];
+            types[pos] = ra->typecodes[k];
+        }
+    }
+    uint32_t begin = 0;
+    for (uint32_t key = 0; key < (1 << 16); ++key) {
+        const uint32_t end = ends[key];
+        if (begin == end) continue;
+        uint8_t type = types[begin];
+        void *c;
+        if (end - begin == 1) {
+            c = get_copy_of_container((void *)containers[begin], &type,
+                                      false);
+        } else {
+            c = container_or_many(containers + begin, types + begin,
+                                  end - begin, &type);
+        }
+        if (c == NULL) {
+            roaring_bitmap_free(answer);
+            answer = NULL;
+            break;
+        }
+        ra_append(answer->high_low_container, (uint16_t)key, c, type);
+        begin = end;
+    }
+    roaring_free(containers);
+    roaring_free(types);
+    roaring_free(ends);
+    return answer;
+}
+
+roaring_bitmap_t *roaring_bitmap_and_many(size_t number,
+                                          const roaring_bitmap_t **x) {
+    if (number == 0) {
+        return roaring_bitmap_create();
+    }
+    if (number == 1) {
+        return roaring_bitmap_copy(x[0]);
+    }
+    // the input with the fewest containers drives the walk
+    size_t lead = 0;
+    for (size_t i = 1; i < number; ++i) {
+        if (x[i]->high_low_container->size <
+            x[lead]->high_low_container->size) {
+            lead = i;
+        }
+    }
+    int32_t *positions = roaring_calloc(number, sizeof(int32_t));
+    if (positions == NULL) return NULL;
+    roaring_array_t *lead_ra = x[lead]->high_low_container;
+    roaring_bitmap_t *answer = roaring_bitmap_create_with_capacity(
+        lead_ra->size);
+    if (answer == NULL) {
+        roaring_free(positions);
+        return NULL;
+    }
+    answer->copy_on_write = true;
+    for (size_t j = 0; j < number; ++j) {
+        answer->copy_on_write = answer->copy_on_write && x[j]->copy_on_write;
+    }
+    for (int32_t i = 0; i < lead_ra->size; ++i) {
+        const uint16_t key = lead_ra->keys[i];
+        bool everywhere = true;
+        for (size_t j = 0; j < number && everywhere; ++j) {
+            if (j == lead) continue;
+            roaring_array_t *ra = x[j]->high_low_container;
+            positions[j] = ra_advance_until(ra, key, positions[j] - 1);
+            if (positions[j] == ra->size) goto done;  // no more common keys
+            everywhere = ra->keys[positions[j]] == key;
+        }
+        if (!everywhere) continue;
+        uint8_t type = lead_ra->typecodes[i];
+        void *c = NULL;
+        for (size_t j = 0; j < number; ++j) {
+            if (j == lead) continue;
+            roaring_array_t *ra = x[j]->high_low_container;
+            uint8_t type2;
+            void *c2 = ra_get_container_at_index(ra, (uint16_t)positions[j],
+                                                 &type2);
+            uint8_t result_type;
+            if (c == NULL) {
+                c = container_and(lead_ra->containers[i], type, c2, type2,
+                                  &result_type);
+            } else {
+                void *result = container_iand(c, type, c2, type2, &result_type);
+                if (result != c) container_free(c, type);
+                c = result;
+            }
+            if (c == NULL) {
+                roaring_bitmap_free(answer);
+                answer = NULL;
+                goto done;
+            }
+            type = result_type;
+            if (!container_nonzero_cardinality(c, type)) break;
+        }
+        if (container_nonzero_cardinality(c, type)) {
+            ra_append(answer->high_low_container, key, c, type);
+        } else {
+            container_free(c, type);
+        }
+    }
+done:
+    roaring_free(positions);
+    return answer;
+}
+
 /**
  * Compute the xor of 'number' bitmaps.
  */
@@ -364,6 +990,7 @@ roaring_bitmap_t *roaring_bitmap_xor_many(size_t number,
 // inplace and (modifies its first argument).
 void roaring_bitmap_and_inplace(roaring_bitmap_t *x1,
                                 const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     int pos1 = 0, pos2 = 0, intersection_size = 0;
     const int length1 = ra_get_size(x1->high_low_container);
     const int length2 = ra_get_size(x2->high_low_container);
@@ -421,15 +1048,15 @@ roaring_bitmap_t *roaring_bitmap_or(const roaring_bitmap_t *x1,
     uint8_t container_result_type = 0;
     const int length1 = x1->high_low_container->size,
               length2 = x2->high_low_container->size;
-    roaring_bitmap_t *answer =
-        roaring_bitmap_create_with_capacity(length1 + length2);
-    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     if (0 == length1) {
         return roaring_bitmap_copy(x2);
     }
     if (0 == length2) {
         return roaring_bitmap_copy(x1);
     }
+    roaring_bitmap_t *answer =
+        roaring_bitmap_create_with_capacity(length1 + length2);
+    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     int pos1 = 0, pos2 = 0;
     uint8_t container_type_1, container_type_2;
     uint16_t s1 = ra_get_key_at_index(x1->high_low_container, pos1);
@@ -497,6 +1124,7 @@ roaring_bitmap_t *roaring_bitmap_or(const roaring_bitmap_t *x1,
 // inplace or (modifies its first argument).
 void roaring_bitmap_or_inplace(roaring_bitmap_t *x1,
                                const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     uint8_t container_result_type = 0;
     int length1 = x1->high_low_container->size;
     const int length2 = x2->high_low_container->size;
@@ -571,15 +1199,15 @@ roaring_bitmap_t *roaring_bitmap_xor(const roaring_bitmap_t *x1,
     uint8_t container_result_type = 0;
     const int length1 = x1->high_low_container->size,
               length2 = x2->high_low_container->size;
-    roaring_bitmap_t *answer =
-        roaring_bitmap_create_with_capacity(length1 + length2);
-    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     if (0 == length1) {
         return roaring_bitmap_copy(x2);
     }
     if (0 == length2) {
         return roaring_bitmap_copy(x1);
     }
+    roaring_bitmap_t *answer =
+        roaring_bitmap_create_with_capacity(length1 + length2);
+    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     int pos1 = 0, pos2 = 0;
     uint8_t container_type_1, container_type_2;
     uint16_t s1 = ra_get_key_at_index(x1->high_low_container, pos1);
@@ -649,6 +1277,7 @@ roaring_bitmap_t *roaring_bitmap_xor(const roaring_bitmap_t *x1,
 
 void roaring_bitmap_xor_inplace(roaring_bitmap_t *x1,
                                 const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     assert(x1 != x2);
     uint8_t container_result_type = 0;
     int length1 = x1->high_low_container->size;
@@ -794,6 +1423,7 @@ roaring_bitmap_t *roaring_bitmap_andnot(const roaring_bitmap_t *x1,
 
 void roaring_bitmap_andnot_inplace(roaring_bitmap_t *x1,
                                    const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     assert(x1 != x2);
 
     uint8_t container_result_type = 0;
@@ -910,6 +1540,7 @@ void roaring_bitmap_to_uint32_array(const roaring_bitmap_t *ra, uint32_t *ans) {
  * true if the result has at least one run container.
 */
 bool roaring_bitmap_run_optimize(roaring_bitmap_t *r) {
+    roaring_bitmap_free_rank_index(r);
     bool answer = false;
     for (int i = 0; i < r->high_low_container->size; i++) {
         uint8_t typecode_original, typecode_after;
@@ -929,6 +1560,7 @@ bool roaring_bitmap_run_optimize(roaring_bitmap_t *r) {
  *  return whether a change was applied
  */
 bool roaring_bitmap_remove_run_compression(roaring_bitmap_t *r) {
+    roaring_bitmap_free_rank_index(r);
     bool answer = false;
     for (int i = 0; i < r->high_low_container->size; i++) {
         uint8_t typecode_original, typecode_after;
@@ -968,11 +1600,11 @@ char *roaring_bitmap_serialize(roaring_bitmap_t *ra, uint32_t *serialize_len) {
            In this case, space-wise, it's more efficient to represent the bitmap
            as an array of uint32_t rather than a serialized bitmap.
         */
-        free(ret);
+        roaring_free(ret);
         uint64_t cardinality = roaring_bitmap_get_cardinality(ra);
 
         unsigned char *a =
-            (unsigned char *)malloc(cardinality * sizeof(uint32_t) + 1);
+            (unsigned char *)roaring_malloc(cardinality * sizeof(uint32_t) + 1);
         if (a == NULL) return NULL;
         *serialize_len = 1 + cardinality * sizeof(uint32_t);
         roaring_bitmap_to_uint32_array(ra, (uint32_t *)a);
@@ -989,16 +1621,57 @@ size_t roaring_bitmap_portable_size_in_bytes(const roaring_bitmap_t *ra) {
 
 roaring_bitmap_t *roaring_bitmap_portable_deserialize(const char *buf) {
     roaring_bitmap_t *ans =
-        (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
     if (ans == NULL) {
         return NULL;
     }
     ans->high_low_container =
         ra_portable_deserialize(buf);  // todo: handle the case where it is NULL
     ans->copy_on_write = false;
+    ans->rank_index = NULL;
+    return ans;
+}
+
+roaring_bitmap_t *roaring_bitmap_portable_deserialize_safe(const char *buf,
+                                                        size_t maxbytes) {
+    roaring_bitmap_t *ans =
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
+    if (ans == NULL) {
+        return NULL;
+    }
+    ans->high_low_container = ra_portable_deserialize_safe(buf, maxbytes);
+    if (ans->high_low_container == NULL) {
+        roaring_free(ans);
+        return NULL;
+    }
+    ans->copy_on_write = false;
+    ans->rank_index = NULL;
+    return ans;
+}
+
+const roaring_bitmap_t *roaring_bitmap_portable_deserialize_frozen(
+    const char *buf) {
+    roaring_bitmap_t *ans =
+        (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
+    if (ans == NULL) {
+        return NULL;
+    }
+    ans->high_low_container = ra_portable_deserialize_frozen(buf);
+    if (ans->high_low_container == NULL) {
+        roaring_free(ans);
+        return NULL;
+    }
+    // never share: a copy must not hold on to the caller's buffer
+    ans->copy_on_write = false;
+    ans->rank_index = NULL;
     return ans;
 }
 
+void roaring_bitmap_frozen_free(const roaring_bitmap_t *r) {
+    roaring_free(r->high_low_container);  // a single block, containers included
+    roaring_free((roaring_bitmap_t *)r);
+}
+
 size_t roaring_bitmap_portable_serialize(const roaring_bitmap_t *ra,
                                          char *buf) {
     return ra_portable_serialize(ra->high_low_container, buf);
@@ -1030,16 +1703,18 @@ roaring_bitmap_t *roaring_bitmap_deserialize(const void *buf,
 
         if (len != buf_len) return (NULL);
 
-        b = (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+        b = (roaring_bitmap_t *)roaring_malloc(sizeof(roaring_bitmap_t));
         if (b) {
             b->high_low_container =
                 ra_deserialize((const char *)buf + 5, buf_len - 5);
             if (b->high_low_container == NULL) {
-                free(b);
+                roaring_free(b);
                 b = NULL;
+            } else {
+                b->copy_on_write = false;
+                b->rank_index = NULL;
             }
         }
-        b->copy_on_write = false;
 
         return (b);
     } else
@@ -1055,6 +1730,420 @@ void roaring_iterate(const roaring_bitmap_t *ra, roaring_iterator iterator,
                           iterator, ptr);
 }
 
+/* Position the iterator at the first value of container it->container_index,
+ * or mark it as exhausted. */
+static bool iter_load_first_value(roaring_uint32_iterator_t *it) {
+    const roaring_array_t *ra = it->parent->high_low_container;
+    it->in_container_index = 0;
+    it->run_index = 0;
+    it->current_value = 0;
+    if (it->container_index < 0 || it->container_index >= ra->size) {
+        return (it->has_value = false);
+    }
+    it->has_value = true;
+    it->typecode = ra->typecodes[it->container_index];
+    it->container = container_unwrap_shared(
+        ra->containers[it->container_index], &it->typecode);
+    it->highbits = ((uint32_t)ra->keys[it->container_index]) << 16;
+    switch (it->typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bc =
+                (const bitset_container_t *)it->container;
+            int32_t wordindex = 0;
+            uint64_t word;
+            while ((word = bc->array[wordindex]) == 0) wordindex++;
+            it->in_container_index = wordindex * 64 + __builtin_ctzll(word);
+            it->current_value = it->highbits | it->in_container_index;
+            break;
+        }
+        case ARRAY_CONTAINER_TYPE_CODE:
+            it->current_value =
+                it->highbits |
+                ((const array_container_t *)it->container)->array[0];
+            break;
+        case RUN_CONTAINER_TYPE_CODE:
+            it->current_value =
+                it->highbits |
+                ((const run_container_t *)it->container)->runs[0].value;
+            break;
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+    return true;
+}
+
+/* Position the iterator at the last value of container it->container_index,
+ * or mark it as exhausted. */
+static bool iter_load_last_value(roaring_uint32_iterator_t *it) {
+    const roaring_array_t *ra = it->parent->high_low_container;
+    if (it->container_index < 0 || it->container_index >= ra->size) {
+        return (it->has_value = false);
+    }
+    it->has_value = true;
+    it->typecode = ra->typecodes[it->container_index];
+    it->container = container_unwrap_shared(
+        ra->containers[it->container_index], &it->typecode);
+    it->highbits = ((uint32_t)ra->keys[it->container_index]) << 16;
+    switch (it->typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bc =
+                (const bitset_container_t *)it->container;
+            int32_t wordindex = BITSET_CONTAINER_SIZE_IN_WORDS - 1;
+            uint64_t word;
+            while ((word = bc->array[wordindex]) == 0) wordindex--;
+            it->in_container_index =
+                wordindex * 64 + (63 - __builtin_clzll(word));
+            it->current_value = it->highbits | it->in_container_index;
+            break;
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac =
+                (const array_container_t *)it->container;
+            it->in_container_index = ac->cardinality - 1;
+            it->current_value =
+                it->highbits | ac->array[it->in_container_index];
+            break;
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)it->container;
+            it->run_index = rc->n_runs - 1;
+            const rle16_t *last = rc->runs + it->run_index;
+            it->current_value =
+                it->highbits | (uint32_t)(last->value + last->length);
+            break;
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+    return true;
+}
+
+/* Position the iterator at the first value >= highbits | lb in the current
+ * container, searching from the current position when allowed. Returns false
+ * if there is no such value in the container. */
+static bool iter_move_in_container(roaring_uint32_iterator_t *it, uint16_t lb,
+                                   bool from_current) {
+    switch (it->typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bc =
+                (const bitset_container_t *)it->container;
+            int32_t wordindex = lb / 64;
+            uint64_t word = bc->array[wordindex] & (UINT64_MAX << (lb % 64));
+            while (word == 0) {
+                if (++wordindex == BITSET_CONTAINER_SIZE_IN_WORDS) return false;
+                word = bc->array[wordindex];
+            }
+            it->in_container_index = wordindex * 64 + __builtin_ctzll(word);
+            it->current_value = it->highbits | it->in_container_index;
+            return true;
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac =
+                (const array_container_t *)it->container;
+            const int32_t start =
+                from_current ? it->in_container_index - 1 : -1;
+            const int32_t i =
+                advanceUntil(ac->array, start, ac->cardinality, lb);
+            if (i >= ac->cardinality) return false;
+            it->in_container_index = i;
+            it->current_value = it->highbits | ac->array[i];
+            return true;
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)it->container;
+            // gallop to the first run ending at or after lb
+            int32_t lower = from_current ? it->run_index : 0;
+            if (rc->runs[lower].value + rc->runs[lower].length < lb) {
+                int32_t spansize = 1;
+                while (lower + spansize < rc->n_runs &&
+                       rc->runs[lower + spansize].value +
+                               rc->runs[lower + spansize].length <
+                           lb) {
+                    spansize <<= 1;
+                }
+                int32_t upper = lower + spansize;
+                if (upper >= rc->n_runs) {
+                    upper = rc->n_runs - 1;
+                    if (rc->runs[upper].value + rc->runs[upper].length < lb)
+                        return false;
+                }
+                lower += spansize >> 1;
+                // invariant: run at lower ends before lb, run at upper does not
+                while (lower + 1 < upper) {
+                    const int32_t mid = (lower + upper) >> 1;
+                    if (rc->runs[mid].value + rc->runs[mid].length < lb) {
+                        lower = mid;
+                    } else {
+                        upper = mid;
+                    }
+                }
+                lower = upper;
+            }
+            it->run_index = lower;
+            const uint16_t start = rc->runs[lower].value;
+            it->current_value = it->highbits | (start < lb ? lb : start);
+            return true;
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return false;
+    }
+}
+
+void roaring_init_iterator(const roaring_bitmap_t *ra,
+                           roaring_uint32_iterator_t *newit) {
+    newit->parent = ra;
+    newit->container_index = 0;
+    iter_load_first_value(newit);
+}
+
+void roaring_init_iterator_last(const roaring_bitmap_t *ra,
+                                roaring_uint32_iterator_t *newit) {
+    newit->parent = ra;
+    newit->container_index = newit->parent->high_low_container->size - 1;
+    iter_load_last_value(newit);
+}
+
+roaring_uint32_iterator_t *roaring_create_iterator(const roaring_bitmap_t *ra) {
+    roaring_uint32_iterator_t *newit =
+        (roaring_uint32_iterator_t *)roaring_malloc(
+            sizeof(roaring_uint32_iterator_t));
+    if (newit == NULL) return NULL;
+    roaring_init_iterator(ra, newit);
+    return newit;
+}
+
+roaring_uint32_iterator_t *roaring_copy_uint32_iterator(
+    const roaring_uint32_iterator_t *it) {
+    roaring_uint32_iterator_t *newit =
+        (roaring_uint32_iterator_t *)roaring_malloc(
+            sizeof(roaring_uint32_iterator_t));
+    if (newit == NULL) return NULL;
+    memcpy(newit, it, sizeof(roaring_uint32_iterator_t));
+    return newit;
+}
+
+void roaring_free_uint32_iterator(roaring_uint32_iterator_t *it) {
+    roaring_free(it);
+}
+
+bool roaring_move_uint32_iterator_equalorlarger(roaring_uint32_iterator_t *it,
+                                                uint32_t val) {
+    roaring_array_t *ra = it->parent->high_low_container;
+    const uint16_t hb = val >> 16;
+    if (it->has_value && it->current_value <= val) {
+        // moving forward: gallop from the current position
+        const int32_t i = ra_advance_until(ra, hb, it->container_index - 1);
+        if (i == it->container_index) {
+            if (iter_move_in_container(it, val & 0xFFFF, true)) return true;
+            it->container_index++;
+            return iter_load_first_value(it);
+        }
+        it->container_index = i;
+    } else {
+        const int32_t i = ra_get_index(ra, hb);
+        it->container_index = (i < 0) ? -i - 1 : i;
+    }
+    if (!iter_load_first_value(it)) return false;
+    if (ra->keys[it->container_index] != hb) return true;
+    if (iter_move_in_container(it, val & 0xFFFF, false)) return true;
+    it->container_index++;
+    return iter_load_first_value(it);
+}
+
+bool roaring_advance_uint32_iterator(roaring_uint32_iterator_t *it) {
+    if (it->container_index >= it->parent->high_low_container->size) {
+        return (it->has_value = false);
+    }
+    if (it->container_index < 0) {
+        it->container_index = 0;
+        return iter_load_first_value(it);
+    }
+    switch (it->typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bc =
+                (const bitset_container_t *)it->container;
+            it->in_container_index++;
+            int32_t wordindex = it->in_container_index / 64;
+            if (wordindex >= BITSET_CONTAINER_SIZE_IN_WORDS) break;
+            uint64_t word = bc->array[wordindex] &
+                            (UINT64_MAX << (it->in_container_index % 64));
+            while (word == 0 &&
+                   wordindex + 1 < BITSET_CONTAINER_SIZE_IN_WORDS) {
+                word = bc->array[++wordindex];
+            }
+            if (word == 0) break;
+            it->in_container_index = wordindex * 64 + __builtin_ctzll(word);
+            it->current_value = it->highbits | it->in_container_index;
+            return (it->has_value = true);
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac =
+                (const array_container_t *)it->container;
+            it->in_container_index++;
+            if (it->in_container_index >= ac->cardinality) break;
+            it->current_value =
+                it->highbits | ac->array[it->in_container_index];
+            return (it->has_value = true);
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)it->container;
+            const rle16_t *run = rc->runs + it->run_index;
+            if ((it->current_value & 0xFFFF) <
+                (uint32_t)(run->value + run->length)) {
+                it->current_value++;
+                return (it->has_value = true);
+            }
+            if (++it->run_index >= rc->n_runs) break;
+            it->current_value = it->highbits | rc->runs[it->run_index].value;
+            return (it->has_value = true);
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+    it->container_index++;
+    return iter_load_first_value(it);
+}
+
+bool roaring_previous_uint32_iterator(roaring_uint32_iterator_t *it) {
+    if (it->container_index < 0) {
+        return (it->has_value = false);
+    }
+    if (it->container_index >= it->parent->high_low_container->size) {
+        it->container_index = it->parent->high_low_container->size - 1;
+        return iter_load_last_value(it);
+    }
+    switch (it->typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bc =
+                (const bitset_container_t *)it->container;
+            if (--it->in_container_index < 0) break;
+            int32_t wordindex = it->in_container_index / 64;
+            uint64_t word = bc->array[wordindex] &
+                            (UINT64_MAX >> (63 - it->in_container_index % 64));
+            while (word == 0 && wordindex > 0) {
+                word = bc->array[--wordindex];
+            }
+            if (word == 0) break;
+            it->in_container_index =
+                wordindex * 64 + (63 - __builtin_clzll(word));
+            it->current_value = it->highbits | it->in_container_index;
+            return (it->has_value = true);
+        }
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac =
+                (const array_container_t *)it->container;
+            if (--it->in_container_index < 0) break;
+            it->current_value =
+                it->highbits | ac->array[it->in_container_index];
+            return (it->has_value = true);
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)it->container;
+            if ((it->current_value & 0xFFFF) > rc->runs[it->run_index].value) {
+                it->current_value--;
+                return (it->has_value = true);
+            }
+            if (--it->run_index < 0) break;
+            const rle16_t *run = rc->runs + it->run_index;
+            it->current_value =
+                it->highbits | (uint32_t)(run->value + run->length);
+            return (it->has_value = true);
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+    it->container_index--;
+    return iter_load_last_value(it);
+}
+
+uint32_t roaring_read_uint32_iterator(roaring_uint32_iterator_t *it,
+                                      uint32_t *buf, uint32_t count) {
+    uint32_t ret = 0;
+    while (it->has_value && ret < count) {
+        switch (it->typecode) {
+            case BITSET_CONTAINER_TYPE_CODE: {
+                const bitset_container_t *bc =
+                    (const bitset_container_t *)it->container;
+                int32_t wordindex = it->in_container_index / 64;
+                uint64_t word = bc->array[wordindex] &
+                                (UINT64_MAX << (it->in_container_index % 64));
+                while (true) {
+                    while (word != 0 && ret < count) {
+                        buf[ret++] = it->highbits | (wordindex * 64 +
+                                                     __builtin_ctzll(word));
+                        word &= word - 1;
+                    }
+                    if (word != 0) {
+                        it->in_container_index =
+                            wordindex * 64 + __builtin_ctzll(word);
+                        it->current_value =
+                            it->highbits | it->in_container_index;
+                        return ret;
+                    }
+                    if (++wordindex == BITSET_CONTAINER_SIZE_IN_WORDS) break;
+                    word = bc->array[wordindex];
+                }
+                break;
+            }
+            case ARRAY_CONTAINER_TYPE_CODE: {
+                const array_container_t *ac =
+                    (const array_container_t *)it->container;
+                uint32_t num = ac->cardinality - it->in_container_index;
+                if (num > count - ret) num = count - ret;
+                const uint16_t *src = ac->array + it->in_container_index;
+                for (uint32_t i = 0; i < num; i++) {
+                    buf[ret++] = it->highbits | src[i];
+                }
+                it->in_container_index += num;
+                if (it->in_container_index < ac->cardinality) {
+                    it->current_value =
+                        it->highbits | ac->array[it->in_container_index];
+                    return ret;
+                }
+                break;
+            }
+            case RUN_CONTAINER_TYPE_CODE: {
+                const run_container_t *rc =
+                    (const run_container_t *)it->container;
+                while (ret < count) {
+                    const rle16_t *run = rc->runs + it->run_index;
+                    const uint32_t largest =
+                        it->highbits | (uint32_t)(run->value + run->length);
+                    uint32_t num = largest - it->current_value + 1;
+                    if (num > count - ret) {
+                        num = count - ret;
+                        for (uint32_t i = 0; i < num; i++) {
+                            buf[ret++] = it->current_value + i;
+                        }
+                        it->current_value += num;
+                        return ret;
+                    }
+                    for (uint32_t i = 0; i < num; i++) {
+                        buf[ret++] = it->current_value + i;
+                    }
+                    if (++it->run_index >= rc->n_runs) break;
+                    it->current_value =
+                        it->highbits | rc->runs[it->run_index].value;
+                }
+                if (it->run_index < rc->n_runs) return ret;
+                break;
+            }
+            default:
+                assert(false);
+                __builtin_unreachable();
+        }
+        it->container_index++;
+        iter_load_first_value(it);
+    }
+    return ret;
+}
+
 bool roaring_bitmap_equals(roaring_bitmap_t *ra1, roaring_bitmap_t *ra2) {
     if (ra1->high_low_container->size != ra2->high_low_container->size) {
         return false;
@@ -1237,6 +2326,7 @@ void roaring_bitmap_flip_inplace(roaring_bitmap_t *x1, uint64_t range_start,
     if (range_start >= range_end) {
         return;  // empty range
     }
+    roaring_bitmap_free_rank_index(x1);
 
     uint16_t hb_start = (uint16_t)(range_start >> 16);
     const uint16_t lb_start = (uint16_t)range_start;
@@ -1275,15 +2365,15 @@ roaring_bitmap_t *roaring_bitmap_lazy_or(const roaring_bitmap_t *x1,
     uint8_t container_result_type = 0;
     const int length1 = x1->high_low_container->size,
               length2 = x2->high_low_container->size;
-    roaring_bitmap_t *answer =
-        roaring_bitmap_create_with_capacity(length1 + length2);
-    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     if (0 == length1) {
         return roaring_bitmap_copy(x2);
     }
     if (0 == length2) {
         return roaring_bitmap_copy(x1);
     }
+    roaring_bitmap_t *answer =
+        roaring_bitmap_create_with_capacity(length1 + length2);
+    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     int pos1 = 0, pos2 = 0;
     uint8_t container_type_1, container_type_2;
     uint16_t s1 = ra_get_key_at_index(x1->high_low_container, pos1);
@@ -1350,6 +2440,7 @@ roaring_bitmap_t *roaring_bitmap_lazy_or(const roaring_bitmap_t *x1,
 
 void roaring_bitmap_lazy_or_inplace(roaring_bitmap_t *x1,
                                     const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     uint8_t container_result_type = 0;
     int length1 = x1->high_low_container->size;
     const int length2 = x2->high_low_container->size;
@@ -1423,15 +2514,15 @@ roaring_bitmap_t *roaring_bitmap_lazy_xor(const roaring_bitmap_t *x1,
     uint8_t container_result_type = 0;
     const int length1 = x1->high_low_container->size,
               length2 = x2->high_low_container->size;
-    roaring_bitmap_t *answer =
-        roaring_bitmap_create_with_capacity(length1 + length2);
-    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
     if (0 == length1) {
         return roaring_bitmap_copy(x2);
     }
     if (0 == length2) {
         return roaring_bitmap_copy(x1);
     }
+    roaring_bitmap_t *answer =
+        roaring_bitmap_create_with_capacity(length1 + length2);
+    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
 
     int pos1 = 0, pos2 = 0;
     uint8_t container_type_1, container_type_2;
@@ -1502,6 +2593,7 @@ roaring_bitmap_t *roaring_bitmap_lazy_xor(const roaring_bitmap_t *x1,
 
 void roaring_bitmap_lazy_xor_inplace(roaring_bitmap_t *x1,
                                      const roaring_bitmap_t *x2) {
+    roaring_bitmap_free_rank_index(x1);
     assert(x1 != x2);
     uint8_t container_result_type = 0;
     int length1 = x1->high_low_container->size;
@@ -1573,6 +2665,7 @@ void roaring_bitmap_lazy_xor_inplace(roaring_bitmap_t *x1,
 }
 
 void roaring_bitmap_repair_after_lazy(roaring_bitmap_t *ra) {
+    roaring_bitmap_free_rank_index(ra);
     for (int i = 0; i < ra->high_low_container->size; ++i) {
         const uint8_t original_typecode = ra->high_low_container->typecodes[i];
         void *container = ra->high_low_container->containers[i];
@@ -1586,6 +2679,30 @@ void roaring_bitmap_repair_after_lazy(roaring_bitmap_t *ra) {
 
 bool roaring_bitmap_select(const roaring_bitmap_t *bm, uint32_t rank,
                            uint32_t *element) {
+    if (bm->rank_index != NULL) {
+        // binary search for the first container whose cumulative cardinality
+        // exceeds rank
+        const uint64_t *cumulative = bm->rank_index;
+        int32_t low = 0, high = bm->high_low_container->size;
+        while (low < high) {
+            const int32_t mid = (low + high) >> 1;
+            if (cumulative[mid] <= rank) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == bm->high_low_container->size) return false;
+        uint32_t start_rank = (low > 0) ? (uint32_t)cumulative[low - 1] : 0;
+        if (!container_select(bm->high_low_container->containers[low],
+                              bm->high_low_container->typecodes[low],
+                              &start_rank, rank, element)) {
+            assert(false);  // the index is stale
+            return false;
+        }
+        *element |= ((uint32_t)bm->high_low_container->keys[low]) << 16;
+        return true;
+    }
     void *container;
     uint8_t typecode;
     uint16_t key;
@@ -1602,8 +2719,51 @@ bool roaring_bitmap_select(const roaring_bitmap_t *bm, uint32_t rank,
 
     if (valid) {
         key = bm->high_low_container->keys[i - 1];
-        *element |= (key << 16);
+        *element |= ((uint32_t)key << 16);
         return true;
     } else
         return false;
 }
+
+uint64_t roaring_bitmap_rank(const roaring_bitmap_t *bm, uint32_t x) {
+    const roaring_array_t *ra = bm->high_low_container;
+    const uint16_t xhigh = x >> 16;
+    int32_t i = ra_get_index(bm->high_low_container, xhigh);
+    const bool found = i >= 0;
+    if (!found) i = -i - 1;
+    // sum the cardinalities of the containers with keys smaller than xhigh
+    uint64_t size = 0;
+    if (bm->rank_index != NULL) {
+        if (i > 0) size = bm->rank_index[i - 1];
+    } else {
+        for (int32_t j = 0; j < i; j++) {
+            size += container_get_cardinality(ra->containers[j],
+                                              ra->typecodes[j]);
+        }
+    }
+    if (found) {
+        size += container_rank(ra->containers[i], ra->typecodes[i], x & 0xFFFF);
+    }
+    return size;
+}
+
+bool roaring_bitmap_build_rank_index(roaring_bitmap_t *r) {
+    const roaring_array_t *ra = r->high_low_container;
+    uint64_t *cumulative = (uint64_t *)roaring_realloc(
+        r->rank_index, (ra->size > 0 ? ra->size : 1) * sizeof(uint64_t));
+    if (cumulative == NULL) {
+        return false;
+    }
+    uint64_t sum = 0;
+    for (int32_t i = 0; i < ra->size; i++) {
+        sum += container_get_cardinality(ra->containers[i], ra->typecodes[i]);
+        cumulative[i] = sum;
+    }
+    r->rank_index = cumulative;
+    return true;
+}
+
+void roaring_bitmap_free_rank_index(roaring_bitmap_t *r) {
+    roaring_free(r->rank_index);
+    r->rank_index = NULL;
+}
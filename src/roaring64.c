@@ -0,0 +1,429 @@
+/*
+ * roaring64.c
+ *
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <roaring/memory.h>
+#include <roaring/roaring64.h>
+
+static inline uint32_t high_bits(uint64_t x) { return (uint32_t)(x >> 32); }
+
+static inline uint32_t low_bits(uint64_t x) { return (uint32_t)x; }
+
+static roaring64_bitmap_t *roaring64_bitmap_create_with_capacity(
+    int32_t cap) {
+    roaring64_bitmap_t *r = roaring_malloc(sizeof(roaring64_bitmap_t));
+    if (r == NULL) return NULL;
+    if (cap < 1) cap = 1;
+    r->size = 0;
+    r->allocation_size = cap;
+    r->high_bits = roaring_malloc(cap * sizeof(uint32_t));
+    r->bitmaps = roaring_malloc(cap * sizeof(roaring_bitmap_t *));
+    if (r->high_bits == NULL || r->bitmaps == NULL) {
+        roaring_free(r->high_bits);
+        roaring_free(r->bitmaps);
+        roaring_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+roaring64_bitmap_t *roaring64_bitmap_create(void) {
+    return roaring64_bitmap_create_with_capacity(4);
+}
+
+roaring64_bitmap_t *roaring64_bitmap_of_ptr(size_t n, const uint64_t *vals) {
+    roaring64_bitmap_t *r = roaring64_bitmap_create();
+    if (r != NULL) roaring64_bitmap_add_many(r, n, vals);
+    return r;
+}
+
+roaring64_bitmap_t *roaring64_bitmap_copy(const roaring64_bitmap_t *r) {
+    roaring64_bitmap_t *ans = roaring64_bitmap_create_with_capacity(r->size);
+    if (ans == NULL) return NULL;
+    for (int32_t i = 0; i < r->size; i++) {
+        roaring_bitmap_t *b = roaring_bitmap_copy(r->bitmaps[i]);
+        if (b == NULL) {
+            roaring64_bitmap_free(ans);
+            return NULL;
+        }
+        ans->high_bits[i] = r->high_bits[i];
+        ans->bitmaps[i] = b;
+        ans->size = i + 1;
+    }
+    return ans;
+}
+
+void roaring64_bitmap_free(roaring64_bitmap_t *r) {
+    for (int32_t i = 0; i < r->size; i++) roaring_bitmap_free(r->bitmaps[i]);
+    roaring_free(r->high_bits);
+    roaring_free(r->bitmaps);
+    roaring_free(r);
+}
+
+/* Returns the index of high, or -(insertion point) - 1 if absent. */
+static int32_t roaring64_find(const roaring64_bitmap_t *r, uint32_t high) {
+    int32_t low = 0;
+    int32_t up = r->size - 1;
+    while (low <= up) {
+        const int32_t middle = (low + up) >> 1;
+        const uint32_t value = r->high_bits[middle];
+        if (value < high) {
+            low = middle + 1;
+        } else if (value > high) {
+            up = middle - 1;
+        } else {
+            return middle;
+        }
+    }
+    return -(low + 1);
+}
+
+/* Returns the bitmap for high, inserting an empty one if needed. */
+static roaring_bitmap_t *roaring64_get_or_create(roaring64_bitmap_t *r,
+                                                 uint32_t high) {
+    int32_t i = roaring64_find(r, high);
+    if (i >= 0) return r->bitmaps[i];
+    i = -i - 1;
+    if (r->size == r->allocation_size) {
+        const int32_t cap = 2 * r->allocation_size;
+        uint32_t *keys = roaring_realloc(r->high_bits, cap * sizeof(uint32_t));
+        if (keys == NULL) return NULL;
+        r->high_bits = keys;
+        roaring_bitmap_t **bitmaps =
+            roaring_realloc(r->bitmaps, cap * sizeof(roaring_bitmap_t *));
+        if (bitmaps == NULL) return NULL;
+        r->bitmaps = bitmaps;
+        r->allocation_size = cap;
+    }
+    roaring_bitmap_t *b = roaring_bitmap_create();
+    if (b == NULL) return NULL;
+    memmove(r->high_bits + i + 1, r->high_bits + i,
+            (r->size - i) * sizeof(uint32_t));
+    memmove(r->bitmaps + i + 1, r->bitmaps + i,
+            (r->size - i) * sizeof(roaring_bitmap_t *));
+    r->high_bits[i] = high;
+    r->bitmaps[i] = b;
+    r->size++;
+    return b;
+}
+
+static void roaring64_erase(roaring64_bitmap_t *r, int32_t i) {
+    roaring_bitmap_free(r->bitmaps[i]);
+    memmove(r->high_bits + i, r->high_bits + i + 1,
+            (r->size - i - 1) * sizeof(uint32_t));
+    memmove(r->bitmaps + i, r->bitmaps + i + 1,
+            (r->size - i - 1) * sizeof(roaring_bitmap_t *));
+    r->size--;
+}
+
+void roaring64_bitmap_add(roaring64_bitmap_t *r, uint64_t x) {
+    roaring_bitmap_t *b = roaring64_get_or_create(r, high_bits(x));
+    if (b != NULL) roaring_bitmap_add(b, low_bits(x));
+}
+
+enum { ADD_MANY_BATCH = 1024 };
+
+void roaring64_bitmap_add_many(roaring64_bitmap_t *r, size_t n,
+                               const uint64_t *vals) {
+    uint32_t buffer[ADD_MANY_BATCH];
+    size_t i = 0;
+    while (i < n) {
+        const uint32_t high = high_bits(vals[i]);
+        roaring_bitmap_t *b = roaring64_get_or_create(r, high);
+        if (b == NULL) return;
+        // hand the low bits over in batches, one call per batch
+        do {
+            size_t length = 0;
+            do {
+                buffer[length++] = low_bits(vals[i++]);
+            } while (i < n && length < ADD_MANY_BATCH &&
+                     high_bits(vals[i]) == high);
+            if (!roaring_bitmap_add_many(b, length, buffer)) {
+                // do not keep the empty bitmap made for this batch
+                if (roaring_bitmap_is_empty(b)) {
+                    roaring64_erase(r, roaring64_find(r, high));
+                }
+                return;
+            }
+        } while (i < n && high_bits(vals[i]) == high);
+    }
+}
+
+void roaring64_bitmap_remove(roaring64_bitmap_t *r, uint64_t x) {
+    const int32_t i = roaring64_find(r, high_bits(x));
+    if (i < 0) return;
+    roaring_bitmap_remove(r->bitmaps[i], low_bits(x));
+    if (roaring_bitmap_is_empty(r->bitmaps[i])) roaring64_erase(r, i);
+}
+
+bool roaring64_bitmap_contains(const roaring64_bitmap_t *r, uint64_t x) {
+    const int32_t i = roaring64_find(r, high_bits(x));
+    return i >= 0 && roaring_bitmap_contains(r->bitmaps[i], low_bits(x));
+}
+
+uint64_t roaring64_bitmap_get_cardinality(const roaring64_bitmap_t *r) {
+    uint64_t card = 0;
+    for (int32_t i = 0; i < r->size; i++)
+        card += roaring_bitmap_get_cardinality(r->bitmaps[i]);
+    return card;
+}
+
+bool roaring64_bitmap_is_empty(const roaring64_bitmap_t *r) {
+    return r->size == 0;  // empty 32-bit bitmaps are never kept
+}
+
+bool roaring64_bitmap_equals(const roaring64_bitmap_t *r1,
+                             const roaring64_bitmap_t *r2) {
+    if (r1->size != r2->size) return false;
+    for (int32_t i = 0; i < r1->size; i++) {
+        if (r1->high_bits[i] != r2->high_bits[i]) return false;
+        if (!roaring_bitmap_equals((roaring_bitmap_t *)r1->bitmaps[i],
+                                   (roaring_bitmap_t *)r2->bitmaps[i]))
+            return false;
+    }
+    return true;
+}
+
+typedef roaring_bitmap_t *(*roaring64_op_t)(const roaring_bitmap_t *,
+                                            const roaring_bitmap_t *);
+
+/*
+ * Merges x1 and x2 by high bits: op combines the bitmaps found in both, the
+ * others are copied over when keep1 (keep2) is set.
+ */
+static roaring64_bitmap_t *roaring64_merge(const roaring64_bitmap_t *x1,
+                                           const roaring64_bitmap_t *x2,
+                                           roaring64_op_t op, bool keep1,
+                                           bool keep2) {
+    roaring64_bitmap_t *ans =
+        roaring64_bitmap_create_with_capacity(x1->size + x2->size);
+    if (ans == NULL) return NULL;
+    int32_t i = 0, j = 0;
+    while (i < x1->size || j < x2->size) {
+        uint32_t high;
+        roaring_bitmap_t *b;
+        if (j == x2->size ||
+            (i < x1->size && x1->high_bits[i] < x2->high_bits[j])) {
+            high = x1->high_bits[i];
+            const roaring_bitmap_t *only = x1->bitmaps[i++];
+            if (!keep1) continue;
+            b = roaring_bitmap_copy(only);
+        } else if (i == x1->size || x2->high_bits[j] < x1->high_bits[i]) {
+            high = x2->high_bits[j];
+            const roaring_bitmap_t *only = x2->bitmaps[j++];
+            if (!keep2) continue;
+            b = roaring_bitmap_copy(only);
+        } else {
+            high = x1->high_bits[i];
+            b = op(x1->bitmaps[i], x2->bitmaps[j]);
+            i++;
+            j++;
+        }
+        if (b == NULL) {
+            roaring64_bitmap_free(ans);
+            return NULL;
+        }
+        if (roaring_bitmap_is_empty(b)) {
+            roaring_bitmap_free(b);
+            continue;
+        }
+        ans->high_bits[ans->size] = high;
+        ans->bitmaps[ans->size] = b;
+        ans->size++;
+    }
+    return ans;
+}
+
+typedef void (*roaring64_inplace_op_t)(roaring_bitmap_t *,
+                                       const roaring_bitmap_t *);
+
+/* Same as roaring64_merge, writing the result to x1. */
+static void roaring64_merge_inplace(roaring64_bitmap_t *x1,
+                                    const roaring64_bitmap_t *x2,
+                                    roaring64_inplace_op_t op, bool keep1,
+                                    bool keep2) {
+    assert(x1 != x2);
+    const int32_t cap = x1->size + (keep2 ? x2->size : 0);
+    roaring64_bitmap_t *ans = roaring64_bitmap_create_with_capacity(cap);
+    if (ans == NULL) return;
+    int32_t i = 0, j = 0;
+    while (i < x1->size || j < x2->size) {
+        uint32_t high;
+        roaring_bitmap_t *b;
+        if (j == x2->size ||
+            (i < x1->size && x1->high_bits[i] < x2->high_bits[j])) {
+            high = x1->high_bits[i];
+            b = x1->bitmaps[i];
+            i++;
+            if (!keep1) {
+                roaring_bitmap_free(b);
+                continue;
+            }
+        } else if (i == x1->size || x2->high_bits[j] < x1->high_bits[i]) {
+            high = x2->high_bits[j];
+            const roaring_bitmap_t *only = x2->bitmaps[j++];
+            if (!keep2) continue;
+            b = roaring_bitmap_copy(only);
+            if (b == NULL) continue;  // out of memory: the values are lost
+        } else {
+            high = x1->high_bits[i];
+            b = x1->bitmaps[i];
+            op(b, x2->bitmaps[j]);
+            i++;
+            j++;
+        }
+        if (roaring_bitmap_is_empty(b)) {
+            roaring_bitmap_free(b);
+            continue;
+        }
+        ans->high_bits[ans->size] = high;
+        ans->bitmaps[ans->size] = b;
+        ans->size++;
+    }
+    // x1 takes over the arrays of ans, whose bitmaps it now owns
+    roaring_free(x1->high_bits);
+    roaring_free(x1->bitmaps);
+    *x1 = *ans;
+    roaring_free(ans);
+}
+
+roaring64_bitmap_t *roaring64_bitmap_and(const roaring64_bitmap_t *x1,
+                                         const roaring64_bitmap_t *x2) {
+    return roaring64_merge(x1, x2, roaring_bitmap_and, false, false);
+}
+
+roaring64_bitmap_t *roaring64_bitmap_or(const roaring64_bitmap_t *x1,
+                                        const roaring64_bitmap_t *x2) {
+    return roaring64_merge(x1, x2, roaring_bitmap_or, true, true);
+}
+
+roaring64_bitmap_t *roaring64_bitmap_xor(const roaring64_bitmap_t *x1,
+                                         const roaring64_bitmap_t *x2) {
+    return roaring64_merge(x1, x2, roaring_bitmap_xor, true, true);
+}
+
+roaring64_bitmap_t *roaring64_bitmap_andnot(const roaring64_bitmap_t *x1,
+                                            const roaring64_bitmap_t *x2) {
+    return roaring64_merge(x1, x2, roaring_bitmap_andnot, true, false);
+}
+
+void roaring64_bitmap_and_inplace(roaring64_bitmap_t *x1,
+                                  const roaring64_bitmap_t *x2) {
+    roaring64_merge_inplace(x1, x2, roaring_bitmap_and_inplace, false, false);
+}
+
+void roaring64_bitmap_or_inplace(roaring64_bitmap_t *x1,
+                                 const roaring64_bitmap_t *x2) {
+    roaring64_merge_inplace(x1, x2, roaring_bitmap_or_inplace, true, true);
+}
+
+void roaring64_bitmap_xor_inplace(roaring64_bitmap_t *x1,
+                                  const roaring64_bitmap_t *x2) {
+    roaring64_merge_inplace(x1, x2, roaring_bitmap_xor_inplace, true, true);
+}
+
+void roaring64_bitmap_andnot_inplace(roaring64_bitmap_t *x1,
+                                     const roaring64_bitmap_t *x2) {
+    roaring64_merge_inplace(x1, x2, roaring_bitmap_andnot_inplace, true,
+                            false);
+}
+
+void roaring64_bitmap_to_uint64_array(const roaring64_bitmap_t *r,
+                                      uint64_t *ans) {
+    uint32_t buffer[256];
+    for (int32_t i = 0; i < r->size; i++) {
+        const uint64_t high = (uint64_t)r->high_bits[i] << 32;
+        roaring_uint32_iterator_t it;
+        roaring_init_iterator(r->bitmaps[i], &it);
+        uint32_t n;
+        while ((n = roaring_read_uint32_iterator(&it, buffer, 256)) > 0) {
+            for (uint32_t k = 0; k < n; k++) *ans++ = high | buffer[k];
+        }
+    }
+}
+
+typedef struct roaring64_iterate_s {
+    roaring_iterator64 iterator;
+    uint64_t high;
+    void *ptr;
+} roaring64_iterate_t;
+
+static void roaring64_iterate_low(uint32_t value, void *param) {
+    roaring64_iterate_t *state = (roaring64_iterate_t *)param;
+    state->iterator(state->high | value, state->ptr);
+}
+
+void roaring64_iterate(const roaring64_bitmap_t *r,
+                       roaring_iterator64 iterator, void *ptr) {
+    roaring64_iterate_t state = {iterator, 0, ptr};
+    for (int32_t i = 0; i < r->size; i++) {
+        state.high = (uint64_t)r->high_bits[i] << 32;
+        roaring_iterate(r->bitmaps[i], roaring64_iterate_low, &state);
+    }
+}
+
+size_t roaring64_bitmap_portable_size_in_bytes(const roaring64_bitmap_t *r) {
+    size_t count = sizeof(uint64_t);
+    for (int32_t i = 0; i < r->size; i++)
+        count += sizeof(uint32_t) +
+                 roaring_bitmap_portable_size_in_bytes(r->bitmaps[i]);
+    return count;
+}
+
+size_t roaring64_bitmap_portable_serialize(const roaring64_bitmap_t *r,
+                                           char *buf) {
+    const uint64_t size = (uint64_t)r->size;
+    memcpy(buf, &size, sizeof(size));
+    size_t off = sizeof(size);
+    for (int32_t i = 0; i < r->size; i++) {
+        memcpy(buf + off, &r->high_bits[i], sizeof(uint32_t));
+        off += sizeof(uint32_t);
+        off += roaring_bitmap_portable_serialize(r->bitmaps[i], buf + off);
+    }
+    return off;
+}
+
+roaring64_bitmap_t *roaring64_bitmap_portable_deserialize_safe(
+    const char *buf, size_t maxbytes) {
+    uint64_t size;
+    if (maxbytes < sizeof(size)) return NULL;
+    memcpy(&size, buf, sizeof(size));
+    size_t off = sizeof(size);
+    // each bitmap takes at least its high bits and a 4-byte cookie
+    if (size > (maxbytes - off) / 8 || size > INT32_MAX) return NULL;
+    roaring64_bitmap_t *r =
+        roaring64_bitmap_create_with_capacity((int32_t)size);
+    if (r == NULL) return NULL;
+    for (uint64_t i = 0; i < size; i++) {
+        uint32_t high;
+        if (maxbytes - off < sizeof(high)) goto fail;
+        memcpy(&high, buf + off, sizeof(high));
+        off += sizeof(high);
+        if (r->size > 0 && high <= r->high_bits[r->size - 1]) goto fail;
+        roaring_bitmap_t *b =
+            roaring_bitmap_portable_deserialize_safe(buf + off, maxbytes - off);
+        if (b == NULL) goto fail;
+        const size_t len = roaring_bitmap_portable_size_in_bytes(b);
+        if (len > maxbytes - off) {
+            roaring_bitmap_free(b);
+            goto fail;
+        }
+        off += len;
+        if (roaring_bitmap_is_empty(b)) {
+            roaring_bitmap_free(b);
+            continue;
+        }
+        r->high_bits[r->size] = high;
+        r->bitmaps[r->size] = b;
+        r->size++;
+    }
+    return r;
+fail:
+    roaring64_bitmap_free(r);
+    return NULL;
+}
@@ -6,6 +6,7 @@
 
 #include <roaring/containers/bitset.h>
 #include <roaring/containers/containers.h>
+#include <roaring/memory.h>
 #include <roaring/roaring_array.h>
 
 // ported from RoaringArray.java
@@ -23,21 +24,21 @@ extern int32_t ra_get_size(roaring_array_t *ra);
 #define INITIAL_CAPACITY 4
 
 roaring_array_t *ra_create_with_capacity(uint32_t cap) {
-    roaring_array_t *new_ra = malloc(sizeof(roaring_array_t));
+    roaring_array_t *new_ra = roaring_malloc(sizeof(roaring_array_t));
     if (!new_ra) return NULL;
     new_ra->keys = NULL;
     new_ra->containers = NULL;
     new_ra->typecodes = NULL;
 
     new_ra->allocation_size = cap;
-    new_ra->keys = malloc(cap * sizeof(uint16_t));
-    new_ra->containers = malloc(cap * sizeof(void *));
-    new_ra->typecodes = malloc(cap * sizeof(uint8_t));
+    new_ra->keys = roaring_malloc(cap * sizeof(uint16_t));
+    new_ra->containers = roaring_malloc(cap * sizeof(void *));
+    new_ra->typecodes = roaring_malloc(cap * sizeof(uint8_t));
     if (!new_ra->keys || !new_ra->containers || !new_ra->typecodes) {
-        free(new_ra);
-        free(new_ra->keys);
-        free(new_ra->containers);
-        free(new_ra->typecodes);
+        roaring_free(new_ra->keys);
+        roaring_free(new_ra->containers);
+        roaring_free(new_ra->typecodes);
+        roaring_free(new_ra);
         return NULL;
     }
     new_ra->size = 0;
@@ -50,7 +51,7 @@ roaring_array_t *ra_create() {
 }
 
 roaring_array_t *ra_copy(roaring_array_t *r, bool copy_on_write) {
-    roaring_array_t *new_ra = malloc(sizeof(roaring_array_t));
+    roaring_array_t *new_ra = roaring_malloc(sizeof(roaring_array_t));
     if (!new_ra) return NULL;
     new_ra->keys = NULL;
     new_ra->containers = NULL;
@@ -58,15 +59,15 @@ roaring_array_t *ra_copy(roaring_array_t *r, bool copy_on_write) {
 
     const int32_t allocsize = r->allocation_size;
     new_ra->allocation_size = allocsize;
-    new_ra->keys = malloc(allocsize * sizeof(uint16_t));
+    new_ra->keys = roaring_malloc(allocsize * sizeof(uint16_t));
     new_ra->containers =
-        calloc(allocsize, sizeof(void *));  // setting pointers to zero
-    new_ra->typecodes = malloc(allocsize * sizeof(uint8_t));
+        roaring_calloc(allocsize, sizeof(void *));  // setting pointers to zero
+    new_ra->typecodes = roaring_malloc(allocsize * sizeof(uint8_t));
     if (!new_ra->keys || !new_ra->containers || !new_ra->typecodes) {
-        free(new_ra);
-        free(new_ra->keys);
-        free(new_ra->containers);
-        free(new_ra->typecodes);
+        roaring_free(new_ra->keys);
+        roaring_free(new_ra->containers);
+        roaring_free(new_ra->typecodes);
+        roaring_free(new_ra);
         return NULL;
     }
     int32_t s = r->size;
@@ -75,6 +76,12 @@ roaring_array_t *ra_copy(roaring_array_t *r, bool copy_on_write) {
     // we go through the containers, turning them into shared containers...
     if (copy_on_write) {
         for (int32_t i = 0; i < s; ++i) {
+            if (r->typecodes[i] == SHARED_CONTAINER_TYPE_CODE) {
+                // only the count changes: r itself may be read concurrently
+                uint8_t typecode = SHARED_CONTAINER_TYPE_CODE;
+                get_copy_of_container(r->containers[i], &typecode, true);
+                continue;
+            }
             r->containers[i] = get_copy_of_container(
                 r->containers[i], &r->typecodes[i], copy_on_write);
         }
@@ -82,18 +89,20 @@ roaring_array_t *ra_copy(roaring_array_t *r, bool copy_on_write) {
         memcpy(new_ra->containers, r->containers, s * sizeof(void *));
         memcpy(new_ra->typecodes, r->typecodes, s * sizeof(uint8_t));
     } else {
-        memcpy(new_ra->typecodes, r->typecodes, s * sizeof(uint8_t));
         for (int32_t i = 0; i < s; i++) {
-            new_ra->containers[i] =
-                container_clone(r->containers[i], r->typecodes[i]);
+            // shared containers are cloned as their underlying type
+            uint8_t typecode = r->typecodes[i];
+            const void *c = container_unwrap_shared(r->containers[i], &typecode);
+            new_ra->typecodes[i] = typecode;
+            new_ra->containers[i] = container_clone(c, typecode);
             if (new_ra->containers[i] == NULL) {
                 for (int32_t j = 0; j < i; j++) {
                     container_free(r->containers[j], r->typecodes[j]);
                 }
-                free(new_ra);
-                free(new_ra->keys);
-                free(new_ra->containers);
-                free(new_ra->typecodes);
+                roaring_free(new_ra);
+                roaring_free(new_ra->keys);
+                roaring_free(new_ra->containers);
+                roaring_free(new_ra->typecodes);
                 return NULL;
             }
         }
@@ -102,34 +111,34 @@ roaring_array_t *ra_copy(roaring_array_t *r, bool copy_on_write) {
 }
 
 static void ra_clear(roaring_array_t *ra) {
-    free(ra->keys);
+    roaring_free(ra->keys);
     ra->keys = NULL;  // paranoid
     for (int i = 0; i < ra->size; ++i) {
         container_free(ra->containers[i], ra->typecodes[i]);
     }
-    free(ra->containers);
+    roaring_free(ra->containers);
     ra->containers = NULL;  // paranoid
-    free(ra->typecodes);
+    roaring_free(ra->typecodes);
     ra->typecodes = NULL;  // paranoid
 }
 
 static void ra_clear_without_containers(roaring_array_t *ra) {
-    free(ra->keys);
+    roaring_free(ra->keys);
     ra->keys = NULL;  // paranoid
-    free(ra->containers);
+    roaring_free(ra->containers);
     ra->containers = NULL;  // paranoid
-    free(ra->typecodes);
+    roaring_free(ra->typecodes);
     ra->typecodes = NULL;  // paranoid
 }
 
 void ra_free(roaring_array_t *ra) {
     ra_clear(ra);
-    free(ra);
+    roaring_free(ra);
 }
 
 void ra_free_without_containers(roaring_array_t *ra) {
     ra_clear_without_containers(ra);
-    free(ra);
+    roaring_free(ra);
 }
 
 void extend_array(roaring_array_t *ra, uint32_t k) {
@@ -139,9 +148,11 @@ void extend_array(roaring_array_t *ra, uint32_t k) {
         int new_capacity =
             (ra->size < 1024) ? 2 * desired_size : 5 * desired_size / 4;
 
-        ra->keys = realloc(ra->keys, sizeof(uint16_t) * new_capacity);
-        ra->containers = realloc(ra->containers, sizeof(void *) * new_capacity);
-        ra->typecodes = realloc(ra->typecodes, sizeof(uint8_t) * new_capacity);
+        ra->keys = roaring_realloc(ra->keys, sizeof(uint16_t) * new_capacity);
+        ra->containers =
+            roaring_realloc(ra->containers, sizeof(void *) * new_capacity);
+        ra->typecodes =
+            roaring_realloc(ra->typecodes, sizeof(uint8_t) * new_capacity);
         if (!ra->keys || !ra->containers || !ra->typecodes) {
             fprintf(stderr, "[%s] %s\n", __FILE__, __func__);
             perror(0);
@@ -175,9 +186,10 @@ void ra_append_copy(roaring_array_t *ra, roaring_array_t *sa, uint16_t index,
         ra->containers[pos] = sa->containers[index];
         ra->typecodes[pos] = sa->typecodes[index];
     } else {
-        ra->containers[pos] =
-            container_clone(sa->containers[index], sa->typecodes[index]);
+        // a shared container is cloned as its underlying type
         ra->typecodes[pos] = sa->typecodes[index];
+        ra->containers[pos] = get_copy_of_container(
+            sa->containers[index], &ra->typecodes[pos], copy_on_write);
     }
     ra->size++;
 }
@@ -204,9 +216,10 @@ void ra_append_copy_range(roaring_array_t *ra, roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
+            // a shared container is cloned as its underlying type
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -250,9 +263,10 @@ void ra_append_range(roaring_array_t *ra, roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
+            // a shared container is cloned as its underlying type
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -373,6 +387,21 @@ void ra_copy_range(roaring_array_t *ra, uint32_t begin, uint32_t end,
             sizeof(uint8_t) * range);
 }
 
+void ra_shift_tail(roaring_array_t *ra, int32_t count, int32_t distance) {
+    if (distance > 0) {
+        extend_array(ra, distance);
+    }
+    const int32_t srcpos = ra->size - count;
+    const int32_t dstpos = srcpos + distance;
+    memmove(&(ra->keys[dstpos]), &(ra->keys[srcpos]),
+            sizeof(uint16_t) * count);
+    memmove(&(ra->containers[dstpos]), &(ra->containers[srcpos]),
+            sizeof(void *) * count);
+    memmove(&(ra->typecodes[dstpos]), &(ra->typecodes[srcpos]),
+            sizeof(uint8_t) * count);
+    ra->size += distance;
+}
+
 void ra_set_container_at_index(roaring_array_t *ra, int32_t i, void *c,
                                uint8_t typecode) {
     assert(i < ra->size);
@@ -416,7 +445,8 @@ char *ra_serialize(roaring_array_t *ra, uint32_t *serialize_len,
 
     (*retry_with_array) = 0;
     /* [ 32 bit length ] [ serialization bytes ] */
-    if ((lens = (uint16_t *)malloc(sizeof(int16_t) * ra->size)) == NULL) {
+    lens = (uint16_t *)roaring_malloc(sizeof(int16_t) * ra->size);
+    if (lens == NULL) {
         *serialize_len = 0;
         return (NULL);
     }
@@ -433,14 +463,14 @@ char *ra_serialize(roaring_array_t *ra, uint32_t *serialize_len,
 
     if ((cardinality * sizeof(uint32_t)) < tot_len) {
         *retry_with_array = 1;
-        free(lens);
+        roaring_free(lens);
         return (NULL);
     }
 
-    out = (char *)malloc(tot_len);
+    out = (char *)roaring_malloc(tot_len);
 
     if (out == NULL) {
-        free(lens);
+        roaring_free(lens);
         *serialize_len = 0;
         return (NULL);
     } else
@@ -484,8 +514,8 @@ char *ra_serialize(roaring_array_t *ra, uint32_t *serialize_len,
             for (int32_t j = 0; j <= i; j++)
                 container_free(ra->containers[j], ra->typecodes[j]);
 
-            free(lens);
-            free(out);
+            roaring_free(lens);
+            roaring_free(out);
             assert(serialized_bytes != lens[i]);
             return (NULL);
         }
@@ -497,7 +527,7 @@ char *ra_serialize(roaring_array_t *ra, uint32_t *serialize_len,
         assert(tot_len != off);
     }
 
-    free(lens);
+    roaring_free(lens);
 
     return (out);
 }
@@ -514,26 +544,27 @@ roaring_array_t *ra_deserialize(const void *buf, uint32_t buf_len) {
 
     if (buf_len < expected_len) return (NULL);
 
-    if ((ra_copy = (roaring_array_t *)malloc(sizeof(roaring_array_t))) == NULL)
+    ra_copy = (roaring_array_t *)roaring_malloc(sizeof(roaring_array_t));
+    if (ra_copy == NULL)
         return (NULL);
 
     memcpy(ra_copy, bufaschar, off = sizeof(roaring_array_t));
 
-    if ((ra_copy->keys = malloc(size * sizeof(uint16_t))) == NULL) {
-        free(ra_copy);
+    if ((ra_copy->keys = roaring_malloc(size * sizeof(uint16_t))) == NULL) {
+        roaring_free(ra_copy);
         return (NULL);
     }
 
-    if ((ra_copy->containers = malloc(size * sizeof(void *))) == NULL) {
-        free(ra_copy->keys);
-        free(ra_copy);
+    if ((ra_copy->containers = roaring_malloc(size * sizeof(void *))) == NULL) {
+        roaring_free(ra_copy->keys);
+        roaring_free(ra_copy);
         return (NULL);
     }
 
-    if ((ra_copy->typecodes = malloc(size * sizeof(uint8_t))) == NULL) {
-        free(ra_copy->containers);
-        free(ra_copy->keys);
-        free(ra_copy);
+    if ((ra_copy->typecodes = roaring_malloc(size * sizeof(uint8_t))) == NULL) {
+        roaring_free(ra_copy->containers);
+        roaring_free(ra_copy->keys);
+        roaring_free(ra_copy);
         return (NULL);
     }
 
@@ -562,9 +593,9 @@ roaring_array_t *ra_deserialize(const void *buf, uint32_t buf_len) {
             for (int32_t j = 0; j < i; j++)
                 container_free(ra_copy->containers[j], ra_copy->typecodes[j]);
 
-            free(ra_copy->containers);
-            free(ra_copy->keys);
-            free(ra_copy);
+            roaring_free(ra_copy->containers);
+            roaring_free(ra_copy->keys);
+            roaring_free(ra_copy);
             return (NULL);
         }
 
@@ -615,7 +646,7 @@ size_t ra_portable_serialize(roaring_array_t *ra, char *buf) {
         memcpy(buf, &cookie, sizeof(cookie));
         buf += sizeof(cookie);
         uint32_t s = (ra->size + 7) / 8;
-        uint8_t *bitmapOfRunContainers = calloc(s, 1);
+        uint8_t *bitmapOfRunContainers = roaring_calloc(s, 1);
         assert(bitmapOfRunContainers != NULL);  // todo: handle
         for (int32_t i = 0; i < ra->size; ++i) {
             if (get_container_type(ra->containers[i], ra->typecodes[i]) ==
@@ -625,7 +656,7 @@ size_t ra_portable_serialize(roaring_array_t *ra, char *buf) {
         }
         memcpy(buf, bitmapOfRunContainers, s);
         buf += s;
-        free(bitmapOfRunContainers);
+        roaring_free(bitmapOfRunContainers);
         if (ra->size < NO_OFFSET_THRESHOLD) {
             startOffset = 4 + 4 * ra->size + s;
         } else {
@@ -695,15 +726,15 @@ roaring_array_t *ra_portable_deserialize(const char *buf) {
     bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
     if (hasrun) {
         int32_t s = (size + 7) / 8;
-        bitmapOfRunContainers = malloc((size + 7) / 8);
+        bitmapOfRunContainers = roaring_malloc((size + 7) / 8);
         assert(bitmapOfRunContainers != NULL);  // todo: handle
         memcpy(bitmapOfRunContainers, buf, s);
         buf += s;
     }
     uint16_t *keys = answer->keys;
-    int32_t *cardinalities = malloc(size * sizeof(int32_t));
+    int32_t *cardinalities = roaring_malloc(size * sizeof(int32_t));
     assert(cardinalities != NULL);  // todo: handle
-    bool *isBitmap = malloc(size * sizeof(bool));
+    bool *isBitmap = roaring_malloc(size * sizeof(bool));
     assert(isBitmap != NULL);  // todo: handle
     uint16_t tmp;
     for (int32_t k = 0; k < size; ++k) {
@@ -746,9 +777,265 @@ roaring_array_t *ra_portable_deserialize(const char *buf) {
             answer->typecodes[k] = ARRAY_CONTAINER_TYPE_CODE;
         }
     }
-    free(bitmapOfRunContainers);
-    free(cardinalities);
-    free(isBitmap);
+    roaring_free(bitmapOfRunContainers);
+    roaring_free(cardinalities);
+    roaring_free(isBitmap);
+    return answer;
+}
+
+roaring_array_t *ra_portable_deserialize_safe(const char *buf,
+                                              size_t maxbytes) {
+    assert(!IS_BIG_ENDIAN);  // not implemented
+    const char *const end = buf + maxbytes;
+#define RA_SAFE_AVAILABLE(n) ((size_t)(end - buf) >= (size_t)(n))
+    if (!RA_SAFE_AVAILABLE(sizeof(uint32_t))) return NULL;
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(int32_t));
+    buf += sizeof(uint32_t);
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return NULL;
+    }
+    int32_t size;
+    if ((cookie & 0xFFFF) == SERIAL_COOKIE)
+        size = (cookie >> 16) + 1;
+    else {
+        if (!RA_SAFE_AVAILABLE(sizeof(int32_t))) return NULL;
+        memcpy(&size, buf, sizeof(int32_t));
+        buf += sizeof(uint32_t);
+    }
+    if (size < 0 || size > MAX_CONTAINERS) return NULL;
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        if (!RA_SAFE_AVAILABLE((size + 7) / 8)) return NULL;
+        bitmapOfRunContainers = buf;
+        buf += (size + 7) / 8;
+    }
+    if (!RA_SAFE_AVAILABLE(size * 2 * sizeof(uint16_t))) return NULL;
+    const char *keyscards = buf;
+    buf += size * 2 * sizeof(uint16_t);
+    if ((!hasrun) || (size >= NO_OFFSET_THRESHOLD)) {
+        // skipping the offsets
+        if (!RA_SAFE_AVAILABLE(size * 4)) return NULL;
+        buf += size * 4;
+    }
+    roaring_array_t *answer = ra_create_with_capacity(size);
+    if (answer == NULL) return NULL;
+    for (int32_t k = 0; k < size; ++k) {
+        uint16_t key, tmp;
+        memcpy(&key, keyscards + 4 * k, sizeof(key));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        const int32_t cardinality = 1 + tmp;
+        if (k > 0 && key <= answer->keys[k - 1]) goto corrupted;
+        if (bitmapOfRunContainers != NULL &&
+            (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            uint16_t n_runs;
+            if (!RA_SAFE_AVAILABLE(sizeof(n_runs))) goto corrupted;
+            memcpy(&n_runs, buf, sizeof(n_runs));
+            if (n_runs == 0 ||
+                !RA_SAFE_AVAILABLE(sizeof(uint16_t) +
+                                   n_runs * sizeof(rle16_t))) {
+                goto corrupted;
+            }
+            run_container_t *c = run_container_create_given_capacity(n_runs);
+            if (c == NULL) goto corrupted;
+            buf += run_container_read(cardinality, c, buf);
+            ra_append(answer, key, c, RUN_CONTAINER_TYPE_CODE);
+            // runs must be sorted, disjoint, within 16 bits and add up to
+            // the stated cardinality
+            int32_t runs_cardinality = 0;
+            int32_t previous_end = -1;
+            for (int32_t r = 0; r < c->n_runs; ++r) {
+                const int32_t start = c->runs[r].value;
+                const int32_t run_end = start + c->runs[r].length;
+                if (start <= previous_end || run_end > 0xFFFF) goto corrupted;
+                runs_cardinality += run_end - start + 1;
+                previous_end = run_end;
+            }
+            if (runs_cardinality != cardinality) goto corrupted;
+        } else if (cardinality > DEFAULT_MAX_SIZE) {
+            if (!RA_SAFE_AVAILABLE(BITSET_CONTAINER_SIZE_IN_WORDS *
+                                   sizeof(uint64_t))) {
+                goto corrupted;
+            }
+            bitset_container_t *c = bitset_container_create();
+            if (c == NULL) goto corrupted;
+            buf += bitset_container_read(cardinality, c, buf);
+            ra_append(answer, key, c, BITSET_CONTAINER_TYPE_CODE);
+            if (bitset_container_compute_cardinality(c) != cardinality) {
+                goto corrupted;
+            }
+        } else {
+            if (!RA_SAFE_AVAILABLE(cardinality * sizeof(uint16_t))) {
+                goto corrupted;
+            }
+            array_container_t *c =
+                array_container_create_given_capacity(cardinality);
+            if (c == NULL) goto corrupted;
+            buf += array_container_read(cardinality, c, buf);
+            ra_append(answer, key, c, ARRAY_CONTAINER_TYPE_CODE);
+            for (int32_t i = 1; i < cardinality; ++i) {
+                if (c->array[i] <= c->array[i - 1]) goto corrupted;
+            }
+        }
+    }
+#undef RA_SAFE_AVAILABLE
+    return answer;
+
+corrupted:
+    ra_free(answer);
+    return NULL;
+}
+
+/* storage for one container of any type inside a frozen roaring array */
+typedef union {
+    array_container_t array;
+    run_container_t run;
+    bitset_container_t bitset;
+} frozen_container_slot_t;
+
+roaring_array_t *ra_portable_deserialize_frozen(const char *buf) {
+    assert(!IS_BIG_ENDIAN);  // not implemented
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(int32_t));
+    buf += sizeof(uint32_t);
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return NULL;
+    }
+    int32_t size;
+    if ((cookie & 0xFFFF) == SERIAL_COOKIE)
+        size = (cookie >> 16) + 1;
+    else {
+        memcpy(&size, buf, sizeof(int32_t));
+        buf += sizeof(uint32_t);
+    }
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        bitmapOfRunContainers = buf;
+        buf += (size + 7) / 8;
+    }
+    const char *keyscards = buf;
+    buf += size * 2 * sizeof(uint16_t);
+    if ((!hasrun) || (size >= NO_OFFSET_THRESHOLD)) {
+        // skipping the offsets
+        buf += size * 4;
+    }
+
+    // First pass: find out how many bitsets are not 8-byte aligned in the
+    // buffer, and how many 16-bit words of array and run data are not 2-byte
+    // aligned (the run bitmap or the buffer itself may have an odd length);
+    // these get copied, everything else is referenced in place.
+    int32_t num_copied_bitsets = 0;
+    size_t num_copied_words = 0;
+    const char *p = buf;
+    for (int32_t k = 0; k < size; ++k) {
+        uint16_t tmp;
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        const int32_t cardinality = 1 + tmp;
+        if (bitmapOfRunContainers != NULL &&
+            (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            uint16_t n_runs;
+            memcpy(&n_runs, p, sizeof(n_runs));
+            p += sizeof(uint16_t);
+            if (((uintptr_t)p & 1) != 0) num_copied_words += 2 * n_runs;
+            p += n_runs * sizeof(rle16_t);
+        } else if (cardinality > DEFAULT_MAX_SIZE) {
+            if (((uintptr_t)p & (sizeof(uint64_t) - 1)) != 0) {
+                num_copied_bitsets++;
+            }
+            p += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+        } else {
+            if (((uintptr_t)p & 1) != 0) num_copied_words += cardinality;
+            p += cardinality * sizeof(uint16_t);
+        }
+    }
+
+    // Everything lives in a single allocation: the roaring array, the
+    // container structs, the pointers to them, the copied bitsets, the
+    // copied array and run data, the keys and the typecodes (in order of
+    // decreasing alignment).
+    const size_t bytes =
+        sizeof(roaring_array_t) + size * sizeof(frozen_container_slot_t) +
+        size * sizeof(void *) +
+        num_copied_bitsets * BITSET_CONTAINER_SIZE_IN_WORDS *
+            sizeof(uint64_t) +
+        num_copied_words * sizeof(uint16_t) + size * sizeof(uint16_t) +
+        size * sizeof(uint8_t);
+    char *arena = roaring_malloc(bytes);
+    if (arena == NULL) {
+        return NULL;
+    }
+    roaring_array_t *answer = (roaring_array_t *)arena;
+    frozen_container_slot_t *slots =
+        (frozen_container_slot_t *)(arena + sizeof(roaring_array_t));
+    answer->containers = (void **)(slots + size);
+    uint64_t *copied_bitsets = (uint64_t *)(answer->containers + size);
+    uint16_t *copied_words =
+        (uint16_t *)(copied_bitsets +
+                     num_copied_bitsets * BITSET_CONTAINER_SIZE_IN_WORDS);
+    answer->keys = copied_words + num_copied_words;
+    answer->typecodes = (uint8_t *)(answer->keys + size);
+    answer->shared = NULL;
+    answer->size = size;
+    answer->allocation_size = size;
+
+    // Second pass: point the containers into the buffer.
+    for (int32_t k = 0; k < size; ++k) {
+        uint16_t tmp;
+        memcpy(&answer->keys[k], keyscards + 4 * k, sizeof(uint16_t));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        const int32_t cardinality = 1 + tmp;
+        if (bitmapOfRunContainers != NULL &&
+            (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            run_container_t *c = &slots[k].run;
+            uint16_t n_runs;
+            memcpy(&n_runs, buf, sizeof(n_runs));
+            c->n_runs = n_runs;
+            c->capacity = n_runs;
+            buf += sizeof(uint16_t);
+            if (((uintptr_t)buf & 1) != 0) {
+                memcpy(copied_words, buf, n_runs * sizeof(rle16_t));
+                c->runs = (rle16_t *)copied_words;
+                copied_words += 2 * n_runs;
+            } else {
+                c->runs = (rle16_t *)buf;
+            }
+            buf += n_runs * sizeof(rle16_t);
+            answer->containers[k] = c;
+            answer->typecodes[k] = RUN_CONTAINER_TYPE_CODE;
+        } else if (cardinality > DEFAULT_MAX_SIZE) {
+            bitset_container_t *c = &slots[k].bitset;
+            c->cardinality = cardinality;
+            if (((uintptr_t)buf & (sizeof(uint64_t) - 1)) != 0) {
+                memcpy(copied_bitsets, buf,
+                       BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t));
+                c->array = copied_bitsets;
+                copied_bitsets += BITSET_CONTAINER_SIZE_IN_WORDS;
+            } else {
+                c->array = (uint64_t *)buf;
+            }
+            buf += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+            answer->containers[k] = c;
+            answer->typecodes[k] = BITSET_CONTAINER_TYPE_CODE;
+        } else {
+            array_container_t *c = &slots[k].array;
+            c->cardinality = cardinality;
+            c->capacity = cardinality;
+            if (((uintptr_t)buf & 1) != 0) {
+                memcpy(copied_words, buf, cardinality * sizeof(uint16_t));
+                c->array = copied_words;
+                copied_words += cardinality;
+            } else {
+                c->array = (uint16_t *)buf;
+            }
+            buf += cardinality * sizeof(uint16_t);
+            answer->containers[k] = c;
+            answer->typecodes[k] = ARRAY_CONTAINER_TYPE_CODE;
+        }
+    }
     return answer;
 }
 
@@ -33,9 +33,9 @@ static void pq_add(roaring_pq_t *pq, roaring_pq_element_t *t) {
 }
 
 static void pq_free(roaring_pq_t *pq) {
-    free(pq->elements);
+    roaring_free(pq->elements);
     pq->elements = NULL;  // paranoid
-    free(pq);
+    roaring_free(pq);
 }
 
 static void percolate_down(roaring_pq_t *pq, uint32_t i) {
@@ -62,8 +62,8 @@ static void percolate_down(roaring_pq_t *pq, uint32_t i) {
 }
 
 static roaring_pq_t *create_pq(const roaring_bitmap_t **arr, uint32_t length) {
-    roaring_pq_t *answer = malloc(sizeof(roaring_pq_t));
-    answer->elements = malloc(sizeof(roaring_pq_element_t) * length);
+    roaring_pq_t *answer = roaring_malloc(sizeof(roaring_pq_t));
+    answer->elements = roaring_malloc(sizeof(roaring_pq_element_t) * length);
     answer->size = length;
     for (uint32_t i = 0; i < length; i++) {
         answer->elements[i].bitmap = (roaring_bitmap_t *) arr[i];
@@ -176,8 +176,8 @@ static roaring_bitmap_t *lazy_or_from_lazy_inputs(roaring_bitmap_t *x1,
     }
     ra_free_without_containers(x1->high_low_container);
     ra_free_without_containers(x2->high_low_container);
-    free(x1);
-    free(x2);
+    roaring_free(x1);
+    roaring_free(x2);
     return answer;
 }
 
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include <roaring/containers/array.h>
+#include <roaring/memory.h>
 #include <roaring/misc/configreport.h>
 
 #include "test.h"
@@ -115,6 +116,19 @@ void and_or_test() {
     array_container_intersection(B1, B2, TMP);
     assert_int_equal(card_inter, array_container_cardinality(TMP));
     assert_true(array_container_equals(BO, TMP));
+    assert_int_equal(card_inter,
+                     array_container_intersection_cardinality(B1, B2));
+
+    // skewed cardinalities go through the galloping path
+    array_container_clear(TMP);
+    for (size_t x = 0; x < (1 << 16); x += 4095) {
+        array_container_add(TMP, x);
+    }
+    array_container_intersection(B1, TMP, BO);
+    assert_int_equal(array_container_cardinality(BO),
+                     array_container_intersection_cardinality(B1, TMP));
+    assert_int_equal(array_container_cardinality(BO),
+                     array_container_intersection_cardinality(TMP, B1));
 
     array_container_union(B1, B2, TMP);
     assert_int_equal(card_union, array_container_cardinality(TMP));
@@ -127,6 +141,81 @@ void and_or_test() {
     array_container_free(TMP);
 }
 
+void andnot_test() {
+    DESCRIBE_TEST;
+
+    // strides chosen so that matches fall at every position of a vector
+    for (size_t stride = 1; stride < 80; stride += 13) {
+        array_container_t* B1 = array_container_create();
+        array_container_t* B2 = array_container_create();
+        array_container_t* BD = array_container_create();
+        array_container_t* TMP = array_container_create();
+
+        assert_non_null(B1);
+        assert_non_null(B2);
+        assert_non_null(BD);
+        assert_non_null(TMP);
+
+        for (size_t x = 0; x < (1 << 16); x += 3) {
+            array_container_add(B1, x);
+            if (x % stride != 0) array_container_add(BD, x);
+        }
+        for (size_t x = 0; x < (1 << 16); x += stride) {
+            array_container_add(B2, x);
+        }
+
+        array_container_andnot(B1, B2, TMP);
+        assert_true(array_container_equals(BD, TMP));
+
+        array_container_andnot(B1, B2, B1);  // in place
+        assert_true(array_container_equals(BD, B1));
+
+        array_container_andnot(B2, B2, TMP);
+        assert_int_equal(0, array_container_cardinality(TMP));
+
+        array_container_free(B1);
+        array_container_free(B2);
+        array_container_free(BD);
+        array_container_free(TMP);
+    }
+}
+
+void xor_test() {
+    DESCRIBE_TEST;
+
+    for (size_t stride = 1; stride < 80; stride += 13) {
+        array_container_t* B1 = array_container_create();
+        array_container_t* B2 = array_container_create();
+        array_container_t* BX = array_container_create();
+        array_container_t* TMP = array_container_create();
+
+        assert_non_null(B1);
+        assert_non_null(B2);
+        assert_non_null(BX);
+        assert_non_null(TMP);
+
+        for (size_t x = 0; x < (1 << 16); ++x) {
+            const bool in_1 = (x % 3 == 0), in_2 = (x % stride == 0);
+            if (in_1) array_container_add(B1, x);
+            if (in_2) array_container_add(B2, x);
+            if (in_1 != in_2) array_container_add(BX, x);
+        }
+
+        array_container_xor(B1, B2, TMP);
+        assert_true(array_container_equals(BX, TMP));
+        array_container_xor(B2, B1, TMP);
+        assert_true(array_container_equals(BX, TMP));
+
+        array_container_xor(B1, B1, TMP);
+        assert_int_equal(0, array_container_cardinality(TMP));
+
+        array_container_free(B1);
+        array_container_free(B2);
+        array_container_free(BX);
+        array_container_free(TMP);
+    }
+}
+
 void to_uint32_array_test() {
     for (size_t offset = 1; offset < 128; offset *= 2) {
         array_container_t* B = array_container_create();
@@ -174,11 +263,34 @@ void select_test() {
     array_container_free(B);
 }
 
+void pooled_grow_test() {
+    roaring_pool_enable(1 << 20);
+    array_container_t* B = array_container_create();
+    assert_non_null(B);
+    for (uint16_t x = 0; x < 3000; x += 2) {
+        array_container_add(B, x);
+        // capacities stay on size classes, so that payloads can be recycled
+        const int32_t bytes = B->capacity * (int32_t)sizeof(uint16_t);
+        assert_int_equal(bytes & (bytes - 1), 0);
+    }
+    for (uint16_t x = 0; x < 3000; x++) {
+        assert_int_equal(array_container_contains(B, x), x % 2 == 0);
+    }
+    // never beyond max
+    const int32_t capacity = B->capacity;
+    assert_true(array_container_grow(B, capacity + 1, capacity + 10, true));
+    assert_int_equal(B->cardinality, 1500);
+    assert_true(B->capacity > capacity && B->capacity <= capacity + 10);
+    array_container_free(B);
+    roaring_pool_disable();
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(printf_test), cmocka_unit_test(add_contains_test),
         cmocka_unit_test(and_or_test), cmocka_unit_test(to_uint32_array_test),
-        cmocka_unit_test(select_test),
+        cmocka_unit_test(select_test), cmocka_unit_test(andnot_test),
+        cmocka_unit_test(xor_test), cmocka_unit_test(pooled_grow_test),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -8,6 +8,8 @@
 #include <string.h>
 #include <time.h>
 #include <iostream>
+#include <utility>
+#include <vector>
 #include <roaring/roaring.h>
 #include "roaring.hh"
 
@@ -209,13 +211,203 @@ void test_example_cpp(bool copy_on_write) {
 
 }
 
+void test_move_cpp() {
+    Roaring a = Roaring::bitmapOf(4, 1, 2, 3, 1000);
+    Roaring b = Roaring::bitmapOf(3, 2, 3, 70000);
+    Roaring c = Roaring::bitmapOf(2, 3, 80000);
+
+    // moving steals the bitmap, the moved-from object can be reassigned
+    roaring_bitmap_t *storage = a.roaring;
+    Roaring m(std::move(a));
+    assert(m.roaring == storage);
+    a = b;
+    assert(a == b);
+    Roaring n;
+    n = std::move(m);
+    assert(n.roaring == storage);
+
+    // rvalue operands are reused for the result
+    Roaring x = n;
+    storage = x.roaring;
+    Roaring i = std::move(x) & b;
+    assert(i.roaring == storage);
+    assert(i == Roaring::bitmapOf(2, 2, 3));
+    Roaring u = n | b | c;
+    assert(u == Roaring::bitmapOf(6, 1, 2, 3, 1000, 70000, 80000));
+    Roaring s = (n ^ b) ^ c;
+    assert(s == Roaring::bitmapOf(5, 1, 3, 1000, 70000, 80000));
+    assert(n == Roaring::bitmapOf(4, 1, 2, 3, 1000));
+
+    // a temporary combined with itself
+    Roaring self = n;
+    Roaring same = std::move(self) & self;
+    assert(same == n);
+    self = n;
+    same = std::move(self) | self;
+    assert(same == n);
+    self = n;
+    assert((std::move(self) ^ self).isEmpty());
+    self = n;
+    assert((std::move(self) - self).isEmpty());
+
+    // bitmaps are moved, not copied, when the vector grows
+    std::vector<Roaring> v;
+    std::vector<roaring_bitmap_t *> pointers;
+    for (uint32_t k = 0; k < 100; k++) {
+        v.push_back(Roaring::bitmapOf(1, k));
+        pointers.push_back(v.back().roaring);
+    }
+    for (uint32_t k = 0; k < 100; k++) {
+        assert(v[k].roaring == pointers[k]);
+        assert(v[k].contains(k));
+    }
+}
+
+void test_iterator_cpp() {
+    // bitset, array and run containers, and an empty bitmap
+    Roaring r;
+    for (uint32_t i = 0; i < 65536; i += 3) r.add(i);
+    for (uint32_t i = 100000; i < 101000; i += 11) r.add(i);
+    for (uint32_t i = 300000; i < 310000; i++) r.add(i);
+    r.add(UINT32_MAX);
+    r.runOptimize();
+    assert(Roaring().begin() == Roaring().end());
+
+    uint64_t card = r.cardinality();
+    std::vector<uint32_t> expected(card);
+    r.toUint32Array(expected.data());
+    std::vector<uint32_t> values(r.begin(), r.end());
+    assert(values == expected);
+    uint64_t count = 0;
+    for (uint32_t v : r) {
+        assert(v == expected[count]);
+        count++;
+    }
+    assert(count == card);
+
+    // lower_bound and equalorlarger
+    assert(*r.lower_bound(0) == 0);
+    assert(*r.lower_bound(1) == 3);
+    assert(*r.lower_bound(65536) == 100000);
+    assert(*r.lower_bound(100001) == 100011);
+    assert(*r.lower_bound(305000) == 305000);
+    assert(*r.lower_bound(310000) == UINT32_MAX);
+    Roaring::const_iterator it = r.begin();
+    assert(it.equalorlarger(100500));
+    assert(*it == *std::lower_bound(expected.begin(), expected.end(), 100500));
+    assert(it.equalorlarger(UINT32_MAX));
+    assert(*it == UINT32_MAX);
+    ++it;
+    assert(it == r.end());
+    Roaring small = Roaring::bitmapOf(1, 5);
+    assert(small.lower_bound(6) == small.end());
+
+    // merge join: values of r that are also in q
+    Roaring q;
+    for (uint32_t i = 0; i < 400000; i += 7) q.add(i);
+    std::vector<uint32_t> joined;
+    Roaring::const_iterator a = r.begin(), b = q.begin();
+    while (a != r.end() && b != q.end()) {
+        if (*a == *b) {
+            joined.push_back(*a);
+            ++a;
+            ++b;
+        } else if (*a < *b) {
+            a.equalorlarger(*b);
+        } else {
+            b.equalorlarger(*a);
+        }
+    }
+    Roaring both = r & q;
+    std::vector<uint32_t> intersection(both.begin(), both.end());
+    assert(joined == intersection);
+
+    // bulk reads
+    std::vector<uint32_t> bulk;
+    uint32_t buf[1000];
+    Roaring::const_iterator c = r.begin();
+    uint32_t got;
+    while ((got = c.read(buf, 1000)) > 0) {
+        bulk.insert(bulk.end(), buf, buf + got);
+    }
+    assert(bulk == expected);
+    assert(c == r.end());
+}
+
+// bitset, array and run containers over a few keys, depending on the seed
+static Roaring make_mixed(uint32_t seed) {
+    Roaring r;
+    for (uint32_t key = seed % 3; key < 12; key += 1 + seed % 2) {
+        const uint32_t base = key << 16;
+        switch ((key + seed) % 3) {
+            case 0:
+                for (uint32_t i = seed; i < 65536; i += 2 + seed) r.add(base + i);
+                break;
+            case 1:
+                for (uint32_t i = seed; i < 65536; i += 101 + seed) r.add(base + i);
+                break;
+            default:
+                for (uint32_t i = 1000 * seed; i < 60000; i += 5000)
+                    for (uint32_t j = i; j < i + 1500; j++) r.add(base + j);
+                break;
+        }
+    }
+    r.runOptimize();
+    return r;
+}
 
+void test_expression_cpp() {
+    Roaring a = make_mixed(0), b = make_mixed(1), c = make_mixed(2),
+            d = make_mixed(3), empty;
+
+    Roaring expected = (a & b) | (c - d);
+    Roaring r = (lazy(a) & b) | (lazy(c) - d);
+    assert(r == expected);
+    assert(((lazy(a) & b) | (lazy(c) - d)).cardinality() ==
+           expected.cardinality());
+
+    // every operator, over leaves and nested expressions
+    const Roaring *inputs[] = {&a, &b, &c, &d, &empty};
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = 0; j < 5; j++) {
+            const Roaring &x = *inputs[i], &y = *inputs[j];
+            assert(Roaring(lazy(x) & y) == (x & y));
+            assert(Roaring(lazy(x) | y) == (x | y));
+            assert(Roaring(lazy(x) ^ y) == (x ^ y));
+            if (&x != &y) assert(Roaring(lazy(x) - y) == (x - y));
+            assert((lazy(x) & y).cardinality() == (x & y).cardinality());
+            assert((lazy(x) | y).cardinality() == (x | y).cardinality());
+            assert((lazy(x) ^ y).cardinality() == (x ^ y).cardinality());
+            assert((lazy(x) - y).cardinality() == (x - y).cardinality());
+            assert((lazy(x) & y).isEmpty() == (x & y).isEmpty());
+            assert(lazy(x).intersects(y) == !(x & y).isEmpty());
+
+            Roaring nested = ((x ^ c) - (y & d)) | (a & (y ^ b));
+            assert(Roaring(((lazy(x) ^ c) - (lazy(y) & d)) |
+                           (a & (lazy(y) ^ b))) == nested);
+            assert((((lazy(x) ^ c) - (lazy(y) & d)) | (a & (lazy(y) ^ b)))
+                       .cardinality() == nested.cardinality());
+            assert((lazy(x) | y).intersects(lazy(c) - d) ==
+                   !((x | y) & (c - d)).isEmpty());
+        }
+    }
+
+    // assigning to a bitmap the expression refers to
+    Roaring t = a;
+    t = (lazy(t) & b) | c;
+    assert(t == ((a & b) | c));
+    assert(Roaring(lazy(empty) | empty).isEmpty());
+    assert(!lazy(a).intersects(lazy(empty)));
+}
 
 int main() {
   test_example(true);
   test_example(false);
   test_example_cpp(true);
   test_example_cpp(false);
+  test_move_cpp();
+  test_iterator_cpp();
+  test_expression_cpp();
 
   return EXIT_SUCCESS;
 }
@@ -1364,6 +1364,85 @@ void run_array_andnot_bug_test() {
     array_container_free(result);
 }
 
+void array_run_intersection_test() {
+    // many short runs against arrays ranging from very sparse to dense, so
+    // that either side gets to gallop over the other
+    run_container_t* r = run_container_create();
+    for (uint32_t start = 5; start < (1 << 16); start += 7) {
+        run_container_add_range(r, start, start + 2);
+    }
+    run_container_add_range(r, 65530, 65535);
+
+    for (uint32_t stride = 1; stride < (1 << 16); stride *= 3) {
+        array_container_t* a = array_container_create();
+        array_container_t* expected = array_container_create();
+        array_container_t* out = array_container_create();
+        for (uint32_t x = stride / 2; x < (1 << 16); x += stride) {
+            array_container_add(a, x);
+            if (run_container_contains(r, x)) array_container_add(expected, x);
+        }
+        array_container_add(a, 65535);
+        array_container_add(expected, 65535);
+
+        array_run_container_intersection(a, r, out);
+        assert_true(array_container_equals(expected, out));
+        assert_int_equal(array_container_cardinality(expected),
+                         array_run_container_intersection_cardinality(a, r));
+        assert_true(array_run_container_intersect(a, r));
+
+        array_run_container_intersection(a, r, a);  // in place
+        assert_true(array_container_equals(expected, a));
+
+        array_container_free(a);
+        array_container_free(expected);
+        array_container_free(out);
+    }
+
+    array_container_t* a = array_container_create();
+    for (uint32_t start = 1; start < (1 << 16) - 8; start += 7) {
+        array_container_add(a, start);  // falls in the gaps between runs
+    }
+    array_container_t* out = array_container_create();
+    array_run_container_intersection(a, r, out);
+    assert_int_equal(0, array_container_cardinality(out));
+    assert_int_equal(0, array_run_container_intersection_cardinality(a, r));
+    assert_false(array_run_container_intersect(a, r));
+
+    run_container_free(r);
+    array_container_free(a);
+    array_container_free(out);
+}
+
+void run_run_lazy_union_conversion_test() {
+    // single values make poor runs: the union becomes an array when small
+    // and a bitset when large, and the temporary run container is freed
+    for (uint32_t stride = 16; stride >= 2; stride /= 8) {
+        run_container_t* r1 = run_container_create();
+        run_container_t* r2 = run_container_create();
+        for (uint32_t x = 0; x < (1 << 16); x += 2 * stride) {
+            run_container_add(r1, x);
+            run_container_add(r2, x + stride);
+        }
+        uint8_t result_type;
+        void* result = container_lazy_or(r1, RUN_CONTAINER_TYPE_CODE, r2,
+                                         RUN_CONTAINER_TYPE_CODE, &result_type);
+        assert_non_null(result);
+        assert_int_equal(result_type, (stride == 16)
+                                          ? ARRAY_CONTAINER_TYPE_CODE
+                                          : BITSET_CONTAINER_TYPE_CODE);
+        result = container_repair_after_lazy(result, &result_type);
+        assert_int_equal(container_get_cardinality(result, result_type),
+                         (1 << 16) / stride);
+        for (uint32_t x = 0; x < (1 << 16); x++) {
+            assert_int_equal(container_contains(result, x, result_type),
+                             x % stride == 0);
+        }
+        container_free(result, result_type);
+        run_container_free(r1);
+        run_container_free(r2);
+    }
+}
+
 void array_negation_empty_test() {
     array_container_t* AI = array_container_create();
     bitset_container_t* BO = bitset_container_create();
@@ -2001,6 +2080,8 @@ int main() {
         cmocka_unit_test(run_xor_test), cmocka_unit_test(run_ixor_test),
         cmocka_unit_test(run_andnot_test), cmocka_unit_test(run_iandnot_test),
         cmocka_unit_test(run_array_andnot_bug_test),
+        cmocka_unit_test(array_run_intersection_test),
+        cmocka_unit_test(run_run_lazy_union_conversion_test),
         cmocka_unit_test(array_bitset_ixor_test),
         cmocka_unit_test(array_bitset_iandnot_test),
         cmocka_unit_test(array_negation_empty_test),
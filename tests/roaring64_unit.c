@@ -0,0 +1,279 @@
+/*
+ * roaring64_unit.c
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <roaring/roaring64.h>
+
+#include "test.h"
+
+/* values spread over several high words, some of them adjacent */
+static roaring64_bitmap_t *make_bitmap(uint64_t seed) {
+    roaring64_bitmap_t *r = roaring64_bitmap_create();
+    for (uint64_t high = 0; high < 6; ++high) {
+        const uint64_t base = (high * (seed + 1)) << 32;
+        for (uint64_t i = seed; i < 200000; i += 7 + seed)
+            roaring64_bitmap_add(r, base + i);
+        roaring64_bitmap_add(r, base + UINT32_MAX);
+    }
+    roaring64_bitmap_add(r, UINT64_MAX);
+    return r;
+}
+
+typedef struct count_state_s {
+    uint64_t count;
+    uint64_t last;
+    bool ordered;
+} count_state_t;
+
+static void count_values(uint64_t value, void *param) {
+    count_state_t *state = (count_state_t *)param;
+    if (state->count > 0 && value <= state->last) state->ordered = false;
+    state->count++;
+    state->last = value;
+}
+
+void basic_test() {
+    roaring64_bitmap_t *r = roaring64_bitmap_create();
+    assert_true(roaring64_bitmap_is_empty(r));
+    const uint64_t vals[] = {0, 1, UINT32_MAX, (uint64_t)UINT32_MAX + 1,
+                             UINT64_C(1) << 40, UINT64_MAX};
+    const size_t n = sizeof(vals) / sizeof(vals[0]);
+    for (size_t i = n; i-- > 0;) roaring64_bitmap_add(r, vals[i]);
+    roaring64_bitmap_add(r, vals[2]);
+    assert_int_equal(roaring64_bitmap_get_cardinality(r), n);
+    for (size_t i = 0; i < n; ++i)
+        assert_true(roaring64_bitmap_contains(r, vals[i]));
+    assert_false(roaring64_bitmap_contains(r, 2));
+    assert_false(roaring64_bitmap_contains(r, (UINT64_C(1) << 40) + 1));
+
+    uint64_t out[sizeof(vals) / sizeof(vals[0])];
+    roaring64_bitmap_to_uint64_array(r, out);
+    assert_memory_equal(out, vals, sizeof(vals));
+
+    roaring64_bitmap_t *r2 = roaring64_bitmap_of_ptr(n, vals);
+    assert_true(roaring64_bitmap_equals(r, r2));
+    roaring64_bitmap_free(r2);
+
+    // emptied high words are dropped
+    roaring64_bitmap_remove(r, UINT64_C(1) << 40);
+    roaring64_bitmap_remove(r, UINT64_C(1) << 40);
+    assert_int_equal(r->size, 3);
+    assert_int_equal(roaring64_bitmap_get_cardinality(r), n - 1);
+    for (size_t i = 0; i < n; ++i) roaring64_bitmap_remove(r, vals[i]);
+    assert_true(roaring64_bitmap_is_empty(r));
+    roaring64_bitmap_free(r);
+}
+
+void add_many_test() {
+    // unsorted, with duplicates, more values per high word than one batch
+    enum { N = 5000 };
+    uint64_t *vals = malloc(N * sizeof(uint64_t));
+    for (size_t i = 0; i < N; ++i) {
+        const uint64_t high = (i < 3000) ? 7 : (i % 3);
+        vals[i] = (high << 32) | ((i * 7919) % 4000);
+    }
+    roaring64_bitmap_t *expected = roaring64_bitmap_create();
+    for (size_t i = 0; i < N; ++i) roaring64_bitmap_add(expected, vals[i]);
+    roaring64_bitmap_t *r = roaring64_bitmap_create();
+    roaring64_bitmap_add_many(r, N, vals);
+    assert_true(roaring64_bitmap_equals(r, expected));
+    roaring64_bitmap_add_many(r, 0, vals);
+    assert_true(roaring64_bitmap_equals(r, expected));
+    roaring64_bitmap_free(r);
+    roaring64_bitmap_free(expected);
+    free(vals);
+}
+
+static int64_t allocation_budget = 0;
+
+static void *budget_malloc(size_t size) {
+    return (allocation_budget-- > 0) ? malloc(size) : NULL;
+}
+
+static void *budget_realloc(void *ptr, size_t size) {
+    return (allocation_budget-- > 0) ? realloc(ptr, size) : NULL;
+}
+
+static void *budget_calloc(size_t count, size_t size) {
+    return (allocation_budget-- > 0) ? calloc(count, size) : NULL;
+}
+
+static void *budget_aligned_malloc(size_t alignment, size_t size) {
+    size = (size + alignment - 1) / alignment * alignment;
+    return (allocation_budget-- > 0) ? aligned_alloc(alignment, size) : NULL;
+}
+
+void add_many_out_of_memory_test() {
+    const uint64_t vals[] = {UINT64_C(3) << 32, (UINT64_C(3) << 32) + 1,
+                             UINT64_C(5) << 32, UINT64_C(9) << 32};
+    const size_t n = sizeof(vals) / sizeof(vals[0]);
+    roaring_memory_t hook = {budget_malloc,         budget_realloc,
+                             budget_calloc,         free,
+                             budget_aligned_malloc, free};
+    for (int64_t budget = 0;; ++budget) {
+        roaring64_bitmap_t *r = roaring64_bitmap_create();
+        roaring64_bitmap_add(r, 1);
+        roaring_init_memory_hook(hook);
+        allocation_budget = budget;
+        roaring64_bitmap_add_many(r, n, vals);
+        roaring_reset_memory_hook();
+        // whatever made it in is there, and no empty 32-bit bitmap is left
+        const bool done = roaring64_bitmap_get_cardinality(r) == n + 1;
+        assert_true(roaring64_bitmap_contains(r, 1));
+        for (int32_t i = 0; i < r->size; ++i) {
+            assert_false(roaring_bitmap_is_empty(r->bitmaps[i]));
+        }
+        roaring64_bitmap_free(r);
+        if (done) break;
+    }
+}
+
+void iterate_test() {
+    roaring64_bitmap_t *r = make_bitmap(3);
+    const uint64_t card = roaring64_bitmap_get_cardinality(r);
+    count_state_t state = {0, 0, true};
+    roaring64_iterate(r, count_values, &state);
+    assert_int_equal(state.count, card);
+    assert_true(state.ordered);
+    assert_true(state.last == UINT64_MAX);
+
+    uint64_t *vals = (uint64_t *)malloc(card * sizeof(uint64_t));
+    roaring64_bitmap_to_uint64_array(r, vals);
+    for (uint64_t i = 0; i < card; ++i) {
+        assert_true(roaring64_bitmap_contains(r, vals[i]));
+        if (i > 0) assert_true(vals[i - 1] < vals[i]);
+    }
+    free(vals);
+    roaring64_bitmap_free(r);
+}
+
+typedef roaring64_bitmap_t *(*op_t)(const roaring64_bitmap_t *,
+                                    const roaring64_bitmap_t *);
+typedef void (*inplace_op_t)(roaring64_bitmap_t *,
+                             const roaring64_bitmap_t *);
+
+/* checks op against a value-by-value evaluation of 'rule' */
+static void check_op(const roaring64_bitmap_t *x1,
+                     const roaring64_bitmap_t *x2, op_t op,
+                     inplace_op_t inplace, int rule) {
+    roaring64_bitmap_t *expected = roaring64_bitmap_create();
+    const roaring64_bitmap_t *inputs[2] = {x1, x2};
+    for (int k = 0; k < 2; ++k) {
+        const uint64_t card = roaring64_bitmap_get_cardinality(inputs[k]);
+        uint64_t *vals = (uint64_t *)malloc(card * sizeof(uint64_t));
+        roaring64_bitmap_to_uint64_array(inputs[k], vals);
+        for (uint64_t i = 0; i < card; ++i) {
+            const bool in1 = roaring64_bitmap_contains(x1, vals[i]);
+            const bool in2 = roaring64_bitmap_contains(x2, vals[i]);
+            const bool keep = rule == 0   ? in1 && in2
+                              : rule == 1 ? in1 || in2
+                              : rule == 2 ? in1 != in2
+                                          : in1 && !in2;
+            if (keep) roaring64_bitmap_add(expected, vals[i]);
+        }
+        free(vals);
+    }
+    roaring64_bitmap_t *actual = op(x1, x2);
+    assert_true(roaring64_bitmap_equals(actual, expected));
+    roaring64_bitmap_free(actual);
+    actual = roaring64_bitmap_copy(x1);
+    inplace(actual, x2);
+    assert_true(roaring64_bitmap_equals(actual, expected));
+    for (int32_t i = 0; i < actual->size; ++i)
+        assert_false(roaring_bitmap_is_empty(actual->bitmaps[i]));
+    roaring64_bitmap_free(actual);
+    roaring64_bitmap_free(expected);
+}
+
+void binary_ops_test() {
+    roaring64_bitmap_t *x1 = make_bitmap(0);
+    roaring64_bitmap_t *x2 = make_bitmap(1);
+    roaring64_bitmap_t *empty = roaring64_bitmap_create();
+    const roaring64_bitmap_t *pairs[][2] = {
+        {x1, x2}, {x2, x1}, {x1, empty}, {empty, x1}, {x1, x1}};
+    for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); ++p) {
+        const roaring64_bitmap_t *a = pairs[p][0], *b = pairs[p][1];
+        roaring64_bitmap_t *copy = roaring64_bitmap_copy(b);  // distinct x2
+        check_op(a, copy, roaring64_bitmap_and, roaring64_bitmap_and_inplace,
+                 0);
+        check_op(a, copy, roaring64_bitmap_or, roaring64_bitmap_or_inplace, 1);
+        check_op(a, copy, roaring64_bitmap_xor, roaring64_bitmap_xor_inplace,
+                 2);
+        check_op(a, copy, roaring64_bitmap_andnot,
+                 roaring64_bitmap_andnot_inplace, 3);
+        roaring64_bitmap_free(copy);
+    }
+    roaring64_bitmap_free(empty);
+    roaring64_bitmap_free(x2);
+    roaring64_bitmap_free(x1);
+}
+
+void serialize_test() {
+    roaring64_bitmap_t *bitmaps[2] = {make_bitmap(2),
+                                      roaring64_bitmap_create()};
+    for (int k = 0; k < 2; ++k) {
+        roaring64_bitmap_t *r = bitmaps[k];
+        const size_t size = roaring64_bitmap_portable_size_in_bytes(r);
+        char *buf = (char *)malloc(size);
+        assert_int_equal(roaring64_bitmap_portable_serialize(r, buf), size);
+
+        roaring64_bitmap_t *back =
+            roaring64_bitmap_portable_deserialize_safe(buf, size);
+        assert_non_null(back);
+        assert_true(roaring64_bitmap_equals(back, r));
+        roaring64_bitmap_free(back);
+
+        // truncated input is rejected
+        for (size_t len = 0; len < size; len += 1 + len / 2)
+            assert_null(roaring64_bitmap_portable_deserialize_safe(buf, len));
+        free(buf);
+    }
+
+    // the layout: a 64-bit count, then high bits and a 32-bit bitmap
+    roaring64_bitmap_t *r = roaring64_bitmap_create();
+    roaring64_bitmap_add(r, (UINT64_C(7) << 32) | 5);
+    roaring_bitmap_t *low = roaring_bitmap_of(1, 5);
+    const size_t low_size = roaring_bitmap_portable_size_in_bytes(low);
+    char expected[64];
+    const uint64_t count = 1;
+    const uint32_t high = 7;
+    memcpy(expected, &count, 8);
+    memcpy(expected + 8, &high, 4);
+    roaring_bitmap_portable_serialize(low, expected + 12);
+    char actual[64];
+    assert_int_equal(roaring64_bitmap_portable_serialize(r, actual),
+                     12 + low_size);
+    assert_memory_equal(actual, expected, 12 + low_size);
+
+    // high bits must be strictly increasing
+    char twice[128];
+    const uint64_t two = 2;
+    memcpy(twice, &two, 8);
+    memcpy(twice + 8, expected + 8, 4 + low_size);
+    memcpy(twice + 12 + low_size, expected + 8, 4 + low_size);
+    assert_null(roaring64_bitmap_portable_deserialize_safe(
+        twice, 8 + 2 * (4 + low_size)));
+
+    roaring_bitmap_free(low);
+    roaring64_bitmap_free(r);
+    roaring64_bitmap_free(bitmaps[1]);
+    roaring64_bitmap_free(bitmaps[0]);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(basic_test),
+        cmocka_unit_test(add_many_test),
+        cmocka_unit_test(add_many_out_of_memory_test),
+        cmocka_unit_test(iterate_test),
+        cmocka_unit_test(binary_ops_test), cmocka_unit_test(serialize_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -78,6 +78,58 @@ void add_contains_test() {
     run_container_free(B);
 }
 
+void add_many_test() {
+    // the existing runs: [100, 199], [300, 309], [1000, 1000], [65530, 65535]
+    run_container_t* B = run_container_create();
+    assert_non_null(B);
+    run_container_add_range(B, 100, 199);
+    run_container_add_range(B, 300, 309);
+    run_container_add(B, 1000);
+    run_container_add_range(B, 65530, 65535);
+
+    // values before, inside, touching, bridging and after the runs
+    uint16_t list[1000];
+    int32_t length = 0;
+    for (uint16_t x = 0; x < 10; x++) list[length++] = x;
+    list[length++] = 99;
+    list[length++] = 150;
+    for (uint16_t x = 200; x < 300; x += 2) list[length++] = x;
+    list[length++] = 310;
+    list[length++] = 999;
+    list[length++] = 1001;
+    for (uint16_t x = 2000; x < 2800; x++) list[length++] = x;
+    list[length++] = 65529;
+
+    for (int32_t prefix = 0; prefix <= length;
+         prefix += (prefix < 16) ? 1 : 97) {
+        run_container_t* actual = run_container_clone(B);
+        run_container_t* expected = run_container_clone(B);
+        assert_non_null(actual);
+        assert_non_null(expected);
+        for (int32_t i = 0; i < prefix; i++) {
+            run_container_add(expected, list[i]);
+        }
+        assert_true(run_container_add_many(actual, list, prefix));
+        assert_true(run_container_equals(actual, expected));
+        assert_int_equal(actual->n_runs, expected->n_runs);
+        assert_true(actual->n_runs <= actual->capacity);
+        run_container_free(actual);
+        run_container_free(expected);
+    }
+
+    // into an empty container
+    run_container_t* empty = run_container_create();
+    assert_non_null(empty);
+    assert_true(run_container_add_many(empty, list, length));
+    assert_int_equal(run_container_cardinality(empty), length);
+    for (int32_t i = 0; i < length; i++) {
+        assert_true(run_container_contains(empty, list[i]));
+    }
+    run_container_free(empty);
+
+    run_container_free(B);
+}
+
 void and_or_test() {
     run_container_t* B1 = run_container_create();
     run_container_t* B2 = run_container_create();
@@ -168,6 +220,7 @@ void select_test() {
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(printf_test), cmocka_unit_test(add_contains_test),
+        cmocka_unit_test(add_many_test),
         cmocka_unit_test(and_or_test), cmocka_unit_test(to_uint32_array_test),
         cmocka_unit_test(select_test),
     };
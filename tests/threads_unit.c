@@ -0,0 +1,187 @@
+/*
+ * threads_unit.c
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <roaring/roaring.h>
+
+#include "test.h"
+
+enum { NUM_READERS = 4, NUM_ROUNDS = 25, NUM_KEYS = 16, READER_COPIES = 20 };
+
+typedef struct reader_s {
+    roaring_bitmap_t *snapshot; /* owned by the reader, which frees it */
+    uint64_t cardinality;       /* of the snapshot when it was taken */
+    bool pooled;
+    bool ok;
+} reader_t;
+
+/* bitset, array and run containers on alternating keys */
+static roaring_bitmap_t *make_master(void) {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t key = 0; key < NUM_KEYS; ++key) {
+        const uint32_t base = key << 16;
+        switch (key % 3) {
+            case 0:
+                for (uint32_t i = 0; i < 65536; i += 3)
+                    roaring_bitmap_add(r, base + i);
+                break;
+            case 1:
+                for (uint32_t i = key; i < 65536; i += 211)
+                    roaring_bitmap_add(r, base + i);
+                break;
+            default:
+                for (uint32_t i = 0; i < 65536; i += 4096)
+                    for (uint32_t j = i; j < i + 2000; ++j)
+                        roaring_bitmap_add(r, base + j);
+                break;
+        }
+    }
+    roaring_bitmap_run_optimize(r);
+    r->copy_on_write = true;
+    return r;
+}
+
+/* copies the snapshot over and over, unsharing every container of the copy */
+static void *reader_run(void *arg) {
+    reader_t *reader = (reader_t *)arg;
+    if (reader->pooled) roaring_pool_enable(1 << 20);
+    reader->ok = true;
+    for (int k = 0; k < READER_COPIES; ++k) {
+        roaring_bitmap_t *copy = roaring_bitmap_copy(reader->snapshot);
+        if (roaring_bitmap_get_cardinality(copy) != reader->cardinality)
+            reader->ok = false;
+        uint64_t added = 0;
+        for (uint32_t key = 0; key < NUM_KEYS; ++key) {
+            const uint32_t x = (key << 16) + 65535;
+            if (!roaring_bitmap_contains(copy, x)) added++;
+            roaring_bitmap_add(copy, x);
+        }
+        if (roaring_bitmap_get_cardinality(copy) !=
+            reader->cardinality + added)
+            reader->ok = false;
+        roaring_bitmap_t *u = roaring_bitmap_or(copy, reader->snapshot);
+        if (!roaring_bitmap_equals(u, copy)) reader->ok = false;
+        roaring_bitmap_free(u);
+        roaring_bitmap_free(copy);
+    }
+    const uint64_t card = roaring_bitmap_get_cardinality(reader->snapshot);
+    if (card != reader->cardinality) reader->ok = false;
+    roaring_bitmap_free(reader->snapshot);
+    if (reader->pooled) roaring_pool_disable();
+    return NULL;
+}
+
+/* Readers work on copy-on-write snapshots while the master is modified. */
+void cow_snapshots_test() {
+    roaring_bitmap_t *master = make_master();
+    uint64_t expected = roaring_bitmap_get_cardinality(master);
+
+    for (int round = 0; round < NUM_ROUNDS; ++round) {
+        reader_t readers[NUM_READERS];
+        pthread_t threads[NUM_READERS];
+        for (int t = 0; t < NUM_READERS; ++t) {
+            readers[t].snapshot = roaring_bitmap_copy(master);
+            readers[t].cardinality = expected;
+            readers[t].pooled = (t % 2) == 1;
+            assert_non_null(readers[t].snapshot);
+            assert_int_equal(pthread_create(&threads[t], NULL, reader_run,
+                                            &readers[t]),
+                             0);
+        }
+        // unshare and modify every container of the master meanwhile
+        for (uint32_t key = 0; key < NUM_KEYS; ++key) {
+            const uint32_t x = (key << 16) + 1 + round;
+            if (roaring_bitmap_contains(master, x)) {
+                roaring_bitmap_remove(master, x);
+                expected--;
+            } else {
+                roaring_bitmap_add(master, x);
+                expected++;
+            }
+        }
+        for (int t = 0; t < NUM_READERS; ++t) {
+            assert_int_equal(pthread_join(threads[t], NULL), 0);
+            assert_true(readers[t].ok);
+        }
+        assert_int_equal(roaring_bitmap_get_cardinality(master), expected);
+    }
+    roaring_bitmap_free(master);
+}
+
+typedef struct snapshot_reader_s {
+    const roaring_bitmap_t *snapshot; /* read by all readers at once */
+    uint64_t cardinality;
+    bool ok;
+} snapshot_reader_t;
+
+static void *snapshot_reader_run(void *arg) {
+    snapshot_reader_t *reader = (snapshot_reader_t *)arg;
+    reader->ok = true;
+    for (int k = 0; k < READER_COPIES; ++k) {
+        const roaring_bitmap_t *mine =
+            roaring_bitmap_snapshot((roaring_bitmap_t *)reader->snapshot);
+        if (roaring_bitmap_get_cardinality(mine) != reader->cardinality)
+            reader->ok = false;
+        roaring_bitmap_t *u = roaring_bitmap_or(mine, reader->snapshot);
+        if (roaring_bitmap_get_cardinality(u) != reader->cardinality)
+            reader->ok = false;
+        roaring_bitmap_free(u);
+        roaring_bitmap_snapshot_free(mine);
+    }
+    const uint64_t card = roaring_bitmap_get_cardinality(reader->snapshot);
+    if (card != reader->cardinality) reader->ok = false;
+    return NULL;
+}
+
+/* Readers share one snapshot while the writer keeps modifying the bitmap. */
+void shared_snapshot_test() {
+    roaring_bitmap_t *live = make_master();
+    live->copy_on_write = false;
+    uint64_t expected = roaring_bitmap_get_cardinality(live);
+
+    for (int round = 0; round < NUM_ROUNDS; ++round) {
+        const roaring_bitmap_t *snapshot = roaring_bitmap_snapshot(live);
+        assert_non_null(snapshot);
+        snapshot_reader_t readers[NUM_READERS];
+        pthread_t threads[NUM_READERS];
+        for (int t = 0; t < NUM_READERS; ++t) {
+            readers[t].snapshot = snapshot;
+            readers[t].cardinality = expected;
+            assert_int_equal(pthread_create(&threads[t], NULL,
+                                            snapshot_reader_run, &readers[t]),
+                             0);
+        }
+        for (uint32_t key = 0; key < NUM_KEYS; ++key) {
+            const uint32_t x = (key << 16) + 1 + round;
+            if (roaring_bitmap_contains(live, x)) {
+                roaring_bitmap_remove(live, x);
+                expected--;
+            } else {
+                roaring_bitmap_add(live, x);
+                expected++;
+            }
+        }
+        for (int t = 0; t < NUM_READERS; ++t) {
+            assert_int_equal(pthread_join(threads[t], NULL), 0);
+            assert_true(readers[t].ok);
+        }
+        roaring_bitmap_snapshot_free(snapshot);
+        assert_int_equal(roaring_bitmap_get_cardinality(live), expected);
+    }
+    roaring_bitmap_free(live);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(cow_snapshots_test),
+        cmocka_unit_test(shared_snapshot_test),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -538,7 +538,7 @@ void test_serialize() {
     assert_true(roaring_bitmap_equals(r1, r2));
     free(arr1);
     free(arr2);
-    free(serialized);
+    roaring_free(serialized);
     roaring_bitmap_free(r1);
     roaring_bitmap_free(r2);
 
@@ -575,7 +575,7 @@ void test_serialize() {
     assert_true(roaring_bitmap_equals(r1, r2));
     free(arr1);
     free(arr2);
-    free(serialized);
+    roaring_free(serialized);
     roaring_bitmap_free(r1);
     roaring_bitmap_free(r2);
 
@@ -601,7 +601,7 @@ void test_serialize() {
     assert_true(roaring_bitmap_equals(r1, r2));
     free(arr1);
     free(arr2);
-    free(serialized);
+    roaring_free(serialized);
     roaring_bitmap_free(r1);
     roaring_bitmap_free(r2);
 
@@ -611,7 +611,7 @@ void test_serialize() {
     uint32_t size;
     char *buff = roaring_bitmap_serialize(old_bm, &size);
     roaring_bitmap_t *new_bm = roaring_bitmap_deserialize(buff, size);
-    free(buff);
+    roaring_free(buff);
     assert_true((unsigned int)roaring_bitmap_get_cardinality(old_bm) ==
                 (unsigned int)roaring_bitmap_get_cardinality(new_bm));
     assert_true(roaring_bitmap_equals(old_bm, new_bm));
@@ -632,6 +632,176 @@ void test_add() {
     roaring_bitmap_free(r1);
 }
 
+void test_add_many() {
+    const uint32_t n = 200000;
+    uint32_t *vals = (uint32_t *)malloc(n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; ++i) {
+        if (i < n / 4)
+            vals[i] = 3 * i;  // sorted, becomes bitsets
+        else if (i < n / 2)
+            vals[i] = (i * 2654435761u) % (1u << 22);  // unsorted
+        else
+            vals[i] = vals[i - n / 2];  // duplicates
+    }
+    roaring_bitmap_t *r1 = roaring_bitmap_create();
+    roaring_bitmap_t *r2 = roaring_bitmap_create();
+    roaring_bitmap_add(r1, 1u << 20);
+    roaring_bitmap_add(r2, 1u << 20);
+    for (uint32_t v = 100; v < 20000; ++v) {
+        roaring_bitmap_add(r1, v);
+        roaring_bitmap_add(r2, v);
+    }
+    roaring_bitmap_run_optimize(r1);
+    roaring_bitmap_run_optimize(r2);
+    for (uint32_t i = 0; i < n; ++i) roaring_bitmap_add(r1, vals[i]);
+    roaring_bitmap_add_many(r2, n, vals);
+    assert_true(roaring_bitmap_equals(r1, r2));
+    assert_int_equal(roaring_bitmap_get_cardinality(r1),
+                     roaring_bitmap_get_cardinality(r2));
+
+    roaring_bitmap_t *r3 = roaring_bitmap_of_ptr(n, vals);
+    assert_true(roaring_bitmap_add_many(r3, 0, vals));
+    for (uint32_t i = 0; i < n; ++i)
+        assert_true(roaring_bitmap_contains(r3, vals[i]));
+
+    // batches merged into the middle of an array container, with overlaps
+    for (uint32_t i = 0; i < 1500; ++i) vals[i] = 4 * i + 1000;
+    roaring_bitmap_t *r4 = roaring_bitmap_of_ptr(1500, vals);
+    roaring_bitmap_t *r5 = roaring_bitmap_of_ptr(1500, vals);
+    for (uint32_t i = 0; i < 1000; ++i) vals[i] = 6 * i;
+    assert_true(roaring_bitmap_add_many(r4, 1000, vals));
+    for (uint32_t i = 0; i < 1000; ++i) roaring_bitmap_add(r5, vals[i]);
+    assert_true(roaring_bitmap_equals(r4, r5));
+    assert_int_equal(roaring_bitmap_get_cardinality(r4), 2084);
+
+    roaring_bitmap_free(r1);
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r3);
+    roaring_bitmap_free(r4);
+    roaring_bitmap_free(r5);
+    free(vals);
+}
+
+static roaring_bitmap_t *make_iterator_test_bitmap() {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t i = 0; i < 100; ++i) roaring_bitmap_add(r, i * 62);  // array
+    for (uint32_t i = 65536; i < 2 * 65536; i += 3)
+        roaring_bitmap_add(r, i);  // bitset
+    for (uint32_t i = 3 * 65536; i < 3 * 65536 + 1000; ++i)
+        roaring_bitmap_add(r, i);  // run
+    for (uint32_t i = 3 * 65536 + 2000; i < 3 * 65536 + 2100; ++i)
+        roaring_bitmap_add(r, i);  // second run
+    for (uint32_t i = UINT32_MAX - 100; i > UINT32_MAX - 200; --i)
+        roaring_bitmap_add(r, i);
+    roaring_bitmap_add(r, UINT32_MAX);
+    roaring_bitmap_run_optimize(r);
+    return r;
+}
+
+void test_iterator() {
+    roaring_bitmap_t *r = make_iterator_test_bitmap();
+    const uint32_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *vals = (uint32_t *)malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, vals);
+
+    roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+    for (uint32_t i = 0; i < card; ++i) {
+        assert_true(it->has_value);
+        assert_int_equal(it->current_value, vals[i]);
+        roaring_advance_uint32_iterator(it);
+    }
+    assert_false(it->has_value);
+    for (uint32_t i = card; i > 0; --i) {
+        assert_true(roaring_previous_uint32_iterator(it));
+        assert_int_equal(it->current_value, vals[i - 1]);
+    }
+    assert_false(roaring_previous_uint32_iterator(it));
+    assert_true(roaring_advance_uint32_iterator(it));
+    assert_int_equal(it->current_value, vals[0]);
+    roaring_free_uint32_iterator(it);
+
+    roaring_uint32_iterator_t last;
+    roaring_init_iterator_last(r, &last);
+    assert_true(last.has_value);
+    assert_int_equal(last.current_value, UINT32_MAX);
+    assert_false(roaring_advance_uint32_iterator(&last));
+
+    roaring_bitmap_t *empty = roaring_bitmap_create();
+    roaring_uint32_iterator_t eit;
+    roaring_init_iterator(empty, &eit);
+    assert_false(eit.has_value);
+    assert_false(roaring_move_uint32_iterator_equalorlarger(&eit, 0));
+    roaring_bitmap_free(empty);
+
+    free(vals);
+    roaring_bitmap_free(r);
+}
+
+void test_iterator_read() {
+    roaring_bitmap_t *r = make_iterator_test_bitmap();
+    const uint32_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *vals = (uint32_t *)malloc(card * sizeof(uint32_t));
+    uint32_t *buf = (uint32_t *)malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, vals);
+
+    const uint32_t chunks[] = {1, 7, 64, 1000, 50000, card + 1};
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+        roaring_uint32_iterator_t it;
+        roaring_init_iterator(r, &it);
+        uint32_t total = 0;
+        while (true) {
+            const uint32_t n =
+                roaring_read_uint32_iterator(&it, buf + total, chunks[c]);
+            total += n;
+            if (n < chunks[c]) break;
+            if (it.has_value) {
+                assert_int_equal(it.current_value, vals[total]);
+            }
+        }
+        assert_false(it.has_value);
+        assert_int_equal(total, card);
+        assert_true(array_equals(buf, total, vals, card));
+    }
+    free(buf);
+    free(vals);
+    roaring_bitmap_free(r);
+}
+
+void test_iterator_move_equalorlarger() {
+    roaring_bitmap_t *r = make_iterator_test_bitmap();
+    const uint32_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *vals = (uint32_t *)malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, vals);
+
+    // leapfrog-style: increasing targets from a single iterator
+    roaring_uint32_iterator_t it;
+    roaring_init_iterator(r, &it);
+    uint32_t j = 0;
+    for (uint64_t target = 0; target <= UINT32_MAX; target += 37 + target / 8) {
+        while (j < card && vals[j] < target) j++;
+        const bool found =
+            roaring_move_uint32_iterator_equalorlarger(&it, (uint32_t)target);
+        assert_int_equal(found, j < card);
+        if (found) assert_int_equal(it.current_value, vals[j]);
+    }
+    // moving backward restarts the search
+    assert_true(roaring_move_uint32_iterator_equalorlarger(&it, 63));
+    assert_int_equal(it.current_value, 124);
+    assert_true(
+        roaring_move_uint32_iterator_equalorlarger(&it, 3 * 65536 + 1500));
+    assert_int_equal(it.current_value, 3 * 65536 + 2000);
+    assert_true(
+        roaring_move_uint32_iterator_equalorlarger(&it, 3 * 65536 + 50));
+    assert_int_equal(it.current_value, 3 * 65536 + 50);
+    assert_true(roaring_move_uint32_iterator_equalorlarger(&it, UINT32_MAX));
+    assert_int_equal(it.current_value, UINT32_MAX);
+    assert_false(roaring_advance_uint32_iterator(&it));
+    assert_true(roaring_move_uint32_iterator_equalorlarger(&it, 4 * 65536));
+    assert_int_equal(it.current_value, UINT32_MAX - 199);
+    free(vals);
+    roaring_bitmap_free(r);
+}
+
 void test_contains() {
     roaring_bitmap_t *r1 = roaring_bitmap_create();
     assert_non_null(r1);
@@ -751,6 +921,104 @@ void test_intersection_bitset_x_bitset_inplace() {
     roaring_bitmap_free(r1);
 }
 
+/* Bitmaps mixing array, bitset and run containers under the same keys. */
+static roaring_bitmap_t *make_mixed_bitmap(uint32_t seed, bool runs) {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t key = 0; key < 6; ++key) {
+        const uint32_t base = key << 16;
+        switch ((key + seed) % 3) {
+            case 0:  // sparse
+                for (uint32_t i = seed; i < 65536; i += 97 + seed)
+                    roaring_bitmap_add(r, base + i);
+                break;
+            case 1:  // dense
+                for (uint32_t i = seed; i < 65536; i += 2 + seed % 3)
+                    roaring_bitmap_add(r, base + i);
+                break;
+            default:  // intervals
+                for (uint32_t i = 1000 * seed; i < 65536; i += 3000)
+                    for (uint32_t j = i; j < i + 1500 && j < 65536; ++j)
+                        roaring_bitmap_add(r, base + j);
+                break;
+        }
+    }
+    if (runs) roaring_bitmap_run_optimize(r);
+    return r;
+}
+
+void test_cardinality_operations() {
+    roaring_bitmap_t *bitmaps[6];
+    for (uint32_t i = 0; i < 6; ++i) {
+        bitmaps[i] = make_mixed_bitmap(i % 3, i >= 3);
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+        for (uint32_t j = 0; j < 6; ++j) {
+            const roaring_bitmap_t *r1 = bitmaps[i], *r2 = bitmaps[j];
+            roaring_bitmap_t *tmp = roaring_bitmap_and(r1, r2);
+            const uint64_t inter = roaring_bitmap_get_cardinality(tmp);
+            assert_int_equal(roaring_bitmap_and_cardinality(r1, r2), inter);
+            roaring_bitmap_free(tmp);
+
+            tmp = roaring_bitmap_or(r1, r2);
+            const uint64_t uni = roaring_bitmap_get_cardinality(tmp);
+            assert_int_equal(roaring_bitmap_or_cardinality(r1, r2), uni);
+            roaring_bitmap_free(tmp);
+
+            tmp = roaring_bitmap_xor(r1, r2);
+            assert_int_equal(roaring_bitmap_xor_cardinality(r1, r2),
+                             roaring_bitmap_get_cardinality(tmp));
+            roaring_bitmap_free(tmp);
+
+            tmp = roaring_bitmap_andnot(r1, r2);
+            assert_int_equal(roaring_bitmap_andnot_cardinality(r1, r2),
+                             roaring_bitmap_get_cardinality(tmp));
+            roaring_bitmap_free(tmp);
+
+            assert_true(roaring_bitmap_jaccard_index(r1, r2) ==
+                        (double)inter / (double)uni);
+            assert_int_equal(roaring_bitmap_intersect(r1, r2), inter > 0);
+        }
+    }
+    for (uint32_t i = 0; i < 6; ++i) roaring_bitmap_free(bitmaps[i]);
+}
+
+void test_intersect() {
+    roaring_bitmap_t *r1 = roaring_bitmap_create();
+    roaring_bitmap_t *r2 = roaring_bitmap_create();
+    assert_false(roaring_bitmap_intersect(r1, r2));
+    // interleaved values in every container pair, never in common
+    for (uint32_t i = 0; i < 65536; i += 2) {
+        roaring_bitmap_add(r1, i);              // bitset
+        roaring_bitmap_add(r2, i + 1);          // bitset
+        roaring_bitmap_add(r1, 65536 + i * 17 % 65536);  // bitset
+    }
+    for (uint32_t i = 0; i < 1000; ++i) {
+        roaring_bitmap_add(r1, 2 * 65536 + 10 * i);      // array
+        roaring_bitmap_add(r2, 2 * 65536 + 10 * i + 5);  // array
+        roaring_bitmap_add(r2, 65536 + 2 * i + 1);       // array vs bitset
+    }
+    for (uint32_t i = 0; i < 3000; ++i) {
+        roaring_bitmap_add(r1, 3 * 65536 + i);         // run
+        roaring_bitmap_add(r2, 3 * 65536 + 5000 + i);  // run
+    }
+    roaring_bitmap_run_optimize(r1);
+    roaring_bitmap_run_optimize(r2);
+    assert_false(roaring_bitmap_intersect(r1, r2));
+    assert_int_equal(roaring_bitmap_and_cardinality(r1, r2), 0);
+
+    // a single common value in the last container is found
+    roaring_bitmap_add(r1, 3 * 65536 + 7999);
+    assert_true(roaring_bitmap_intersect(r1, r2));
+    assert_true(roaring_bitmap_intersect(r2, r1));
+    roaring_bitmap_remove(r1, 3 * 65536 + 7999);
+    roaring_bitmap_add(r2, 65535);
+    assert_false(roaring_bitmap_intersect(r1, r2));
+    roaring_bitmap_add(r2, 2 * 65536 + 9990);
+    assert_true(roaring_bitmap_intersect(r1, r2));
+    roaring_bitmap_free(r1);
+    roaring_bitmap_free(r2);
+}
+
 void test_union(bool copy_on_write) {
     roaring_bitmap_t *r1 = roaring_bitmap_create();
     r1->copy_on_write = copy_on_write;
@@ -2367,6 +2635,717 @@ void select_test() {
     free(input);
 }
 
+void test_rank_and_rank_index() {
+    roaring_bitmap_t *r = make_mixed_bitmap(1, true);
+    roaring_bitmap_add(r, UINT32_MAX);
+    const uint32_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *vals = (uint32_t *)malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, vals);
+
+    for (int with_index = 0; with_index < 2; ++with_index) {
+        if (with_index) {
+            assert_true(roaring_bitmap_build_rank_index(r));
+            assert_non_null(r->rank_index);
+        }
+        assert_int_equal(roaring_bitmap_rank(r, 0), vals[0] == 0);
+        assert_int_equal(roaring_bitmap_rank(r, UINT32_MAX), card);
+        uint32_t j = 0;
+        for (uint32_t x = 0; x < 7 * 65536; x += 13) {
+            while (j < card && vals[j] <= x) j++;
+            assert_int_equal(roaring_bitmap_rank(r, x), j);
+        }
+        for (uint32_t i = 0; i < card; i += 7) {
+            uint32_t element;
+            assert_true(roaring_bitmap_select(r, i, &element));
+            assert_int_equal(element, vals[i]);
+            assert_int_equal(roaring_bitmap_rank(r, element), i + 1);
+        }
+        uint32_t element;
+        assert_true(roaring_bitmap_select(r, card - 1, &element));
+        assert_int_equal(element, UINT32_MAX);
+        assert_false(roaring_bitmap_select(r, card, &element));
+    }
+
+    // mutations drop the index
+    roaring_bitmap_add(r, 10 * 65536);
+    assert_null(r->rank_index);
+    assert_true(roaring_bitmap_build_rank_index(r));
+    roaring_bitmap_t *r2 = roaring_bitmap_copy(r);
+    assert_null(r2->rank_index);
+    roaring_bitmap_or_inplace(r, r2);
+    assert_null(r->rank_index);
+    assert_true(roaring_bitmap_build_rank_index(r));
+    assert_int_equal(roaring_bitmap_rank(r, 10 * 65536), card);
+    roaring_bitmap_free_rank_index(r);
+    assert_null(r->rank_index);
+
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r);
+    free(vals);
+}
+
+void test_range_mutations() {
+    // [min, max) pairs: inside a container, across boundaries, whole
+    // containers, and ranges reaching past the populated keys
+    const uint32_t ranges[][2] = {
+        {5, 6},           {100, 2000},         {0, 65536},
+        {65000, 70000},   {1000, 3 * 65536},   {2 * 65536 + 7, 5 * 65536 + 9},
+        {4 * 65536, 9 * 65536}, {8 * 65536, 10 * 65536 + 3},
+        {0, 12 * 65536}};
+    const size_t nranges = sizeof(ranges) / sizeof(ranges[0]);
+    for (uint32_t b = 0; b < 6; ++b) {
+        roaring_bitmap_t *base = make_mixed_bitmap(b % 3, b >= 3);
+        for (size_t k = 0; k < nranges; ++k) {
+            const uint32_t min = ranges[k][0], max = ranges[k][1];
+            roaring_bitmap_t *range = roaring_bitmap_from_range(min, max, 1);
+
+            roaring_bitmap_t *r = roaring_bitmap_copy(base);
+            roaring_bitmap_add_range(r, min, max);
+            roaring_bitmap_t *expected = roaring_bitmap_or(base, range);
+            assert_true(roaring_bitmap_equals(r, expected));
+            assert_true(roaring_bitmap_contains_range(r, min, max));
+            roaring_bitmap_free(expected);
+            roaring_bitmap_free(r);
+
+            r = roaring_bitmap_copy(base);
+            roaring_bitmap_remove_range(r, min, max);
+            expected = roaring_bitmap_andnot(base, range);
+            assert_true(roaring_bitmap_equals(r, expected));
+            assert_false(roaring_bitmap_intersect(r, range));
+            roaring_bitmap_free(expected);
+            roaring_bitmap_free(r);
+
+            const bool contained =
+                roaring_bitmap_and_cardinality(base, range) == max - min;
+            assert_true(roaring_bitmap_contains_range(base, min, max) ==
+                        contained);
+            roaring_bitmap_free(range);
+        }
+        roaring_bitmap_free(base);
+    }
+
+    // a dense bitmap: sub-ranges are contained until a hole is punched
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    roaring_bitmap_add_range(r, 10, 10000000);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 10000000 - 10);
+    assert_true(roaring_bitmap_contains_range(r, 10, 10000000));
+    assert_false(roaring_bitmap_contains_range(r, 9, 100));
+    assert_true(roaring_bitmap_contains_range(r, 100, 100));
+    roaring_bitmap_remove_range(r, 500000, 500001);
+    assert_false(roaring_bitmap_contains_range(r, 10, 10000000));
+    assert_true(roaring_bitmap_contains_range(r, 500001, 10000000));
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 10000000 - 11);
+    roaring_bitmap_remove_range(r, 0, 10000000);
+    assert_true(roaring_bitmap_is_empty(r));
+
+    // bounds past UINT32_MAX are clamped
+    roaring_bitmap_add_range(r, UINT32_MAX - 9, UINT64_MAX);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 10);
+    assert_true(roaring_bitmap_contains(r, UINT32_MAX));
+    assert_true(roaring_bitmap_contains_range(r, UINT32_MAX - 9, UINT64_MAX));
+    roaring_bitmap_remove_range(r, UINT32_MAX, (uint64_t)UINT32_MAX + 1);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 9);
+    roaring_bitmap_free(r);
+
+    // copy-on-write siblings are left untouched
+    roaring_bitmap_t *orig = make_mixed_bitmap(1, true);
+    orig->copy_on_write = true;
+    const uint64_t card = roaring_bitmap_get_cardinality(orig);
+    roaring_bitmap_t *copy = roaring_bitmap_copy(orig);
+    roaring_bitmap_add_range(copy, 0, 3 * 65536);
+    roaring_bitmap_remove_range(copy, 3 * 65536 + 5, 6 * 65536);
+    assert_int_equal(roaring_bitmap_get_cardinality(orig), card);
+    roaring_bitmap_t *fresh = make_mixed_bitmap(1, true);
+    assert_true(roaring_bitmap_equals(orig, fresh));
+    assert_true(roaring_bitmap_contains_range(copy, 0, 3 * 65536));
+    assert_int_equal(roaring_bitmap_rank(copy, UINT32_MAX),
+                     roaring_bitmap_rank(copy, 3 * 65536 + 4));
+    roaring_bitmap_free(fresh);
+    roaring_bitmap_free(copy);
+    roaring_bitmap_free(orig);
+}
+
+/* in_place: whether all array and run data is 2-byte aligned in the
+ * serialized form, and so must be read in place */
+static void check_frozen_view(roaring_bitmap_t *r, size_t offset,
+                              bool in_place) {
+    const size_t len = roaring_bitmap_portable_size_in_bytes(r);
+    char *storage = (char *)malloc(len + offset);
+    char *buf = storage + offset;
+    assert_int_equal(roaring_bitmap_portable_serialize(r, buf), len);
+    const roaring_bitmap_t *frozen =
+        roaring_bitmap_portable_deserialize_frozen(buf);
+    assert_non_null(frozen);
+
+    // aligned array and run containers are read in place, others copied
+    const roaring_array_t *ra = frozen->high_low_container;
+    for (int32_t i = 0; i < ra->size; ++i) {
+        const char *data = NULL;
+        if (ra->typecodes[i] == ARRAY_CONTAINER_TYPE_CODE) {
+            data = (const char *)((array_container_t *)ra->containers[i])->array;
+        } else if (ra->typecodes[i] == RUN_CONTAINER_TYPE_CODE) {
+            data = (const char *)((run_container_t *)ra->containers[i])->runs;
+        } else {
+            data = (const char *)((bitset_container_t *)ra->containers[i])
+                       ->array;
+            assert_int_equal((uintptr_t)data & 7, 0);
+            continue;
+        }
+        assert_int_equal((uintptr_t)data & 1, 0);
+        if (in_place) assert_true(data >= buf && data < buf + len);
+    }
+
+    assert_int_equal(roaring_bitmap_get_cardinality(frozen),
+                     roaring_bitmap_get_cardinality(r));
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)frozen, r));
+    for (uint32_t x = 0; x < 7 * 65536; x += 11) {
+        assert_true(roaring_bitmap_contains(frozen, x) ==
+                    roaring_bitmap_contains(r, x));
+    }
+
+    roaring_bitmap_t *other = make_mixed_bitmap(0, true);
+    roaring_bitmap_t *(*ops[])(const roaring_bitmap_t *,
+                               const roaring_bitmap_t *) = {
+        roaring_bitmap_and, roaring_bitmap_or, roaring_bitmap_andnot,
+        roaring_bitmap_xor};
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); ++k) {
+        roaring_bitmap_t *expected = ops[k](r, other);
+        roaring_bitmap_t *actual = ops[k](frozen, other);
+        assert_true(roaring_bitmap_equals(actual, expected));
+        roaring_bitmap_free(actual);
+        roaring_bitmap_free(expected);
+        expected = ops[k](other, r);
+        actual = ops[k](other, frozen);
+        assert_true(roaring_bitmap_equals(actual, expected));
+        roaring_bitmap_free(actual);
+        roaring_bitmap_free(expected);
+    }
+    roaring_bitmap_free(other);
+
+    // copies are independent of the buffer
+    roaring_bitmap_t *copy = roaring_bitmap_copy(frozen);
+    roaring_bitmap_frozen_free(frozen);
+    memset(buf, 0, len);
+    assert_true(roaring_bitmap_equals(copy, r));
+    roaring_bitmap_free(copy);
+    free(storage);
+}
+
+void test_portable_deserialize_frozen() {
+    for (int runs = 0; runs < 2; ++runs) {
+        roaring_bitmap_t *r = make_mixed_bitmap(2, runs);
+        roaring_bitmap_add(r, 100 * 65536 + 7);
+        // with runs, the header is odd: 1 byte of run bitmap for 7 keys
+        check_frozen_view(r, 0, !runs);
+        check_frozen_view(r, 2, !runs);  // bitsets land on unaligned addresses
+        check_frozen_view(r, 1, runs);
+        roaring_bitmap_free(r);
+    }
+    // few run containers: the serialized form has no offset header, and
+    // the run bitmap has an odd length
+    roaring_bitmap_t *r = roaring_bitmap_from_range(1000, 100000, 1);
+    roaring_bitmap_run_optimize(r);
+    check_frozen_view(r, 0, false);
+    check_frozen_view(r, 1, true);
+    roaring_bitmap_free(r);
+    // an odd-length run bitmap ahead of array, run and bitset containers
+    r = roaring_bitmap_from_range(5, 70000, 1);
+    for (uint32_t x = 2 * 65536; x < 3 * 65536; x += 32)
+        roaring_bitmap_add(r, x);
+    for (uint32_t x = 3 * 65536; x < 4 * 65536; x += 3)
+        roaring_bitmap_add(r, x);
+    roaring_bitmap_run_optimize(r);
+    assert_int_equal(r->high_low_container->size, 4);
+    check_frozen_view(r, 0, false);
+    check_frozen_view(r, 3, true);
+    roaring_bitmap_free(r);
+    r = roaring_bitmap_create();
+    check_frozen_view(r, 0, true);
+    roaring_bitmap_free(r);
+
+    assert_null(roaring_bitmap_portable_deserialize_frozen("\1\0\0\0"));
+}
+
+static char *serialize_for_test(roaring_bitmap_t *r, size_t *len) {
+    *len = roaring_bitmap_portable_size_in_bytes(r);
+    char *buf = (char *)malloc(*len);
+    assert_int_equal(roaring_bitmap_portable_serialize(r, buf), *len);
+    return buf;
+}
+
+void test_portable_deserialize_safe() {
+    for (int runs = 0; runs < 2; ++runs) {
+        roaring_bitmap_t *r = make_mixed_bitmap(1, runs);
+        size_t len;
+        char *buf = serialize_for_test(r, &len);
+        roaring_bitmap_t *r2 =
+            roaring_bitmap_portable_deserialize_safe(buf, len);
+        assert_non_null(r2);
+        assert_true(roaring_bitmap_equals(r, r2));
+        roaring_bitmap_free(r2);
+        // every truncation is detected
+        for (size_t cut = 0; cut < len; cut += (len - cut > 64) ? 61 : 1) {
+            assert_null(roaring_bitmap_portable_deserialize_safe(buf, cut));
+        }
+        free(buf);
+        roaring_bitmap_free(r);
+    }
+
+    // keys out of order, then array values out of order
+    roaring_bitmap_t *r = roaring_bitmap_of(3, 1, 5, 2 * 65536);
+    size_t len;
+    char *buf = serialize_for_test(r, &len);
+    uint16_t v = 0;
+    memcpy(buf + 12, &v, sizeof(v));  // second key
+    assert_null(roaring_bitmap_portable_deserialize_safe(buf, len));
+    free(buf);
+    buf = serialize_for_test(r, &len);
+    v = 7;
+    memcpy(buf + 24, &v, sizeof(v));  // first value of the first container
+    assert_null(roaring_bitmap_portable_deserialize_safe(buf, len));
+    free(buf);
+    roaring_bitmap_free(r);
+
+    // bitset content disagrees with the stated cardinality
+    r = roaring_bitmap_from_range(0, 10000, 2);
+    buf = serialize_for_test(r, &len);
+    buf[10]--;
+    assert_null(roaring_bitmap_portable_deserialize_safe(buf, len));
+    free(buf);
+    roaring_bitmap_free(r);
+
+    // a run going past the end of its container
+    r = roaring_bitmap_from_range(65000, 65536, 1);
+    roaring_bitmap_run_optimize(r);
+    buf = serialize_for_test(r, &len);
+    v = 1000;
+    memcpy(buf + 13, &v, sizeof(v));  // length of the first run
+    assert_null(roaring_bitmap_portable_deserialize_safe(buf, len));
+    memcpy(buf, "\1\0\0\0", 4);
+    assert_null(roaring_bitmap_portable_deserialize_safe(buf, len));
+    free(buf);
+    roaring_bitmap_free(r);
+}
+
+/* Runs the tasks backward, to check that order does not matter. */
+static void reverse_parallel_for(void *pool, roaring_parallel_task_t task,
+                                 void *arg, size_t n_tasks) {
+    size_t *calls = (size_t *)pool;
+    for (size_t i = n_tasks; i > 0; --i) {
+        task(arg, i - 1);
+        (*calls)++;
+    }
+}
+
+void test_or_many_parallel() {
+    enum { NUMBER = 8 };
+    roaring_bitmap_t *bitmaps[NUMBER];
+    for (uint32_t i = 0; i < NUMBER; ++i) {
+        bitmaps[i] = make_mixed_bitmap(i % 3, i % 2);
+        // spread some keys so that partitions differ between inputs
+        for (uint32_t k = 0; k < 50; ++k) {
+            roaring_bitmap_add(bitmaps[i], (k * (i + 3) * 977u) << 12);
+        }
+    }
+    // copy-on-write inputs hold shared containers
+    bitmaps[0]->copy_on_write = true;
+    roaring_bitmap_t *sharing = roaring_bitmap_copy(bitmaps[0]);
+    const roaring_bitmap_t *inputs[NUMBER + 1];
+    for (uint32_t i = 0; i < NUMBER; ++i) inputs[i] = bitmaps[i];
+    inputs[NUMBER] = sharing;
+
+    roaring_bitmap_t *expected = roaring_bitmap_or_many(NUMBER + 1, inputs);
+    const size_t partitions[] = {1, 2, 3, 7, 64, 100000};
+    for (size_t p = 0; p < sizeof(partitions) / sizeof(partitions[0]); ++p) {
+        roaring_bitmap_t *actual = roaring_bitmap_or_many_parallel(
+            NUMBER + 1, inputs, partitions[p], NULL, NULL);
+        assert_non_null(actual);
+        assert_true(roaring_bitmap_equals(actual, expected));
+        roaring_bitmap_free(actual);
+
+        size_t calls = 0;
+        actual = roaring_bitmap_or_many_parallel(
+            NUMBER + 1, inputs, partitions[p], reverse_parallel_for, &calls);
+        assert_true(roaring_bitmap_equals(actual, expected));
+        assert_int_equal(calls, partitions[p] > 65536 ? 65536 : partitions[p]);
+        roaring_bitmap_free(actual);
+
+        // single input
+        actual = roaring_bitmap_or_many_parallel(1, inputs + NUMBER,
+                                                 partitions[p], NULL, NULL);
+        assert_true(roaring_bitmap_equals(actual, sharing));
+        roaring_bitmap_free(actual);
+    }
+    roaring_bitmap_t *empty = roaring_bitmap_or_many_parallel(0, NULL, 4,
+                                                              NULL, NULL);
+    assert_true(roaring_bitmap_is_empty(empty));
+    roaring_bitmap_free(empty);
+
+    roaring_bitmap_free(expected);
+    roaring_bitmap_free(sharing);
+    for (uint32_t i = 0; i < NUMBER; ++i) roaring_bitmap_free(bitmaps[i]);
+}
+
+void test_or_and_many_horizontal() {
+    enum { NUMBER = 7 };
+    roaring_bitmap_t *bitmaps[NUMBER];
+    for (uint32_t i = 0; i < NUMBER; ++i) {
+        bitmaps[i] = make_mixed_bitmap(i % 3, i % 2);
+        roaring_bitmap_add(bitmaps[i], (20 + i) << 16);  // key of its own
+    }
+    // full run containers
+    roaring_bitmap_t *full = roaring_bitmap_from_range(0, 3 << 16, 1);
+    roaring_bitmap_run_optimize(full);
+    roaring_bitmap_free(bitmaps[NUMBER - 1]);
+    bitmaps[NUMBER - 1] = full;
+    bitmaps[0]->copy_on_write = true;
+    roaring_bitmap_t *sharing = roaring_bitmap_copy(bitmaps[0]);
+
+    const roaring_bitmap_t *inputs[NUMBER + 1];
+    for (uint32_t i = 0; i < NUMBER; ++i) inputs[i] = bitmaps[i];
+    inputs[NUMBER] = sharing;
+    for (size_t n = 0; n <= NUMBER + 1; ++n) {
+        roaring_bitmap_t *expected = roaring_bitmap_or_many(n, inputs);
+        roaring_bitmap_t *actual = roaring_bitmap_or_many_horizontal(n, inputs);
+        assert_true(roaring_bitmap_equals(actual, expected));
+        roaring_bitmap_free(actual);
+        roaring_bitmap_free(expected);
+
+        actual = roaring_bitmap_and_many(n, inputs);
+        if (n == 0) {
+            assert_true(roaring_bitmap_is_empty(actual));
+        } else {
+            expected = roaring_bitmap_copy(inputs[0]);
+            for (size_t i = 1; i < n; ++i) {
+                roaring_bitmap_and_inplace(expected, inputs[i]);
+            }
+            assert_true(roaring_bitmap_equals(actual, expected));
+            roaring_bitmap_free(expected);
+        }
+        roaring_bitmap_free(actual);
+    }
+    // an input with no common key ends the intersection early
+    roaring_bitmap_t *far = roaring_bitmap_of(1, 40 << 16);
+    const roaring_bitmap_t *pair[2] = {full, far};
+    roaring_bitmap_t *actual = roaring_bitmap_and_many(2, pair);
+    assert_true(roaring_bitmap_is_empty(actual));
+    roaring_bitmap_free(actual);
+    roaring_bitmap_free(far);
+
+    roaring_bitmap_free(sharing);
+    for (uint32_t i = 0; i < NUMBER; ++i) roaring_bitmap_free(bitmaps[i]);
+}
+
+// counting allocator: every block handed out must come back
+static int64_t live_blocks = 0;
+static int64_t live_aligned_blocks = 0;
+static int64_t aligned_allocations = 0;
+
+static void *counting_malloc(size_t size) {
+    void *p = malloc(size);
+    if (p != NULL) live_blocks++;
+    return p;
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    void *p = realloc(ptr, size);
+    if (ptr == NULL && p != NULL) live_blocks++;
+    return p;
+}
+
+static void *counting_calloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (p != NULL) live_blocks++;
+    return p;
+}
+
+static void counting_free(void *ptr) {
+    if (ptr != NULL) live_blocks--;
+    free(ptr);
+}
+
+static void *counting_aligned_malloc(size_t alignment, size_t size) {
+    size = (size + alignment - 1) / alignment * alignment;
+    void *p = aligned_alloc(alignment, size);
+    if (p != NULL) live_aligned_blocks++;
+    aligned_allocations++;
+    return p;
+}
+
+static void counting_aligned_free(void *ptr) {
+    if (ptr != NULL) live_aligned_blocks--;
+    free(ptr);
+}
+
+void test_memory_hooks() {
+    roaring_memory_t hook = {counting_malloc,         counting_realloc,
+                             counting_calloc,         counting_free,
+                             counting_aligned_malloc, counting_aligned_free};
+    roaring_init_memory_hook(hook);
+
+    roaring_bitmap_t *r1 = make_mixed_bitmap(0, false);
+    roaring_bitmap_t *r2 = make_mixed_bitmap(1, true);
+    assert_true(live_blocks > 0);
+    assert_true(live_aligned_blocks > 0);
+
+    roaring_bitmap_t *u = roaring_bitmap_or(r1, r2);
+    roaring_bitmap_xor_inplace(u, r1);
+    roaring_bitmap_t *plain = roaring_bitmap_copy(u);
+    u->copy_on_write = true;
+    roaring_bitmap_t *cow = roaring_bitmap_copy(u);
+    roaring_bitmap_andnot_inplace(cow, r2);
+    assert_true(roaring_bitmap_build_rank_index(u));
+
+    uint32_t len;
+    char *buf = roaring_bitmap_serialize(plain, &len);
+    assert_non_null(buf);
+    roaring_bitmap_t *back = roaring_bitmap_deserialize(buf, len);
+    assert_true(roaring_bitmap_equals(back, plain));
+    roaring_free(buf);
+
+    buf = (char *)malloc(roaring_bitmap_portable_size_in_bytes(r2));
+    roaring_bitmap_portable_serialize(r2, buf);
+    const roaring_bitmap_t *frozen =
+        roaring_bitmap_portable_deserialize_frozen(buf);
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)frozen, r2));
+    roaring_bitmap_frozen_free(frozen);
+    free(buf);
+
+    roaring_uint32_iterator_t *it = roaring_create_iterator(u);
+    roaring_free_uint32_iterator(it);
+
+    const roaring_bitmap_t *inputs[3] = {r1, r2, u};
+    roaring_bitmap_t *many = roaring_bitmap_or_many_heap(3, inputs);
+    roaring_bitmap_free(many);
+
+    roaring_bitmap_free(back);
+    roaring_bitmap_free(cow);
+    roaring_bitmap_free(plain);
+    roaring_bitmap_free(u);
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r1);
+    assert_int_equal(live_blocks, 0);
+    assert_int_equal(live_aligned_blocks, 0);
+
+    roaring_reset_memory_hook();
+    roaring_bitmap_free(roaring_bitmap_of(2, 1, 1 << 20));
+    assert_int_equal(live_blocks, 0);
+}
+
+static void *failing_malloc(size_t size) {
+    (void)size;
+    return NULL;
+}
+
+static void *failing_realloc(void *ptr, size_t size) {
+    (void)ptr;
+    (void)size;
+    return NULL;
+}
+
+static void *failing_calloc(size_t count, size_t size) {
+    (void)count;
+    (void)size;
+    return NULL;
+}
+
+static void *failing_aligned_malloc(size_t alignment, size_t size) {
+    (void)alignment;
+    (void)size;
+    return NULL;
+}
+
+void test_add_many_out_of_memory() {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t x = 0; x < 1000; x += 10) roaring_bitmap_add(r, x);
+    roaring_bitmap_add_range(r, 2 << 16, (2 << 16) + 500);
+    roaring_bitmap_t *expected = roaring_bitmap_copy(r);
+    uint32_t vals[5000];
+    for (uint32_t i = 0; i < 5000; ++i) vals[i] = 5 * i + 1;
+
+    roaring_memory_t hook = {failing_malloc,         failing_realloc,
+                             failing_calloc,         free,
+                             failing_aligned_malloc, free};
+    roaring_init_memory_hook(hook);
+    // the array must grow, then become a bitset
+    assert_false(roaring_bitmap_add_many(r, 100, vals));
+    assert_false(roaring_bitmap_add_many(r, 5000, vals));
+    // a new key
+    vals[0] = 7 << 16;
+    assert_false(roaring_bitmap_add_many(r, 1, vals));
+    roaring_reset_memory_hook();
+
+    assert_true(roaring_bitmap_equals(r, expected));
+    roaring_bitmap_free(expected);
+    roaring_bitmap_free(r);
+}
+
+// fails once the budget is spent, counts what it hands out until then
+static int64_t allocation_budget = 0;
+
+static void *budget_malloc(size_t size) {
+    if (allocation_budget-- <= 0) return NULL;
+    return counting_malloc(size);
+}
+
+static void *budget_realloc(void *ptr, size_t size) {
+    if (allocation_budget-- <= 0) return NULL;
+    return counting_realloc(ptr, size);
+}
+
+static void *budget_calloc(size_t count, size_t size) {
+    if (allocation_budget-- <= 0) return NULL;
+    return counting_calloc(count, size);
+}
+
+static void *budget_aligned_malloc(size_t alignment, size_t size) {
+    if (allocation_budget-- <= 0) return NULL;
+    return counting_aligned_malloc(alignment, size);
+}
+
+typedef roaring_bitmap_t *(*many_op_t)(size_t, const roaring_bitmap_t **);
+
+// every allocation failure must be reported cleanly, without leaking
+static void check_many_out_of_memory(many_op_t op, size_t number,
+                                     const roaring_bitmap_t **inputs) {
+    roaring_bitmap_t *expected = op(number, inputs);
+    roaring_memory_t hook = {budget_malloc,         budget_realloc,
+                             budget_calloc,         counting_free,
+                             budget_aligned_malloc, counting_aligned_free};
+    roaring_init_memory_hook(hook);
+    for (int64_t budget = 0;; ++budget) {
+        live_blocks = 0;
+        live_aligned_blocks = 0;
+        allocation_budget = budget;
+        roaring_bitmap_t *actual = op(number, inputs);
+        if (actual != NULL) {
+            assert_true(roaring_bitmap_equals(actual, expected));
+            assert_int_equal(actual->copy_on_write, expected->copy_on_write);
+            roaring_bitmap_free(actual);
+        }
+        assert_int_equal(live_blocks, 0);
+        assert_int_equal(live_aligned_blocks, 0);
+        if (actual != NULL) break;
+    }
+    roaring_reset_memory_hook();
+    roaring_bitmap_free(expected);
+}
+
+void test_many_out_of_memory() {
+    enum { NUMBER = 4 };
+    roaring_bitmap_t *bitmaps[NUMBER];
+    const roaring_bitmap_t *inputs[NUMBER];
+    for (uint32_t i = 0; i < NUMBER; ++i) {
+        bitmaps[i] = make_mixed_bitmap(i % 3, i % 2);
+        inputs[i] = bitmaps[i];
+    }
+    check_many_out_of_memory(roaring_bitmap_or_many_horizontal, NUMBER,
+                             inputs);
+    for (uint32_t i = 0; i < NUMBER; ++i) roaring_bitmap_free(bitmaps[i]);
+
+    // bitsets only, which intersect both into a bitset and into an array
+    for (uint32_t i = 0; i < NUMBER; ++i) {
+        bitmaps[i] = roaring_bitmap_from_range(0, 1 << 16, i + 2);
+        roaring_bitmap_add_range(bitmaps[i], (1 << 16) + 1000 * i,
+                                 (1 << 16) + 1000 * i + 10000);
+        roaring_bitmap_remove_run_compression(bitmaps[i]);
+        bitmaps[i]->copy_on_write = true;
+        inputs[i] = bitmaps[i];
+    }
+    check_many_out_of_memory(roaring_bitmap_and_many, NUMBER, inputs);
+
+    // the intersection is copy-on-write only if every input is
+    roaring_bitmap_t *actual = roaring_bitmap_and_many(NUMBER, inputs);
+    assert_true(actual->copy_on_write);
+    roaring_bitmap_free(actual);
+    bitmaps[NUMBER - 1]->copy_on_write = false;
+    actual = roaring_bitmap_and_many(NUMBER, inputs);
+    assert_false(actual->copy_on_write);
+    roaring_bitmap_free(actual);
+
+    for (uint32_t i = 0; i < NUMBER; ++i) roaring_bitmap_free(bitmaps[i]);
+}
+
+void test_snapshot() {
+    roaring_bitmap_t *r = make_mixed_bitmap(2, true);
+    assert_true(roaring_bitmap_build_rank_index(r));
+    roaring_bitmap_t *expected = roaring_bitmap_copy(r);
+
+    const roaring_bitmap_t *snap = roaring_bitmap_snapshot(r);
+    assert_non_null(snap);
+    assert_non_null(snap->rank_index);
+    assert_false(snap->copy_on_write);
+    const roaring_bitmap_t *snap2 =
+        roaring_bitmap_snapshot((roaring_bitmap_t *)snap);
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)snap, expected));
+
+    // the writer keeps going, the views do not move
+    for (uint32_t x = 0; x < (8 << 16); x += 333)
+        roaring_bitmap_flip_inplace(r, x, x + 7);
+    roaring_bitmap_add(r, 100 << 16);
+    roaring_bitmap_remove_range(r, 0, 1 << 16);
+    assert_false(roaring_bitmap_equals(r, expected));
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)snap, expected));
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)snap2, expected));
+    assert_int_equal(roaring_bitmap_rank(snap, UINT32_MAX),
+                     roaring_bitmap_get_cardinality(expected));
+
+    roaring_bitmap_t *copy = roaring_bitmap_copy(snap);
+    roaring_bitmap_snapshot_free(snap);
+    roaring_bitmap_t *u = roaring_bitmap_or(snap2, r);
+    roaring_bitmap_t *v = roaring_bitmap_or(expected, r);
+    assert_true(roaring_bitmap_equals(u, v));
+    roaring_bitmap_free(u);
+    roaring_bitmap_free(v);
+    roaring_bitmap_free(r);
+    assert_true(roaring_bitmap_equals((roaring_bitmap_t *)snap2, expected));
+    roaring_bitmap_snapshot_free(snap2);
+    assert_true(roaring_bitmap_equals(copy, expected));
+    roaring_bitmap_free(copy);
+    roaring_bitmap_free(expected);
+}
+
+void test_container_pool() {
+    roaring_memory_t hook = {counting_malloc,         counting_realloc,
+                             counting_calloc,         counting_free,
+                             counting_aligned_malloc, counting_aligned_free};
+    roaring_init_memory_hook(hook);
+
+    roaring_bitmap_t *r1 = make_mixed_bitmap(0, false);
+    roaring_bitmap_t *r2 = make_mixed_bitmap(1, true);
+    roaring_bitmap_t *expected[3] = {roaring_bitmap_and(r1, r2),
+                                     roaring_bitmap_or(r1, r2),
+                                     roaring_bitmap_xor(r1, r2)};
+
+    roaring_pool_enable(1 << 20);
+    int64_t warm_allocations = 0;
+    for (int round = 0; round < 10; ++round) {
+        if (round == 1) warm_allocations = aligned_allocations;
+        roaring_bitmap_t *actual[3] = {roaring_bitmap_and(r1, r2),
+                                       roaring_bitmap_or(r1, r2),
+                                       roaring_bitmap_xor(r1, r2)};
+        for (int k = 0; k < 3; ++k) {
+            assert_true(roaring_bitmap_equals(actual[k], expected[k]));
+            roaring_bitmap_free(actual[k]);
+        }
+    }
+    // after the first round, every bitset comes from the pool
+    assert_int_equal(aligned_allocations, warm_allocations);
+
+    // a limit of zero caches nothing
+    roaring_pool_enable(0);
+    roaring_bitmap_free(roaring_bitmap_or(r1, r2));
+    assert_true(aligned_allocations > warm_allocations);
+    roaring_pool_disable();
+
+    for (int k = 0; k < 3; ++k) roaring_bitmap_free(expected[k]);
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r1);
+    assert_int_equal(live_blocks, 0);
+    assert_int_equal(live_aligned_blocks, 0);
+    roaring_reset_memory_hook();
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_stats), cmocka_unit_test(test_addremove),
@@ -2384,13 +3363,27 @@ int main() {
         cmocka_unit_test(test_iterate_withbitmap),
         cmocka_unit_test(test_iterate_withrun),
         cmocka_unit_test(test_serialize),
-        cmocka_unit_test(test_portable_serialize), cmocka_unit_test(test_add),
+        cmocka_unit_test(test_portable_serialize),
+        cmocka_unit_test(test_portable_deserialize_frozen),
+        cmocka_unit_test(test_portable_deserialize_safe),
+        cmocka_unit_test(test_add),
+        cmocka_unit_test(test_add_many),
+        cmocka_unit_test(test_add_many_out_of_memory),
+        cmocka_unit_test(test_iterator),
+        cmocka_unit_test(test_iterator_read),
+        cmocka_unit_test(test_iterator_move_equalorlarger),
         cmocka_unit_test(test_contains),
+        cmocka_unit_test(test_range_mutations),
         cmocka_unit_test(test_intersection_array_x_array),
         cmocka_unit_test(test_intersection_array_x_array_inplace),
         cmocka_unit_test(test_intersection_bitset_x_bitset),
         cmocka_unit_test(test_intersection_bitset_x_bitset_inplace),
+        cmocka_unit_test(test_or_many_parallel),
+        cmocka_unit_test(test_or_and_many_horizontal),
+        cmocka_unit_test(test_many_out_of_memory),
         cmocka_unit_test(test_union_true), cmocka_unit_test(test_union_false),
+        cmocka_unit_test(test_cardinality_operations),
+        cmocka_unit_test(test_intersect),
         cmocka_unit_test(test_xor_false),
         cmocka_unit_test(test_xor_inplace_false),
         cmocka_unit_test(test_xor_lazy_false),
@@ -2431,6 +3424,10 @@ int main() {
         cmocka_unit_test(test_flip_run_container_removal),
         cmocka_unit_test(test_flip_run_container_removal2),
         cmocka_unit_test(select_test),
+        cmocka_unit_test(test_rank_and_rank_index),
+        cmocka_unit_test(test_memory_hooks),
+        cmocka_unit_test(test_container_pool),
+        cmocka_unit_test(test_snapshot),
         // cmocka_unit_test(test_run_to_bitset),
         // cmocka_unit_test(test_run_to_array),
     };
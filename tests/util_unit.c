@@ -9,6 +9,7 @@
 #include <stdlib.h>
 
 #include <roaring/bitset_util.h>
+#include <roaring/isadetection.h>
 
 #include "test.h"
 
@@ -129,6 +130,149 @@ void setandextract_avx2_uint32() {
 }
 #endif
 
+#ifdef USENEON
+void setandextract_neon_uint32() {
+    const unsigned int bitset_size = 1 << 16;
+    const unsigned int bitset_size_in_words =
+        bitset_size / (sizeof(uint64_t) * 8);
+
+    for (unsigned int offset = 1; offset < bitset_size; offset++) {
+        const unsigned int valsize = bitset_size / offset;
+        uint16_t* vals = malloc(valsize * sizeof(uint16_t));
+        uint64_t* bitset = calloc(bitset_size_in_words, sizeof(uint64_t));
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            vals[k] = (uint16_t)(k * offset);
+        }
+
+        bitset_set_list(bitset, vals, valsize);
+        uint32_t* newvals = malloc(valsize * sizeof(uint32_t));
+        const size_t nv = bitset_extract_setbits_neon(
+            bitset, bitset_size_in_words, newvals, valsize, 0);
+        assert_int_equal(nv, valsize);
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            assert_int_equal(newvals[k], vals[k]);
+        }
+
+        free(vals);
+        free(newvals);
+        free(bitset);
+    }
+}
+
+void setandextract_neon_uint16() {
+    const unsigned int bitset_size = 1 << 16;
+    const unsigned int bitset_size_in_words =
+        bitset_size / (sizeof(uint64_t) * 8);
+
+    for (unsigned int offset = 1; offset < bitset_size; offset++) {
+        const unsigned int valsize = bitset_size / offset;
+        uint16_t* vals = malloc(valsize * sizeof(uint16_t));
+        uint64_t* bitset = calloc(bitset_size_in_words, sizeof(uint64_t));
+        for (unsigned int k = 0; k < valsize; ++k) {
+            vals[k] = (uint16_t)(k * offset);
+        }
+
+        bitset_set_list(bitset, vals, valsize);
+        uint16_t* newvals = malloc(valsize * sizeof(uint16_t));
+        const size_t nv = bitset_extract_setbits_neon_uint16(
+            bitset, bitset_size_in_words, newvals, valsize, 0);
+        assert_int_equal(nv, valsize);
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            assert_int_equal(newvals[k], vals[k]);
+        }
+
+        free(vals);
+        free(newvals);
+        free(bitset);
+    }
+}
+#endif
+
+void hardware_support_test() {
+    const int support = roaring_hardware_support();
+    // each level implies the previous ones
+    if (support & ROARING_SUPPORTS_AVX512)
+        assert_true(support & ROARING_SUPPORTS_AVX2);
+    if (support & ROARING_SUPPORTS_AVX2)
+        assert_true(support & ROARING_SUPPORTS_SSE42);
+#ifdef USEAVX
+    // the build targets AVX2 and the tests run on the build machine
+    assert_true(support & ROARING_SUPPORTS_AVX2);
+#endif
+#ifdef USEAVX512
+    assert_true(support & ROARING_SUPPORTS_AVX512);
+#endif
+    assert_int_equal(roaring_hardware_support(), support);
+}
+
+#if defined(USEAVX512) || defined(ROARING_DISPATCH)
+void setandextract_avx512_uint32() {
+    if (!(roaring_hardware_support() & ROARING_SUPPORTS_AVX512)) return;
+    const unsigned int bitset_size = 1 << 16;
+    const unsigned int bitset_size_in_words =
+        bitset_size / (sizeof(uint64_t) * 8);
+
+    for (unsigned int offset = 1; offset < bitset_size; offset++) {
+        const unsigned int valsize = bitset_size / offset;
+        uint16_t* vals = malloc(valsize * sizeof(uint16_t));
+        uint64_t* bitset = calloc(bitset_size_in_words, sizeof(uint64_t));
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            vals[k] = (uint16_t)(k * offset);
+        }
+
+        bitset_set_list(bitset, vals, valsize);
+        uint32_t* newvals = malloc(valsize * sizeof(uint32_t));
+        assert_int_equal(bitset_extract_setbits_avx512(
+                             bitset, bitset_size_in_words, newvals, valsize, 0),
+                         valsize);
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            assert_int_equal(newvals[k], vals[k]);
+        }
+
+        free(vals);
+        free(newvals);
+        free(bitset);
+    }
+}
+
+void setandextract_avx512_uint16() {
+    if (!(roaring_hardware_support() & ROARING_SUPPORTS_AVX512)) return;
+    const unsigned int bitset_size = 1 << 16;
+    const unsigned int bitset_size_in_words =
+        bitset_size / (sizeof(uint64_t) * 8);
+
+    for (unsigned int offset = 1; offset < bitset_size; offset++) {
+        const unsigned int valsize = bitset_size / offset;
+        uint16_t* vals = malloc(valsize * sizeof(uint16_t));
+        uint64_t* bitset = calloc(bitset_size_in_words, sizeof(uint64_t));
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            vals[k] = (uint16_t)(k * offset);
+        }
+
+        bitset_set_list(bitset, vals, valsize);
+        uint16_t* newvals = malloc(valsize * sizeof(uint16_t));
+        assert_int_equal(
+            bitset_extract_setbits_avx512_uint16(bitset, bitset_size_in_words,
+                                                 newvals, valsize, 0),
+            valsize);
+
+        for (unsigned int k = 0; k < valsize; ++k) {
+            assert_int_equal(newvals[k], vals[k]);
+        }
+
+        free(vals);
+        free(newvals);
+        free(bitset);
+    }
+}
+#endif
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(setandextract_uint16),
@@ -138,6 +282,15 @@ int main() {
         cmocka_unit_test(setandextract_uint32),
 #ifdef USE_AVX
         cmocka_unit_test(setandextract_avx2_uint32),
+#endif
+#ifdef USENEON
+        cmocka_unit_test(setandextract_neon_uint32),
+        cmocka_unit_test(setandextract_neon_uint16),
+#endif
+        cmocka_unit_test(hardware_support_test),
+#if defined(USEAVX512) || defined(ROARING_DISPATCH)
+        cmocka_unit_test(setandextract_avx512_uint32),
+        cmocka_unit_test(setandextract_avx512_uint16),
 #endif
     };
 
@@ -3,7 +3,12 @@ if(SANITIZE)
   set(SANITIZE_FLAGS "-fsanitize=address -fno-omit-frame-pointer -fsanitize=undefined")
 endif()
 
-set(OPT_FLAGS "-march=native")
+if(PORTABLE)
+  # without -march=native, portability.h selects the SIMD kernels at runtime
+  set(OPT_FLAGS "")
+else()
+  set(OPT_FLAGS "-march=native")
+endif()
 if(AVX_TUNING)
   # even if AVX_TUNING is enabled, the code can still disable it if __AVX2__ or __BMI2__ are undefined
   set (OPT_FLAGS "${OPT_FLAGS} -DUSEAVX  ${OPT_FLAGS}" )